@@ -25,6 +25,7 @@
  *
  */
 #include "include/Logger.h"
+#include "include/trace.hpp"
 
 #include <chrono>
 #include <bitset>
@@ -40,7 +41,7 @@ namespace ace {
 namespace utils
 {
 
-Logger::Logger() {
+Logger::Logger() : async_(false), dropped_(0) {
     ofs_.open("mysprinkler.txt");
     //std::cout.rdbuf(ofs_.rdbuf());
 }
@@ -87,7 +88,7 @@ Logger::hexdump(const std::vector<unsigned char> &s,
         unsigned int line_len) {
     if (logging_mode_ < LOGGING::VERBOSE)
         return;
-    lock_.lock();
+    std::lock_guard<std::mutex>lock(lock_);
     oss_ << "\033[1;36m[HEX DUMP] Displaying: " << s.size()
             << " bytes. " << Now() << std::endl;
     const std::string::size_type slen(s.size());
@@ -125,12 +126,75 @@ Logger::hexdump(const std::vector<unsigned char> &s,
 
 void
 Logger::Output() {
-    ofs_ << oss_.rdbuf();
-    std::cout << oss_.str();
-    if (!oss_.str().empty()) {
-        oss_.str(std::string());
+    // callers hold lock_
+    std::string text = oss_.str();
+    oss_.str(std::string());
+    {
+        std::lock_guard<std::mutex>lock(queue_lock_);
+        if (async_) {
+            if (queue_.size() < 4096) {
+                queue_.push_back(std::move(text));
+            } else {
+                dropped_++;
+            }
+            queue_cv_.notify_one();
+            return;
+        }
+    }
+    Write(text);
+}
+
+void
+Logger::Write(const std::string& text) {
+    TRACE_SPAN("log", "write");
+    ofs_ << text;
+    std::cout << text;
+}
+
+void
+Logger::Async(bool async) {
+    {
+        std::lock_guard<std::mutex>lock(queue_lock_);
+        if (async_ == async) return;
+        async_ = async;
+    }
+    if (async) {
+        writer_ = std::thread(&Logger::Writer, this);
+    } else {
+        queue_cv_.notify_one();
+        writer_.join();
     }
-    lock_.unlock();
+}
+
+void
+Logger::Writer() {
+    TRACE_THREAD("logger");
+    std::unique_lock<std::mutex>lock(queue_lock_);
+    while (async_ || !queue_.empty()) {
+        if (queue_.empty()) {
+            queue_cv_.wait(lock);
+            continue;
+        }
+        std::deque<std::string> lines;
+        lines.swap(queue_);
+        unsigned long dropped = dropped_;
+        dropped_ = 0;
+        lock.unlock();
+        TRACE_SPAN("log", "flush", static_cast<std::int64_t> (lines.size()));
+        for (const auto& line : lines) {
+            Write(line);
+        }
+        if (dropped) {
+            Write("[WARNING] " + std::to_string(dropped) +
+                    " log lines dropped\n");
+        }
+        std::cout.flush();
+        lock.lock();
+    }
+}
+
+Logger::~Logger() {
+    Async(false);
 }
 
 std::string
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "include/codegen.hpp"
+#include "include/program.hpp"
+#include "include/validate.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+
+namespace {
+
+const char* ModeName(MODE mode) {
+    switch (mode) {
+        case MODE::even_only: return "even_only";
+        case MODE::odd_only: return "odd_only";
+        case MODE::weekdays: return "weekdays";
+        default: return "interval";
+    }
+}
+
+// keeps a friendly name from closing the comment it is written into
+std::string Comment(std::string text) {
+    std::replace(text.begin(), text.end(), '\n', ' ');
+    for (size_t pos; (pos = text.find("*/")) != std::string::npos;) {
+        text.replace(pos, 2, "* /");
+    }
+    return text;
+}
+
+} // namespace
+
+bool GenerateFixedConfig(const YAML::Node& yConfig, const std::string& source,
+        std::ostream& os, std::vector<std::string>& errors) {
+    site_report report;
+    report.source = source;
+    if (!ValidateConfig(yConfig, report)) {
+        errors = report.errors;
+        return false;
+    }
+    const std::vector<site_zone>& zones = report.zones;
+    for (const auto& zone : zones) {
+        if (zone.coil.bus != 0) {
+            errors.push_back("zone " + std::to_string(zone.id) + " is on a "
+                    "Modbus bus, fixed builds drive gpio only");
+        }
+        if (zone.max_cycle > 0 || zone.min_soak > 0) {
+            errors.push_back("zone " + std::to_string(zone.id) + " has "
+                    "max_cycle/min_soak, fixed builds water each zone in one "
+                    "go");
+        }
+    }
+    for (auto& program : report.programs) {
+        if (program.Disabled()) continue;
+        if (!program.After().empty() || !program.NotWith().empty()) {
+            errors.push_back("program " + std::to_string(program.Id()) +
+                    " has after/not_with, fixed builds run programs in start "
+                    "order only");
+        }
+        if (program.WindowFrom() >= 0) {
+            errors.push_back("program " + std::to_string(program.Id()) +
+                    " has a window, fixed builds start programs at a fixed "
+                    "time");
+        }
+    }
+    YAML::Node yTariff = yConfig["tariff"];
+    if (yTariff.IsDefined() && !yTariff.IsNull()) {
+        errors.push_back("tariff is set, fixed builds do not plan around "
+                "rates");
+    }
+    if (!errors.empty()) return false;
+    std::vector<Program> programs;
+    for (auto& program : report.programs) {
+        if (!program.Disabled()) programs.push_back(program);
+    }
+
+    std::string logging_mode = yConfig["logging_mode"].as<std::string>("NONE");
+    std::transform(logging_mode.begin(), logging_mode.end(),
+            logging_mode.begin(), ::toupper);
+    static const std::set<std::string> modes = {
+        "NONE", "INFO", "WARNING", "DEBUG", "TRACE", "VERBOSE"
+    };
+    if (modes.count(logging_mode) == 0) logging_mode = "NONE";
+
+    os << "/*\n * Generated by 'mysprinkler generate' from " << Comment(source)
+            << ", do not edit.\n */\n\n"
+            << "#ifndef SITE_CONFIG_HPP\n#define SITE_CONFIG_HPP\n\n"
+            << "#include \"include/fixed.hpp\"\n\n"
+            << "namespace site {\n\n"
+            << "constexpr const char* gpio_directory = \""
+            << yConfig["gpio_directory"].as<std::string>("/sys/class/gpio")
+            << "\";\n"
+            << "constexpr bool daemon = "
+            << (yConfig["daemon"].as<bool>(false) ? "true" : "false") << ";\n"
+            << "constexpr ace::utils::Logger::LOGGING logging_mode = "
+            << "ace::utils::Logger::" << logging_mode << ";\n\n";
+
+    os << "// FixedZone<id, gpio, invert_logic, enabled>\n"
+            << "using zones = zone_table<";
+    for (size_t i = 0; i < zones.size(); i++) {
+        const site_zone& zone = zones[i];
+        os << (i == 0 ? "\n" : ",\n") << "        FixedZone<" << zone.id << ", "
+                << zone.gpio << ", " << std::boolalpha << zone.invert_logic
+                << ", " << zone.enabled << "> /* " << Comment(zone.name)
+                << " */";
+    }
+    os << ">;\n\n";
+
+    for (auto& program : programs) {
+        if (program.ZoneDetail().empty()) continue;
+        os << "constexpr fixed_zone_detail program_" << program.Id()
+                << "_zones[] = {\n";
+        for (const auto& detail : program.ZoneDetail()) {
+            os << "    {" << detail.zone_id << ", " << detail.duration
+                    << "},\n";
+        }
+        os << "};\n\n";
+    }
+
+    os << "// id, hour, minute, mode, interval, weekdays, zones, zone count\n"
+            << "constexpr fixed_program programs[] = {\n";
+    for (auto& program : programs) {
+        unsigned weekdays = 0;
+        for (int day : program.Weekdays()) weekdays |= 1u << day;
+        std::ostringstream zones_name;
+        if (program.ZoneDetail().empty()) {
+            zones_name << "nullptr";
+        } else {
+            zones_name << "program_" << program.Id() << "_zones";
+        }
+        os << "    {" << program.Id() << ", " << program.Hour() << ", "
+                << program.Minute() << ", MODE::" << ModeName(program.Mode())
+                << ", " << program.Interval() << ", 0x" << std::hex
+                << weekdays << std::dec << ", " << zones_name.str() << ", "
+                << program.ZoneDetail().size() << "},\n";
+    }
+    if (programs.empty()) {
+        os << "    {0, 0, 0, MODE::weekdays, 0, 0x0, nullptr, 0},\n";
+    }
+    os << "};\n\n} // namespace site\n\n#endif /* SITE_CONFIG_HPP */\n";
+    return true;
+}
+
+int GenerateCommand(int argc, char* argv[]) {
+    if (argc < 1) {
+        std::cout << "eg: mysprinkler generate /etc/mysprinkler.yaml "
+                "site_config.hpp\n";
+        return EXIT_FAILURE;
+    }
+    YAML::Node yConfig;
+    try {
+        yConfig = YAML::LoadFile(argv[0]);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    std::ostringstream header;
+    std::vector<std::string> errors;
+    if (!GenerateFixedConfig(yConfig, argv[0], header, errors)) {
+        for (const auto& error : errors) {
+            std::cerr << argv[0] << ": " << error << "\n";
+        }
+        return EXIT_FAILURE;
+    }
+
+    if (argc < 2) {
+        std::cout << header.str();
+        return EXIT_SUCCESS;
+    }
+    std::ofstream ofs(argv[1]);
+    ofs << header.str();
+    return ofs.good() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
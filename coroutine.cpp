@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "include/coroutine.hpp"
+#include "include/cycles.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+Executor::Executor() : now_(clock::now()), sequence_(0), resumes_(0) {
+}
+
+Executor::~Executor() {
+}
+
+Task* Executor::Spawn(std::unique_ptr<Task> task) {
+    Task* raw = task.get();
+    tasks_[raw] = std::move(task);
+    ready_.push_back(Push(raw, clock::time_point()));
+    return raw;
+}
+
+void Executor::Wake(Task* task, clock::time_point t) {
+    timers_.push(Push(task, t));
+}
+
+void Executor::Ready(Task* task) {
+    ready_.push_back(Push(task, clock::time_point()));
+}
+
+void Executor::Cancel(Task* task) {
+    tasks_.erase(task); // its wakes are no longer live
+}
+
+void Executor::Run(clock::time_point until) {
+    while (!tasks_.empty()) {
+        now_ = clock::now();
+        // ready first, then every timer due, in time order
+        while (!ready_.empty()) {
+            timer wake = ready_.front();
+            ready_.pop_front();
+            Resume(wake);
+        }
+        while (!timers_.empty() && timers_.top().at <= now_) {
+            timer wake = timers_.top();
+            timers_.pop();
+            Resume(wake);
+        }
+        if (!ready_.empty()) continue;
+        clock::time_point next = Next();
+        if (next == clock::time_point::max() || now_ >= until) break;
+        std::this_thread::sleep_until(std::min(until, next));
+    }
+}
+
+void Executor::Poll() {
+    Run(clock::time_point::min());
+}
+
+Executor::clock::time_point Executor::Next() {
+    // timers replaced by a later wake are dropped once on top
+    while (!timers_.empty() && !Live(timers_.top())) {
+        timers_.pop();
+    }
+    return timers_.empty() ? clock::time_point::max() : timers_.top().at;
+}
+
+Executor::clock::time_point Executor::Now() const {
+    return now_;
+}
+
+size_t Executor::Tasks() const {
+    return tasks_.size();
+}
+
+std::uint64_t Executor::Resumes() const {
+    return resumes_;
+}
+
+Executor::timer Executor::Push(Task* task, clock::time_point t) {
+    task->wake_ = ++sequence_;
+    return {t, task->wake_, task};
+}
+
+bool Executor::Live(const timer& wake) const {
+    // a destroyed task's address may be reused, its sequence is not
+    return tasks_.count(wake.task) != 0 && wake.task->wake_ == wake.sequence;
+}
+
+void Executor::Resume(const timer& wake) {
+    if (!Live(wake)) return;
+    Task* task = wake.task;
+    resumes_++;
+    task->Resume(*this);
+    if (task->Done()) tasks_.erase(task);
+}
+
+namespace {
+
+using clock = Executor::clock;
+
+// what both designs record of one program
+struct bench_stats {
+    bench_stats() : switches(0), late_ns(0), late_max_ns(0) {
+    }
+    std::uint64_t switches; // relay transitions
+    std::int64_t late_ns; // summed over transitions
+    std::int64_t late_max_ns;
+
+    void Late(clock::duration late) {
+        std::int64_t ns = std::max<std::int64_t>(0,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(late)
+                .count());
+        switches++;
+        late_ns += ns;
+        late_max_ns = std::max(late_max_ns, ns);
+    }
+};
+
+// relays both designs switch, only counted so the bench measures waiting
+std::atomic<std::uint64_t> relays_on[8];
+
+/*! A program run as a coroutine: its cycles in order, each after its
+ * start in the plan. A zone with no time is skipped. */
+class ProgramTask : public Task {
+public:
+    ProgramTask(const cycle_plan& plan, clock::time_point start,
+            clock::duration unit, bench_stats& stats) : plan_(plan),
+    start_(start), unit_(unit), stats_(stats), step_(0) {
+    }
+protected:
+    void Resume(Executor& executor) override {
+        CO_BEGIN;
+        for (step_ = 0; step_ < plan_.steps.size(); step_++) {
+            if (plan_.steps[step_].seconds == 0) continue;
+            due_ = start_ + plan_.steps[step_].start * unit_;
+            CO_SLEEP_UNTIL(executor, due_);
+            stats_.Late(clock::now() - due_);
+            relays_on[plan_.steps[step_].zone_id % 8]++;
+            due_ += plan_.steps[step_].seconds * unit_;
+            CO_SLEEP_UNTIL(executor, due_);
+            stats_.Late(clock::now() - due_);
+            relays_on[plan_.steps[step_].zone_id % 8]--;
+        }
+        CO_END;
+    }
+private:
+    const cycle_plan& plan_;
+    clock::time_point start_;
+    clock::duration unit_;
+    bench_stats& stats_;
+    size_t step_;
+    clock::time_point due_;
+};
+
+// the same program on a thread of its own
+void ProgramThread(const cycle_plan& plan, clock::time_point start,
+        clock::duration unit, bench_stats& stats) {
+    for (const auto& step : plan.steps) {
+        if (step.seconds == 0) continue;
+        clock::time_point due = start + step.start * unit;
+        std::this_thread::sleep_until(due);
+        stats.Late(clock::now() - due);
+        relays_on[step.zone_id % 8]++;
+        due += step.seconds * unit;
+        std::this_thread::sleep_until(due);
+        stats.Late(clock::now() - due);
+        relays_on[step.zone_id % 8]--;
+    }
+}
+
+long ResidentKb() {
+    long pages = 0, resident = 0;
+    FILE* f = std::fopen("/proc/self/statm", "r");
+    if (f == nullptr) return 0;
+    if (std::fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+    std::fclose(f);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+struct bench_result {
+    long resident_kb; // growth once every program started
+    double wall_ms;
+    double cpu_us; // per transition
+    long context_switches;
+    bench_stats stats;
+};
+
+double CpuUs(const rusage& usage) {
+    return usage.ru_utime.tv_sec * 1e6 + usage.ru_utime.tv_usec +
+            usage.ru_stime.tv_sec * 1e6 + usage.ru_stime.tv_usec;
+}
+
+template<typename F>
+bench_result Measure(F run) {
+    bench_result result = {};
+    rusage before, after;
+    long resident = ResidentKb();
+    getrusage(RUSAGE_SELF, &before);
+    auto begin = clock::now();
+    run(result);
+    result.wall_ms = std::chrono::duration<double, std::milli>(
+            clock::now() - begin).count();
+    getrusage(RUSAGE_SELF, &after);
+    result.resident_kb -= resident;
+    result.cpu_us = (CpuUs(after) - CpuUs(before)) /
+            std::max<std::uint64_t>(1, result.stats.switches);
+    result.context_switches = after.ru_nvcsw + after.ru_nivcsw -
+            before.ru_nvcsw - before.ru_nivcsw;
+    return result;
+}
+
+void Print(const char* name, const bench_result& result) {
+    std::printf("%-9s %9ld %9.0f %9llu %9.2f %10ld %9.1f %9.1f\n", name,
+            result.resident_kb, result.wall_ms,
+            static_cast<unsigned long long> (result.stats.switches),
+            result.cpu_us, result.context_switches,
+            result.stats.late_ns / 1e3 / std::max<std::uint64_t>(1,
+            result.stats.switches), result.stats.late_max_ns / 1e3);
+}
+
+} // namespace
+
+int CoroBenchCommand(int argc, char* argv[]) {
+    int programs = argc > 0 ? std::max(1, std::atoi(argv[0])) : 1000;
+    int cycles = argc > 1 ? std::max(1, std::atoi(argv[1])) : 3;
+    int step_us = argc > 2 ? std::max(1, std::atoi(argv[2])) : 1000;
+
+    // four zones of cycles steps each, soaking 2 steps, as the daemon plans
+    std::vector<cycle_zone> zones;
+    for (int zone = 1; zone <= 4; zone++) {
+        zones.push_back({zone, cycles, 1, 2});
+    }
+    cycle_plan plan = PlanCycles(zones, 1);
+    clock::duration unit = std::chrono::microseconds(step_us);
+    // every program is spawned before the first is due
+    clock::duration setup = std::chrono::milliseconds(10) +
+            std::chrono::microseconds(50) * programs;
+    // starts spread over one step so programs do not wake in lock step
+    auto offset = [unit, programs](int i) {
+        return unit * i / programs;
+    };
+    std::printf("%d programs of %zu cycles, %d us steps, %.1f ms each, "
+            "%zu byte coroutine frames\n", programs, plan.steps.size(),
+            step_us, plan.makespan * step_us / 1e3, sizeof (ProgramTask));
+    std::printf("%-9s %9s %9s %9s %9s %10s %9s %9s\n", "design", "rss kb",
+            "wall ms", "switches", "cpu us", "ctx switch", "late us",
+            "late max");
+
+    bench_result coroutines = Measure([&](bench_result & result) {
+        Executor executor;
+        clock::time_point start = clock::now() + setup;
+        for (int i = 0; i < programs; i++) {
+            executor.Spawn(std::unique_ptr<Task>(new ProgramTask(plan,
+                    start + offset(i), unit, result.stats)));
+        }
+        result.resident_kb = ResidentKb();
+        executor.Run();
+    });
+    Print("coroutine", coroutines);
+
+    bench_result threads = Measure([&](bench_result & result) {
+        std::vector<bench_stats> stats(programs);
+        std::vector<std::thread> running;
+        clock::time_point start = clock::now() + setup;
+        long resident = 0;
+        for (int i = 0; i < programs; i++) {
+            running.emplace_back(ProgramThread, std::cref(plan),
+                    start + offset(i), unit, std::ref(stats[i]));
+            resident = std::max(resident, ResidentKb());
+        }
+        result.resident_kb = resident;
+        for (auto& thread : running) {
+            thread.join();
+        }
+        for (const auto& s : stats) {
+            result.stats.switches += s.switches;
+            result.stats.late_ns += s.late_ns;
+            result.stats.late_max_ns = std::max(result.stats.late_max_ns,
+                    s.late_max_ns);
+        }
+    });
+    Print("thread", threads);
+    return EXIT_SUCCESS;
+}
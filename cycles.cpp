@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "include/cycles.hpp"
+#include "include/validate.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+
+namespace {
+
+// the order ready zones are picked in
+enum PICK {
+    pick_order, pick_tail, pick_soak
+};
+
+struct zone_state {
+    const cycle_zone* zone;
+    int order; // in the program
+    std::vector<int> cycles; // lengths
+    size_t next; // cycle
+    int ready; // earliest start of the next cycle
+    int tail; // seconds of the cycles left and the soaks between them
+    bool on;
+};
+
+// the fewest cycles no longer than max_cycle, near equal
+std::vector<int> Split(const cycle_zone& zone) {
+    int seconds = std::max(0, zone.seconds);
+    int count = 1;
+    if (zone.max_cycle > 0 && seconds > zone.max_cycle) {
+        count = (seconds + zone.max_cycle - 1) / zone.max_cycle;
+    }
+    std::vector<int> cycles(count, seconds / count);
+    for (int i = 0; i < seconds % count; i++) {
+        cycles[i]++;
+    }
+    return cycles;
+}
+
+bool Before(const zone_state& left, const zone_state& right, PICK pick) {
+    if (pick == pick_soak && left.zone->min_soak != right.zone->min_soak) {
+        return left.zone->min_soak > right.zone->min_soak;
+    }
+    if (pick != pick_order && left.tail != right.tail) {
+        return left.tail > right.tail;
+    }
+    return left.order < right.order;
+}
+
+cycle_plan ListSchedule(const std::vector<cycle_zone>& zones,
+        int max_concurrent, PICK pick) {
+    std::vector<zone_state> states;
+    size_t left = 0;
+    for (size_t i = 0; i < zones.size(); i++) {
+        zone_state state = {&zones[i], static_cast<int> (i), Split(zones[i]),
+            0, 0, 0, false};
+        for (int seconds : state.cycles) {
+            state.tail += seconds;
+        }
+        state.tail += static_cast<int> (state.cycles.size() - 1) *
+                std::max(0, zones[i].min_soak);
+        left += state.cycles.size();
+        states.push_back(state);
+    }
+
+    cycle_plan plan;
+    plan.makespan = 0;
+    std::vector<std::pair<int, zone_state*> > running; // end, zone
+    for (int now = 0; left > 0 || !running.empty();) {
+        // start rested zones while there is room
+        while (static_cast<int> (running.size()) < max_concurrent) {
+            zone_state* best = nullptr;
+            for (auto& state : states) {
+                if (state.on || state.next == state.cycles.size() ||
+                        state.ready > now) continue;
+                if (best == nullptr || Before(state, *best, pick)) {
+                    best = &state;
+                }
+            }
+            if (best == nullptr) break;
+            int seconds = best->cycles[best->next];
+            int soak = best->next ? std::max(0, best->zone->min_soak) : 0;
+            plan.steps.push_back({best->zone->zone_id, now, seconds, soak});
+            best->tail -= seconds;
+            best->on = true;
+            if (++best->next < best->cycles.size()) {
+                best->tail -= std::max(0, best->zone->min_soak);
+            }
+            running.push_back({now + seconds, best});
+            left--;
+        }
+
+        // on to the next cycle end, or the next zone rested
+        int next = INT_MAX;
+        for (const auto& run : running) {
+            next = std::min(next, run.first);
+        }
+        if (static_cast<int> (running.size()) < max_concurrent) {
+            for (const auto& state : states) {
+                if (!state.on && state.next < state.cycles.size()) {
+                    next = std::min(next, state.ready);
+                }
+            }
+        }
+        if (next == INT_MAX) break;
+        now = std::max(now, next);
+        for (auto run = running.begin(); run != running.end();) {
+            if (run->first > now) {
+                ++run;
+                continue;
+            }
+            run->second->on = false;
+            run->second->ready = now + std::max(0, run->second->zone->min_soak);
+            plan.makespan = std::max(plan.makespan, run->first);
+            run = running.erase(run);
+        }
+    }
+    return plan;
+}
+
+std::string Minutes(int seconds) {
+    char buffer[16];
+    std::snprintf(buffer, sizeof (buffer), "%d:%02d", seconds / 60,
+            seconds % 60);
+    return buffer;
+}
+
+} // namespace
+
+cycle_plan PlanCycles(const std::vector<cycle_zone>& zones,
+        int max_concurrent) {
+    max_concurrent = std::max(1, max_concurrent);
+    // the configured order wins ties, so a program without cycling is
+    // watered as it always was
+    cycle_plan best = ListSchedule(zones, max_concurrent, pick_order);
+    for (PICK pick : {pick_tail, pick_soak}) {
+        cycle_plan plan = ListSchedule(zones, max_concurrent, pick);
+        if (plan.makespan < best.makespan) best = std::move(plan);
+    }
+    return best;
+}
+
+cycle_plan NaiveCycles(const std::vector<cycle_zone>& zones) {
+    cycle_plan plan;
+    int now = 0;
+    for (const auto& zone : zones) {
+        std::vector<int> cycles = Split(zone);
+        for (size_t i = 0; i < cycles.size(); i++) {
+            int soak = i ? std::max(0, zone.min_soak) : 0;
+            now += soak;
+            plan.steps.push_back({zone.zone_id, now, cycles[i], soak});
+            now += cycles[i];
+        }
+    }
+    plan.makespan = now;
+    return plan;
+}
+
+int CycleLowerBound(const std::vector<cycle_zone>& zones,
+        int max_concurrent) {
+    max_concurrent = std::max(1, max_concurrent);
+    long long total = 0;
+    int chain = 0; // a zone's cycles and soaks back to back
+    for (const auto& zone : zones) {
+        int cycles = static_cast<int> (Split(zone).size());
+        total += std::max(0, zone.seconds);
+        chain = std::max(chain, std::max(0, zone.seconds) +
+                (cycles - 1) * std::max(0, zone.min_soak));
+    }
+    int work = static_cast<int> ((total + max_concurrent - 1) /
+            max_concurrent);
+    return std::max(work, chain);
+}
+
+int CyclesCommand(int argc, char* argv[]) {
+    int max_concurrent = 1;
+    bool show_plan = false;
+    std::string config;
+    for (int i = 0; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--concurrent" && i + 1 < argc) {
+            max_concurrent = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--plan") {
+            show_plan = true;
+        } else {
+            config = arg;
+        }
+    }
+    if (config.empty()) {
+        std::cout << "eg: mysprinkler cycles /etc/mysprinkler.yaml "
+                "[--concurrent N] [--plan]\n";
+        return EXIT_FAILURE;
+    }
+    site_report report;
+    try {
+        ValidateConfig(YAML::LoadFile(config), report);
+    } catch (const std::exception& e) {
+        std::cout << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+    std::map<int, const site_zone*> zones;
+    for (const auto& zone : report.zones) {
+        zones[zone.id] = &zone;
+    }
+
+    std::printf("%7s %5s %6s %9s %9s %9s %9s\n", "program", "zones",
+            "cycles", "naive", "planned", "bound", "plan us");
+    for (auto& program : report.programs) {
+        // durations and cycle settings are minutes
+        std::vector<cycle_zone> cycle_zones;
+        for (const auto& detail : program.ZoneDetail()) {
+            auto zone = zones.find(detail.zone_id);
+            bool known = zone != zones.end();
+            cycle_zones.push_back({detail.zone_id, detail.duration * 60,
+                known ? zone->second->max_cycle * 60 : 0,
+                known ? zone->second->min_soak * 60 : 0});
+        }
+        auto begin = std::chrono::steady_clock::now();
+        cycle_plan plan = PlanCycles(cycle_zones, max_concurrent);
+        double us = std::chrono::duration<double, std::micro>(
+                std::chrono::steady_clock::now() - begin).count();
+        std::printf("%7d %5zu %6zu %9s %9s %9s %9.1f\n", program.Id(),
+                cycle_zones.size(), plan.steps.size(),
+                Minutes(NaiveCycles(cycle_zones).makespan).c_str(),
+                Minutes(plan.makespan).c_str(),
+                Minutes(CycleLowerBound(cycle_zones, max_concurrent)).c_str(),
+                us);
+        if (!show_plan) continue;
+        for (const auto& step : plan.steps) {
+            std::printf("    +%-8s zone %-4d for %-7s", Minutes(step.start)
+                    .c_str(), step.zone_id, Minutes(step.seconds).c_str());
+            if (step.soak) {
+                std::printf(" after a %s soak", Minutes(step.soak).c_str());
+            }
+            std::printf("\n");
+        }
+    }
+    return EXIT_SUCCESS;
+}
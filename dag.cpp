@@ -0,0 +1,374 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "include/dag.hpp"
+#include "include/cycles.hpp"
+#include "include/timezone.hpp"
+#include "include/validate.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <string>
+
+namespace {
+
+// after edges among the listed programs, by index
+std::vector<std::vector<size_t> > Predecessors(
+        const std::vector<dag_program>& programs) {
+    std::map<int, size_t> index;
+    for (size_t i = 0; i < programs.size(); i++) {
+        index[programs[i].id] = i;
+    }
+    std::vector<std::vector<size_t> > before(programs.size());
+    for (size_t i = 0; i < programs.size(); i++) {
+        for (int id : programs[i].after) {
+            auto it = index.find(id);
+            if (it != index.end() && it->second != i) {
+                before[i].push_back(it->second);
+            }
+        }
+    }
+    return before;
+}
+
+bool Contains(const std::vector<int>& ids, int id) {
+    return std::find(ids.begin(), ids.end(), id) != ids.end();
+}
+
+bool Conflict(const dag_program& left, const dag_program& right) {
+    if (Contains(left.not_with, right.id) || Contains(right.not_with, left.id))
+        return true;
+    for (int zone : left.zones) {
+        if (Contains(right.zones, zone)) return true;
+    }
+    return false;
+}
+
+std::string Minutes(int seconds) {
+    char buffer[16];
+    std::snprintf(buffer, sizeof (buffer), "%d:%02d", seconds / 60,
+            seconds % 60);
+    return buffer;
+}
+
+std::string Ids(const std::vector<int>& ids, const char* separator) {
+    std::string text;
+    for (int id : ids) {
+        if (!text.empty()) text += separator;
+        text += std::to_string(id);
+    }
+    return text;
+}
+
+} // namespace
+
+bool OrderPrograms(const std::vector<dag_program>& programs,
+        std::vector<int>& order, std::vector<int>& cycle) {
+    auto before = Predecessors(programs);
+    std::vector<std::vector<size_t> > after(programs.size());
+    std::vector<size_t> waiting(programs.size());
+    for (size_t i = 0; i < programs.size(); i++) {
+        waiting[i] = before[i].size();
+        for (size_t j : before[i]) {
+            after[j].push_back(i);
+        }
+    }
+    std::set<std::pair<int, size_t> > ready; // by id
+    for (size_t i = 0; i < programs.size(); i++) {
+        if (waiting[i] == 0) ready.insert({programs[i].id, i});
+    }
+    order.clear();
+    cycle.clear();
+    while (!ready.empty()) {
+        size_t i = ready.begin()->second;
+        ready.erase(ready.begin());
+        order.push_back(programs[i].id);
+        for (size_t j : after[i]) {
+            if (--waiting[j] == 0) ready.insert({programs[j].id, j});
+        }
+    }
+    if (order.size() == programs.size()) return true;
+
+    // everything left waits on something else left, walking back from any
+    // of them comes round to a cycle
+    size_t at = 0;
+    while (waiting[at] == 0) at++;
+    std::vector<size_t> seen(programs.size(), 0);
+    std::vector<size_t> walk;
+    while (!seen[at]) {
+        seen[at] = walk.size() + 1;
+        walk.push_back(at);
+        for (size_t j : before[at]) {
+            if (waiting[j] > 0) {
+                at = j;
+                break;
+            }
+        }
+    }
+    // the walk runs against the edges, the cycle is reported along them
+    for (size_t k = walk.size(); k-- > seen[at] - 1;) {
+        cycle.push_back(programs[walk[k]].id);
+    }
+    return false;
+}
+
+std::vector<dag_program> NightPrograms(std::vector<Program> programs,
+        const std::map<int, dag_zone>& zones, std::time_t from,
+        std::time_t to) {
+    std::vector<dag_program> night;
+    for (auto& program : programs) {
+        if (program.Disabled()) continue;
+        program.NextStartTime(from - 1);
+        if (program.StartTime() >= to) continue;
+
+        std::vector<cycle_zone> cycle_zones;
+        dag_program entry = {program.Id(), program.Priority(),
+            program.StartTime(), 0, {}, program.After(), program.NotWith()};
+        for (const auto& detail : program.ZoneDetail()) {
+            auto zone = zones.find(detail.zone_id);
+            bool known = zone != zones.end();
+            cycle_zones.push_back({detail.zone_id, detail.duration * 60,
+                known ? zone->second.max_cycle * 60 : 0,
+                known ? zone->second.min_soak * 60 : 0});
+            entry.zones.push_back(detail.zone_id);
+        }
+        entry.seconds = PlanCycles(cycle_zones, 1).makespan;
+        std::sort(entry.zones.begin(), entry.zones.end());
+        night.push_back(entry);
+    }
+    return night;
+}
+
+dag_plan PlanNight(const std::vector<dag_program>& programs, int capacity) {
+    capacity = std::max(1, capacity);
+    dag_plan plan = {};
+    if (programs.empty()) return plan;
+
+    std::vector<int> order, cycle;
+    auto before = Predecessors(programs);
+    if (!OrderPrograms(programs, order, cycle)) {
+        // the caller reported it, plan as independent timers
+        for (auto& edges : before) {
+            edges.clear();
+        }
+        order.clear();
+        for (const auto& program : programs) {
+            order.push_back(program.id);
+        }
+    }
+    std::map<int, size_t> index;
+    for (size_t i = 0; i < programs.size(); i++) {
+        index[programs[i].id] = i;
+    }
+    std::time_t origin = programs[0].start;
+    for (const auto& program : programs) {
+        origin = std::min(origin, program.start);
+    }
+    std::vector<int> release(programs.size());
+    for (size_t i = 0; i < programs.size(); i++) {
+        release[i] = static_cast<int> (programs[i].start - origin);
+    }
+
+    // earliest finish with unlimited capacity gives the critical path,
+    // the longest chain behind each program orders the list
+    std::vector<int> finish(programs.size(), 0);
+    std::vector<long> parent(programs.size(), -1);
+    for (int id : order) {
+        size_t i = index[id];
+        int start = release[i];
+        for (size_t j : before[i]) {
+            if (finish[j] > start) {
+                start = finish[j];
+                parent[i] = static_cast<long> (j);
+            }
+        }
+        finish[i] = start + std::max(0, programs[i].seconds);
+    }
+    size_t last = std::max_element(finish.begin(), finish.end()) -
+            finish.begin();
+    plan.critical_path = finish[last];
+    for (long i = static_cast<long> (last); i >= 0; i = parent[i]) {
+        plan.critical.insert(plan.critical.begin(), programs[i].id);
+    }
+    std::vector<int> tail(programs.size(), 0);
+    for (auto id = order.rbegin(); id != order.rend(); ++id) {
+        size_t i = index[*id];
+        tail[i] += std::max(0, programs[i].seconds);
+        for (size_t j : before[i]) {
+            tail[j] = std::max(tail[j], tail[i]);
+        }
+    }
+
+    std::vector<bool> started(programs.size(), false);
+    std::vector<int> ended(programs.size(), -1); // once finished
+    std::vector<std::pair<int, size_t> > running; // end, program
+    size_t done = 0;
+    for (int now = 0; done < programs.size();) {
+        while (static_cast<int> (running.size()) < capacity) {
+            long best = -1;
+            for (size_t i = 0; i < programs.size(); i++) {
+                if (started[i] || release[i] > now) continue;
+                bool ready = std::all_of(before[i].begin(), before[i].end(),
+                        [&ended](size_t j) {
+                            return ended[j] >= 0;
+                        });
+                if (!ready) continue;
+                bool conflict = std::any_of(running.begin(), running.end(),
+                        [&](const std::pair<int, size_t>& run) {
+                            return Conflict(programs[i], programs[run.second]);
+                        });
+                if (conflict) continue;
+                if (best < 0) {
+                    best = static_cast<long> (i);
+                    continue;
+                }
+                const dag_program& a = programs[i];
+                const dag_program& b = programs[best];
+                if (a.priority != b.priority ? a.priority > b.priority :
+                        tail[i] != tail[best] ? tail[i] > tail[best] :
+                        release[i] != release[best] ?
+                        release[i] < release[best] : a.id < b.id) {
+                    best = static_cast<long> (i);
+                }
+            }
+            if (best < 0) break;
+            int seconds = std::max(0, programs[best].seconds);
+            started[best] = true;
+            running.push_back({now + seconds, static_cast<size_t> (best)});
+            plan.steps.push_back({programs[best].id, now, now + seconds});
+        }
+
+        // on to the next end, or the next start time
+        int next = -1;
+        for (const auto& run : running) {
+            if (next < 0 || run.first < next) next = run.first;
+        }
+        for (size_t i = 0; i < programs.size(); i++) {
+            if (!started[i] && release[i] > now &&
+                    (next < 0 || release[i] < next)) next = release[i];
+        }
+        if (next < 0) break; // nothing left can start
+        now = next;
+        for (auto run = running.begin(); run != running.end();) {
+            if (run->first > now) {
+                ++run;
+                continue;
+            }
+            ended[run->second] = run->first;
+            plan.makespan = std::max(plan.makespan, run->first);
+            done++;
+            run = running.erase(run);
+        }
+    }
+    return plan;
+}
+
+int DagCommand(int argc, char* argv[]) {
+    int capacity = 2;
+    int nights = 7;
+    bool show_plan = false;
+    std::string config;
+    for (int i = 0; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--capacity" && i + 1 < argc) {
+            capacity = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--nights" && i + 1 < argc) {
+            nights = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--plan") {
+            show_plan = true;
+        } else {
+            config = arg;
+        }
+    }
+    if (config.empty()) {
+        std::cout << "eg: mysprinkler dag /etc/mysprinkler.yaml "
+                "[--capacity N] [--nights N] [--plan]\n";
+        return EXIT_FAILURE;
+    }
+    site_report report;
+    try {
+        ValidateConfig(YAML::LoadFile(config), report);
+    } catch (const std::exception& e) {
+        std::cout << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+    std::map<int, dag_zone> zones;
+    for (const auto& zone : report.zones) {
+        zones[zone.id] = {zone.max_cycle, zone.min_soak};
+    }
+
+    // the whole graph, whether or not the programs meet in a night
+    std::vector<dag_program> all;
+    for (auto& program : report.programs) {
+        all.push_back({program.Id(), 0, 0, 0, {}, program.After(),
+            program.NotWith()});
+    }
+    std::vector<int> order, cycle;
+    if (!OrderPrograms(all, order, cycle)) {
+        std::printf("programs %s -> %d depend on each other\n",
+                Ids(cycle, " -> ").c_str(), cycle.front());
+        return EXIT_FAILURE;
+    }
+    std::printf("dependency order %s\n", Ids(order, ", ").c_str());
+
+    // nights run from noon to noon, local, tonight first
+    std::tm tm = TimeZone::Local().ToLocal(std::time(nullptr));
+    tm.tm_hour = 12;
+    tm.tm_min = tm.tm_sec = 0;
+    std::printf("%-10s %8s %9s %9s %9s  %s\n", "night", "programs",
+            "serial", "capacity", "critical", "critical path");
+    for (int night = 0; night < nights; night++) {
+        std::tm noon = tm;
+        noon.tm_mday += night;
+        std::tm next = noon;
+        next.tm_mday++;
+        std::time_t from = 0, to = 0;
+        TimeZone::Local().ToUtc(noon, from);
+        TimeZone::Local().ToUtc(next, to);
+        std::vector<dag_program> programs = NightPrograms(report.programs,
+                zones, from, to);
+        dag_plan plan = PlanNight(programs, capacity);
+        std::tm local = TimeZone::Local().ToLocal(from);
+        char date[16];
+        std::strftime(date, sizeof (date), "%Y-%m-%d", &local);
+        std::printf("%-10s %8zu %9s %9s %9s  %s\n", date, programs.size(),
+                Minutes(PlanNight(programs, 1).makespan).c_str(),
+                Minutes(plan.makespan).c_str(),
+                Minutes(plan.critical_path).c_str(),
+                Ids(plan.critical, " -> ").c_str());
+        if (!show_plan) continue;
+        for (const auto& step : plan.steps) {
+            std::printf("    +%-8s program %-4d until +%s\n",
+                    Minutes(step.start).c_str(), step.id,
+                    Minutes(step.end).c_str());
+        }
+    }
+    return EXIT_SUCCESS;
+}
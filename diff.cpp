@@ -0,0 +1,513 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "include/diff.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace {
+
+const size_t kNone = static_cast<size_t> (-1);
+
+int Minutes(std::int64_t seconds) {
+    return static_cast<int> (std::lround(seconds / 60.0));
+}
+
+// one side of the diff, loaded the way the daemon loads it
+struct site {
+    std::string path;
+    YAML::Node config;
+    site_report report;
+    std::string error; // the config could not be read
+    std::vector<std::string> warnings;
+    planned_schedule schedule;
+};
+
+bool LoadSite(site& side) {
+    side.report.source = side.path;
+    try {
+        side.config = YAML::LoadFile(side.path);
+        ValidateConfig(side.config, side.report);
+    } catch (const std::exception& e) {
+        side.error = side.path + ": " + e.what();
+        return false;
+    }
+    for (const auto& error : side.report.errors) {
+        side.warnings.push_back(side.path + ": " + error);
+    }
+    return true;
+}
+
+void ReplaySite(site& side, std::time_t from, int days) {
+    Timeline timeline(from, days);
+    for (const auto& warning : LoadTimeline(timeline, side.config,
+            side.report)) {
+        side.warnings.push_back(side.path + ": " + warning);
+    }
+    side.schedule = ExpandSchedule(timeline, from, from + days * 86400LL);
+}
+
+} // namespace
+
+planned_schedule ExpandSchedule(Timeline& timeline, std::time_t from,
+        std::time_t to) {
+    // every slot of the runs due in range, the last may water past it
+    std::vector<timeline_slot> slots = timeline.Range(from,
+            std::numeric_limits<std::time_t>::max());
+    planned_schedule schedule;
+    std::map<std::pair<int, std::time_t>, size_t> index; // program, due
+    std::vector<std::pair<size_t, size_t> > spans; // first and last slot
+    std::vector<size_t> owner(slots.size(), kNone);
+    for (size_t i = 0; i < slots.size(); i++) {
+        const timeline_slot& slot = slots[i];
+        if (slot.due < from || slot.due >= to) continue;
+        auto it = index.insert(std::make_pair(std::make_pair(slot.program_id,
+                slot.due), schedule.runs.size()));
+        if (it.second) {
+            schedule.runs.push_back({slot.due, slot.program_id, slot.start,
+                slot.end, 0, {}});
+            spans.push_back(std::make_pair(i, i));
+        }
+        size_t r = it.first->second;
+        planned_run& run = schedule.runs[r];
+        int seconds = static_cast<int> (slot.end - slot.start);
+        run.end = slot.end;
+        run.seconds += seconds;
+        // cycles and preempted parts add up
+        auto zone = std::lower_bound(run.zones.begin(), run.zones.end(),
+                std::make_pair(slot.zone_id, 0));
+        if (zone == run.zones.end() || zone->first != slot.zone_id) {
+            zone = run.zones.insert(zone, std::make_pair(slot.zone_id, 0));
+        }
+        zone->second += seconds;
+        spans[r].second = i;
+        owner[i] = r;
+        schedule.zones[slot.zone_id] += seconds;
+    }
+
+    // what kept each run from watering as configured, slots never overlap
+    std::vector<run_overlap> overlaps;
+    for (size_t r = 0; r < schedule.runs.size(); r++) {
+        const planned_run& run = schedule.runs[r];
+        size_t first = spans[r].first;
+        int with = 0;
+        std::time_t seconds = run.start - run.due;
+        if (seconds > 0 && first > 0) {
+            // the zone watering when it was due, or the last one before
+            auto at = std::upper_bound(slots.begin(), slots.begin() + first,
+                    run.due, [](std::time_t value, const timeline_slot & s) {
+                        return value < s.start;
+                    });
+            const timeline_slot& slot = at != slots.begin() &&
+                    (at - 1)->end > run.due ? *(at - 1) : slots[first - 1];
+            with = slot.program_id;
+        }
+        for (size_t i = first + 1; i < spans[r].second; i++) {
+            if (owner[i] == r) continue;
+            if (with == 0) with = slots[i].program_id;
+            seconds += slots[i].end - slots[i].start;
+        }
+        if (seconds > 0) {
+            overlaps.push_back({r, with, static_cast<int> (seconds)});
+        }
+    }
+
+    std::vector<size_t> order(schedule.runs.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&schedule](size_t lhs, size_t rhs) {
+        const planned_run& left = schedule.runs[lhs];
+        const planned_run& right = schedule.runs[rhs];
+        return left.due != right.due ? left.due < right.due :
+                left.program_id < right.program_id;
+    });
+    std::vector<size_t> rank(order.size());
+    std::vector<planned_run> runs;
+    runs.reserve(order.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        rank[order[i]] = i;
+        runs.push_back(std::move(schedule.runs[order[i]]));
+    }
+    schedule.runs.swap(runs);
+    for (auto& overlap : overlaps) {
+        overlap.run = rank[overlap.run];
+    }
+    std::sort(overlaps.begin(), overlaps.end(),
+            [](const run_overlap& lhs, const run_overlap & rhs) {
+                return lhs.run < rhs.run;
+            });
+    schedule.overlaps.swap(overlaps);
+    return schedule;
+}
+
+schedule_diff DiffSchedules(const planned_schedule& before,
+        const planned_schedule& after, int shift_seconds) {
+    schedule_diff diff = {};
+
+    // the runs of each program, by due
+    std::map<int, std::pair<std::vector<size_t>, std::vector<size_t> > > runs;
+    for (size_t i = 0; i < before.runs.size(); i++) {
+        runs[before.runs[i].program_id].first.push_back(i);
+    }
+    for (size_t i = 0; i < after.runs.size(); i++) {
+        runs[after.runs[i].program_id].second.push_back(i);
+    }
+    std::vector<size_t> counterpart(after.runs.size(), kNone);
+    for (const auto& program : runs) {
+        const std::vector<size_t>& a = program.second.first;
+        const std::vector<size_t>& b = program.second.second;
+        std::vector<std::pair<size_t, size_t> > matched;
+        std::vector<size_t> left_a, left_b;
+        size_t i = 0, j = 0;
+        while (i < a.size() || j < b.size()) {
+            if (j == b.size() || (i < a.size() &&
+                    before.runs[a[i]].due < after.runs[b[j]].due)) {
+                left_a.push_back(a[i++]);
+            } else if (i == a.size() ||
+                    after.runs[b[j]].due < before.runs[a[i]].due) {
+                left_b.push_back(b[j++]);
+            } else {
+                matched.push_back(std::make_pair(a[i++], b[j++]));
+                if (before.runs[matched.back().first].start !=
+                        after.runs[matched.back().second].start) {
+                    diff.shifted.push_back(matched.back());
+                }
+            }
+        }
+        for (i = 0, j = 0; i < left_a.size() || j < left_b.size();) {
+            std::time_t from = i < left_a.size() ?
+                    before.runs[left_a[i]].due : 0;
+            std::time_t to = j < left_b.size() ?
+                    after.runs[left_b[j]].due : 0;
+            if (i < left_a.size() && j < left_b.size() &&
+                    std::abs(to - from) <= shift_seconds) {
+                matched.push_back(std::make_pair(left_a[i++], left_b[j++]));
+                diff.shifted.push_back(matched.back());
+            } else if (j == left_b.size() || (i < left_a.size() && from < to)) {
+                diff.removed.push_back(left_a[i++]);
+            } else {
+                diff.added.push_back(left_b[j++]);
+            }
+        }
+
+        program_change change = {program.first, 0, 0, 0};
+        for (const auto& pair : matched) {
+            counterpart[pair.second] = pair.first;
+            const planned_run& was = before.runs[pair.first];
+            const planned_run& is = after.runs[pair.second];
+            if (was.zones == is.zones) continue;
+            if (change.runs++ == 0) {
+                change.before_seconds = was.seconds;
+                change.after_seconds = is.seconds;
+            }
+        }
+        if (change.runs > 0) diff.changed.push_back(change);
+    }
+    std::sort(diff.added.begin(), diff.added.end());
+    std::sort(diff.removed.begin(), diff.removed.end());
+    std::sort(diff.shifted.begin(), diff.shifted.end());
+
+    for (const auto& zone : before.zones) {
+        diff.zones[zone.first].first = zone.second;
+    }
+    for (const auto& zone : after.zones) {
+        diff.zones[zone.first].second = zone.second;
+    }
+    for (auto it = diff.zones.begin(); it != diff.zones.end();) {
+        if (it->second.first == it->second.second) {
+            it = diff.zones.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    std::vector<bool> overlapped(before.runs.size());
+    for (const auto& overlap : before.overlaps) {
+        overlapped[overlap.run] = true;
+    }
+    for (size_t i = 0; i < after.overlaps.size(); i++) {
+        size_t was = counterpart[after.overlaps[i].run];
+        if (was == kNone || !overlapped[was]) {
+            diff.new_overlaps.push_back(i);
+        }
+    }
+    return diff;
+}
+
+int DiffCommand(int argc, char* argv[]) {
+    int days = 30;
+    int shift = 12 * 60;
+    int limit = -1;
+    bool json = false;
+    std::time_t from = std::time(nullptr);
+    std::vector<std::string> files;
+    for (int i = 0; i < argc; i++) {
+        std::string arg = argv[i];
+        bool value = i + 1 < argc;
+        if (arg == "--days" && value) {
+            days = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--shift" && value) {
+            shift = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--limit" && value) {
+            limit = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--from" && value) {
+            if (!ParseLocal(argv[++i], from)) {
+                std::cout << "Invalid time " << argv[i] << ", expecting "
+                        "YYYY-MM-DD [HH:MM]\n";
+                return 2;
+            }
+        } else if (arg == "--json") {
+            json = true;
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (files.size() != 2) {
+        std::cout << "eg: mysprinkler diff /etc/mysprinkler.yaml new.yaml "
+                "[--days N] [--from \"YYYY-MM-DD HH:MM\"] [--shift MINUTES] "
+                "[--limit N] [--json]\n";
+        return 2;
+    }
+    if (limit < 0) limit = json ? 0 : 20; // 0 lists everything
+    std::time_t to = from + days * 86400LL;
+
+    // both versions load, then replay, side by side
+    auto begin = std::chrono::steady_clock::now();
+    site sites[2];
+    sites[0].path = files[0];
+    sites[1].path = files[1];
+    bool loaded[2];
+    std::thread other([&sites, &loaded]() {
+        loaded[1] = LoadSite(sites[1]);
+    });
+    loaded[0] = LoadSite(sites[0]);
+    other.join();
+    for (const auto& side : sites) {
+        if (!side.error.empty()) {
+            std::cout << side.error << "\n";
+            return 2;
+        }
+    }
+    auto loaded_at = std::chrono::steady_clock::now();
+    other = std::thread([&sites, from, days]() {
+        ReplaySite(sites[1], from, days);
+    });
+    ReplaySite(sites[0], from, days);
+    other.join();
+    const planned_schedule& before = sites[0].schedule;
+    const planned_schedule& after = sites[1].schedule;
+    schedule_diff diff = DiffSchedules(before, after, shift * 60);
+    auto end = std::chrono::steady_clock::now();
+    double load_ms = std::chrono::duration<double, std::milli>(
+            loaded_at - begin).count();
+    double diff_ms = std::chrono::duration<double, std::milli>(
+            end - loaded_at).count();
+
+    std::vector<std::string> warnings = sites[0].warnings;
+    warnings.insert(warnings.end(), sites[1].warnings.begin(),
+            sites[1].warnings.end());
+    auto shown = [limit](size_t size) {
+        return limit ? std::min<size_t> (size, limit) : size;
+    };
+    std::ostringstream os;
+    if (json) {
+        auto runs = [&](const char* name, const planned_schedule& schedule,
+                const std::vector<size_t>& list) {
+            os << ",\n \"" << name << "\": [";
+            for (size_t i = 0; i < shown(list.size()); i++) {
+                const planned_run& run = schedule.runs[list[i]];
+                os << (i ? ",\n   " : "\n   ") << "{\"program\": "
+                        << run.program_id << ", \"due\": "
+                        << JsonString(IsoUtc(run.due)) << ", \"start\": "
+                        << JsonString(IsoUtc(run.start)) << ", \"minutes\": "
+                        << Minutes(run.seconds) << "}";
+            }
+            os << "]";
+        };
+        os << "{\"before\": " << JsonString(files[0])
+                << ", \"after\": " << JsonString(files[1])
+                << ", \"from\": " << JsonString(IsoUtc(from))
+                << ", \"to\": " << JsonString(IsoUtc(to))
+                << ",\n \"runs\": {\"before\": " << before.runs.size()
+                << ", \"after\": " << after.runs.size()
+                << ", \"added\": " << diff.added.size()
+                << ", \"removed\": " << diff.removed.size()
+                << ", \"shifted\": " << diff.shifted.size()
+                << ", \"changed\": " << diff.changed.size() << "}";
+        runs("added", after, diff.added);
+        runs("removed", before, diff.removed);
+        os << ",\n \"shifted\": [";
+        for (size_t i = 0; i < shown(diff.shifted.size()); i++) {
+            const planned_run& was = before.runs[diff.shifted[i].first];
+            const planned_run& is = after.runs[diff.shifted[i].second];
+            os << (i ? ",\n   " : "\n   ") << "{\"program\": "
+                    << was.program_id << ", \"from\": "
+                    << JsonString(IsoUtc(was.start)) << ", \"to\": "
+                    << JsonString(IsoUtc(is.start)) << ", \"minutes\": "
+                    << Minutes(is.start - was.start) << "}";
+        }
+        os << "],\n \"changed\": [";
+        for (size_t i = 0; i < shown(diff.changed.size()); i++) {
+            const program_change& change = diff.changed[i];
+            os << (i ? ",\n   " : "\n   ") << "{\"program\": "
+                    << change.program_id << ", \"runs\": " << change.runs
+                    << ", \"before_minutes\": "
+                    << Minutes(change.before_seconds)
+                    << ", \"after_minutes\": "
+                    << Minutes(change.after_seconds) << "}";
+        }
+        os << "],\n \"zones\": [";
+        size_t count = 0;
+        for (const auto& zone : diff.zones) {
+            if (count == shown(diff.zones.size())) break;
+            os << (count++ ? ",\n   " : "\n   ") << "{\"zone\": " << zone.first
+                    << ", \"before_minutes\": " << Minutes(zone.second.first)
+                    << ", \"after_minutes\": " << Minutes(zone.second.second)
+                    << "}";
+        }
+        os << "],\n \"overlaps\": {\"before\": " << before.overlaps.size()
+                << ", \"after\": " << after.overlaps.size()
+                << ", \"new\": " << diff.new_overlaps.size()
+                << ", \"added\": [";
+        for (size_t i = 0; i < shown(diff.new_overlaps.size()); i++) {
+            const run_overlap& overlap = after.overlaps[diff.new_overlaps[i]];
+            const planned_run& run = after.runs[overlap.run];
+            os << (i ? ",\n   " : "\n   ") << "{\"program\": "
+                    << run.program_id << ", \"due\": "
+                    << JsonString(IsoUtc(run.due)) << ", \"with\": "
+                    << overlap.with << ", \"minutes\": "
+                    << Minutes(overlap.seconds) << "}";
+        }
+        os << "]},\n \"warnings\": " << "[";
+        for (size_t i = 0; i < warnings.size(); i++) {
+            os << (i ? ", " : "") << JsonString(warnings[i]);
+        }
+        char summary[128];
+        std::snprintf(summary, sizeof (summary), "],\n \"summary\": "
+                "{\"load_ms\": %.1f, \"diff_ms\": %.1f}}\n", load_ms, diff_ms);
+        os << summary;
+    } else {
+        char line[160];
+        auto more = [&os, limit](size_t size) {
+            if (limit && size > static_cast<size_t> (limit)) {
+                os << "  ... " << size - limit << " more\n";
+            }
+        };
+        auto runs = [&](const char* name, const planned_schedule& schedule,
+                const std::vector<size_t>& list) {
+            if (list.empty()) return;
+            os << name << "\n";
+            for (size_t i = 0; i < shown(list.size()); i++) {
+                const planned_run& run = schedule.runs[list[i]];
+                std::snprintf(line, sizeof (line), "  program %-6d %s %5d min"
+                        "\n", run.program_id, FormatLocal(run.start,
+                        "%Y/%m/%d %H:%M").c_str(), Minutes(run.seconds));
+                os << line;
+            }
+            more(list.size());
+        };
+        for (const auto& warning : warnings) {
+            os << "warning: " << warning << "\n";
+        }
+        os << files[0] << " -> " << files[1] << ", " << days << " days from "
+                << FormatLocal(from, "%Y/%m/%d %H:%M %Z") << "\n";
+        std::snprintf(line, sizeof (line), "runs %zu -> %zu: %zu added, %zu "
+                "removed, %zu shifted, %zu programs changed\n",
+                before.runs.size(), after.runs.size(), diff.added.size(),
+                diff.removed.size(), diff.shifted.size(), diff.changed.size());
+        os << line;
+        runs("added", after, diff.added);
+        runs("removed", before, diff.removed);
+        if (!diff.shifted.empty()) os << "shifted\n";
+        for (size_t i = 0; i < shown(diff.shifted.size()); i++) {
+            const planned_run& was = before.runs[diff.shifted[i].first];
+            const planned_run& is = after.runs[diff.shifted[i].second];
+            std::snprintf(line, sizeof (line), "  program %-6d %s -> %s %+5d "
+                    "min\n", was.program_id, FormatLocal(was.start,
+                    "%Y/%m/%d %H:%M").c_str(), FormatLocal(is.start,
+                    "%H:%M").c_str(), Minutes(is.start - was.start));
+            os << line;
+        }
+        more(diff.shifted.size());
+        if (!diff.changed.empty()) os << "changed\n";
+        for (size_t i = 0; i < shown(diff.changed.size()); i++) {
+            const program_change& change = diff.changed[i];
+            std::snprintf(line, sizeof (line), "  program %-6d %4d runs, "
+                    "%d -> %d min\n", change.program_id, change.runs,
+                    Minutes(change.before_seconds),
+                    Minutes(change.after_seconds));
+            os << line;
+        }
+        more(diff.changed.size());
+        if (!diff.zones.empty()) os << "zone minutes\n";
+        size_t count = 0;
+        for (const auto& zone : diff.zones) {
+            if (count++ == shown(diff.zones.size())) break;
+            std::snprintf(line, sizeof (line), "  zone %-6d %8d -> %8d "
+                    "%+8d\n", zone.first, Minutes(zone.second.first),
+                    Minutes(zone.second.second), Minutes(zone.second.second) -
+                    Minutes(zone.second.first));
+            os << line;
+        }
+        more(diff.zones.size());
+        std::snprintf(line, sizeof (line), "overlaps %zu -> %zu, %zu new\n",
+                before.overlaps.size(), after.overlaps.size(),
+                diff.new_overlaps.size());
+        os << line;
+        for (size_t i = 0; i < shown(diff.new_overlaps.size()); i++) {
+            const run_overlap& overlap = after.overlaps[diff.new_overlaps[i]];
+            const planned_run& run = after.runs[overlap.run];
+            std::snprintf(line, sizeof (line), "  program %-6d due %s held "
+                    "up by program %d, %d min\n", run.program_id,
+                    FormatLocal(run.due, "%Y/%m/%d %H:%M").c_str(),
+                    overlap.with, Minutes(overlap.seconds));
+            os << line;
+        }
+        more(diff.new_overlaps.size());
+        std::snprintf(line, sizeof (line), "loaded in %.1f ms, replayed and "
+                "compared in %.1f ms\n", load_ms, diff_ms);
+        os << line;
+    }
+    std::string out = os.str();
+    std::fwrite(out.data(), 1, out.size(), stdout);
+
+    // as diff(1), 1 when the schedules differ
+    bool differ = !diff.added.empty() || !diff.removed.empty() ||
+            !diff.shifted.empty() || !diff.changed.empty() ||
+            !diff.zones.empty() || !diff.new_overlaps.empty();
+    return differ ? 1 : 0;
+}
@@ -0,0 +1,398 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "include/events.hpp"
+#include "include/Logger.h"
+#include "include/trace.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using ace::utils::Logger;
+
+namespace {
+
+const char* kEventNames[] = {
+    "program_start", "program_skip", "program_preempted", "program_done",
+    "zone_on", "zone_off"
+};
+
+const char* kReasonNames[] = {
+    "ran", "disabled", "unknown_zone", "shutdown", "fault", "preempted",
+    "moist", "stopped"
+};
+
+// MQTT remaining length, 7 bits a byte
+void AppendLength(std::string& packet, size_t length) {
+    do {
+        unsigned char byte = length % 128;
+        length /= 128;
+        if (length) byte |= 0x80;
+        packet += static_cast<char> (byte);
+    } while (length);
+}
+
+void AppendString(std::string& packet, const std::string& text) {
+    packet += static_cast<char> (text.size() >> 8);
+    packet += static_cast<char> (text.size() & 0xff);
+    packet += text;
+}
+
+std::string Packet(unsigned char type, const std::string& body) {
+    std::string packet(1, static_cast<char> (type));
+    AppendLength(packet, body.size());
+    return packet + body;
+}
+
+} // namespace
+
+EventPublisher::EventPublisher() : first_(0), next_(0), dropped_(0),
+reported_(0), published_(0), connects_(0), running_(false), fd_(-1) {
+}
+
+EventPublisher::~EventPublisher() {
+    Stop();
+}
+
+void EventPublisher::Start(const mqtt_options& options) {
+    Stop();
+    std::lock_guard<std::mutex>lock(lock_);
+    options_ = options;
+    options_.buffer = std::max(1, options_.buffer);
+    options_.batch = std::max(1, options_.batch);
+    options_.keepalive = std::max(1, options_.keepalive);
+    ring_.assign(options_.buffer, event());
+    first_ = next_; // emptied by Stop(), the totals carry on
+    running_ = true;
+    thread_ = std::thread(&EventPublisher::Run, this);
+}
+
+void EventPublisher::Stop() {
+    {
+        std::lock_guard<std::mutex>lock(lock_);
+        if (!running_) return;
+        running_ = false;
+    }
+    cv_.notify_one();
+    thread_.join();
+}
+
+bool EventPublisher::Running() const {
+    std::lock_guard<std::mutex>lock(lock_);
+    return running_;
+}
+
+void EventPublisher::Push(EVENT_TYPE type, int program_id, int zone_id,
+        int seconds, RUN_REASON reason) {
+    event e;
+    e.at = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    e.type = type;
+    e.reason = reason;
+    e.program_id = program_id;
+    e.zone_id = zone_id;
+    e.seconds = seconds;
+
+    bool wake;
+    {
+        std::lock_guard<std::mutex>lock(lock_);
+        if (!running_) return;
+        if (next_ - first_ == ring_.size()) {
+            first_++;
+            dropped_++;
+        }
+        ring_[next_ % ring_.size()] = e;
+        next_++;
+        // the first of a batch starts the linger, a full batch ends it
+        size_t buffered = next_ - first_;
+        wake = buffered == 1 ||
+                buffered == static_cast<size_t> (options_.batch);
+    }
+    if (wake) cv_.notify_one();
+}
+
+std::uint64_t EventPublisher::Pushed() const {
+    std::lock_guard<std::mutex>lock(lock_);
+    return next_;
+}
+
+std::uint64_t EventPublisher::Published() const {
+    std::lock_guard<std::mutex>lock(lock_);
+    return published_;
+}
+
+std::uint64_t EventPublisher::Dropped() const {
+    std::lock_guard<std::mutex>lock(lock_);
+    return dropped_;
+}
+
+std::uint64_t EventPublisher::Connects() const {
+    std::lock_guard<std::mutex>lock(lock_);
+    return connects_;
+}
+
+void EventPublisher::Run() {
+    TRACE_THREAD("mqtt");
+    using clock = std::chrono::steady_clock;
+    const clock::duration kMinBackoff = std::chrono::milliseconds(500);
+    clock::duration backoff = kMinBackoff;
+    auto retry = clock::now();
+    auto keepalive = std::chrono::seconds(options_.keepalive);
+    std::vector<event> batch;
+
+    std::unique_lock<std::mutex>lock(lock_);
+    for (;;) {
+        if (!running_ && (fd_ < 0 || first_ == next_)) break;
+
+        if (fd_ < 0) {
+            if (clock::now() < retry) {
+                cv_.wait_until(lock, retry, [this] {
+                    return !running_;
+                });
+                continue;
+            }
+            lock.unlock();
+            bool connected = Connect();
+            lock.lock();
+            if (!connected) {
+                // shutting down with the broker away, what is left is lost
+                if (!running_) break;
+                retry = clock::now() + backoff;
+                backoff = std::min<clock::duration>(backoff * 2,
+                        std::chrono::seconds(30));
+                continue;
+            }
+            backoff = kMinBackoff;
+            connects_++;
+        }
+
+        if (first_ == next_) {
+            // idle, ping within the keepalive
+            auto ping = sent_ + keepalive / 2;
+            cv_.wait_until(lock, ping, [this] {
+                return !running_ || first_ != next_;
+            });
+            if (first_ != next_ || !running_ || clock::now() < ping) continue;
+            lock.unlock();
+            bool alive = Receive() && clock::now() - received_ <
+                    keepalive * 3 / 2 && Send(Packet(0xc0, std::string()));
+            if (!alive) Disconnect(false);
+            lock.lock();
+            continue;
+        }
+
+        if (running_ && next_ - first_ < static_cast<size_t> (options_.batch)) {
+            cv_.wait_for(lock, std::chrono::milliseconds(options_.linger_ms),
+                    [this] {
+                        return !running_ || next_ - first_ >=
+                                static_cast<size_t> (options_.batch);
+                    });
+        }
+        std::uint64_t from = first_;
+        std::uint64_t to = std::min<std::uint64_t>(next_,
+                first_ + options_.batch);
+        batch.clear();
+        for (std::uint64_t i = from; i < to; i++) {
+            batch.push_back(ring_[i % ring_.size()]);
+        }
+        std::uint64_t dropped = dropped_ - reported_;
+        lock.unlock();
+
+        std::string body;
+        AppendString(body, options_.topic);
+        body += Payload(batch, dropped);
+        TRACE_SPAN("mqtt", "publish", static_cast<std::int64_t> (to - from));
+        bool sent = Receive() && Send(Packet(0x30, body));
+        if (!sent) Disconnect(false);
+
+        lock.lock();
+        if (sent) {
+            // events pushed out of the ring while in flight reached the
+            // broker all the same
+            if (first_ > from) dropped_ -= std::min(first_, to) - from;
+            first_ = std::max(first_, to);
+            reported_ += dropped;
+            published_ += to - from;
+        }
+    }
+    // never reached the broker
+    dropped_ += next_ - first_;
+    first_ = next_;
+    lock.unlock();
+    if (fd_ >= 0) Disconnect(true);
+}
+
+bool EventPublisher::Connect() {
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    std::string port = std::to_string(options_.port);
+    int error = getaddrinfo(options_.host.c_str(), port.c_str(), &hints,
+            &addresses);
+    if (error) {
+        Logger::Instance().Warning("MQTT broker %s: %s",
+                options_.host.c_str(), gai_strerror(error));
+        return false;
+    }
+    for (addrinfo* a = addresses; a != nullptr && fd_ < 0; a = a->ai_next) {
+        fd_ = socket(a->ai_family, a->ai_socktype | SOCK_NONBLOCK |
+                SOCK_CLOEXEC, a->ai_protocol);
+        if (fd_ < 0) continue;
+        // connect within 2 seconds
+        bool connected = connect(fd_, a->ai_addr, a->ai_addrlen) == 0;
+        if (!connected && errno == EINPROGRESS) {
+            pollfd p = {fd_, POLLOUT, 0};
+            int e = 0;
+            socklen_t length = sizeof (e);
+            connected = poll(&p, 1, 2000) == 1 &&
+                    getsockopt(fd_, SOL_SOCKET, SO_ERROR, &e, &length) == 0 &&
+                    e == 0;
+        }
+        if (!connected) {
+            close(fd_);
+            fd_ = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (fd_ < 0) {
+        Logger::Instance().Debug("MQTT broker %s:%d unreachable",
+                options_.host.c_str(), options_.port);
+        return false;
+    }
+
+    // blocking from here, a broker that stops reading fails a send in 2s
+    fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) & ~O_NONBLOCK);
+    timeval timeout = {2, 0};
+    setsockopt(fd_, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof (timeout));
+    int one = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+
+    std::string body;
+    AppendString(body, "MQTT");
+    body += static_cast<char> (4); // 3.1.1
+    body += static_cast<char> (0x02); // clean session
+    body += static_cast<char> (options_.keepalive >> 8);
+    body += static_cast<char> (options_.keepalive & 0xff);
+    AppendString(body, options_.client_id);
+    unsigned char connack[4] = {};
+    size_t got = 0;
+    if (Send(Packet(0x10, body))) {
+        pollfd p = {fd_, POLLIN, 0};
+        while (got < sizeof (connack) && poll(&p, 1, 2000) == 1) {
+            ssize_t n = recv(fd_, connack + got, sizeof (connack) - got, 0);
+            if (n <= 0) break;
+            got += n;
+        }
+    }
+    if (got < sizeof (connack) || connack[0] != 0x20 || connack[3] != 0) {
+        Logger::Instance().Warning("MQTT broker %s:%d refused the "
+                "connection, code %d", options_.host.c_str(), options_.port,
+                got == sizeof (connack) ? connack[3] : -1);
+        Disconnect(false);
+        return false;
+    }
+    received_ = std::chrono::steady_clock::now();
+    Logger::Instance().Info("Connected to MQTT broker %s:%d",
+            options_.host.c_str(), options_.port);
+    return true;
+}
+
+void EventPublisher::Disconnect(bool clean) {
+    if (fd_ < 0) return;
+    if (clean) Send(Packet(0xe0, std::string()));
+    close(fd_);
+    fd_ = -1;
+}
+
+bool EventPublisher::Send(const std::string& packet) {
+    for (size_t sent = 0; sent < packet.size();) {
+        ssize_t n = send(fd_, packet.data() + sent, packet.size() - sent,
+                MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            Logger::Instance().Debug("MQTT send failed: %s",
+                    std::strerror(errno));
+            return false;
+        }
+        sent += n;
+    }
+    sent_ = std::chrono::steady_clock::now();
+    return true;
+}
+
+bool EventPublisher::Receive() {
+    // only PINGRESP is expected at QoS 0, the bytes themselves are skipped
+    char buffer[256];
+    for (;;) {
+        ssize_t n = recv(fd_, buffer, sizeof (buffer), MSG_DONTWAIT);
+        if (n > 0) {
+            received_ = std::chrono::steady_clock::now();
+            continue;
+        }
+        return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK ||
+                errno == EINTR);
+    }
+}
+
+std::string EventPublisher::Payload(const std::vector<event>& events,
+        std::uint64_t dropped) const {
+    std::string payload = "{\"dropped\":" + std::to_string(dropped) +
+            ",\"events\":[";
+    char item[160];
+    for (size_t i = 0; i < events.size(); i++) {
+        const event& e = events[i];
+        int n = std::snprintf(item, sizeof (item), "%s{\"at\":%lld,"
+                "\"event\":\"%s\",\"program\":%d", i ? "," : "",
+                static_cast<long long> (e.at), kEventNames[e.type],
+                e.program_id);
+        if (e.type == event_zone_on || e.type == event_zone_off) {
+            n += std::snprintf(item + n, sizeof (item) - n, ",\"zone\":%d",
+                    e.zone_id);
+        }
+        if (e.type == event_zone_off) {
+            n += std::snprintf(item + n, sizeof (item) - n, ",\"seconds\":%d,"
+                    "\"reason\":\"%s\"", e.seconds, kReasonNames[e.reason]);
+        } else if (e.type == event_program_start) {
+            n += std::snprintf(item + n, sizeof (item) - n, ",\"late\":%d",
+                    e.seconds);
+        }
+        payload.append(item, n);
+        payload += '}';
+    }
+    return payload + "]}";
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Entry point of the fixed installation build, see 'make fixed'. The site
+ * configuration is compiled in from site_config.hpp, written by
+ * 'mysprinkler generate', so there is no YAML or BlackLib dependency.
+ */
+
+#include "include/fixed.hpp"
+#include "site_config.hpp"
+
+#include <csignal>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+using site_scheduler = FixedScheduler<site::zones>;
+
+static site_scheduler* scheduler_ = nullptr;
+
+void signal_callback(int signum) {
+    ace::utils::Logger::Instance().Debug("Caught signal %d", signum);
+
+    site::zones::AllOff();
+
+    StartShutdown();
+
+    if (scheduler_ != nullptr) scheduler_->Wake();
+}
+
+int main() {
+    std::signal(SIGTERM, signal_callback);
+    std::signal(SIGINT, signal_callback);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    ace::utils::Logger::Instance().SetLoggingMode(site::logging_mode);
+
+    if (site::daemon && daemon(1, 0)) {
+        fprintf(stderr, "Error: daemon() failed: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    if (!site::zones::Open(site::gpio_directory)) {
+        ace::utils::Logger::Instance().Warning("Unable to open every zone "
+                "under %s", site::gpio_directory);
+    }
+    site::zones::AllOff();
+
+    site_scheduler scheduler(site::programs);
+    scheduler_ = &scheduler;
+    bool fRet = scheduler.Run();
+    scheduler_ = nullptr;
+
+    site::zones::AllOff();
+    ace::utils::Logger::Instance().Info("mysprinkler exited cleanly.");
+    return fRet ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,376 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "include/flow.hpp"
+#include "include/Logger.h"
+#include "include/trace.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+using ace::utils::Logger;
+
+FlowMonitor::FlowMonitor() : sample_seconds_(5), running_(false) {
+    wake_fd_[0] = wake_fd_[1] = -1;
+}
+
+FlowMonitor::~FlowMonitor() {
+    Stop();
+}
+
+void FlowMonitor::LoadSensors(const YAML::Node yNodes, int sample_seconds) {
+    sample_seconds_ = std::max(1, sample_seconds);
+    for (auto it = yNodes.begin(); it != yNodes.end(); ++it) {
+        YAML::Node details = it->second;
+        std::unique_ptr<flow_sensor> sensor(new flow_sensor());
+
+        sensor->id = it->first.as<int>(0);
+        sensor->gpio = details["gpio"].as<int>(-1);
+        sensor->pulses_per_unit = details["pulses_per_unit"].as<double>(1);
+        if (sensor->pulses_per_unit <= 0) sensor->pulses_per_unit = 1;
+        YAML::Node zones = details["zones"];
+        for (size_t c = 0; c < zones.size(); c++) {
+            sensor->zones.push_back(zones[c].as<int>(0));
+        }
+        sensor->tolerance = details["tolerance"].as<double>(0.25);
+        sensor->leak_rate = details["leak_rate"].as<double>(0.1);
+        sensor->leak_samples = details["leak_samples"].as<int>(3);
+        sensor->learn_samples = details["learn_samples"].as<int>(6);
+        sensor->simulate = details["simulated"].as<bool>(false);
+        sensor->simulated_hz = details["simulated_hz"].as<double>(0);
+        sensor->simulated_idle_hz = details["simulated_idle_hz"].as<double>(0);
+        sensor->fd = sensor->sim_fd = -1;
+        sensor->last_pulses = 0;
+        sensor->leak_count = 0;
+
+        Logger::Instance().Debug("Flow sensor %d on %s %d, %.1f pulses/unit",
+                sensor->id, sensor->simulate ? "simulator" : "gpio",
+                sensor->gpio, sensor->pulses_per_unit);
+        sensors_.push_back(std::move(sensor));
+    }
+}
+
+bool FlowMonitor::Empty() const {
+    return sensors_.empty();
+}
+
+bool FlowMonitor::OpenInput(flow_sensor& sensor) {
+    if (sensor.simulate) {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) != 0) return false;
+        sensor.fd = fds[0];
+        sensor.sim_fd = fds[1];
+        return true;
+    }
+    if (sensor.gpio < 0) return false;
+
+    char chip[32];
+    std::snprintf(chip, sizeof (chip), "/dev/gpiochip%d", sensor.gpio / 32);
+    int chip_fd = open(chip, O_RDONLY | O_CLOEXEC);
+    if (chip_fd < 0) return false;
+
+    // the kernel timestamps and queues every edge, nothing is lost to
+    // polling latency the way a sysfs value file would
+#ifdef GPIO_V2_GET_LINE_IOCTL
+    struct gpio_v2_line_request req;
+    std::memset(&req, 0, sizeof (req));
+    req.offsets[0] = sensor.gpio % 32;
+    req.num_lines = 1;
+    req.event_buffer_size = 1024;
+    req.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING;
+    std::strncpy(req.consumer, "mysprinkler", sizeof (req.consumer) - 1);
+    int rc = ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &req);
+#else
+    struct gpioevent_request req;
+    std::memset(&req, 0, sizeof (req));
+    req.lineoffset = sensor.gpio % 32;
+    req.handleflags = GPIOHANDLE_REQUEST_INPUT;
+    req.eventflags = GPIOEVENT_REQUEST_RISING_EDGE;
+    std::strncpy(req.consumer_label, "mysprinkler",
+            sizeof (req.consumer_label) - 1);
+    int rc = ioctl(chip_fd, GPIO_GET_LINEEVENT_IOCTL, &req);
+#endif
+    close(chip_fd);
+    if (rc != 0) return false;
+
+    sensor.fd = req.fd;
+    fcntl(sensor.fd, F_SETFL, fcntl(sensor.fd, F_GETFL) | O_NONBLOCK);
+    return true;
+}
+
+bool FlowMonitor::Start(active_zones_fn active_zones, zone_fault_fn zone_fault,
+        site_fault_fn site_fault) {
+    if (sensors_.empty() || running_) return true;
+
+    active_zones_ = active_zones;
+    zone_fault_ = zone_fault;
+    site_fault_ = site_fault;
+
+    bool simulate = false;
+    for (auto& sensor : sensors_) {
+        if (!OpenInput(*sensor)) {
+            Logger::Instance().Warning("Unable to open flow sensor %d: %s",
+                    sensor->id, std::strerror(errno));
+        }
+        simulate |= sensor->simulate;
+    }
+    if (pipe2(wake_fd_, O_CLOEXEC) != 0) return false;
+
+    running_ = true;
+    count_thread_ = std::thread(&FlowMonitor::CountPulses, this);
+    monitor_thread_ = std::thread(&FlowMonitor::Monitor, this);
+    if (simulate) {
+        simulate_thread_ = std::thread(&FlowMonitor::Simulate, this);
+    }
+    return true;
+}
+
+void FlowMonitor::Stop() {
+    if (!running_) return;
+    {
+        std::lock_guard<std::mutex>lock(lock_);
+        running_ = false;
+    }
+    cv_.notify_all();
+    char c = 0;
+    if (write(wake_fd_[1], &c, 1) < 0) {
+        Logger::Instance().Warning("Unable to wake flow counting thread");
+    }
+
+    for (std::thread* t : {&count_thread_, &monitor_thread_, &simulate_thread_}) {
+        if (t->joinable()) t->join();
+    }
+
+    for (auto& sensor : sensors_) {
+        if (sensor->simulate) {
+            Logger::Instance().Info("Flow sensor %d counted %llu of %llu "
+                    "simulated pulses", sensor->id,
+                    static_cast<unsigned long long> (sensor->pulses.load()),
+                    static_cast<unsigned long long> (sensor->generated.load()));
+        }
+        for (int fd : {sensor->fd, sensor->sim_fd}) {
+            if (fd >= 0) close(fd);
+        }
+        sensor->fd = sensor->sim_fd = -1;
+    }
+    close(wake_fd_[0]);
+    close(wake_fd_[1]);
+    wake_fd_[0] = wake_fd_[1] = -1;
+}
+
+double FlowMonitor::Rate(int sensor_id) const {
+    for (const auto& sensor : sensors_) {
+        if (sensor->id == sensor_id) return sensor->rate;
+    }
+    return 0;
+}
+
+void FlowMonitor::CountPulses() {
+    TRACE_THREAD("flow count");
+    std::vector<pollfd> fds;
+    std::vector<flow_sensor*> owners;
+    for (auto& sensor : sensors_) {
+        if (sensor->fd < 0) continue;
+        fds.push_back({sensor->fd, POLLIN, 0});
+        owners.push_back(sensor.get());
+    }
+    fds.push_back({wake_fd_[0], POLLIN, 0});
+
+    union {
+#ifdef GPIO_V2_GET_LINE_IOCTL
+        struct gpio_v2_line_event events[64];
+#else
+        struct gpioevent_data events[64];
+#endif
+        char bytes[4096];
+    } buffer;
+
+    while (running_) {
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            Logger::Instance().Warning("Flow counting stopped: %s",
+                    std::strerror(errno));
+            break;
+        }
+        for (size_t i = 0; i < owners.size(); i++) {
+            if (!(fds[i].revents & POLLIN)) continue;
+            flow_sensor& sensor = *owners[i];
+            ssize_t n;
+            // drain everything queued, a burst of edges costs one wake up
+            while ((n = read(sensor.fd, &buffer, sizeof (buffer))) > 0) {
+                if (sensor.simulate) {
+                    sensor.pulses.fetch_add(n, std::memory_order_relaxed);
+                    continue;
+                }
+#ifdef GPIO_V2_GET_LINE_IOCTL
+                // line_seqno counts every edge the kernel saw, even ones
+                // dropped because the event buffer overflowed
+                size_t count = n / sizeof (buffer.events[0]);
+                sensor.pulses.store(buffer.events[count - 1].line_seqno,
+                        std::memory_order_relaxed);
+#else
+                sensor.pulses.fetch_add(n / sizeof (buffer.events[0]),
+                        std::memory_order_relaxed);
+#endif
+            }
+        }
+    }
+}
+
+void FlowMonitor::Simulate() {
+    std::vector<double> owed(sensors_.size(), 0);
+    char pulses[4096];
+    std::memset(pulses, 1, sizeof (pulses));
+    auto last = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex>lk(lock_);
+    while (running_) {
+        cv_.wait_for(lk, std::chrono::milliseconds(10));
+        auto now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(now - last).count();
+        last = now;
+
+        std::vector<int> active = active_zones_();
+        for (size_t i = 0; i < sensors_.size(); i++) {
+            flow_sensor& sensor = *sensors_[i];
+            if (!sensor.simulate || sensor.sim_fd < 0) continue;
+
+            bool flowing = std::any_of(active.begin(), active.end(),
+                    [&sensor](int zone) {
+                        return sensor.zones.empty() ||
+                                std::find(sensor.zones.begin(),
+                                sensor.zones.end(), zone) != sensor.zones.end();
+                    });
+            owed[i] += seconds * (flowing ? sensor.simulated_hz :
+                    sensor.simulated_idle_hz);
+            while (owed[i] >= 1) {
+                size_t n = std::min<size_t>(owed[i], sizeof (pulses));
+                ssize_t written = write(sensor.sim_fd, pulses, n);
+                if (written <= 0) break; // pipe full, catch up next tick
+                owed[i] -= written;
+                sensor.generated.fetch_add(written, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+void FlowMonitor::Monitor() {
+    TRACE_THREAD("flow monitor");
+    auto last = std::chrono::steady_clock::now();
+
+    while (running_) {
+        {
+            std::unique_lock<std::mutex>lk(lock_);
+            cv_.wait_for(lk, std::chrono::seconds(sample_seconds_), [this] {
+                return !running_;
+            });
+        }
+        if (!running_) break;
+
+        auto now = std::chrono::steady_clock::now();
+        double minutes = std::chrono::duration<double>(now - last).count() / 60;
+        last = now;
+
+        std::vector<int> active = active_zones_();
+        for (auto& sensor : sensors_) {
+            if (sensor->fd >= 0) Sample(*sensor, minutes, active);
+        }
+    }
+}
+
+void FlowMonitor::Sample(flow_sensor& sensor, double minutes,
+        const std::vector<int>& active) {
+    std::uint64_t pulses = sensor.pulses.load(std::memory_order_relaxed);
+    double rate = (pulses - sensor.last_pulses) / sensor.pulses_per_unit /
+            minutes;
+    sensor.last_pulses = pulses;
+    sensor.rate = rate;
+
+    // zones on and downstream of this meter
+    std::vector<int> on;
+    for (int zone : active) {
+        if (sensor.zones.empty() || std::find(sensor.zones.begin(),
+                sensor.zones.end(), zone) != sensor.zones.end()) {
+            on.push_back(zone);
+        }
+    }
+    std::sort(on.begin(), on.end());
+    // a sample spanning a zone switching, part of it flowed otherwise
+    bool steady = on == sensor.last_on;
+    sensor.last_on = on;
+
+    if (on.empty()) {
+        if (rate <= sensor.leak_rate) {
+            sensor.leak_count = 0;
+        } else if (++sensor.leak_count >= sensor.leak_samples) {
+            Logger::Instance().Warning("Flow sensor %d reads %.2f/min with "
+                    "every zone off, shutting off the site", sensor.id, rate);
+            sensor.leak_count = 0;
+            site_fault_(sensor.id, rate);
+        }
+        return;
+    }
+    sensor.leak_count = 0;
+
+    double expected = 0;
+    bool trusted = true;
+    for (int zone : on) {
+        const flow_baseline& baseline = baselines_[zone];
+        trusted &= baseline.samples >= sensor.learn_samples;
+        expected += baseline.rate;
+    }
+    Logger::Instance().Trace("Flow sensor %d reads %.2f/min, expecting %.2f",
+            sensor.id, rate, expected);
+
+    if (steady && trusted && rate > expected * (1 + sensor.tolerance)) {
+        for (int zone : on) {
+            Logger::Instance().Warning("Zone %d flow %.2f/min exceeds its "
+                    "baseline of %.2f/min, shutting it off", zone,
+                    rate / on.size(), baselines_[zone].rate);
+            zone_fault_(zone, rate / on.size());
+        }
+        return;
+    }
+
+    // learn only from samples where one zone had the meter to itself
+    // throughout, averaging the first ones before tracking slow changes
+    if (steady && on.size() == 1) {
+        flow_baseline& baseline = baselines_[on.front()];
+        baseline.samples++;
+        double weight = std::max(0.1, 1.0 / baseline.samples);
+        baseline.rate += (rate - baseline.rate) * weight;
+    }
+}
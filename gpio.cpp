@@ -0,0 +1,370 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "include/gpio.hpp"
+#include "include/Logger.h"
+#include "include/trace.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// set before any line is opened
+std::string root_ = "/sys/class/gpio";
+gpio_faults faults_;
+std::atomic<int> writes_(0); // for gpio_faults.stall_after
+
+const char* kLineFiles[] = {"direction", "edge", "active_low", "value"};
+
+bool WriteFile(const std::string& path, const char* value) {
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC | O_CREAT | O_TRUNC,
+            0644);
+    if (fd < 0) return false;
+    ssize_t len = static_cast<ssize_t> (std::strlen(value));
+    bool ok = write(fd, value, len) == len;
+    close(fd);
+    return ok;
+}
+
+bool Exists(const std::string& path) {
+    return access(path.c_str(), F_OK) == 0;
+}
+
+// sleeps the whole time, signals included
+void Stall(int ms) {
+    auto end = std::chrono::steady_clock::now() +
+            std::chrono::milliseconds(ms);
+    while (std::chrono::steady_clock::now() < end) {
+        std::this_thread::sleep_until(end);
+    }
+}
+
+} // namespace
+
+SysfsGpio::SysfsGpio(int pin, bool output) : pin_(pin), output_(output),
+fd_(-1), fail_(false) {
+}
+
+SysfsGpio::~SysfsGpio() {
+    if (fd_ >= 0) close(fd_);
+}
+
+void SysfsGpio::Root(const std::string& root) {
+    root_ = root;
+}
+
+std::string SysfsGpio::Root() {
+    return root_;
+}
+
+void SysfsGpio::Faults(const gpio_faults& faults) {
+    faults_ = faults;
+}
+
+int SysfsGpio::Pin() const {
+    return pin_;
+}
+
+bool SysfsGpio::Open() {
+    TRACE_SPAN("gpio", "open", pin_);
+    fail_ = true;
+    if (Inject()) return false;
+
+    std::string line = root_ + "/gpio" + std::to_string(pin_);
+    if (!Exists(line + "/value")) {
+        if (!WriteFile(root_ + "/export", std::to_string(pin_).c_str())) {
+            return false;
+        }
+        // the line appears asynchronously, udev may still be fixing modes
+        for (int i = 0; i < 1000 && !Exists(line + "/value"); i++) {
+            usleep(1000);
+        }
+    }
+    if (!WriteFile(line + "/direction", output_ ? "out" : "in")) return false;
+
+    if (fd_ >= 0) close(fd_);
+    fd_ = open((line + "/value").c_str(),
+            (output_ ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+    fail_ = fd_ < 0;
+    return !fail_;
+}
+
+bool SysfsGpio::Write(bool high) {
+    TRACE_SPAN("gpio", "write", pin_);
+    if (faults_.stall_ms > 0 && writes_.fetch_add(1) == faults_.stall_after) {
+        Stall(faults_.stall_ms);
+    }
+    fail_ = Inject() || fd_ < 0;
+    if (!fail_ && !Ignore()) {
+        fail_ = pwrite(fd_, high ? "1" : "0", 1, 0) != 1;
+    }
+    return !fail_;
+}
+
+bool SysfsGpio::ForceWrite(bool high) {
+    return fd_ >= 0 && pwrite(fd_, high ? "1" : "0", 1, 0) == 1;
+}
+
+bool SysfsGpio::IsHigh() {
+    TRACE_SPAN("gpio", "read", pin_);
+    char value = '0';
+    fail_ = Inject() || fd_ < 0 || pread(fd_, &value, 1, 0) != 1;
+    return !fail_ && value == '1';
+}
+
+bool SysfsGpio::IsOpen() const {
+    return fd_ >= 0;
+}
+
+bool SysfsGpio::Fail() const {
+    return fail_;
+}
+
+bool SysfsGpio::Inject() {
+    if (faults_.latency_us > 0) {
+        usleep(faults_.latency_us);
+    }
+    if (faults_.failure_rate > 0) {
+        thread_local std::minstd_rand rng(std::random_device{}());
+        if (std::uniform_real_distribution<double>(0, 1)(rng) <
+                faults_.failure_rate) {
+            errno = EIO;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SysfsGpio::Ignore() {
+    if (std::find(faults_.stuck.begin(), faults_.stuck.end(), pin_) !=
+            faults_.stuck.end()) {
+        return true;
+    }
+    if (faults_.ignore_rate > 0) {
+        thread_local std::minstd_rand rng(std::random_device{}());
+        return std::uniform_real_distribution<double>(0, 1)(rng) <
+                faults_.ignore_rate;
+    }
+    return false;
+}
+
+FakeGpioTree::FakeGpioTree() : inotify_fd_(-1), running_(false) {
+    wake_fd_[0] = wake_fd_[1] = -1;
+}
+
+FakeGpioTree::~FakeGpioTree() {
+    Destroy();
+}
+
+bool FakeGpioTree::Create(const std::string& root) {
+    Destroy();
+    if (root.compare(0, 5, "/sys/") == 0 || root == "/sys") {
+        ace::utils::Logger::Instance().Warning("Refusing to fake gpio under "
+                "%s", root.c_str());
+        return false;
+    }
+    mkdir(root.c_str(), 0755);
+    if (!WriteFile(root + "/export", "") ||
+            !WriteFile(root + "/unexport", "")) {
+        ace::utils::Logger::Instance().Warning("Unable to create fake gpio "
+                "tree %s: %s", root.c_str(), std::strerror(errno));
+        return false;
+    }
+
+    inotify_fd_ = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (inotify_fd_ < 0 ||
+            inotify_add_watch(inotify_fd_, root.c_str(), IN_CLOSE_WRITE) < 0 ||
+            pipe2(wake_fd_, O_CLOEXEC) != 0) {
+        Destroy();
+        return false;
+    }
+    root_ = root;
+    running_ = true;
+    thread_ = std::thread(&FakeGpioTree::Watch, this);
+    ace::utils::Logger::Instance().Info("Faking gpio under %s", root.c_str());
+    return true;
+}
+
+void FakeGpioTree::Destroy() {
+    running_ = false;
+    if (wake_fd_[1] >= 0) {
+        char wake = 0;
+        if (write(wake_fd_[1], &wake, 1) < 0) {
+            ace::utils::Logger::Instance().Warning("Unable to wake fake gpio "
+                    "thread");
+        }
+    }
+    if (thread_.joinable()) thread_.join();
+    for (int* fd : {&inotify_fd_, &wake_fd_[0], &wake_fd_[1]}) {
+        if (*fd >= 0) close(*fd);
+        *fd = -1;
+    }
+    if (root_.empty()) return;
+
+    // remove only what the tree created, never a directory's other contents
+    if (DIR* dir = opendir(root_.c_str())) {
+        while (struct dirent* entry = readdir(dir)) {
+            if (std::strncmp(entry->d_name, "gpio", 4) != 0) continue;
+            std::string line = root_ + "/" + entry->d_name;
+            for (const char* file : kLineFiles) {
+                unlink((line + "/" + file).c_str());
+            }
+            rmdir(line.c_str());
+        }
+        closedir(dir);
+    }
+    unlink((root_ + "/export").c_str());
+    unlink((root_ + "/unexport").c_str());
+    rmdir(root_.c_str());
+    root_.clear();
+}
+
+void FakeGpioTree::Watch() {
+    alignas(struct inotify_event) char buffer[4096];
+    pollfd fds[2] = {
+        {inotify_fd_, POLLIN, 0},
+        {wake_fd_[0], POLLIN, 0}
+    };
+    while (running_) {
+        if (poll(fds, 2, -1) < 0 && errno != EINTR) break;
+        if (fds[1].revents) break;
+        ssize_t len;
+        while ((len = read(inotify_fd_, buffer, sizeof (buffer))) > 0) {
+            for (char* at = buffer; at < buffer + len;) {
+                auto* event = reinterpret_cast<struct inotify_event*> (at);
+                if (event->len > 0) {
+                    if (std::strcmp(event->name, "export") == 0) {
+                        Export("export", true);
+                    } else if (std::strcmp(event->name, "unexport") == 0) {
+                        Export("unexport", false);
+                    }
+                }
+                at += sizeof (struct inotify_event) + event->len;
+            }
+        }
+    }
+}
+
+void FakeGpioTree::Export(const char* file, bool add) {
+    char value[32] = {};
+    int fd = open((root_ + "/" + file).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    ssize_t len = read(fd, value, sizeof (value) - 1);
+    close(fd);
+    if (len <= 0) return;
+    int pin = std::atoi(value);
+
+    std::string line = root_ + "/gpio" + std::to_string(pin);
+    if (add) {
+        mkdir(line.c_str(), 0755);
+        // value last, its existence tells SysfsGpio::Open the line is ready
+        WriteFile(line + "/direction", "in");
+        WriteFile(line + "/edge", "none");
+        WriteFile(line + "/active_low", "0");
+        WriteFile(line + "/value", "0");
+    } else {
+        for (const char* name : kLineFiles) {
+            unlink((line + "/" + name).c_str());
+        }
+        rmdir(line.c_str());
+    }
+}
+
+int GpioBenchCommand(int argc, char* argv[]) {
+    if (argc < 1) {
+        std::printf("eg: mysprinkler gpio-bench /dev/shm/gpio [pins] [toggles]"
+                " [latency_us] [failure_rate]\n");
+        return EXIT_FAILURE;
+    }
+    std::string root = argv[0];
+    int pins = argc > 1 ? std::max(1, std::atoi(argv[1])) : 8;
+    int toggles = argc > 2 ? std::max(1, std::atoi(argv[2])) : 100000;
+    gpio_faults faults;
+    faults.latency_us = argc > 3 ? std::atoi(argv[3]) : 0;
+    faults.failure_rate = argc > 4 ? std::atof(argv[4]) : 0;
+
+    FakeGpioTree tree;
+    if (!tree.Create(root)) {
+        std::printf("Unable to create a fake gpio tree under %s\n",
+                root.c_str());
+        return EXIT_FAILURE;
+    }
+    SysfsGpio::Root(root);
+    SysfsGpio::Faults(faults);
+
+    using clock = std::chrono::steady_clock;
+    std::vector<std::unique_ptr<SysfsGpio> > lines;
+    for (int pin = 0; pin < pins; pin++) {
+        lines.emplace_back(new SysfsGpio(40 + pin, true));
+    }
+    auto begin = clock::now();
+    int open_failures = 0;
+    for (auto& line : lines) {
+        open_failures += !line->Open();
+    }
+    double open_us = std::chrono::duration<double, std::micro>(
+            clock::now() - begin).count() / pins;
+
+    // one transition is a relay switched on or off, as Zone::TurnOn/TurnOff
+    std::vector<double> latency(toggles);
+    int failures = 0;
+    for (int i = 0; i < toggles; i++) {
+        SysfsGpio& line = *lines[i % pins];
+        auto start = clock::now();
+        failures += !line.Write((i / pins) % 2 == 0);
+        latency[i] = std::chrono::duration<double, std::micro>(
+                clock::now() - start).count();
+    }
+    std::sort(latency.begin(), latency.end());
+    auto at = [&latency](double q) {
+        return latency[std::min(latency.size() - 1,
+                static_cast<size_t> (q * latency.size()))];
+    };
+
+    std::printf("%d lines under %s, %.1f us to export and open each, "
+            "%d failed\n", pins, root.c_str(), open_us, open_failures);
+    std::printf("%d transitions, %d failed, latency us: p50 %.2f p90 %.2f "
+            "p99 %.2f p99.9 %.2f max %.2f\n", toggles, failures, at(0.5),
+            at(0.9), at(0.99), at(0.999), latency.back());
+    return EXIT_SUCCESS;
+}
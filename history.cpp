@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "include/history.hpp"
+#include "include/timezone.hpp"
+#include "include/Logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+enum COLUMN {
+    col_start, col_end, col_zone, col_program, col_planned, col_actual,
+    col_reason, col_count
+};
+
+const char* kColumnNames[col_count] = {
+    "start", "end", "zone", "program", "planned", "actual", "reason"
+};
+const size_t kColumnWidths[col_count] = {8, 8, 4, 4, 4, 4, 1};
+
+const std::int64_t kIndexEvery = 256; // rows between sparse index entries
+const size_t kIndexWidth = 16; // start time, row number
+
+// partition for an instant, one per UTC month, eg: 2026-10
+std::string PartitionName(std::int64_t t) {
+    std::int64_t days = t >= 0 ? t / 86400 : -((-t + 86399) / 86400);
+    std::int64_t y;
+    int m, d;
+    TimeZone::CivilFromDays(days, y, m, d);
+    char name[16];
+    std::snprintf(name, sizeof (name), "%04d-%02d", static_cast<int> (y), m);
+    return name;
+}
+
+// UTC range [begin, end) covered by a partition name
+bool PartitionRange(const std::string& name, std::int64_t& begin,
+        std::int64_t& end) {
+    int y, m;
+    char tail;
+    if (std::sscanf(name.c_str(), "%4d-%2d%c", &y, &m, &tail) != 2 ||
+            m < 1 || m > 12) {
+        return false;
+    }
+    begin = TimeZone::DaysFromCivil(y, m, 1) * 86400;
+    end = TimeZone::DaysFromCivil(m == 12 ? y + 1 : y, m == 12 ? 1 : m + 1, 1)
+            * 86400;
+    return true;
+}
+
+// read-only memory mapping of a whole column file
+class mapped_file {
+public:
+
+    explicit mapped_file(const std::string& path) : data_(nullptr), size_(0) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED) {
+                data_ = p;
+                size_ = st.st_size;
+                madvise(p, size_, MADV_SEQUENTIAL);
+            }
+        }
+        close(fd);
+    }
+
+    ~mapped_file() {
+        if (data_ != nullptr) munmap(data_, size_);
+    }
+
+    template <typename T>
+    const T* As() const {
+        return static_cast<const T*> (data_);
+    }
+
+    size_t Size() const {
+        return size_;
+    }
+private:
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+    void* data_;
+    size_t size_;
+};
+
+} // namespace
+
+RunHistory::RunHistory() : rows_(0) {
+    std::fill(fds_, fds_ + 8, -1);
+}
+
+RunHistory::~RunHistory() {
+    ClosePartition();
+}
+
+bool RunHistory::Open(const std::string& directory) {
+    std::lock_guard<std::mutex>lock(lock_);
+    if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        ace::utils::Logger::Instance().Warning("Unable to create history "
+                "directory %s: %s", directory.c_str(), std::strerror(errno));
+        return false;
+    }
+    ClosePartition();
+    directory_ = directory;
+    return true;
+}
+
+bool RunHistory::IsOpen() const {
+    return !directory_.empty();
+}
+
+bool RunHistory::OpenPartition(const std::string& name) {
+    std::string path = directory_ + "/" + name;
+    if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST) return false;
+
+    std::int64_t rows = -1;
+    for (int c = 0; c <= col_count; c++) {
+        std::string file = path + "/" + (c < col_count ? kColumnNames[c] :
+                "index");
+        fds_[c] = open(file.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fds_[c] < 0) {
+            ClosePartition();
+            return false;
+        }
+        struct stat st;
+        if (c < col_count && fstat(fds_[c], &st) == 0) {
+            std::int64_t n = st.st_size / kColumnWidths[c];
+            rows = rows < 0 ? n : std::min(rows, n);
+        }
+    }
+
+    // drop any row torn by a crash part way through Append
+    for (int c = 0; c < col_count; c++) {
+        if (ftruncate(fds_[c], rows * kColumnWidths[c]) != 0) {
+            ClosePartition();
+            return false;
+        }
+    }
+    if (ftruncate(fds_[col_count], (rows + kIndexEvery - 1) / kIndexEvery *
+            kIndexWidth) != 0) {
+        ClosePartition();
+        return false;
+    }
+    partition_ = name;
+    rows_ = rows;
+    return true;
+}
+
+void RunHistory::ClosePartition() {
+    for (int c = 0; c <= col_count; c++) {
+        if (fds_[c] >= 0) close(fds_[c]);
+        fds_[c] = -1;
+    }
+    partition_.clear();
+    rows_ = 0;
+}
+
+bool RunHistory::Append(const run_record& record) {
+    std::lock_guard<std::mutex>lock(lock_);
+    if (directory_.empty()) return false;
+
+    std::string name = PartitionName(record.start);
+    if (name != partition_) {
+        ClosePartition();
+        if (!OpenPartition(name)) {
+            ace::utils::Logger::Instance().Warning("Unable to open history "
+                    "partition %s/%s", directory_.c_str(), name.c_str());
+            return false;
+        }
+    }
+
+    const void* values[col_count] = {
+        &record.start, &record.end, &record.zone_id, &record.program_id,
+        &record.planned, &record.actual, &record.reason
+    };
+    bool ok = true;
+    for (int c = 0; c < col_count; c++) {
+        ok &= pwrite(fds_[c], values[c], kColumnWidths[c],
+                rows_ * kColumnWidths[c]) ==
+                static_cast<ssize_t> (kColumnWidths[c]);
+    }
+    if (ok && rows_ % kIndexEvery == 0) {
+        std::int64_t entry[2] = {record.start, rows_};
+        ok = pwrite(fds_[col_count], entry, kIndexWidth,
+                rows_ / kIndexEvery * kIndexWidth) ==
+                static_cast<ssize_t> (kIndexWidth);
+    }
+    if (!ok) {
+        // reopen on the next append, which truncates the partial row
+        ClosePartition();
+        return false;
+    }
+    rows_++;
+    return true;
+}
+
+std::map<std::int64_t, std::map<int, zone_total> > RunHistory::Aggregate(
+        std::time_t from, std::time_t to, PERIOD period) const {
+    std::map<std::int64_t, std::map<int, zone_total> > totals;
+
+    std::vector<std::string> partitions;
+    DIR* dir = opendir(directory_.c_str());
+    if (dir == nullptr) return totals;
+    while (struct dirent* entry = readdir(dir)) {
+        std::int64_t begin, end;
+        std::string name(entry->d_name);
+        if (PartitionRange(name, begin, end) && begin < to && end > from)
+            partitions.push_back(name);
+    }
+    closedir(dir);
+    std::sort(partitions.begin(), partitions.end());
+
+    const TimeZone& tz = TimeZone::Local();
+    for (const auto& name : partitions) {
+        std::string path = directory_ + "/" + name + "/";
+        mapped_file start(path + kColumnNames[col_start]);
+        mapped_file zone(path + kColumnNames[col_zone]);
+        mapped_file actual(path + kColumnNames[col_actual]);
+        mapped_file reason(path + kColumnNames[col_reason]);
+        mapped_file index(path + "index");
+
+        std::int64_t rows = std::min(std::min(start.Size() / 8,
+                zone.Size() / 4), std::min(actual.Size() / 4, reason.Size()));
+
+        // rows are appended in start order, seek with the sparse index
+        std::int64_t row = 0;
+        const std::int64_t* idx = index.As<std::int64_t>();
+        for (size_t i = 0; i < index.Size() / kIndexWidth; i++) {
+            if (idx[i * 2] >= from) break;
+            row = std::min(idx[i * 2 + 1], rows);
+        }
+
+        const std::int64_t* starts = start.As<std::int64_t>();
+        const std::int32_t* zones = zone.As<std::int32_t>();
+        const std::int32_t* actuals = actual.As<std::int32_t>();
+        const std::uint8_t* reasons = reason.As<std::uint8_t>();
+        for (; row < rows; row++) {
+            std::int64_t t = starts[row];
+            if (t < from) continue;
+            if (t >= to) break;
+
+            std::tm tm = tz.ToLocal(t);
+            std::int64_t key = period == by_month ?
+                    (tm.tm_year + 1900LL) * 12 + tm.tm_mon :
+                    TimeZone::DaysFromCivil(tm.tm_year + 1900, tm.tm_mon + 1,
+                    tm.tm_mday);
+
+            zone_total& total = totals[key][zones[row]];
+            total.seconds += actuals[row]; // a faulted run may have watered
+            if (reasons[row] == reason_ran) {
+                total.runs++;
+            } else if (reasons[row] != reason_preempted) {
+                total.skips++;
+            }
+        }
+    }
+    return totals;
+}
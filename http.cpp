@@ -0,0 +1,1042 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "include/http.hpp"
+#include "include/Logger.h"
+#include "include/torture.hpp"
+#include "include/trace.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using ace::utils::Logger;
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+const std::uint64_t kListen = 0;
+const std::uint64_t kWake = ~std::uint64_t(0);
+
+const char kDashboard[] = R"html(<!DOCTYPE html>
+<html>
+<head>
+<meta charset="utf-8">
+<meta name="viewport" content="width=device-width, initial-scale=1">
+<title>mysprinkler</title>
+<style>
+body { font-family: sans-serif; margin: 1em auto; max-width: 44em; padding: 0 1em; }
+table { border-collapse: collapse; width: 100%; margin-bottom: 1.5em; }
+th, td { text-align: left; padding: .3em .5em; border-bottom: 1px solid #ddd; }
+.on { color: #070; font-weight: bold; }
+.fault { color: #b00; }
+#error { color: #b00; }
+</style>
+</head>
+<body>
+<h1>mysprinkler</h1>
+<p><span id="running">&nbsp;</span> <button onclick="post('/api/stop')">Stop</button></p>
+<p id="error"></p>
+<h2>Zones</h2>
+<table><thead><tr><th>Zone</th><th>Name</th><th>State</th><th>Left</th></tr></thead>
+<tbody id="zones"></tbody></table>
+<h2>Programs</h2>
+<table><thead><tr><th>Program</th><th>Priority</th><th>Next start</th><th></th></tr></thead>
+<tbody id="programs"></tbody></table>
+<script>
+function text(value) {
+  var span = document.createElement('span');
+  span.textContent = value;
+  return span.innerHTML;
+}
+function time(t) {
+  return new Date(t * 1000).toLocaleString();
+}
+function post(path) {
+  fetch(path, {method: 'POST', headers: {'Content-Type': 'application/json'}})
+      .then(refresh);
+}
+function show(s) {
+  var c = s.current;
+  document.getElementById('running').textContent = c ?
+      'Program ' + c.program + (c.manual ? ' (manual)' : '') +
+      (c.watering ? ', zone ' + c.zone : c.soaking ? ', soaking' : '') :
+      'Idle';
+  document.getElementById('zones').innerHTML = s.zones.map(function (z) {
+    var state = z.faulted ? '<span class="fault">faulted</span>' :
+        !z.enabled ? 'disabled' : z.on ? '<span class="on">on</span>' : 'off';
+    return '<tr><td>' + z.id + '</td><td>' + text(z.name) + '</td><td>' +
+        state + '</td><td>' + (z.on ? Math.ceil(z.remaining / 60) + ' min' :
+        '') + '</td></tr>';
+  }).join('');
+  document.getElementById('programs').innerHTML = s.programs.map(function (p) {
+    return '<tr><td>' + p.id + '</td><td>' + p.priority + '</td><td>' +
+        time(p.next) + '</td><td><button onclick="post(\'/api/programs/' +
+        p.id + '/run\')">Run</button></td></tr>';
+  }).join('');
+}
+function refresh() {
+  fetch('/api/status').then(function (r) {
+    return r.json();
+  }).then(function (s) {
+    document.getElementById('error').textContent = '';
+    show(s);
+  }).catch(function (e) {
+    document.getElementById('error').textContent = 'Unreachable: ' + e;
+  });
+}
+refresh();
+setInterval(refresh, 2000);
+</script>
+</body>
+</html>
+)html";
+
+struct asset {
+    const char* path;
+    const char* type;
+    std::shared_ptr<const std::string> body;
+    std::string etag;
+};
+
+std::string Quoted(std::uint64_t value) {
+    char etag[24];
+    std::snprintf(etag, sizeof (etag), "\"%016" PRIx64 "\"", value);
+    return etag;
+}
+
+// FNV-1a, for the ETag of a compiled in asset
+std::uint64_t Hash(const std::string& text) {
+    std::uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : text) {
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+const std::vector<asset>& Assets() {
+    static const std::vector<asset> assets = [] {
+        std::vector<asset> list;
+        auto body = std::make_shared<const std::string>(kDashboard);
+        for (const char* path : {"/", "/index.html"}) {
+            list.push_back({path, "text/html; charset=utf-8", body,
+                Quoted(Hash(*body))});
+        }
+        return list;
+    }();
+    return assets;
+}
+
+const char* Reason(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 202: return "Accepted";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        case 415: return "Unsupported Media Type";
+        case 431: return "Request Header Fields Too Large";
+        case 503: return "Service Unavailable";
+    }
+    return "Error";
+}
+
+void Json(std::string& out, const std::string& text) {
+    out += '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char> (c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof (escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+void Append(std::string& out, const char* format, ...)
+__attribute__((format(printf, 2, 3)));
+
+void Append(std::string& out, const char* format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int n = std::vsnprintf(buffer, sizeof (buffer), format, args);
+    va_end(args);
+    if (n > 0) out.append(buffer, std::min<size_t>(n, sizeof (buffer) - 1));
+}
+
+void ZonesJson(std::string& out, const scheduler_state& state) {
+    out += '[';
+    for (const auto& zone : state.zones) {
+        if (out.back() != '[') out += ',';
+        Append(out, "{\"id\":%d,\"name\":", zone.id);
+        Json(out, zone.name);
+        Append(out, ",\"enabled\":%s,\"on\":%s,\"faulted\":%s,"
+                "\"remaining\":%d}", zone.enabled ? "true" : "false",
+                zone.commanded ? "true" : "false",
+                zone.faulted ? "true" : "false", zone.remaining);
+    }
+    out += ']';
+}
+
+void ProgramsJson(std::string& out, const scheduler_state& state) {
+    out += '[';
+    for (const auto& program : state.programs) {
+        if (out.back() != '[') out += ',';
+        Append(out, "{\"id\":%d,\"priority\":%d,\"next\":%lld}", program.id,
+                program.priority, static_cast<long long> (program.start));
+    }
+    out += ']';
+}
+
+void RunJson(std::string& out, const state_run& run) {
+    Append(out, "{\"program\":%d,\"priority\":%d,\"manual\":%s,\"due\":%lld,"
+            "\"zone\":%d,\"watering\":%s,\"soaking\":%s,\"zones_left\":%d}",
+            run.program_id, run.priority, run.manual ? "true" : "false",
+            static_cast<long long> (run.due), run.zone_id,
+            run.watering ? "true" : "false", run.soaking ? "true" : "false",
+            run.zones_left);
+}
+
+// due runs waiting their turn, then every program's next start
+void NextJson(std::string& out, const scheduler_state& state) {
+    out += '[';
+    for (const auto& run : state.pending) {
+        if (out.back() != '[') out += ',';
+        Append(out, "{\"program\":%d,\"start\":%lld,\"due\":true}", run.id,
+                static_cast<long long> (run.start));
+    }
+    for (const auto& program : state.programs) {
+        if (out.back() != '[') out += ',';
+        Append(out, "{\"program\":%d,\"start\":%lld,\"due\":false}",
+                program.id, static_cast<long long> (program.start));
+    }
+    out += ']';
+}
+
+} // namespace
+
+void StatusJson(std::string& out, const scheduler_state& state,
+        std::uint64_t version) {
+    Append(out, "{\"version\":%" PRIu64 ",\"at\":%lld,\"loops\":%" PRIu64
+            ",\"current\":", version, static_cast<long long> (state.at),
+            state.loops);
+    if (state.Current()) {
+        RunJson(out, *state.Current());
+    } else {
+        out += "null";
+    }
+    out += ",\"suspended\":[";
+    for (size_t i = 0; i + 1 < state.runs.size(); i++) {
+        if (i) out += ',';
+        RunJson(out, state.runs[i]);
+    }
+    out += "],\"zones\":";
+    ZonesJson(out, state);
+    out += ",\"programs\":";
+    ProgramsJson(out, state);
+    out += ",\"next\":";
+    NextJson(out, state);
+    out += '}';
+}
+
+namespace {
+
+bool Equal(const char* text, size_t length, const char* word) {
+    return std::strlen(word) == length && strncasecmp(text, word, length) == 0;
+}
+
+} // namespace
+
+struct HttpServer::connection {
+    int fd;
+    size_t index;
+    std::vector<char> in; // request_bytes
+    size_t in_length;
+    char head[384]; // of the response being written
+    size_t head_length;
+    size_t head_sent;
+    std::shared_ptr<const std::string> body;
+    size_t body_sent;
+    bool close_after; // once the response is written
+    bool peer_closed; // answer what was sent, then close
+    bool want_write; // EPOLLOUT armed
+    clock::time_point active;
+};
+
+HttpServer::HttpServer() : state_(nullptr), listen_fd_(-1), epoll_fd_(-1),
+port_(0), running_(false), accepted_(0), rejected_(0), requests_(0),
+not_modified_(0), regenerated_(0) {
+    wake_fd_[0] = wake_fd_[1] = -1;
+}
+
+HttpServer::~HttpServer() {
+    Stop();
+}
+
+bool HttpServer::Start(const http_options& options,
+        const Snapshots<scheduler_state>& state, run_program_fn run_program,
+        stop_fn stop) {
+    Stop();
+    options_ = options;
+    options_.max_clients = std::max(1, options_.max_clients);
+    options_.request_bytes = std::max(256, options_.request_bytes);
+    state_ = &state;
+    run_program_ = run_program;
+    stop_ = stop;
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<std::uint16_t> (options_.port));
+    if (inet_pton(AF_INET, options_.bind.c_str(), &address.sin_addr) != 1) {
+        Logger::Instance().Warning("http: bad bind address %s",
+                options_.bind.c_str());
+        return false;
+    }
+    listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+            0);
+    int yes = 1;
+    socklen_t length = sizeof (address);
+    if (listen_fd_ < 0 ||
+            setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &yes,
+            sizeof (yes)) != 0 ||
+            bind(listen_fd_, reinterpret_cast<sockaddr*> (&address),
+            sizeof (address)) != 0 || listen(listen_fd_, 64) != 0 ||
+            getsockname(listen_fd_, reinterpret_cast<sockaddr*> (&address),
+            &length) != 0) {
+        Logger::Instance().Warning("http: unable to listen on %s:%d, %s",
+                options_.bind.c_str(), options_.port, std::strerror(errno));
+        Stop();
+        return false;
+    }
+    port_ = ntohs(address.sin_port);
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0 || pipe2(wake_fd_, O_CLOEXEC | O_NONBLOCK) != 0) {
+        Logger::Instance().Warning("http: %s", std::strerror(errno));
+        Stop();
+        return false;
+    }
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = kListen;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &event);
+    event.data.u64 = kWake;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_[0], &event);
+
+    // every connection's memory up front, nothing grows with clients
+    connections_.clear();
+    for (int i = 0; i < options_.max_clients; i++) {
+        std::unique_ptr<connection> c(new connection());
+        c->fd = -1;
+        c->index = i;
+        c->in.resize(options_.request_bytes);
+        connections_.push_back(std::move(c));
+    }
+    Assets();
+
+    running_ = true;
+    thread_ = std::thread(&HttpServer::Serve, this);
+    Logger::Instance().Info("http: listening on %s:%d, %d clients at most",
+            options_.bind.c_str(), port_, options_.max_clients);
+    return true;
+}
+
+void HttpServer::Stop() {
+    if (running_) {
+        running_ = false;
+        char c = 0;
+        if (write(wake_fd_[1], &c, 1) < 0) {
+            Logger::Instance().Warning("Unable to wake the http thread");
+        }
+    }
+    if (thread_.joinable()) thread_.join();
+    for (auto& c : connections_) {
+        if (c->fd >= 0) Close(*c);
+    }
+    for (int* fd : {&listen_fd_, &epoll_fd_, &wake_fd_[0], &wake_fd_[1]}) {
+        if (*fd >= 0) close(*fd);
+        *fd = -1;
+    }
+    cache_.clear();
+}
+
+bool HttpServer::Running() const {
+    return running_;
+}
+
+int HttpServer::Port() const {
+    return port_;
+}
+
+http_stats HttpServer::Stats() const {
+    return {accepted_, rejected_, requests_, not_modified_, regenerated_};
+}
+
+void HttpServer::Serve() {
+    TRACE_THREAD("http");
+    std::vector<epoll_event> events(64);
+    clock::time_point swept = clock::now();
+    while (running_) {
+        int n = epoll_wait(epoll_fd_, events.data(), events.size(), 1000);
+        if (n < 0 && errno != EINTR) {
+            Logger::Instance().Warning("http: stopped, %s",
+                    std::strerror(errno));
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            std::uint64_t id = events[i].data.u64;
+            if (id == kWake) continue;
+            if (id == kListen) {
+                Accept();
+                continue;
+            }
+            connection& c = *connections_[id - 1];
+            if (c.fd < 0) continue;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                Close(c);
+                continue;
+            }
+            if ((events[i].events & EPOLLOUT) && !Flush(c)) continue;
+            // once a response drained, pipelined requests are answered too
+            if (!c.want_write) Read(c);
+        }
+
+        // kept alive connections idle too long
+        clock::time_point now = clock::now();
+        if (now - swept < std::chrono::seconds(1)) continue;
+        swept = now;
+        for (auto& c : connections_) {
+            if (c->fd >= 0 && now - c->active >
+                    std::chrono::seconds(options_.idle_seconds)) {
+                Close(*c);
+            }
+        }
+    }
+}
+
+void HttpServer::Accept() {
+    for (;;) {
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK |
+                SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return; // EAGAIN, or out of descriptors until one closes
+        }
+        auto free = std::find_if(connections_.begin(), connections_.end(),
+                [](const std::unique_ptr<connection>& c) {
+                    return c->fd < 0;
+                });
+        if (free == connections_.end()) {
+            static const char kBusy[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                    "Content-Length: 0\r\nRetry-After: 1\r\n"
+                    "Connection: close\r\n\r\n";
+            if (send(fd, kBusy, sizeof (kBusy) - 1, MSG_NOSIGNAL) < 0) {
+                // the client is told by the close
+            }
+            close(fd);
+            rejected_++;
+            continue;
+        }
+        int yes = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof (yes));
+        connection& c = **free;
+        c.fd = fd;
+        c.in_length = 0;
+        c.head_length = c.head_sent = c.body_sent = 0;
+        c.body.reset();
+        c.close_after = false;
+        c.peer_closed = false;
+        c.want_write = false;
+        c.active = clock::now();
+        epoll_event event = {};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.u64 = c.index + 1;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+        accepted_++;
+    }
+}
+
+void HttpServer::Read(connection& c) {
+    while (c.in_length < c.in.size()) {
+        ssize_t n = read(c.fd, c.in.data() + c.in_length,
+                c.in.size() - c.in_length);
+        if (n > 0) {
+            c.in_length += n;
+        } else if (n == 0) {
+            c.peer_closed = true;
+            break;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            Close(c);
+            return;
+        }
+    }
+    c.active = clock::now();
+
+    // pipelined requests are answered in order, one response at a time
+    while (c.fd >= 0 && !c.want_write && Respond(c)) {
+        if (!Flush(c)) return;
+    }
+    if (c.fd >= 0 && !c.want_write && c.peer_closed) Close(c);
+}
+
+bool HttpServer::Respond(connection& c) {
+    const char* begin = c.in.data();
+    const char* end = begin + c.in_length;
+    static const char kEnd[] = "\r\n\r\n";
+    const char* head_end = std::search(begin, end, kEnd, kEnd + 4);
+    if (head_end == end) {
+        if (c.in_length == c.in.size()) {
+            Reply(c, 431, "text/plain", nullptr, "", false);
+            return true;
+        }
+        return false;
+    }
+    head_end += 4;
+
+    // request line
+    const char* line_end = std::search(begin, head_end, kEnd, kEnd + 2);
+    const char* method = begin;
+    const char* method_end = std::find(method, line_end, ' ');
+    const char* target = method_end + (method_end < line_end);
+    const char* target_end = std::find(target, line_end, ' ');
+    const char* version = target_end + (target_end < line_end);
+    if (target_end == line_end || *target != '/') {
+        Reply(c, 400, "text/plain", nullptr, "", false);
+        return true;
+    }
+    bool keep_alive = Equal(version, line_end - version, "HTTP/1.1");
+
+    std::string if_none_match, host, origin, content_type;
+    size_t content_length = 0;
+    bool bad_length = false, has_length = false;
+    for (const char* line = line_end + 2; line < head_end - 2;) {
+        const char* next = std::search(line, head_end, kEnd, kEnd + 2);
+        const char* colon = std::find(line, next, ':');
+        if (colon != next) {
+            const char* value = colon + 1;
+            while (value < next && (*value == ' ' || *value == '\t')) value++;
+            size_t name = colon - line;
+            if (Equal(line, name, "connection")) {
+                if (Equal(value, next - value, "close")) keep_alive = false;
+                if (Equal(value, next - value, "keep-alive")) keep_alive = true;
+            } else if (Equal(line, name, "if-none-match")) {
+                if_none_match.assign(value, next);
+            } else if (Equal(line, name, "host")) {
+                host.assign(value, next);
+            } else if (Equal(line, name, "origin")) {
+                origin.assign(value, next);
+            } else if (Equal(line, name, "content-type")) {
+                content_type.assign(value, std::find(value, next, ';'));
+            } else if (Equal(line, name, "content-length")) {
+                // digits only and no bigger than the buffer, so nothing
+                // negative or past size_t reaches request_length
+                size_t length = 0;
+                const char* digit = value;
+                while (digit < next && *digit >= '0' && *digit <= '9' &&
+                        length <= c.in.size()) {
+                    length = length * 10 + (*digit++ - '0');
+                }
+                while (digit < next && (*digit == ' ' || *digit == '\t')) {
+                    digit++;
+                }
+                bad_length = bad_length || digit == value || digit != next ||
+                        length > c.in.size() ||
+                        (has_length && length != content_length);
+                has_length = true;
+                content_length = length;
+            }
+        }
+        line = next + 2;
+    }
+    if (bad_length) {
+        Reply(c, 400, "text/plain", nullptr, "", false);
+        return true;
+    }
+    size_t request_length = head_end - begin + content_length;
+    if (request_length > c.in.size()) {
+        Reply(c, 413, "text/plain", nullptr, "", false);
+        return true;
+    }
+    if (request_length > c.in_length) return false; // the body is on its way
+
+    std::string path(target, std::find(target, target_end, '?'));
+    bool get = Equal(method, method_end - method, "GET");
+    bool post = Equal(method, method_end - method, "POST");
+    std::memmove(c.in.data(), begin + request_length,
+            c.in_length - request_length);
+    c.in_length -= request_length;
+    requests_++;
+    TRACE_SPAN("http", "request");
+
+    for (const auto& a : Assets()) {
+        if (path != a.path) continue;
+        if (!get) {
+            Reply(c, 405, "text/plain", nullptr, "", keep_alive);
+        } else if (if_none_match == a.etag) {
+            not_modified_++;
+            Reply(c, 304, a.type, nullptr, a.etag, keep_alive);
+        } else {
+            Reply(c, 200, a.type, a.body, a.etag, keep_alive);
+        }
+        return true;
+    }
+
+    if (path == "/api/status" || path == "/api/zones" ||
+            path == "/api/programs" || path == "/api/next") {
+        std::uint64_t snapshot = 0;
+        auto body = get ? Body(path, snapshot) : nullptr;
+        std::string etag = Quoted(snapshot);
+        if (!get) {
+            Reply(c, 405, "text/plain", nullptr, "", keep_alive);
+        } else if (!body) {
+            Reply(c, 503, "text/plain", nullptr, "", keep_alive);
+        } else if (if_none_match == etag) {
+            not_modified_++;
+            Reply(c, 304, "application/json", nullptr, etag, keep_alive);
+        } else {
+            Reply(c, 200, "application/json", body, etag, keep_alive);
+        }
+        return true;
+    }
+
+    // a page on another site can POST a form or a plain fetch here without
+    // the browser asking first, but not one typed application/json, and
+    // what it does send carries its own Origin
+    if (post) {
+        while (!content_type.empty() && content_type.back() == ' ') {
+            content_type.pop_back();
+        }
+        size_t scheme = origin.find("://");
+        if (!origin.empty() && (scheme == std::string::npos ||
+                origin.compare(scheme + 3, std::string::npos, host) != 0)) {
+            Logger::Instance().Warning("http: refused a POST to %s from %s",
+                    path.c_str(), origin.c_str());
+            Reply(c, 403, "text/plain", nullptr, "", keep_alive);
+            return true;
+        }
+        if (!Equal(content_type.data(), content_type.size(),
+                "application/json")) {
+            Reply(c, 415, "text/plain", nullptr, "", keep_alive);
+            return true;
+        }
+    }
+
+    if (path == "/api/stop") {
+        if (!post) {
+            Reply(c, 405, "text/plain", nullptr, "", keep_alive);
+            return true;
+        }
+        Logger::Instance().Info("http: stopping every run");
+        stop_();
+        Reply(c, 202, "application/json", std::make_shared<const std::string>(
+                "{\"stopped\":true}"), "", keep_alive);
+        return true;
+    }
+
+    int program_id = 0;
+    char tail[8] = {};
+    if (std::sscanf(path.c_str(), "/api/programs/%d/%7s", &program_id, tail)
+            == 2 && std::string(tail) == "run") {
+        if (!post) {
+            Reply(c, 405, "text/plain", nullptr, "", keep_alive);
+            return true;
+        }
+        auto state = state_->Read();
+        bool known = state && std::any_of(state->programs.begin(),
+                state->programs.end(), [program_id](const state_program& p) {
+                    return p.id == program_id;
+                });
+        if (!known) {
+            Reply(c, 404, "application/json", std::make_shared<const
+                    std::string>("{\"error\":\"unknown program\"}"), "",
+                    keep_alive);
+            return true;
+        }
+        Logger::Instance().Info("http: manual run of program %d", program_id);
+        run_program_(program_id);
+        std::string body;
+        Append(body, "{\"queued\":%d}", program_id);
+        Reply(c, 202, "application/json", std::make_shared<const std::string>(
+                std::move(body)), "", keep_alive);
+        return true;
+    }
+
+    Reply(c, 404, "text/plain", nullptr, "", keep_alive);
+    return true;
+}
+
+void HttpServer::Reply(connection& c, int status, const char* type,
+        std::shared_ptr<const std::string> body, const std::string& etag,
+        bool keep_alive) {
+    int n = std::snprintf(c.head, sizeof (c.head), "HTTP/1.1 %d %s\r\n",
+            status, Reason(status));
+    if (status != 304) {
+        n += std::snprintf(c.head + n, sizeof (c.head) - n, "Content-Type: "
+                "%s\r\nContent-Length: %zu\r\n", type, body ? body->size() :
+                0);
+    }
+    if (!etag.empty()) {
+        n += std::snprintf(c.head + n, sizeof (c.head) - n, "ETag: %s\r\n"
+                "Cache-Control: no-cache\r\n", etag.c_str());
+    }
+    n += std::snprintf(c.head + n, sizeof (c.head) - n, "Connection: %s\r\n"
+            "\r\n", keep_alive ? "keep-alive" : "close");
+    c.head_length = std::min<size_t>(n, sizeof (c.head) - 1);
+    c.head_sent = 0;
+    c.body = status == 304 ? nullptr : std::move(body);
+    c.body_sent = 0;
+    c.close_after = c.close_after || !keep_alive;
+}
+
+bool HttpServer::Flush(connection& c) {
+    while (c.head_sent < c.head_length ||
+            (c.body && c.body_sent < c.body->size())) {
+        iovec parts[2];
+        int count = 0;
+        if (c.head_sent < c.head_length) {
+            parts[count++] = {c.head + c.head_sent, c.head_length -
+                c.head_sent};
+        }
+        if (c.body && c.body_sent < c.body->size()) {
+            parts[count++] = {const_cast<char*> (c.body->data()) +
+                c.body_sent, c.body->size() - c.body_sent};
+        }
+        msghdr message = {};
+        message.msg_iov = parts;
+        message.msg_iovlen = count;
+        ssize_t n = sendmsg(c.fd, &message, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (!c.want_write) {
+                    c.want_write = true;
+                    epoll_event event = {};
+                    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+                    event.data.u64 = c.index + 1;
+                    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, c.fd, &event);
+                }
+                return true;
+            }
+            Close(c);
+            return false;
+        }
+        size_t sent = n;
+        size_t head = std::min(sent, c.head_length - c.head_sent);
+        c.head_sent += head;
+        c.body_sent += sent - head;
+    }
+    c.body.reset();
+    if (c.want_write) {
+        c.want_write = false;
+        epoll_event event = {};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.u64 = c.index + 1;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, c.fd, &event);
+    }
+    if (c.close_after) {
+        Close(c);
+        return false;
+    }
+    return true;
+}
+
+void HttpServer::Close(connection& c) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, c.fd, nullptr);
+    close(c.fd);
+    c.fd = -1;
+    c.body.reset();
+    c.in_length = 0;
+}
+
+std::shared_ptr<const std::string> HttpServer::Body(const std::string& path,
+        std::uint64_t& version) {
+    auto state = state_->Read();
+    if (!state) return nullptr;
+    cached_body& cached = cache_[path];
+    if (cached.body && cached.snapshot == state.Version()) {
+        version = cached.version;
+        return cached.body;
+    }
+    version = state.Version();
+
+    TRACE_SPAN("http", "regenerate");
+    std::string body;
+    body.reserve(cached.body ? cached.body->size() + 64 : 1024);
+    if (path == "/api/status") {
+        StatusJson(body, *state, version);
+    } else if (path == "/api/zones") {
+        ZonesJson(body, *state);
+    } else if (path == "/api/programs") {
+        ProgramsJson(body, *state);
+    } else {
+        NextJson(body, *state);
+    }
+    regenerated_++;
+    cached.snapshot = version;
+    // eg: /api/programs while only a zone's seconds left moved
+    if (cached.body && *cached.body == body) {
+        version = cached.version;
+        return cached.body;
+    }
+    cached.version = version;
+    cached.body = std::make_shared<const std::string>(std::move(body));
+    return cached.body;
+}
+
+namespace {
+
+struct bench_client {
+    int fd;
+    bool connecting;
+    std::string in;
+    std::string etag; // of the last 200, sent back with --revalidate
+    clock::time_point sent;
+};
+
+int Connect(const addrinfo* address) {
+    int fd = socket(address->ai_family, SOCK_STREAM | SOCK_NONBLOCK |
+            SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, address->ai_addr, address->ai_addrlen) != 0 &&
+            errno != EINPROGRESS) {
+        close(fd);
+        return -1;
+    }
+    int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof (yes));
+    return fd;
+}
+
+// the length of a whole response at the front of in, 0 if not all there
+size_t ResponseLength(const std::string& in, int& status, bool& close_after,
+        std::string& etag) {
+    size_t head = in.find("\r\n\r\n");
+    if (head == std::string::npos) return 0;
+    head += 4;
+    status = std::atoi(in.c_str() + std::min<size_t>(9, in.size()));
+    size_t length = 0;
+    close_after = false;
+    for (size_t line = in.find("\r\n") + 2; line < head - 2;) {
+        size_t next = in.find("\r\n", line);
+        size_t colon = in.find(':', line);
+        if (colon < next) {
+            std::string name = in.substr(line, colon - line);
+            std::string value = in.substr(colon + 2, next - colon - 2);
+            if (strcasecmp(name.c_str(), "content-length") == 0) {
+                length = std::strtoul(value.c_str(), nullptr, 10);
+            } else if (strcasecmp(name.c_str(), "connection") == 0) {
+                close_after = strcasecmp(value.c_str(), "close") == 0;
+            } else if (strcasecmp(name.c_str(), "etag") == 0) {
+                etag = value;
+            }
+        }
+        line = next + 2;
+    }
+    return in.size() >= head + length ? head + length : 0;
+}
+
+} // namespace
+
+int HttpBenchCommand(int argc, char* argv[]) {
+    std::string target = argc > 0 ? argv[0] : "";
+    int clients = 64;
+    int seconds = 5;
+    std::string path = "/api/status";
+    bool revalidate = false;
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--revalidate") {
+            revalidate = true;
+        } else if (positional == 0) {
+            clients = std::max(1, std::atoi(argv[i]));
+            positional++;
+        } else if (positional == 1) {
+            seconds = std::max(1, std::atoi(argv[i]));
+            positional++;
+        } else {
+            path = arg;
+        }
+    }
+    size_t colon = target.rfind(':');
+    if (target.empty() || colon == std::string::npos) {
+        std::printf("eg: mysprinkler http-bench 127.0.0.1:8080 [clients] "
+                "[seconds] [path] [--revalidate]\n");
+        return EXIT_FAILURE;
+    }
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* address = nullptr;
+    if (getaddrinfo(target.substr(0, colon).c_str(),
+            target.substr(colon + 1).c_str(), &hints, &address) != 0) {
+        std::printf("Unable to resolve %s\n", target.c_str());
+        return EXIT_FAILURE;
+    }
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    std::vector<bench_client> all(clients);
+    std::uint64_t connects = 0, errors = 0;
+    std::map<int, std::uint64_t> statuses;
+    LatencyHistogram latency;
+    auto open = [&](size_t i) {
+        bench_client& c = all[i];
+        c.fd = Connect(address);
+        c.connecting = true;
+        c.in.clear();
+        if (c.fd < 0) {
+            errors++;
+            return;
+        }
+        connects++;
+        epoll_event event = {};
+        event.events = EPOLLOUT;
+        event.data.u64 = i;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, c.fd, &event);
+    };
+    auto drop = [&](bench_client& c) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c.fd, nullptr);
+        close(c.fd);
+        c.fd = -1;
+    };
+    auto request = [&](bench_client& c) {
+        std::string text = "GET " + path + " HTTP/1.1\r\nHost: " + target +
+                "\r\n";
+        if (revalidate && !c.etag.empty()) {
+            text += "If-None-Match: " + c.etag + "\r\n";
+        }
+        text += "\r\n";
+        c.sent = clock::now();
+        return send(c.fd, text.data(), text.size(), MSG_NOSIGNAL) ==
+                static_cast<ssize_t> (text.size());
+    };
+    for (int i = 0; i < clients; i++) {
+        open(i);
+    }
+
+    std::vector<epoll_event> events(256);
+    std::vector<char> buffer(64 * 1024);
+    clock::time_point end = clock::now() + std::chrono::seconds(seconds);
+    while (clock::now() < end) {
+        int n = epoll_wait(epoll_fd, events.data(), events.size(), 100);
+        for (int e = 0; e < n; e++) {
+            size_t i = events[e].data.u64;
+            bench_client& c = all[i];
+            if (c.fd < 0) continue;
+            if (c.connecting) {
+                int error = 0;
+                socklen_t length = sizeof (error);
+                getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+                epoll_event event = {};
+                event.events = EPOLLIN;
+                event.data.u64 = i;
+                epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c.fd, &event);
+                c.connecting = false;
+                if (error != 0 || !request(c)) {
+                    errors++;
+                    drop(c);
+                    open(i);
+                }
+                continue;
+            }
+            ssize_t got = read(c.fd, buffer.data(), buffer.size());
+            if (got <= 0) {
+                if (got < 0 && errno == EAGAIN) continue;
+                errors++; // closed with a response outstanding
+                drop(c);
+                open(i);
+                continue;
+            }
+            c.in.append(buffer.data(), got);
+            int status = 0;
+            bool close_after = false;
+            std::string etag;
+            size_t length = ResponseLength(c.in, status, close_after, etag);
+            if (length == 0) continue;
+            latency.Record(clock::now() - c.sent);
+            statuses[status]++;
+            if (status == 200 && !etag.empty()) c.etag = etag;
+            c.in.erase(0, length);
+            if (close_after) {
+                drop(c);
+                open(i);
+            } else if (!request(c)) {
+                errors++;
+                drop(c);
+                open(i);
+            }
+        }
+    }
+    for (auto& c : all) {
+        if (c.fd >= 0) close(c.fd);
+    }
+    close(epoll_fd);
+    freeaddrinfo(address);
+
+    std::printf("%d clients, %s for %d seconds%s\n", clients, path.c_str(),
+            seconds, revalidate ? ", revalidating" : "");
+    std::printf("%.0f requests/s, %llu connects, %llu errors\n",
+            latency.Count() / static_cast<double> (seconds),
+            static_cast<unsigned long long> (connects),
+            static_cast<unsigned long long> (errors));
+    for (const auto& status : statuses) {
+        std::printf("  %d: %llu\n", status.first,
+                static_cast<unsigned long long> (status.second));
+    }
+    std::printf("%s\n", latency.Summary("reply").c_str());
+    return errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -31,6 +31,10 @@
 #include <fstream>
 #include <sstream>
 
+#include <condition_variable>
+#include <deque>
+#include <string>
+#include <thread>
 #include <vector>
 #include <mutex>
 
@@ -72,6 +76,13 @@ public:
     void PrintTime();
     void SetLoggingMode(LOGGING logging_mode);
     void SetLogFile(std::ofstream outputFilestream);
+    /*! @brief Writes from a background thread.
+     *
+     * Callers only format and queue a line, so a real-time thread never
+     * waits on the terminal or the log file. Past 4096 queued lines new
+     * ones are dropped and counted. Turning it off writes what is queued.
+     */
+    void Async(bool async);
 
     void
     Trace(const std::string& data) {
@@ -90,14 +101,22 @@ protected:
 private:
     void hexout(const char& c);
     void Output();
+    void Write(const std::string& text);
+    void Writer();
     std::mutex lock_;
     std::string Now();
     LOGGING logging_mode_;
 
+    std::mutex queue_lock_; // guards queue_, async_ and dropped_
+    std::condition_variable queue_cv_;
+    std::deque<std::string> queue_;
+    std::thread writer_;
+    bool async_;
+    unsigned long dropped_;
+
     Logger();
 
-    ~Logger() {
-    }
+    ~Logger();
 };
 } // namespace utils
 } // ace
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * File:   codegen.hpp
+ * Author: Aaron
+ *
+ * Created on October 19, 2026, 1:40 PM
+ */
+
+#ifndef CODEGEN_HPP
+#define CODEGEN_HPP
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <yaml-cpp/yaml.h>
+
+/*! @brief Writes a validated configuration as compile time tables.
+ *
+ * The output is the site_config.hpp included by the fixed installation
+ * build (fixed.cpp).
+ *
+ * @param [in] yConfig parsed configuration
+ * @param [in] source name of the configuration, for the header comment
+ * @param [out] os generated header
+ * @param [out] errors why the configuration was rejected
+ *
+ * @return false if the configuration is invalid, nothing is written
+ */
+bool GenerateFixedConfig(const YAML::Node& yConfig, const std::string& source,
+        std::ostream& os, std::vector<std::string>& errors);
+
+// mysprinkler generate <config> [site_config.hpp]
+int GenerateCommand(int argc, char* argv[]);
+
+#endif /* CODEGEN_HPP */
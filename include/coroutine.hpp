@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * File:   coroutine.hpp
+ * Author: Aaron
+ *
+ * Created on October 19, 2026, 8:40 PM
+ *
+ * Stackless coroutines for C++14, in the manner of protothreads. A task's
+ * Resume() is written as straight-line code between CO_BEGIN and CO_END
+ * and suspends with CO_SLEEP_UNTIL/CO_SLEEP_FOR/CO_SUSPEND, the next
+ * Resume() continues after the suspension point. What must survive a
+ * suspension lives in the task's members, locals do not; the task object
+ * is the coroutine frame.
+ *
+ * Suspension points are switch labels: no two on one line and none inside
+ * a switch of the task's own.
+ */
+
+#ifndef COROUTINE_HPP
+#define COROUTINE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+class Executor;
+
+class Task {
+public:
+    Task() : line_(0), wake_(0) {
+    }
+    virtual ~Task() {
+    }
+    bool Done() const {
+        return line_ < 0;
+    }
+protected:
+    friend class Executor;
+    virtual void Resume(Executor& executor) = 0;
+    int line_; // where Resume() continues, -1 once it finished
+    std::uint64_t wake_; // the sequence of its last Wake() or Ready()
+};
+
+#define CO_BEGIN switch (line_) { case 0:
+#define CO_END } line_ = -1
+// suspends until executor.Ready(this)
+#define CO_SUSPEND \
+    do { line_ = __LINE__; return; case __LINE__:; } while (0)
+#define CO_SLEEP_UNTIL(executor, t) \
+    do { line_ = __LINE__; (executor).Wake(this, (t)); return; \
+        case __LINE__:; } while (0)
+#define CO_SLEEP_FOR(executor, d) \
+    CO_SLEEP_UNTIL(executor, (executor).Now() + (d))
+
+/*! @brief Runs tasks on the calling thread.
+ *
+ * Spawned and readied tasks resume in order, sleeping ones once their
+ * time passed, earliest first. Between them Run() sleeps until the next
+ * timer, Poll() returns for a loop of the caller's own to wait. A task
+ * waits on one thing at a time: Wake() or Ready() replace what it waited
+ * on before, so readying a sleeping task cuts its sleep short. A task
+ * that finished is destroyed.
+ */
+class Executor {
+public:
+    // the scheduler's, zones end at wall clock times
+    using clock = std::chrono::system_clock;
+
+    Executor();
+    ~Executor();
+
+    Task* Spawn(std::unique_ptr<Task> task); // first resumes on the next pass
+    void Wake(Task* task, clock::time_point t); // for CO_SLEEP_UNTIL
+    void Ready(Task* task); // resumes a CO_SUSPENDed task on the next pass
+    void Cancel(Task* task); // destroys a task that has not finished
+    // runs until no task is left, or until
+    void Run(clock::time_point until = clock::time_point::max());
+    void Poll(); // resumes what is ready or due, without sleeping
+    clock::time_point Next(); // of the earliest timer, max() if none
+
+    clock::time_point Now() const; // of the current pass
+    size_t Tasks() const;
+    std::uint64_t Resumes() const;
+private:
+    struct timer {
+        clock::time_point at;
+        std::uint64_t sequence; // wake order among equal times
+        Task* task;
+        bool operator>(const timer& other) const {
+            return at != other.at ? at > other.at : sequence > other.sequence;
+        }
+    };
+
+    timer Push(Task* task, clock::time_point t); // replaces its last wake
+    bool Live(const timer& wake) const; // the task's current wake
+    void Resume(const timer& wake);
+
+    std::priority_queue<timer, std::vector<timer>, std::greater<timer> >
+    timers_;
+    std::deque<timer> ready_;
+    std::unordered_map<Task*, std::unique_ptr<Task> > tasks_;
+    clock::time_point now_;
+    std::uint64_t sequence_;
+    std::uint64_t resumes_;
+};
+
+// mysprinkler coro-bench [programs] [cycles] [step_us]
+int CoroBenchCommand(int argc, char* argv[]);
+
+#endif /* COROUTINE_HPP */
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * File:   cycles.hpp
+ * Author: Aaron
+ *
+ * Created on October 19, 2026, 6:10 PM
+ */
+
+#ifndef CYCLES_HPP
+#define CYCLES_HPP
+
+#include <vector>
+
+// a zone of a program run, all in seconds
+struct cycle_zone {
+    int zone_id;
+    int seconds; // total watering
+    int max_cycle; // longest single watering, 0 for one cycle
+    int min_soak; // shortest rest between two cycles
+};
+
+// one cycle of a zone in a plan
+struct cycle_step {
+    int zone_id;
+    int start; // seconds after the run started, as planned
+    int seconds;
+    int soak; // rest needed since the zone's previous cycle, 0 for the first
+};
+
+struct cycle_plan {
+    std::vector<cycle_step> steps; // by start
+    int makespan; // seconds from the first cycle on to the last off
+};
+
+/*! @brief Interleaves the cycles of a program's zones.
+ *
+ * Each zone's total is split into the fewest cycles no longer than its
+ * max_cycle, of near equal length. Cycles are list scheduled: whenever
+ * fewer than max_concurrent zones water, a rested zone starts its next
+ * cycle. The zone picked is the one with the most work left including its
+ * soaks, the configured order and the longest soak first are tried too and
+ * the shortest plan is kept. A program without cycling keeps its configured
+ * order.
+ */
+cycle_plan PlanCycles(const std::vector<cycle_zone>& zones,
+        int max_concurrent);
+// every cycle of a zone and its soaks before the next zone, for comparison
+cycle_plan NaiveCycles(const std::vector<cycle_zone>& zones);
+// no plan can be shorter
+int CycleLowerBound(const std::vector<cycle_zone>& zones, int max_concurrent);
+
+// mysprinkler cycles <config> [--concurrent N] [--plan]
+int CyclesCommand(int argc, char* argv[]);
+
+#endif /* CYCLES_HPP */
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * File:   dag.hpp
+ * Author: Aaron
+ *
+ * Created on October 19, 2026, 8:30 PM
+ */
+
+#ifndef DAG_HPP
+#define DAG_HPP
+
+#include "program.hpp"
+
+#include <ctime>
+#include <map>
+#include <vector>
+
+// a program due in a night, times in seconds
+struct dag_program {
+    int id;
+    int priority;
+    std::time_t start; // UTC
+    int seconds; // its zones in cycles, as PlanCycles() runs them
+    std::vector<int> zones;
+    std::vector<int> after; // of the programs in the night
+    std::vector<int> not_with;
+};
+
+// a zone's cycle settings, minutes as Zone::Cycle()
+struct dag_zone {
+    int max_cycle;
+    int min_soak;
+};
+
+struct dag_step {
+    int id;
+    int start; // seconds after the first start of the night
+    int end;
+};
+
+struct dag_plan {
+    std::vector<dag_step> steps; // by start
+    int makespan; // first start to last end
+    int critical_path; // the longest chain of after, no plan is shorter
+    std::vector<int> critical; // program ids along it
+};
+
+/*! @brief Orders programs so each comes after those it starts after.
+ *
+ * Kahn's algorithm, ties in id order. Dependencies on programs not in the
+ * list are ignored.
+ *
+ * @param [out] order program ids
+ * @param [out] cycle the ids of one cycle, if there is one
+ * @return false if the after dependencies form a cycle
+ */
+bool OrderPrograms(const std::vector<dag_program>& programs,
+        std::vector<int>& order, std::vector<int>& cycle);
+
+/*! @brief The programs starting in [from, to), at most one run each.
+ *
+ * A program's length is its zones planned with PlanCycles() one at a time,
+ * durations read as minutes.
+ */
+std::vector<dag_program> NightPrograms(std::vector<Program> programs,
+        const std::map<int, dag_zone>& zones, std::time_t from, std::time_t to);
+
+/*! @brief Runs a night's programs as a DAG, up to capacity at once.
+ *
+ * List scheduling: whenever fewer than capacity programs run, a program
+ * whose start time passed and whose after programs finished starts, unless
+ * it shares a zone with, or is not_with, a running one. The highest
+ * priority goes first, then the longest chain still to run behind it, so
+ * the critical path is never held up by a branch that can wait. Capacity 1
+ * is what the daemon does.
+ */
+dag_plan PlanNight(const std::vector<dag_program>& programs, int capacity);
+
+// mysprinkler dag <config> [--capacity N] [--nights N] [--plan]
+int DagCommand(int argc, char* argv[]);
+
+#endif /* DAG_HPP */
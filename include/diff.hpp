@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * File:   diff.hpp
+ * Author: Aaron
+ *
+ * Created on October 19, 2026, 11:55 PM
+ */
+
+#ifndef DIFF_HPP
+#define DIFF_HPP
+
+#include "timeline.hpp"
+
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <utility>
+#include <vector>
+
+// one program start that waters, as the timeline replays it
+struct planned_run {
+    std::time_t due;
+    int program_id;
+    std::time_t start; // first zone on
+    std::time_t end; // last zone off
+    int seconds; // watered
+    std::vector<std::pair<int, int> > zones; // zone id, seconds, by id
+};
+
+// a run kept waiting past its start or interrupted by other programs
+struct run_overlap {
+    size_t run; // index in planned_schedule::runs
+    int with; // the program watering when it was due or first in its way
+    int seconds; // waited and interrupted
+};
+
+struct planned_schedule {
+    std::vector<planned_run> runs; // by due, then program id
+    std::vector<run_overlap> overlaps; // by run
+    std::map<int, std::int64_t> zones; // seconds watered by zone
+};
+
+// a program whose runs start as before but water otherwise
+struct program_change {
+    int program_id;
+    int runs;
+    int before_seconds; // of the first of them
+    int after_seconds;
+};
+
+struct schedule_diff {
+    std::vector<size_t> added; // in the after runs
+    std::vector<size_t> removed; // in the before runs
+    std::vector<std::pair<size_t, size_t> > shifted; // before, after
+    std::vector<program_change> changed;
+    // zones whose total differs, seconds before and after
+    std::map<int, std::pair<std::int64_t, std::int64_t> > zones;
+    std::vector<size_t> new_overlaps; // in the after overlaps
+};
+
+/*! @brief The runs of a timeline within [from, to).
+ *
+ * Slots are grouped by program and due time, so a run keeps the scheduler's
+ * one zone at a time, holds, preemption, offsets and tariff starts. Runs
+ * skipped by the scheduler are not there.
+ */
+planned_schedule ExpandSchedule(Timeline& timeline, std::time_t from,
+        std::time_t to);
+
+/*! @brief What changes from one schedule to the other.
+ *
+ * Runs of a program due at the same time are the same run, shifted if it
+ * starts watering at another time. Of those left, a run of the program due
+ * within shift_seconds of one left in the other schedule, in order, has
+ * shifted, the rest are added or removed. An overlap is new if its run is
+ * added or its counterpart ran clear of the others before.
+ */
+schedule_diff DiffSchedules(const planned_schedule& before,
+        const planned_schedule& after, int shift_seconds);
+
+// mysprinkler diff <before> <after> [--days N] [--from "YYYY-MM-DD HH:MM"]
+//     [--shift MINUTES] [--limit N] [--json]
+int DiffCommand(int argc, char* argv[]);
+
+#endif /* DIFF_HPP */
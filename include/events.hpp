@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * File:   events.hpp
+ * Author: Aaron
+ *
+ * Created on October 19, 2026, 7:50 PM
+ */
+
+#ifndef EVENTS_HPP
+#define EVENTS_HPP
+
+#include "history.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum EVENT_TYPE {
+    event_program_start, event_program_skip, event_program_preempted,
+    event_program_done, event_zone_on, event_zone_off
+};
+
+// one zone or program state change
+struct event {
+    std::int64_t at; // UTC milliseconds
+    std::uint8_t type; // EVENT_TYPE
+    std::uint8_t reason; // RUN_REASON of a zone_off
+    std::int32_t program_id;
+    std::int32_t zone_id; // 0 for a program event
+    std::int32_t seconds; // watered by a zone_off, late of a program_start
+};
+
+// the mqtt: node of the configuration
+struct mqtt_options {
+    mqtt_options() : host("127.0.0.1"), port(1883), client_id("mysprinkler"),
+    topic("mysprinkler/events"), keepalive(30), buffer(1024), batch(64),
+    linger_ms(100) {
+    }
+    std::string host;
+    int port;
+    std::string client_id;
+    std::string topic;
+    int keepalive; // seconds
+    int buffer; // events held while the broker is slow or away
+    int batch; // events per message at most
+    int linger_ms; // wait for a batch to fill
+};
+
+/*! @brief Publishes state changes to an MQTT broker.
+ *
+ * Push() copies an event into a fixed ring and returns, it never waits on
+ * the network. A thread publishes the ring in batches, one QoS 0 message
+ * of a JSON array each, to topic. When the broker is away the thread
+ * reconnects with backoff from half a second to 30 seconds and events wait
+ * in the ring; once full the oldest are dropped. Each message carries the
+ * number dropped since the last one, Dropped() the total. Every event
+ * Pushed() while running ends up Published() or Dropped() once stopped.
+ *
+ * Speaks MQTT 3.1.1 over TCP, CONNECT, PUBLISH, PINGREQ and DISCONNECT.
+ */
+class EventPublisher {
+public:
+    EventPublisher();
+    ~EventPublisher();
+
+    void Start(const mqtt_options& options);
+    void Stop(); // publishes what is buffered if connected
+    bool Running() const;
+    void Push(EVENT_TYPE type, int program_id, int zone_id = 0,
+            int seconds = 0, RUN_REASON reason = reason_ran);
+
+    std::uint64_t Pushed() const; // events
+    std::uint64_t Published() const;
+    std::uint64_t Dropped() const;
+    std::uint64_t Connects() const;
+private:
+    void Run();
+    bool Connect();
+    void Disconnect(bool clean);
+    bool Send(const std::string& packet);
+    bool Receive(); // reads what the broker sent, false once it is gone
+    std::string Payload(const std::vector<event>& events,
+            std::uint64_t dropped) const;
+
+    mqtt_options options_;
+    mutable std::mutex lock_; // guards everything below but the socket
+    std::condition_variable cv_;
+    std::vector<event> ring_;
+    std::uint64_t first_; // sequence of the oldest buffered event
+    std::uint64_t next_;
+    std::uint64_t dropped_;
+    std::uint64_t reported_; // of dropped_, told the broker about
+    std::uint64_t published_;
+    std::uint64_t connects_;
+    bool running_;
+    std::thread thread_;
+
+    int fd_; // publishing thread only
+    std::chrono::steady_clock::time_point sent_; // last packet out
+    std::chrono::steady_clock::time_point received_; // last packet in
+};
+
+#endif /* EVENTS_HPP */
@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * File:   fixed.hpp
+ * Author: Aaron
+ *
+ * Created on October 19, 2026, 1:40 PM
+ */
+
+#ifndef FIXED_HPP
+#define FIXED_HPP
+
+#include "Logger.h"
+#include "program.hpp"
+#include "shutdown.hpp"
+#include "timezone.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// one zone of a compiled in program
+struct fixed_zone_detail {
+    int zone_id;
+    int duration; // minutes
+};
+
+// a compiled in program, written by 'mysprinkler generate'
+struct fixed_program {
+    int id;
+    int hour;
+    int minute;
+    MODE mode;
+    int interval;
+    unsigned weekdays; // bit 0 = sunday
+    const fixed_zone_detail* zones;
+    int zone_count;
+};
+
+namespace fixed {
+
+inline bool WriteFile(const char* path, const char* value) {
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    ssize_t len = static_cast<ssize_t> (std::strlen(value));
+    bool ok = write(fd, value, len) == len;
+    close(fd);
+    return ok;
+}
+
+} // namespace fixed
+
+/*! @brief A relay on a GPIO pin known at compile time.
+ *
+ * Pin and logic polarity are template arguments, so turning the relay on
+ * or off is a single write of a constant to a value file opened once.
+ */
+template <int Id, int Pin, bool InvertLogic, bool Enabled>
+class FixedZone {
+public:
+    static constexpr int id = Id;
+    static constexpr bool enabled = Enabled;
+
+    // exports the pin under root (eg: /sys/class/gpio) as an output
+    static bool Open(const char* root) {
+        char path[128];
+        std::snprintf(path, sizeof (path), "%s/gpio%d/value", root, Pin);
+        if (access(path, F_OK) != 0) {
+            char export_path[128], pin[16];
+            std::snprintf(export_path, sizeof (export_path), "%s/export", root);
+            std::snprintf(pin, sizeof (pin), "%d", Pin);
+            fixed::WriteFile(export_path, pin);
+        }
+        char direction[128];
+        std::snprintf(direction, sizeof (direction), "%s/gpio%d/direction",
+                root, Pin);
+        fixed::WriteFile(direction, "out");
+        Fd() = open(path, O_RDWR | O_CLOEXEC);
+        return Fd() >= 0;
+    }
+
+    static bool TurnOn() {
+        return Write(InvertLogic ? '0' : '1');
+    }
+
+    static bool TurnOff() {
+        return Write(InvertLogic ? '1' : '0');
+    }
+private:
+
+    static int& Fd() {
+        static int fd = -1;
+        return fd;
+    }
+
+    static bool Write(char level) {
+        return pwrite(Fd(), &level, 1, 0) == 1;
+    }
+};
+
+/*! @brief The zones of a fixed installation.
+ *
+ * Zone lookups by id expand to a chain of compares against constants.
+ */
+template <typename... Zones>
+struct zone_table {
+
+    static bool Open(const char* root) {
+        bool ok = true;
+        (void) std::initializer_list<int>{(ok &= Zones::Open(root), 0)...};
+        return ok;
+    }
+
+    static void AllOff() {
+        (void) std::initializer_list<int>{(Zones::TurnOff(), 0)...};
+    }
+
+    // returns 1 if switched, 0 if the zone is disabled, -1 if unknown
+    static int Set(int id, bool on) {
+        int result = -1;
+        (void) std::initializer_list<int>{(Zones::id == id ?
+            (result = Zones::enabled ? ((on ? Zones::TurnOn() :
+            Zones::TurnOff()), 1) : 0) : 0)...};
+        return result;
+    }
+};
+
+/*! @brief MainLoop and RunZones over compiled in zone and program tables.
+ *
+ * Start times come from the same Program::NextStartTime() as the dynamic
+ * build, programs run one at a time in start time order.
+ */
+template <typename Zones>
+class FixedScheduler {
+public:
+
+    template <size_t N>
+    explicit FixedScheduler(const fixed_program(&programs)[N]) {
+        programs_.resize(N);
+        for (size_t i = 0; i < N; i++) {
+            const fixed_program& p = programs[i];
+            std::vector<int> weekdays;
+            for (int day = 0; day < 7; day++) {
+                if (p.weekdays & (1u << day)) weekdays.push_back(day);
+            }
+            std::list<zone_detail> details;
+            for (int z = 0; z < p.zone_count; z++) {
+                details.push_back(zone_detail(p.zones[z].zone_id,
+                        p.zones[z].duration));
+            }
+            programs_[i].LoadProgram(p.id, p.hour, p.minute, p.mode,
+                    p.interval, weekdays, details);
+        }
+    }
+
+    bool Run() {
+        using ace::utils::Logger;
+        while (!ShutdownRequested()) {
+            Program* program = Next();
+            if (program == nullptr) {
+                Logger::Instance().Info("Nothing to do. Exiting...");
+                StartShutdown();
+                break;
+            }
+            Logger::Instance().Info("Program %i scheduled to run at %s",
+                    program->Id(), Format(program->StartTime()).c_str());
+
+            std::unique_lock<std::mutex>lk(mutex_);
+            if (cv_.wait_until(lk, std::chrono::system_clock::from_time_t(
+                    program->StartTime())) == std::cv_status::timeout) {
+                lk.unlock();
+                RunZones(program->ZoneDetail());
+                program->NextStartTime();
+                Logger::Instance().Info("Program %i completed and will run"
+                        " again on %s", program->Id(),
+                        Format(program->StartTime()).c_str());
+            }
+        }
+        return true;
+    }
+
+    void Wake() {
+        cv_.notify_all();
+    }
+private:
+
+    // the enabled program starting first, table order breaks ties
+    Program* Next() {
+        Program* next = nullptr;
+        for (auto& program : programs_) {
+            if (program.Disabled()) continue;
+            if (next == nullptr || program.StartTime() < next->StartTime())
+                next = &program;
+        }
+        return next;
+    }
+
+    void RunZones(const std::list<zone_detail>& list_detail) {
+        using ace::utils::Logger;
+        for (const auto& detail : list_detail) {
+            if (ShutdownRequested()) break;
+            if (Zones::Set(detail.zone_id, true) != 1) continue;
+            Logger::Instance().Info("Watering zone %d for %d minutes",
+                    detail.zone_id, detail.duration);
+
+            std::unique_lock<std::mutex>lk(mutex_);
+            cv_.wait_until(lk, std::chrono::system_clock::now() +
+                    std::chrono::minutes(detail.duration));
+            Zones::Set(detail.zone_id, false);
+        }
+    }
+
+    static std::string Format(std::time_t t) {
+        std::tm tm = TimeZone::Local().ToLocal(t);
+        char buffer[64];
+        std::strftime(buffer, sizeof (buffer), "%Y/%m/%d %T %Z", &tm);
+        return buffer;
+    }
+
+    std::vector<Program> programs_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+};
+
+#endif /* FIXED_HPP */
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * File:   flow.hpp
+ * Author: Aaron
+ *
+ * Created on October 19, 2026, 11:20 AM
+ */
+
+#ifndef FLOW_HPP
+#define FLOW_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <yaml-cpp/yaml.h>
+
+// one flow meter on a water main
+struct flow_sensor {
+    flow_sensor() : pulses(0), generated(0), rate(0) {
+    }
+    int id;
+    int gpio; // pulse input, gpio N is line N % 32 of /dev/gpiochip<N / 32>
+    double pulses_per_unit; // meter K-factor
+    std::vector<int> zones; // zones downstream of this meter, empty is all
+    double tolerance; // fraction above a zone's baseline that is a fault
+    double leak_rate; // units per minute tolerated with every zone off
+    int leak_samples; // consecutive leak samples before a site shut off
+    int learn_samples; // samples a zone runs before its baseline is trusted
+    bool simulate; // pulses come from the simulated source, not the gpio
+    double simulated_hz; // simulated pulses per second with a zone on
+    double simulated_idle_hz; // simulated pulses per second with all off
+
+    int fd; // edge event descriptor, or read end of the simulated pipe
+    int sim_fd; // write end of the simulated pipe
+    std::atomic<std::uint64_t> pulses; // counted by the counting thread only
+    std::atomic<std::uint64_t> generated; // pulses the simulator produced
+    std::atomic<double> rate; // units per minute at the last sample
+    std::uint64_t last_pulses;
+    int leak_count;
+    std::vector<int> last_on; // zones on at the previous sample, sorted
+};
+
+// learned flow of one zone
+struct flow_baseline {
+    flow_baseline() : rate(0), samples(0) {
+    }
+    double rate; // units per minute, the mean until learn_samples
+    int samples; // steady samples, the zone alone on the meter throughout
+};
+
+/*! @brief Counts flow meter pulses and shuts off zones on abnormal flow.
+ *
+ * A counting thread waits on edge events of every meter and keeps one
+ * lock-free pulse counter per meter. A monitor thread samples the counters
+ * every sample period, attributes the flow to the zones that are on and
+ * learns each zone's normal flow. Flow above a zone's baseline faults that
+ * zone, flow with every zone off faults the whole site.
+ */
+class FlowMonitor {
+public:
+    using active_zones_fn = std::function<std::vector<int>()>;
+    using zone_fault_fn = std::function<void(int zone_id, double rate)>;
+    using site_fault_fn = std::function<void(int sensor_id, double rate)>;
+
+    FlowMonitor();
+    ~FlowMonitor();
+
+    void LoadSensors(const YAML::Node yNodes, int sample_seconds);
+    bool Empty() const;
+
+    /*! @brief Opens the pulse inputs and starts the monitor.
+     *
+     * @param [in] active_zones returns the ids of the zones commanded on
+     * @param [in] zone_fault called to take a zone out of service
+     * @param [in] site_fault called to take every zone out of service
+     */
+    bool Start(active_zones_fn active_zones, zone_fault_fn zone_fault,
+            site_fault_fn site_fault);
+    void Stop();
+
+    double Rate(int sensor_id) const; // units per minute, last sample
+private:
+    bool OpenInput(flow_sensor& sensor);
+    void CountPulses(); // counting thread
+    void Simulate(); // simulated pulse source thread
+    void Monitor(); // sampling thread
+    void Sample(flow_sensor& sensor, double minutes,
+            const std::vector<int>& active);
+
+    std::vector<std::unique_ptr<flow_sensor> > sensors_;
+    std::map<int, flow_baseline> baselines_; // by zone id, monitor thread
+    int sample_seconds_;
+    int wake_fd_[2]; // wakes the counting thread on Stop()
+    std::atomic<bool> running_;
+    std::mutex lock_;
+    std::condition_variable cv_;
+    std::thread count_thread_;
+    std::thread simulate_thread_;
+    std::thread monitor_thread_;
+    active_zones_fn active_zones_;
+    zone_fault_fn zone_fault_;
+    site_fault_fn site_fault_;
+};
+
+#endif /* FLOW_HPP */
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * File:   gpio.hpp
+ * Author: Aaron
+ *
+ * Created on October 19, 2026, 3:50 PM
+ */
+
+#ifndef GPIO_HPP
+#define GPIO_HPP
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// injected into every gpio operation, for testing against a fake tree
+struct gpio_faults {
+    gpio_faults() : latency_us(0), failure_rate(0), ignore_rate(0),
+    stall_ms(0), stall_after(0) {
+    }
+    int latency_us; // added to each operation
+    double failure_rate; // chance, 0 to 1, that an operation fails
+    double ignore_rate; // chance a write reports success but does nothing
+    std::vector<int> stuck; // pins whose writes never take
+    int stall_ms; // one write blocks this long, eg: a wedged driver
+    int stall_after; // writes before the one that stalls
+};
+
+/*! @brief One GPIO line through the sysfs interface.
+ *
+ * The sysfs root is configurable (gpio_directory) so the relays can be
+ * driven against a fake tree off-board. The value file is opened once and
+ * rewritten in place.
+ */
+class SysfsGpio {
+public:
+    SysfsGpio(int pin, bool output);
+    ~SysfsGpio();
+    SysfsGpio(const SysfsGpio&) = delete;
+    SysfsGpio& operator=(const SysfsGpio&) = delete;
+
+    static void Root(const std::string& root); // default /sys/class/gpio
+    static std::string Root();
+    static void Faults(const gpio_faults& faults);
+
+    int Pin() const;
+    bool Open(); // exports the line and sets its direction
+    bool Write(bool high);
+    // the write alone, no trace span or faults, safe in a signal handler
+    bool ForceWrite(bool high);
+    bool IsHigh();
+    bool IsOpen() const;
+    bool Fail() const; // the last operation failed
+private:
+    bool Inject(); // delays, and returns true if the operation should fail
+    bool Ignore(); // true if a write should silently not take
+    int pin_;
+    bool output_;
+    int fd_; // value file
+    bool fail_;
+};
+
+/*! @brief A sysfs GPIO tree in a scratch directory, eg: under /dev/shm.
+ *
+ * Creates export and unexport files and a thread that, like the kernel,
+ * adds gpioN/{direction,value,edge,active_low} when N is written to export
+ * and removes it again on unexport.
+ */
+class FakeGpioTree {
+public:
+    FakeGpioTree();
+    ~FakeGpioTree();
+
+    bool Create(const std::string& root);
+    void Destroy(); // stops the thread and removes the tree
+private:
+    void Watch();
+    void Export(const char* file, bool add);
+
+    std::string root_;
+    int inotify_fd_;
+    int wake_fd_[2]; // wakes the watch thread on Destroy()
+    std::atomic<bool> running_;
+    std::thread thread_;
+};
+
+// mysprinkler gpio-bench <scratch dir> [pins] [toggles] [latency_us] [failure_rate]
+int GpioBenchCommand(int argc, char* argv[]);
+
+#endif /* GPIO_HPP */
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * File:   history.hpp
+ * Author: Aaron
+ *
+ * Created on October 19, 2026, 10:05 AM
+ */
+
+#ifndef HISTORY_HPP
+#define HISTORY_HPP
+
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <string>
+
+// why a zone of a program did or did not water
+enum RUN_REASON {
+    reason_ran, reason_disabled, reason_unknown_zone, reason_shutdown,
+    reason_fault,
+    reason_preempted, // watered part way, the rest resumes in a later record
+    reason_moist, // skipped, its soil sensors read wet
+    reason_stopped // ended by a stop request, eg: over http
+};
+
+// one zone run (or skipped run) of a program
+struct run_record {
+    std::int64_t start; // UTC seconds
+    std::int64_t end; // UTC seconds
+    std::int32_t zone_id;
+    std::int32_t program_id;
+    std::int32_t planned; // seconds the program asked for
+    std::int32_t actual; // seconds the zone was on
+    std::uint8_t reason; // RUN_REASON
+};
+
+// aggregation bucket for history queries
+enum PERIOD {
+    by_day, by_month
+};
+
+// watering totals of one zone within one period
+struct zone_total {
+    zone_total() : seconds(0), runs(0), skips(0) {
+    }
+    std::int64_t seconds;
+    int runs;
+    int skips;
+};
+
+/*! @brief Append-only, column oriented history of zone runs.
+ *
+ * Records are partitioned by UTC month into directories (eg: 2026-10) that
+ * hold one fixed-width file per column and a sparse index of start times.
+ * Queries memory-map only the partitions and columns they need.
+ */
+class RunHistory {
+public:
+    RunHistory();
+    ~RunHistory();
+
+    bool Open(const std::string& directory); // creates it when missing
+    bool IsOpen() const;
+    bool Append(const run_record& record); // thread-safe
+
+    /*! @brief Sums watering per zone per local day or month.
+     *
+     * Scans the start, zone, actual and reason columns of the partitions
+     * overlapping [from, to) only.
+     *
+     * @return period key -> zone id -> totals. Keys are days since
+     * 1970-01-01 for by_day, year * 12 + month - 1 for by_month.
+     */
+    std::map<std::int64_t, std::map<int, zone_total> > Aggregate(
+            std::time_t from, std::time_t to, PERIOD period) const;
+private:
+    bool OpenPartition(const std::string& name);
+    void ClosePartition();
+
+    std::string directory_;
+    std::string partition_; // name of the partition open for writing
+    int fds_[8]; // column files of partition_, then its index
+    std::int64_t rows_; // rows in partition_
+    std::mutex lock_;
+};
+
+#endif /* HISTORY_HPP */
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * File:   http.hpp
+ * Author: Aaron
+ *
+ * Created on October 19, 2026, 7:50 PM
+ */
+
+#ifndef HTTP_HPP
+#define HTTP_HPP
+
+#include "rcu.hpp"
+#include "state.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// the http: node of the configuration
+struct http_options {
+    http_options() : bind("0.0.0.0"), port(8080), max_clients(32),
+    idle_seconds(30), request_bytes(2048) {
+    }
+    std::string bind; // address to listen on
+    int port; // 0 picks a free one, see HttpServer::Port()
+    int max_clients; // connections held at once, more are turned away
+    int idle_seconds; // a kept alive connection is closed after this
+    int request_bytes; // request line and headers, per connection
+};
+
+struct http_stats {
+    std::uint64_t accepted;
+    std::uint64_t rejected; // turned away, every connection was in use
+    std::uint64_t requests;
+    std::uint64_t not_modified; // answered 304 from If-None-Match
+    std::uint64_t regenerated; // status bodies rebuilt from a new snapshot
+};
+
+/*! @brief Status and control of the daemon over HTTP/1.1.
+ *
+ * One thread serves every connection from an epoll loop. Connections are
+ * kept alive, requests may be pipelined and are answered in order. Memory
+ * is fixed at start up: max_clients connections of request_bytes each, a
+ * response body is shared, never copied per connection.
+ *
+ * GET /api/status, /api/zones, /api/programs and /api/next answer JSON made
+ * from the latest scheduler snapshot, rebuilt only when a new snapshot was
+ * published, which is only when the state changed. Their ETag is the
+ * snapshot version the body last differed at. The dashboard is compiled
+ * in and sent with an ETag of its content, a matching If-None-Match is
+ * answered 304. POST /api/programs/<id>/run starts a manual run and POST
+ * /api/stop ends every run. A POST must be typed application/json and any
+ * Origin must match Host, which keeps other sites' pages from sending one.
+ *
+ * There is no authentication, listen on a trusted network only.
+ */
+class HttpServer {
+public:
+    using run_program_fn = std::function<void(int program_id)>;
+    using stop_fn = std::function<void()>;
+
+    HttpServer();
+    ~HttpServer();
+
+    bool Start(const http_options& options,
+            const Snapshots<scheduler_state>& state, run_program_fn run_program,
+            stop_fn stop);
+    void Stop();
+    bool Running() const;
+    int Port() const; // bound, when options.port was 0
+    http_stats Stats() const;
+private:
+    struct connection;
+    struct cached_body {
+        std::uint64_t snapshot; // the version it was made from
+        std::uint64_t version; // its ETag, moves only when the body does
+        std::shared_ptr<const std::string> body;
+    };
+
+    void Serve(); // server thread
+    void Accept();
+    void Read(connection& c);
+    bool Respond(connection& c); // false to close once written
+    bool Flush(connection& c); // false on error
+    void Close(connection& c);
+    void Reply(connection& c, int status, const char* type,
+            std::shared_ptr<const std::string> body, const std::string& etag,
+            bool keep_alive);
+    std::shared_ptr<const std::string> Body(const std::string& path,
+            std::uint64_t& version);
+
+    http_options options_;
+    const Snapshots<scheduler_state>* state_;
+    run_program_fn run_program_;
+    stop_fn stop_;
+    int listen_fd_;
+    int epoll_fd_;
+    int wake_fd_[2]; // wakes the server thread on Stop()
+    int port_;
+    std::vector<std::unique_ptr<connection> > connections_;
+    std::map<std::string, cached_body> cache_; // by path, server thread
+    std::thread thread_;
+    std::atomic<bool> running_;
+    std::atomic<std::uint64_t> accepted_;
+    std::atomic<std::uint64_t> rejected_;
+    std::atomic<std::uint64_t> requests_;
+    std::atomic<std::uint64_t> not_modified_;
+    std::atomic<std::uint64_t> regenerated_;
+};
+
+// the body of GET /api/status, eg: for a stall dump
+void StatusJson(std::string& out, const scheduler_state& state,
+        std::uint64_t version);
+
+// mysprinkler http-bench host:port [clients] [seconds] [path]
+int HttpBenchCommand(int argc, char* argv[]);
+
+#endif /* HTTP_HPP */
@@ -36,31 +36,127 @@
 #define MAIN_HPP
 
 #include "Logger.h"
+#include "coroutine.hpp"
+#include "cycles.hpp"
+#include "dag.hpp"
+#include "diff.hpp"
+#include "events.hpp"
+#include "flow.hpp"
+#include "gpio.hpp"
+#include "history.hpp"
+#include "http.hpp"
+#include "modbus.hpp"
 #include "zone.hpp"
 #include "program.hpp"
+#include "realtime.hpp"
+#include "soil.hpp"
+#include "state.hpp"
+#include "status.hpp"
+#include "supervisor.hpp"
+#include "supply.hpp"
+#include "tariff.hpp"
+#include "torture.hpp"
 
 #include <yaml-cpp/yaml.h>
 
+#include <chrono>
 #include <condition_variable>
 #include <deque>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <vector>
 
 using namespace ace;
 
+// a program run that is watering, suspended or waiting to start
+struct program_run {
+    shared_program program;
+    std::time_t due; // start time, or when a manual run was requested
+    int priority;
+    bool manual;
+    bool suspended; // preempted, resumes when it is current again
+    bool watering; // the front zone is on
+    bool soaking; // the front zone waits out its soak
+    bool held; // waits on a program it starts after or is not run with
+    std::time_t released; // last held, catch up counts from here
+    std::deque<cycle_step> remaining; // cycles yet to finish, front first
+    std::chrono::seconds left; // of the front cycle
+    std::chrono::system_clock::time_point zone_end; // while watering
+    std::chrono::system_clock::time_point soak_end; // while soaking
+    // zone id, when the zone last turned off in this run
+    std::map<int, std::chrono::system_clock::time_point> off;
+    shared_zone zone; // while watering
+    run_record record; // of the front zone while watering
+    Task* task; // waters its zones on executor_ while in runs_, null once done
+};
+
 std::deque<shared_program> programs_; 
 std::list<shared_zone> zones_; 
+// back is current, the rest are suspended; a deque, so a run stays where
+// its task refers to it
+std::deque<program_run> runs_;
+std::deque<program_run> pending_; // due, waiting on a higher priority run
+Executor executor_; // the tasks of runs_, on the scheduler thread
+std::deque<int> manual_requests_; // program ids, guarded by program_mutex_
+bool stop_requested_ = false; // end every run, guarded by program_mutex_
+bool fault_pending_ = false; // a zone faulted, guarded by program_mutex_
 std::condition_variable cv_;
 std::mutex program_mutex_;
-std::mutex zone_mutex_;
 bool is_daemon_;
+RunHistory history_;
+FlowMonitor flow_monitor_;
+SoilMonitor soil_monitor_;
+FakeGpioTree fake_gpio_; // gpio_fake, relays driven off-board
+StatusWriter status_;
+int status_seconds_ = 1; // heartbeat period of the status page
+std::time_t started_;
+std::uint64_t loops_ = 0;
+std::uint64_t heartbeats_ = 0;
+// of zone durations, seconds under mysprinkler torture
+std::chrono::seconds duration_unit_ = std::chrono::minutes(1);
+LatencyHistogram* start_latency_ = nullptr; // transitions, when measured
+LatencyHistogram* stop_latency_ = nullptr;
+// when the last zone turned off, or was due to if later
+std::chrono::system_clock::time_point free_at_;
+realtime_options realtime_;
+WorkQueue background_; // history writes off the valve thread, realtime mode
+EventPublisher events_; // state changes to an MQTT broker
+relay_stats relay_totals_; // of every zone, kept once zones_ is cleared
+// published at the end of each scheduler pass, read from any thread
+Snapshots<scheduler_state> state_;
+HttpServer http_; // status and control, the http: node
+std::map<int, int> start_offsets_; // minutes, by program id, offsets_file
+Supervisor supervisor_; // the supervisor: node, stalls and the watchdog
+Heartbeat scheduler_beat_("scheduler"); // through each pass of MainLoop
+tariff_table tariff_; // no rates without a tariff: node
+std::time_t next_tariff_plan_ = 0; // the noon ending the planned night
+// relay boards on serial lines, the MODBUS: node, by id
+std::map<int, std::shared_ptr<ModbusBus> > modbus_buses_;
+std::vector<std::unique_ptr<ModbusSlaveSim> > modbus_sims_; // simulated lines
 
 void LoadPrograms(const YAML::Node yNodes);
+void LoadBuses(const YAML::Node yNodes);
 void LoadZones(const YAML::Node yNodes);
 void QueueProgram(const shared_program& program);
-void RunZones(const std::list<zone_detail>& list_detail);
-void StopAllZones();
+void CheckDependencies();
+void PlanTonight(std::time_t now);
+void RequestManualRun(int program_id);
+void RequestStop();
+void EndRuns(RUN_REASON reason);
+bool StartZone(program_run& run);
+void StopZone(program_run& run, RUN_REASON reason);
+void RecordRun(const run_record& record);
+void Dispatch(std::time_t now);
+void PublishState(std::time_t now);
+void PublishStatus(const scheduler_state& state);
+bool StopAllZones();
+void RelayFault(const shared_zone& zone, bool on);
+std::vector<int> ActiveZones();
+void FaultZone(int zone_id, double rate);
+void FaultSite(int sensor_id, double rate);
 bool MainLoop();
+int HistoryReport(int argc, char* argv[]);
 
 #endif /* MAIN_HPP */
 
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * File:   modbus.hpp
+ * Author: Aaron
+ *
+ * Created on October 19, 2026, 11:30 PM
+ */
+
+#ifndef MODBUS_HPP
+#define MODBUS_HPP
+
+#include "torture.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// one serial line, a MODBUS: entry
+struct modbus_options {
+    modbus_options() : baud(19200), parity("even"), timeout_ms(100),
+    retries(2) {
+    }
+    std::string device; // eg: /dev/ttyUSB0
+    int baud;
+    std::string parity; // even, odd or none, none sends two stop bits
+    int timeout_ms; // for a whole response
+    int retries; // sends of a request after the first
+};
+
+// a zone's relay on a board, bus 0 for a gpio zone
+struct modbus_coil {
+    modbus_coil() : bus(0), slave(0), coil(0) {
+    }
+    int bus; // MODBUS: id
+    int slave; // address, 1 to 247
+    int coil; // 0 based
+};
+
+struct modbus_stats {
+    modbus_stats() : transitions(0), requests(0), attempts(0), timeouts(0),
+    bad_frames(0), exceptions(0), failed(0) {
+    }
+    std::uint64_t transitions; // coil changes asked for, forced ones too
+    std::uint64_t requests; // frames they were coalesced into
+    std::uint64_t attempts; // sends, retries included
+    std::uint64_t timeouts;
+    std::uint64_t bad_frames; // CRC or echo not matching the request
+    std::uint64_t exceptions; // the board refused, not retried
+    std::uint64_t failed; // requests not confirmed
+};
+
+struct modbus_result {
+    bool confirmed;
+    int attempts;
+};
+
+/*! @brief A Modbus RTU master driving relay coils on one serial line.
+ *
+ * Transitions are queued for the bus thread. Whatever is queued while the
+ * line is busy goes out together: changes to one board are coalesced into
+ * a Write Multiple Coils request, coils in between that the bus knows are
+ * resent as they are, and the boards are written back to back. A board's
+ * response confirms its request, a timeout or a bad frame is retried.
+ * RTU allows one request on the line at a time, separate lines run on
+ * threads of their own.
+ */
+class ModbusBus {
+public:
+    ModbusBus();
+    ~ModbusBus();
+    ModbusBus(const ModbusBus&) = delete;
+    ModbusBus& operator=(const ModbusBus&) = delete;
+
+    bool Open(const modbus_options& options); // false if the line is not
+    void Close(); // waits for the queued requests
+    bool IsOpen() const;
+    const std::string& Device() const;
+
+    // a coil of the bus, off is the state ForceOff() leaves it in
+    void Register(int slave, int coil, bool off = false);
+    std::future<modbus_result> Submit(int slave, int coil, bool on);
+    modbus_result Write(int slave, int coil, bool on); // Submit() and wait
+    bool Coil(int slave, int coil) const; // as last confirmed
+    // every registered coil off, safe in a signal handler
+    void ForceOff();
+
+    modbus_stats Stats() const;
+    // round trips of confirmed requests, read once the bus is closed
+    const LatencyHistogram& Latency() const;
+private:
+    struct request {
+        int slave;
+        int coil;
+        bool on;
+        std::promise<modbus_result> done;
+    };
+    void Run();
+    // sends frame until a response of response bytes confirms it
+    modbus_result Transact(const std::vector<std::uint8_t>& frame,
+            size_t response);
+    void Silence(); // the 3.5 character gap between frames
+
+    modbus_options options_;
+    int fd_;
+    int wake_fd_[2]; // wakes the bus thread, written from signal handlers
+    std::atomic<bool> running_;
+    std::atomic<bool> force_off_;
+    std::thread thread_;
+    mutable std::mutex lock_;
+    std::vector<request> queue_;
+    std::map<std::pair<int, int>, bool> coils_; // known, by slave, coil
+    std::map<std::pair<int, int>, bool> off_; // registered
+    modbus_stats stats_;
+    LatencyHistogram latency_;
+    std::int64_t char_ns_; // one character on the line
+    std::int64_t last_ns_; // end of the last frame, steady clock
+};
+
+// a simulated line of boards, MODBUS: simulated
+struct modbus_sim_options {
+    modbus_sim_options() : coils(16), baud(19200), latency_us(0),
+    drop_rate(0), corrupt_rate(0) {
+    }
+    std::vector<int> slaves; // addresses that answer
+    int coils; // per board
+    int baud; // frames take as long as on a real line, 0 for no wait
+    int latency_us; // before a board answers
+    double drop_rate; // chance a request goes unanswered
+    double corrupt_rate; // chance a response has a bad CRC
+};
+
+/*! @brief Relay boards answering on a pseudo-terminal.
+ *
+ * Device() is opened as the serial line, without parity. Write Single
+ * Coil and Write Multiple Coils are answered as a board does, others with
+ * an exception.
+ */
+class ModbusSlaveSim {
+public:
+    ModbusSlaveSim();
+    ~ModbusSlaveSim();
+
+    bool Start(const modbus_sim_options& options);
+    void Stop();
+    const std::string& Device() const;
+    bool Coil(int slave, int coil) const;
+    std::uint64_t Frames() const; // requests received
+private:
+    void Run();
+    void Answer(std::vector<std::uint8_t>& frame);
+
+    modbus_sim_options options_;
+    std::string device_;
+    int master_fd_;
+    int slave_fd_; // kept open so the line stays up between users
+    int wake_fd_[2];
+    std::atomic<bool> running_;
+    std::thread thread_;
+    mutable std::mutex lock_;
+    std::map<int, std::vector<bool> > boards_;
+    std::atomic<std::uint64_t> frames_;
+};
+
+std::uint16_t ModbusCrc(const std::uint8_t* data, size_t size);
+
+// mysprinkler modbus-bench [--slaves N] [--coils N] [--rounds N] [--baud N]
+//     [--latency-us N] [--drop R] [--corrupt R]
+int ModbusBenchCommand(int argc, char* argv[]);
+
+#endif /* MODBUS_HPP */
@@ -35,10 +35,16 @@
 #ifndef PROGRAM_HPP
 #define PROGRAM_HPP
 
+#include <cstdint>
 #include <list>
 #include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
 
+#ifndef MYSPRINKLER_FIXED
 #include <yaml-cpp/yaml.h>
+#endif
 
 // holds custom details of a given zone fur use by the Program object
 struct zone_detail {
@@ -53,29 +59,113 @@ enum MODE {
     even_only, odd_only, weekdays, interval
 };
 
+// what to do with a start that could not run on time
+enum CATCH_UP {
+    catch_up_run_late, // run as soon as possible
+    catch_up_skip, // run only within a minute of the start time
+    catch_up_within // run only within catch_up_minutes of the start time
+};
+
+// how well a program keeps to its start times
+struct program_stats {
+    program_stats() : runs(0), skips(0), preemptions(0), late_total(0),
+    late_max(0) {
+    }
+    int runs;
+    int skips; // starts dropped by the catch up policy or still running
+    int preemptions; // times suspended by a higher priority run
+    std::int64_t late_total; // seconds, start time to first zone on
+    std::int64_t late_max;
+};
+
 class Program {
 public:
     Program();
     ~Program();
     const int Id(); // returns the program id
-    void LoadProgram(int id, YAML::Node node); // Loads the program from config
+#ifndef MYSPRINKLER_FIXED
+    void LoadProgram(int id, const YAML::Node& node); // Loads the program from config
+#endif
+    // Loads the program from values, eg: a compiled in table (fixed.hpp)
+    void LoadProgram(int id, int hour, int minute, MODE mode, int interval,
+            const std::vector<int>& weekdays,
+            const std::list<zone_detail>& zone_details);
     const std::time_t& StartTime(); // return the set Start Time
     void NextStartTime(); // sets the next starting time/day
+    void NextStartTime(std::time_t now); // next starting time/day after now
     std::list<zone_detail> ZoneDetail(); // returns a list of zones to run
-    bool Disabled();
+    bool Disabled() const;
     void Disabled(bool disabled);
+    int Hour() const;
+    int Minute() const;
+    // minutes added to every start, eg: to share a supply with other sites
+    int Offset() const;
+    void Offset(int minutes); // and finds the next start again
+    MODE Mode() const;
+    int Interval() const;
+    const std::vector<int>& Weekdays() const; // sorted, 0 = sunday
+    int Priority() const; // higher preempts lower, default 0
+    CATCH_UP CatchUp() const;
+    int CatchUpMinutes() const;
+    /*! @brief Applies the catch up policy to a start.
+     *
+     * @param [in] due the start time
+     * @param [in] now when the program could start
+     *
+     * @return true if the program may still start
+     */
+    bool MayStart(std::time_t due, std::time_t now) const;
+    void RecordStart(std::time_t due, std::time_t started);
+    void RecordSkip();
+    void RecordPreempted();
+    const program_stats& Stats() const;
+    // configuration mistakes found by LoadProgram, eg: an unknown mode
+    const std::vector<std::string>& Problems() const;
+    /*! @brief Programs this one starts after.
+     *
+     * A run waits while any of them is due, waiting or running, so programs
+     * due together run in dependency order. See PlanNight().
+     */
+    const std::vector<int>& After() const;
+    // programs this one never runs alongside, either way round
+    const std::vector<int>& NotWith() const;
+    void ClearDependencies(); // eg: they form a cycle
+    /*! @brief The start window, minutes of the day, -1 without one.
+     *
+     * The program may start from WindowFrom() on as long as it finishes by
+     * WindowUntil(), which may be past midnight. Without an hour it starts
+     * at WindowFrom() unless a tariff plan moves it, see PlanTariff().
+     */
+    int WindowFrom() const;
+    int WindowUntil() const;
 private:
-    void LoadWeekdays(YAML::Node weekdays);
+#ifndef MYSPRINKLER_FIXED
+    void LoadWeekdays(const YAML::Node& weekdays);
     void SetMode(std::string mode); // set the mode of the program
-    void SetDay(std::tm & tm); // helper to set the next runtime (day))
+    void SetCatchUp(std::string catch_up);
+    void LoadIds(const YAML::Node& node, std::vector<int>& ids); // one or a list
+    void LoadWindow(const YAML::Node& node); // {from: "HH:MM", until: "HH:MM"}
+#endif
+    std::int64_t SetDay(std::int64_t day); // helper to set the next runtime (day))
+    std::time_t LocalStart(std::int64_t day); // hour_:minute_ local on day
     int id_; // Program ID, user defined.
     int hour_; // hour which to start the program
     int minute_; // minutes after the hour to start the program
+    int offset_; // minutes, see mysprinkler supply
     MODE mode_; // watering mode - even_only, odd_only, interval or weekdays
     int interval_; // number of days between watering
     bool rain_delay_; // are we delaying this program when it rains
     std::vector<int> weekdays_; // list of weekdays the program will run
     bool disabled_;
+    int priority_;
+    CATCH_UP catch_up_;
+    int catch_up_minutes_;
+    program_stats stats_;
+    std::vector<std::string> problems_;
+    std::vector<int> after_;
+    std::vector<int> not_with_;
+    int window_from_;
+    int window_until_;
     // TODO replace std::list<zone_detail> with a map
     std::list<zone_detail> zone_details_; // list of zones used in this program
     std::time_t next_runtime_;
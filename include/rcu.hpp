@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * File:   rcu.hpp
+ * Author: Aaron
+ *
+ * Created on October 19, 2026, 7:20 PM
+ */
+
+#ifndef RCU_HPP
+#define RCU_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*! @brief The latest of a series of immutable snapshots, read without locks.
+ *
+ * One writer at a time publishes a new snapshot, which replaces the current
+ * one with a single pointer swap. Readers pin the current snapshot with a
+ * hazard slot and read it in place, they never take a lock, never wait on
+ * the writer and always see one whole snapshot. The writer never waits on
+ * readers either: a replaced snapshot still pinned is kept on a retired
+ * list and freed by a later Publish() once no slot holds it.
+ *
+ * Snapshots are reference counted, View::Share() keeps one past the view.
+ * At most kSlots views may be held at once, a reader past that spins until
+ * a view is released.
+ */
+template <typename T>
+class Snapshots {
+    struct node {
+        std::shared_ptr<const T> value;
+        std::uint64_t version;
+    };
+
+    // padded to a cache line, readers of different slots do not contend
+    struct slot {
+        std::atomic<const node*> pinned;
+        char padding[64 - sizeof (std::atomic<const node*>)];
+    };
+public:
+    static const int kSlots = 64;
+
+    // a pinned snapshot, empty if nothing was published yet
+    class View {
+    public:
+        View() : slot_(nullptr), node_(nullptr) {
+        }
+
+        View(View&& other) : slot_(other.slot_), node_(other.node_) {
+            other.slot_ = nullptr;
+            other.node_ = nullptr;
+        }
+
+        View& operator=(View&& other) {
+            std::swap(slot_, other.slot_);
+            std::swap(node_, other.node_);
+            return *this;
+        }
+
+        ~View() {
+            if (slot_ != nullptr) slot_->store(nullptr);
+        }
+
+        explicit operator bool() const {
+            return node_ != nullptr;
+        }
+
+        const T& operator*() const {
+            return *node_->value;
+        }
+
+        const T* operator->() const {
+            return node_->value.get();
+        }
+
+        std::uint64_t Version() const {
+            return node_ ? node_->version : 0;
+        }
+
+        std::shared_ptr<const T> Share() const {
+            return node_ ? node_->value : std::shared_ptr<const T>();
+        }
+    private:
+        friend class Snapshots;
+
+        View(std::atomic<const node*>* slot, const node* pinned) :
+        slot_(slot), node_(pinned) {
+        }
+
+        std::atomic<const node*>* slot_;
+        const node* node_;
+    };
+
+    Snapshots() : current_(nullptr), version_(0) {
+        for (auto& s : slots_) {
+            s.pinned.store(nullptr);
+        }
+    }
+
+    ~Snapshots() {
+        Reclaim(true);
+        delete current_.load();
+    }
+
+    Snapshots(const Snapshots&) = delete;
+    Snapshots& operator=(const Snapshots&) = delete;
+
+    void Publish(std::shared_ptr<const T> snapshot) {
+        node* next = new node{std::move(snapshot), ++version_};
+        node* previous = current_.exchange(next);
+        if (previous != nullptr) retired_.push_back(previous);
+        Reclaim(false);
+    }
+
+    View Read() const {
+        const node* current = current_.load();
+        if (current == nullptr) return View();
+        // slots are tried from a different place on each thread
+        thread_local unsigned hint = static_cast<unsigned> (
+                std::hash<std::thread::id>()(std::this_thread::get_id()));
+        for (unsigned i = hint;; i++) {
+            std::atomic<const node*>& pinned = slots_[i % kSlots].pinned;
+            const node* empty = nullptr;
+            if (pinned.load(std::memory_order_relaxed) != nullptr ||
+                    !pinned.compare_exchange_strong(empty, current)) {
+                if (i - hint >= kSlots) std::this_thread::yield();
+                continue;
+            }
+            // pinned only counts if the snapshot was still current after
+            for (const node* check; (check = current_.load()) != current;) {
+                current = check;
+                pinned.store(current);
+            }
+            hint = i;
+            return View(&pinned, current);
+        }
+    }
+
+    std::uint64_t Version() const {
+        const node* current = current_.load();
+        return current ? current->version : 0;
+    }
+
+    size_t Retired() const { // waiting on readers, writer only
+        return retired_.size();
+    }
+private:
+    void Reclaim(bool all) {
+        for (auto it = retired_.begin(); it != retired_.end();) {
+            bool pinned = false;
+            for (const auto& s : slots_) {
+                if (s.pinned.load() == *it) {
+                    pinned = true;
+                    break;
+                }
+            }
+            if (pinned && !all) {
+                ++it;
+            } else {
+                delete *it;
+                it = retired_.erase(it);
+            }
+        }
+    }
+
+    std::atomic<node*> current_;
+    mutable slot slots_[kSlots];
+    std::uint64_t version_; // writer only
+    std::vector<node*> retired_; // writer only
+};
+
+template <typename T>
+const int Snapshots<T>::kSlots;
+
+#endif /* RCU_HPP */
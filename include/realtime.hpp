@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * File:   realtime.hpp
+ * Author: Aaron
+ *
+ * Created on October 19, 2026, 7:05 PM
+ */
+
+#ifndef REALTIME_HPP
+#define REALTIME_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// the realtime: node of the configuration
+struct realtime_options {
+    realtime_options() : enabled(false), priority(50), cpu(-1),
+    lock_memory(true), heap_bytes(4 << 20), stack_bytes(256 << 10) {
+    }
+    bool enabled;
+    int priority; // SCHED_FIFO, 1 to 99
+    int cpu; // the valve thread is pinned here, -1 for any
+    bool lock_memory;
+    size_t heap_bytes; // prefaulted and kept by malloc
+    size_t stack_bytes; // prefaulted on the valve thread
+};
+
+/*! @brief Locks the process in memory.
+ *
+ * mlockall() current and future pages, stops malloc from giving memory
+ * back or using mmap, then touches heap_bytes of heap so the first
+ * allocations after start do not fault.
+ *
+ * @return an error message, empty on success
+ */
+std::string LockMemory(size_t heap_bytes);
+// touches bytes of the calling thread's stack
+void PrefaultStack(size_t bytes);
+/*! @brief Moves the calling thread to SCHED_FIFO at priority.
+ *
+ * Pins it to cpu too, unless cpu is negative.
+ *
+ * @return an error message, empty on success
+ */
+std::string MakeRealtime(int priority, int cpu);
+
+/*! @brief Runs work posted by a real-time thread on a normal one.
+ *
+ * Post() only queues, so the poster never waits on a disk. Past 1024
+ * queued items work is dropped. Stop() runs what is queued.
+ */
+class WorkQueue {
+public:
+    WorkQueue();
+    ~WorkQueue();
+
+    void Start();
+    void Stop();
+    bool Running() const;
+    bool Post(std::function<void()> work); // false if dropped
+private:
+    void Run();
+
+    mutable std::mutex lock_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()> > queue_;
+    std::thread thread_;
+    bool running_;
+};
+
+#endif /* REALTIME_HPP */
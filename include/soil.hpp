@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * File:   soil.hpp
+ * Author: Aaron
+ *
+ * Created on October 19, 2026, 9:30 PM
+ */
+
+#ifndef SOIL_HPP
+#define SOIL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <yaml-cpp/yaml.h>
+
+// the last capacity values pushed, oldest first
+template<typename T>
+class SampleRing {
+public:
+    explicit SampleRing(size_t capacity) : values_(capacity), next_(0),
+    size_(0) {
+    }
+    void Push(const T& value) {
+        values_[next_] = value;
+        next_ = (next_ + 1) % values_.size();
+        if (size_ < values_.size()) size_++;
+    }
+    size_t Size() const {
+        return size_;
+    }
+    const T& operator[](size_t i) const {
+        return values_[(next_ + values_.size() - size_ + i) % values_.size()];
+    }
+private:
+    std::vector<T> values_;
+    size_t next_;
+    size_t size_;
+};
+
+// moisture over one minute or hour
+struct soil_bucket {
+    std::time_t start;
+    float mean; // percent
+    float min;
+    float max;
+};
+
+// downsamples samples into buckets of period seconds
+struct soil_history {
+    soil_history(int period, size_t buckets) : period(period), ring(buckets),
+    count(0) {
+    }
+    void Add(std::time_t t, double moisture);
+
+    int period;
+    SampleRing<soil_bucket> ring;
+    soil_bucket open; // the bucket being filled
+    int count; // samples in open
+};
+
+enum SOIL_STATE {
+    soil_unknown, soil_dry, soil_wet
+};
+
+// one moisture probe on an ADC channel
+struct soil_sensor {
+    soil_sensor() : samples(600), minutes(60, 24 * 60), hours(3600, 14 * 24),
+    state(soil_unknown), moisture(0), raw(0) {
+    }
+    int id;
+    int channel; // read from in_voltage<channel>_raw
+    std::vector<int> zones; // zones it measures
+    int dry_raw; // reading in dry soil, or air
+    int wet_raw; // reading in saturated soil, or water
+    double low; // percent, at or below turns dry
+    double high; // percent, at or above turns wet
+    int average; // samples averaged before comparing
+    int program; // started when the sensor turns dry, 0 for none
+    bool simulate; // the channel file is written by the simulator
+    double simulated_raw;
+    double simulated_dry_per_minute; // raw drift with its zones off
+    double simulated_wet_per_minute; // raw drift with one of its zones on
+
+    int fd;
+    int failures; // consecutive failed reads
+    SampleRing<int> samples; // raw, sampling thread only
+    soil_history minutes; // under SoilMonitor's history lock
+    soil_history hours;
+    std::atomic<int> state; // SOIL_STATE
+    std::atomic<double> moisture; // percent, averaged
+    std::atomic<int> raw; // last read
+};
+
+/*! @brief Samples soil moisture probes on an ADC.
+ *
+ * A sampling thread reads every channel each sample period through file
+ * descriptors held open, one pread per channel, keeps the raw samples and
+ * a per minute and per hour history. Moisture is the average of the last
+ * samples scaled between dry_raw and wet_raw. A sensor turns dry at or
+ * below low and wet again at or above high, so readings near a threshold
+ * do not flip it. Turning dry can start a program.
+ *
+ * Channels are read as the Linux IIO sysfs interface lays them out,
+ * directory/in_voltage<N>_raw. With simulated sensors the monitor creates
+ * these files under directory and writes them itself.
+ */
+class SoilMonitor {
+public:
+    using active_zones_fn = std::function<std::vector<int>()>;
+    using start_program_fn = std::function<void(int program_id)>;
+
+    SoilMonitor();
+    ~SoilMonitor();
+
+    void LoadSensors(const YAML::Node yNodes, const std::string& directory,
+            int sample_ms);
+    bool Empty() const;
+    bool Start(active_zones_fn active_zones, start_program_fn start_program);
+    void Stop();
+
+    /*! @brief Whether a zone's soil needs no water.
+     *
+     * Lock free, for the scheduler thread.
+     *
+     * @return true if the zone has sensors and every one reads wet
+     */
+    bool Wet(int zone_id) const;
+    // ids of the sensors, in configuration order
+    std::vector<int> Sensors() const;
+    double Moisture(int sensor_id) const;
+    SOIL_STATE State(int sensor_id) const;
+    int Raw(int sensor_id) const;
+    // closed buckets, oldest first, period 60 or 3600
+    std::vector<soil_bucket> History(int sensor_id, int period) const;
+private:
+    bool OpenChannel(soil_sensor& sensor);
+    void Run(); // sampling thread
+    void Simulate(double minutes, const std::vector<int>& active);
+    void Sample(soil_sensor& sensor, std::time_t now);
+    const soil_sensor* Find(int sensor_id) const;
+
+    std::vector<std::unique_ptr<soil_sensor> > sensors_;
+    std::string directory_;
+    int sample_ms_;
+    std::atomic<bool> running_;
+    std::mutex lock_;
+    std::condition_variable cv_;
+    mutable std::mutex history_lock_;
+    std::thread thread_;
+    active_zones_fn active_zones_;
+    start_program_fn start_program_;
+};
+
+// mysprinkler soil <config> [seconds]
+int SoilCommand(int argc, char* argv[]);
+
+#endif /* SOIL_HPP */
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * File:   state.hpp
+ * Author: Aaron
+ *
+ * Created on October 19, 2026, 7:25 PM
+ */
+
+#ifndef STATE_HPP
+#define STATE_HPP
+
+#include "rcu.hpp"
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+struct state_zone {
+    int id;
+    std::string name;
+    bool enabled;
+    bool commanded; // relay switched on by the scheduler
+    bool faulted;
+    int remaining; // seconds left watering, 0 when off
+};
+
+// a program run started, preempted or soaking
+struct state_run {
+    int program_id;
+    int priority;
+    bool manual;
+    std::time_t due;
+    int zone_id; // watering or next, -1 when none are left
+    bool watering;
+    bool soaking;
+    int zones_left; // cycles, the current one included
+};
+
+struct state_program {
+    int id;
+    int priority;
+    std::time_t start; // UTC seconds
+};
+
+/*! @brief The scheduler as of the end of one pass of its loop.
+ *
+ * Published to a Snapshots<scheduler_state> by the scheduler thread, any
+ * thread may read it. A new snapshot, and so a new version, is published
+ * only when something besides at and loops changed.
+ */
+struct scheduler_state {
+    std::time_t at;
+    std::uint64_t loops; // scheduler wake ups since start
+    std::vector<state_zone> zones;
+    std::vector<state_run> runs; // the running program last
+    std::vector<state_program> pending; // due, waiting their turn
+    std::vector<state_program> programs; // by next start
+
+    const state_run* Current() const; // nullptr when idle
+    std::vector<int> ActiveZones() const; // commanded on
+    // the same zones, runs, pending and programs, at and loops aside
+    bool SameAs(const scheduler_state& other) const;
+};
+
+bool operator==(const state_zone& left, const state_zone& right);
+bool operator==(const state_run& left, const state_run& right);
+bool operator==(const state_program& left, const state_program& right);
+
+// mysprinkler snapshot-bench [readers] [seconds] [publish_us]
+int SnapshotBenchCommand(int argc, char* argv[]);
+
+#endif /* STATE_HPP */
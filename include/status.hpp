@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * File:   status.hpp
+ * Author: Aaron
+ *
+ * Created on October 19, 2026, 2:30 PM
+ *
+ * Layout of the live status page the daemon publishes in POSIX shared
+ * memory. This header has no dependencies outside the standard library so
+ * monitoring tools can include it on its own, see StatusReader.
+ */
+
+#ifndef STATUS_HPP
+#define STATUS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MYSPRINKLER_STATUS_PAGE "/mysprinkler-status"
+
+#if ATOMIC_INT_LOCK_FREE != 2
+#error "the status page sequence must be lock free to be shared between processes"
+#endif
+
+const std::uint32_t status_magic = 0x4d595350; // "MYSP"
+const std::uint32_t status_version = 1;
+const int status_max_zones = 32;
+const int status_max_queued = 8;
+
+// one zone as last published
+struct status_zone {
+    std::int32_t id;
+    std::uint8_t enabled;
+    std::uint8_t commanded; // relay switched on by the scheduler
+    std::uint8_t faulted;
+    std::uint8_t reserved;
+    std::int32_t remaining; // seconds left watering, 0 when off
+    char name[36]; // truncated, always terminated
+};
+
+// a program waiting on its start time, or due and waiting its turn
+struct status_program {
+    std::int32_t id;
+    std::int32_t priority;
+    std::int64_t start; // UTC seconds
+};
+
+// everything a reader gets in one consistent snapshot
+struct status_snapshot {
+    std::int32_t pid;
+    std::int32_t reserved;
+    std::int64_t started; // UTC seconds the daemon started
+    std::int64_t heartbeat; // UTC seconds of the last publish
+    std::uint64_t heartbeats; // publishes since start
+    std::uint64_t loops; // scheduler wake ups since start
+
+    std::int32_t program_id; // running program, -1 when idle
+    std::int32_t program_priority;
+    std::uint8_t program_manual;
+    std::uint8_t reserved2[3];
+    std::int32_t suspended; // runs preempted by the running program
+    std::int64_t program_due; // UTC seconds the running program was due
+
+    std::int32_t zone_count;
+    std::int32_t queued_count;
+    status_zone zones[status_max_zones];
+    status_program queued[status_max_queued]; // soonest first
+};
+
+/*! @brief The shared memory object, written by one process at a time.
+ *
+ * The sequence is odd while the writer updates the snapshot. Readers copy
+ * the snapshot and retry if the sequence was odd or moved meanwhile, so a
+ * read never blocks or slows the writer and takes no system calls.
+ */
+struct status_page {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint32_t size; // sizeof(status_page) of the writer
+    std::atomic<std::uint32_t> sequence;
+    status_snapshot snapshot;
+};
+
+/*! @brief Maps a status page read only and takes snapshots of it.
+ */
+class StatusReader {
+public:
+
+    StatusReader() : page_(nullptr) {
+    }
+
+    ~StatusReader() {
+        Close();
+    }
+
+    bool Open(const char* name = MYSPRINKLER_STATUS_PAGE) {
+        Close();
+        int fd = shm_open(name, O_RDONLY, 0);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof (status_page)) {
+            close(fd);
+            return false;
+        }
+        void* map = mmap(nullptr, sizeof (status_page), PROT_READ, MAP_SHARED,
+                fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) return false;
+        page_ = static_cast<const status_page*> (map);
+        if (page_->magic != status_magic || page_->version != status_version ||
+                page_->size != sizeof (status_page)) {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void Close() {
+        if (page_ != nullptr) {
+            munmap(const_cast<status_page*> (page_), sizeof (status_page));
+            page_ = nullptr;
+        }
+    }
+
+    /*! @brief Copies a consistent snapshot.
+     *
+     * @param [out] snapshot
+     * @param [in] tries attempts before giving up on a busy writer
+     *
+     * @return false if no consistent copy was taken
+     */
+    bool Snapshot(status_snapshot& snapshot, int tries = 1000) const {
+        if (page_ == nullptr) return false;
+        while (tries-- > 0) {
+            std::uint32_t before = page_->sequence.load(
+                    std::memory_order_acquire);
+            if (before & 1) continue; // writer is mid update
+            std::memcpy(&snapshot, &page_->snapshot, sizeof (snapshot));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (page_->sequence.load(std::memory_order_relaxed) == before)
+                return true;
+        }
+        return false;
+    }
+private:
+    const status_page* page_;
+};
+
+/*! @brief Creates and updates the status page, daemon side.
+ */
+class StatusWriter {
+public:
+    StatusWriter();
+    ~StatusWriter();
+
+    bool Open(const char* name);
+    bool IsOpen() const;
+    void Close(); // unlinks the page
+    void Publish(const status_snapshot& snapshot);
+private:
+    status_page* page_;
+    char name_[64];
+};
+
+// mysprinkler status [page name]
+int StatusCommand(int argc, char* argv[]);
+
+#endif /* STATUS_HPP */
@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * File:   supervisor.hpp
+ * Author: Aaron
+ *
+ * Created on October 19, 2026, 10:40 PM
+ */
+
+#ifndef SUPERVISOR_HPP
+#define SUPERVISOR_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <pthread.h>
+
+// the supervisor: node of the configuration
+struct supervisor_options {
+    supervisor_options() : budget_ms(5000), period_ms(1000),
+    watchdog_timeout(0), dump_directory("/tmp") {
+    }
+    int budget_ms; // a heartbeat busy this long is a stall
+    int period_ms; // how often heartbeats are checked and the watchdog petted
+    std::string watchdog; // eg: /dev/watchdog, empty for none
+    int watchdog_timeout; // seconds, 0 keeps the driver's
+    std::string dump_directory;
+};
+
+// a relay the supervisor switches off without going through its Zone
+struct supervisor_relay {
+    int pin;
+    bool invert_logic;
+};
+
+struct supervisor_stats {
+    std::uint64_t checks;
+    std::uint64_t pets; // of the watchdog
+    std::uint64_t stalls;
+    std::int64_t longest_ns; // a heartbeat was busy, stalled or not
+};
+
+/*! @brief A path of the daemon the supervisor watches, eg: a scheduler pass.
+ *
+ * The path calls Busy() when it starts work that should finish quickly
+ * and Idle() when it is done or about to wait. Lock free, any thread.
+ */
+class Heartbeat {
+public:
+    explicit Heartbeat(const char* name); // a string literal
+    Heartbeat(const Heartbeat&) = delete;
+    Heartbeat& operator=(const Heartbeat&) = delete;
+
+    void Busy(std::int64_t arg = 0); // arg goes in a dump, eg: a zone id
+    void Idle();
+    const char* Name() const;
+    std::int64_t BusyFor(std::int64_t now) const; // nanoseconds, 0 if idle
+    std::int64_t Arg() const;
+    pthread_t Thread() const; // that last called Busy()
+    std::uint64_t Beats() const;
+private:
+    const char* name_;
+    std::atomic<std::int64_t> since_; // steady clock ns, 0 while idle
+    std::atomic<std::int64_t> arg_;
+    std::atomic<pthread_t> thread_;
+    std::atomic<std::uint64_t> beats_;
+};
+
+/*! @brief Watches heartbeats and pets a hardware watchdog while they beat.
+ *
+ * A thread checks every heartbeat each period. While none has been busy
+ * longer than the budget it pets the watchdog. On the first stall it
+ * switches every relay off by writing its sysfs value file afresh, so a
+ * thread wedged on a relay or a lock does not hold it up, and runs the
+ * relays_off hooks for relays elsewhere, eg: Modbus coils. It then writes
+ * a dump: the heartbeats, the stalled thread's stack, the scheduler state
+ * and a trace snapshot. After that it stops petting for good and calls
+ * stalled. The watchdog resets the board unless the daemon is restarted
+ * in time; Stop() only disarms it with the magic close if nothing stalled.
+ */
+class Supervisor {
+public:
+    using state_fn = std::function<std::string()>;
+    // the heartbeat, how long it was busy in nanoseconds and the dump
+    using stalled_fn = std::function<void(const Heartbeat&, std::int64_t,
+            const std::string&)>;
+    // turns relays off without locking or logging, see ModbusBus::ForceOff()
+    using relays_off_fn = std::function<void()>;
+
+    Supervisor();
+    ~Supervisor();
+
+    void Watch(Heartbeat& heartbeat); // before Start()
+    void AddRelaysOff(relays_off_fn off); // before Start(), run with the gpios
+    /*! @brief Opens the watchdog and starts the thread.
+     *
+     * @param [in] state the scheduler state for a dump, eg: JSON
+     * @param [in] stalled called once from the supervisor thread after the
+     *             relays are off and the dump written, may block
+     *
+     * @return false if the watchdog could not be opened, the heartbeats are
+     *         watched regardless
+     */
+    bool Start(const supervisor_options& options,
+            const std::vector<supervisor_relay>& relays, state_fn state,
+            stalled_fn stalled);
+    void Stop();
+    bool Running() const;
+    bool Stalled() const;
+    supervisor_stats Stats() const;
+private:
+    void Run();
+    void Stall(const Heartbeat& heartbeat, std::int64_t busy);
+    void RelaysOff(); // open, write and close each value file
+    std::string Dump(const Heartbeat& stalled, std::int64_t busy);
+
+    supervisor_options options_;
+    // value file and what turns it off, built before anything can stall
+    std::vector<std::pair<std::string, const char*> > relays_;
+    std::vector<relays_off_fn> relays_off_;
+    std::vector<Heartbeat*> heartbeats_;
+    state_fn state_;
+    stalled_fn stalled_fn_;
+    int watchdog_fd_;
+    std::atomic<bool> running_;
+    std::atomic<bool> stalled_;
+    std::atomic<std::uint64_t> checks_;
+    std::atomic<std::uint64_t> pets_;
+    std::atomic<std::uint64_t> stalls_;
+    std::atomic<std::int64_t> longest_ns_;
+    int wake_fd_[2]; // ends the wait on Stop()
+    std::thread thread_;
+};
+
+#endif /* SUPERVISOR_HPP */
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * File:   supply.hpp
+ * Author: Aaron
+ *
+ * Created on October 19, 2026, 9:50 PM
+ *
+ * Staggers the programs of several sites on one supply line, see
+ * mysprinkler supply.
+ */
+
+#ifndef SUPPLY_HPP
+#define SUPPLY_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+// a program of one site as the shared supply sees it, times in minutes
+struct supply_program {
+    size_t site; // index of the site's config
+    int id;
+    int start; // after noon, as configured, so a night sorts in order
+    std::vector<double> flow; // per minute of the run, units per minute
+    std::vector<int> after; // programs of the same site
+};
+
+struct supply_plan {
+    std::vector<int> offsets; // minutes added to each program's start
+    int window; // from the first start on to the last zone off
+    double peak; // the most drawn in any minute
+    int over; // minutes drawing more than the capacity
+};
+
+/*! @brief Staggers programs under a shared flow capacity.
+ *
+ * Every program is taken to run the same night, so the plan holds on any
+ * night. A site runs one program at a time and after dependencies are
+ * kept. Programs are placed one by one at the earliest start, no earlier
+ * than configured, where the site is free and the supply has room for
+ * every minute of their flow; configured start, largest volume and highest
+ * flow first are tried and the shortest window kept. A program that alone
+ * draws more than the capacity runs with nothing else.
+ */
+supply_plan PlanSupply(const std::vector<supply_program>& programs,
+        double capacity);
+// as configured, each site still one program at a time
+supply_plan Unstaggered(const std::vector<supply_program>& programs,
+        double capacity);
+// no plan can have a shorter window
+int SupplyLowerBound(const std::vector<supply_program>& programs,
+        double capacity);
+
+/*! @brief Reads the offsets a site applies, eg: written by mysprinkler supply.
+ *
+ * @param [in] path a yaml file with PROGRAMS: {id: minutes}
+ * @param [out] offsets by program id
+ * @param [out] error what went wrong
+ *
+ * @return false if it could not be read
+ */
+bool LoadOffsets(const std::string& path, std::map<int, int>& offsets,
+        std::string& error);
+
+// mysprinkler supply --capacity F [--out DIR] [--plan] <config or directory>...
+int SupplyCommand(int argc, char* argv[]);
+
+#endif /* SUPPLY_HPP */
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * File:   tariff.hpp
+ * Author: Aaron
+ *
+ * Created on October 19, 2026, 11:05 PM
+ */
+
+#ifndef TARIFF_HPP
+#define TARIFF_HPP
+
+#include "program.hpp"
+
+#include <ctime>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <yaml-cpp/yaml.h>
+
+// time of use prices, the tariff: node
+struct tariff_table {
+    tariff_table() : pump_kw(1) {
+    }
+    // minute of the day a price starts and its price per kWh, by minute
+    std::vector<std::pair<int, double> > rates;
+    double pump_kw; // drawn while a zone waters
+    std::map<int, double> zone_kw; // zones that draw otherwise
+
+    double Price(int minute) const; // minute of the day, local
+    double Kw(int zone_id) const;
+};
+
+// a zone as the tariff plan sees it
+struct tou_zone {
+    bool enabled;
+    int max_cycle; // minutes, see Zone::Cycle()
+    int min_soak;
+    double kw;
+};
+
+// a program due in a night, minutes after the noon it starts from
+struct tou_program {
+    int id;
+    int start; // as configured
+    bool window; // may move, see Program::WindowFrom()
+    int from; // earliest start, the configured one without a window
+    int until; // latest finish with a window
+    std::vector<double> kw; // per minute of the run
+    std::vector<int> after;
+};
+
+struct tou_plan {
+    std::vector<int> starts; // by program, minutes after noon
+    double cost;
+    bool feasible; // every window kept
+};
+
+/*! @brief Reads the tariff: node and the zones' pump_kw.
+ *
+ * @return false without a tariff: node or with a mistake in it, error
+ *         then says which
+ */
+bool LoadTariff(const YAML::Node& yConfig, tariff_table& tariff,
+        std::string& error);
+
+/*! @brief The programs starting from on in the night after origin.
+ *
+ * origin is a local noon, to the next. Windowed programs are taken at their
+ * configured start and their windows begin no earlier than from. The draw
+ * of each minute comes from its zones in the order PlanCycles() runs them.
+ */
+std::vector<tou_program> NightLoads(const std::vector<Program>& programs,
+        const std::map<int, tou_zone>& zones, std::time_t origin,
+        std::time_t from, std::time_t to);
+
+// programs at their configured starts, each after the one before finishes
+tou_plan FixedStarts(const std::vector<tou_program>& programs,
+        const tariff_table& tariff);
+
+/*! @brief The cheapest starts, one program at a time.
+ *
+ * Programs without a window run as FixedStarts() has them and the windowed
+ * ones fit in the minutes between. Those keep their dependency order, then
+ * by window opening or by deadline, and dynamic programming over each
+ * minute of the night finds the cheapest starts for each order. If no
+ * windows can all be kept the fixed starts are returned, not feasible.
+ */
+tou_plan PlanTariff(const std::vector<tou_program>& programs,
+        const tariff_table& tariff);
+
+// mysprinkler tariff <config> [--nights N] [--plan]
+int TariffCommand(int argc, char* argv[]);
+
+#endif /* TARIFF_HPP */
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * File:   timeline.hpp
+ * Author: Aaron
+ *
+ * Created on October 19, 2026, 4:40 PM
+ */
+
+#ifndef TIMELINE_HPP
+#define TIMELINE_HPP
+
+#include "cycles.hpp"
+#include "program.hpp"
+#include "tariff.hpp"
+#include "validate.hpp"
+
+#include <cstdint>
+#include <ctime>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+// one zone watering, [start, end) in UTC seconds
+struct timeline_slot {
+    std::time_t start;
+    std::time_t end;
+    int zone_id;
+    int program_id;
+    std::time_t due; // start time of the program run
+};
+
+// a start the scheduler would drop, still running or past its catch up
+struct timeline_skip {
+    std::time_t due;
+    int program_id;
+};
+
+/*! @brief Upcoming zone slots of every program over a rolling horizon.
+ *
+ * Program starts are expanded with Program::NextStartTime the way the
+ * scheduler steps them and replayed through the scheduler's rules: one
+ * zone at a time, priority preemption, after and not_with holds, catch up
+ * from the end of a hold and skipping a start while the program is still
+ * busy, zones in cycles as PlanCycles() interleaves them. The result is one
+ * sorted list of slots that never overlap, and a start and prefix sum
+ * index per zone.
+ *
+ * Everything is built on the first query after a change. A changed
+ * program re-expands only its own starts and the replay restarts from the
+ * last idle moment before the change, the slots before it are kept.
+ */
+class Timeline {
+public:
+    explicit Timeline(std::time_t now, int horizon_days = 14);
+
+    // zones the scheduler knows, a disabled or unknown zone is skipped,
+    // cycle settings in minutes as Zone::Cycle()
+    void Zone(int zone_id, bool enabled, int max_cycle = 0, int min_soak = 0);
+    /*! @brief Adds or replaces a program.
+     *
+     * A new or changed program starts from now, as if the daemon loaded it.
+     *
+     * @return false if the program is unchanged, nothing is invalidated
+     */
+    bool Set(const Program& program);
+    void Remove(int program_id);
+    /*! @brief Programs with a start window start where the tariff is cheapest.
+     *
+     * Each night, noon to noon, is planned with PlanTariff() as the daemon
+     * plans it at noon, the night now is in from now, the nights on as many
+     * threads as there are cores. An empty tariff starts them as configured.
+     */
+    void Tariff(const tariff_table& tariff);
+    // moves now forward, extends the horizon and drops slots before now
+    void Advance(std::time_t now);
+    std::time_t Horizon() const; // starts before this are expanded
+
+    /*! @brief The zone watering at a time.
+     *
+     * @return false if no zone waters at t
+     */
+    bool At(std::time_t t, timeline_slot& slot);
+    // slots overlapping [from, to)
+    std::vector<timeline_slot> Range(std::time_t from, std::time_t to);
+    // seconds the zone waters within [from, to)
+    std::int64_t ZoneSeconds(int zone_id, std::time_t from, std::time_t to);
+    std::map<int, std::int64_t> ZoneTotals(std::time_t from, std::time_t to);
+    std::vector<timeline_skip> Skips(std::time_t from, std::time_t to);
+
+    std::uint64_t Replayed() const; // slots replayed since construction
+private:
+    struct program_entry {
+        Program next; // StartTime() is the first start not expanded
+        std::string fingerprint;
+        std::vector<std::time_t> starts; // sorted, before horizon_
+    };
+
+    // nothing watering or waiting at, the replay can restart here
+    struct checkpoint {
+        std::time_t at;
+        size_t slots;
+        size_t skips;
+    };
+
+    struct zone_entry {
+        bool enabled;
+        int max_cycle;
+        int min_soak;
+    };
+
+    struct zone_index {
+        std::vector<std::time_t> starts;
+        std::vector<std::time_t> ends;
+        std::vector<std::int64_t> seconds; // prefix sums, one more than slots
+    };
+
+    bool Planned(const Program& program) const; // starts from the tariff
+    void Expand(program_entry& entry);
+    void PlanWindows();
+    void Invalidate(std::time_t from);
+    void Build();
+    void Replay();
+    void Trim();
+
+    std::time_t now_;
+    std::time_t horizon_;
+    int horizon_days_;
+    std::map<int, zone_entry> zones_;
+    std::map<int, program_entry> programs_;
+    tariff_table tariff_;
+    bool windows_dirty_; // the tariff plan needs redoing
+
+    std::time_t dirty_; // replay from here, max() when built
+    bool index_dirty_;
+    std::vector<timeline_slot> slots_;
+    std::vector<timeline_skip> skips_;
+    std::vector<checkpoint> idle_;
+    std::map<int, zone_index> by_zone_;
+    std::uint64_t replayed_;
+};
+
+/*! @brief Fills a timeline with a validated configuration.
+ *
+ * Only enabled programs are set, with the start offsets of the
+ * offsets_file and the tariff, and the programs whose after dependencies
+ * form a cycle lose their dependencies, as the daemon loads them.
+ *
+ * @return what the daemon would warn of, eg: an unreadable offsets_file
+ */
+std::vector<std::string> LoadTimeline(Timeline& timeline,
+        const YAML::Node& yConfig, const site_report& report);
+
+// "YYYY-MM-DD" or "YYYY-MM-DD HH:MM", local
+bool ParseLocal(const char* text, std::time_t& t);
+std::string FormatLocal(std::time_t t, const char* format); // strftime, local
+
+// mysprinkler timeline <config> [days] [at|from|to "YYYY-MM-DD HH:MM"]...
+int TimelineCommand(int argc, char* argv[]);
+
+#endif /* TIMELINE_HPP */
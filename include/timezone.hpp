@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * File:   timezone.hpp
+ * Author: Aaron
+ *
+ * Created on October 19, 2026, 9:10 AM
+ */
+
+#ifndef TIMEZONE_HPP
+#define TIMEZONE_HPP
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+/*! @brief Local time zone rules loaded once from the system zoneinfo.
+ *
+ * The TZif file (or POSIX TZ string) is parsed into a compact table of
+ * transition instants, with the footer rule expanded forward so that every
+ * lookup is a binary search. All conversions are const, thread-safe and do
+ * not allocate, unlike std::localtime/std::mktime which consult global TZ
+ * state on every call.
+ */
+class TimeZone {
+public:
+
+    // what ToUtc does with a local time skipped by a forward transition
+    enum GAP_POLICY {
+        gap_forward, // interpret with the earlier offset, eg: 02:30 -> 03:30
+        gap_backward, // interpret with the later offset, eg: 02:30 -> 01:30
+        gap_reject // fail the conversion
+    };
+
+    // what ToUtc does with a local time repeated by a backward transition
+    enum OVERLAP_POLICY {
+        overlap_earliest, // first occurrence (still daylight time)
+        overlap_latest, // second occurrence (standard time)
+        overlap_reject // fail the conversion
+    };
+
+public:
+    TimeZone(); // UTC until loaded
+
+    /*! @brief Returns the process wide local time zone.
+     *
+     * Loaded on first use from $TZ or /etc/localtime, falls back to UTC.
+     */
+    static const TimeZone& Local();
+
+    bool Load(); // load from $TZ, or /etc/localtime when unset
+    bool LoadFile(const std::string& path); // load a TZif file
+    bool LoadRule(const std::string& rule); // load a POSIX TZ string
+    const std::string& Name() const;
+
+    /*! @brief Converts a UTC instant into local wall time.
+     *
+     * Fills every std::tm field including tm_wday, tm_yday and tm_isdst.
+     */
+    std::tm ToLocal(std::time_t utc) const;
+
+    /*! @brief Converts local wall time into a UTC instant.
+     *
+     * tm_isdst is ignored, gaps and overlaps are resolved by policy.
+     * Out of range fields (eg: tm_mday 32) are normalized like mktime.
+     *
+     * @return false if the policy rejected the local time.
+     */
+    bool ToUtc(const std::tm& local, std::time_t& utc,
+            GAP_POLICY gap = gap_forward,
+            OVERLAP_POLICY overlap = overlap_earliest) const;
+
+    int Offset(std::time_t utc) const; // seconds east of UTC at utc
+
+    // civil calendar helpers, days are counted from 1970-01-01
+    static std::int64_t DaysFromCivil(std::int64_t y, int m, int d);
+    static void CivilFromDays(std::int64_t days, std::int64_t& y, int& m,
+            int& d);
+    static int Weekday(std::int64_t days); // 0 = sunday
+private:
+
+    struct zone_type {
+        std::int32_t offset; // seconds east of UTC
+        bool is_dst;
+        char abbr[8];
+    };
+
+    bool ParseTzif(const std::vector<unsigned char>& data);
+    bool ParseRule(const std::string& rule, std::int64_t from);
+    int AddType(std::int32_t offset, bool is_dst, const std::string& abbr);
+    int TypeAt(std::time_t utc) const;
+
+    std::string name_;
+    std::vector<std::int64_t> transitions_; // sorted UTC instants
+    std::vector<std::uint8_t> transition_types_; // index into types_
+    std::vector<zone_type> types_;
+    int initial_type_; // in effect before the first transition
+};
+
+// mysprinkler tz-bench [conversions] [threads]
+int TimeZoneBenchCommand(int argc, char* argv[]);
+
+#endif /* TIMEZONE_HPP */
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * File:   torture.hpp
+ * Author: Aaron
+ *
+ * Created on October 19, 2026, 5:30 PM
+ *
+ * Pieces of the dispatch torture test, mysprinkler torture. The test itself
+ * lives in main.cpp as it drives the real MainLoop.
+ */
+
+#ifndef TORTURE_HPP
+#define TORTURE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*! @brief Log-linear histogram of latencies, in the manner of HdrHistogram.
+ *
+ * Values below 128 ns are exact, above that each power of two is split in
+ * 64 buckets, so a percentile is within 1.6% of the recorded value. One
+ * thread records, Count() may be read from any.
+ */
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void Record(std::chrono::nanoseconds latency); // negative counts as 0
+    std::uint64_t Count() const;
+    std::int64_t Percentile(double percent) const; // nanoseconds
+    std::int64_t Max() const;
+    // eg: "start  1000  p50 12.1 us  p99 ...", values in microseconds
+    std::string Summary(const char* name) const;
+private:
+    static size_t Index(std::uint64_t value);
+    static std::int64_t Highest(size_t index); // largest value of a bucket
+
+    std::vector<std::uint64_t> counts_;
+    std::atomic<std::uint64_t> count_;
+    std::int64_t max_;
+};
+
+/*! @brief Background load while the test runs.
+ *
+ * CPU threads spin on arithmetic, I/O threads rewrite and fsync a file of
+ * their own in the scratch directory.
+ */
+class LoadGenerator {
+public:
+    LoadGenerator();
+    ~LoadGenerator();
+
+    void Start(int cpu_threads, int io_threads, const std::string& directory);
+    void Stop(); // joins the threads and removes their files
+private:
+    std::atomic<bool> running_;
+    std::vector<std::thread> threads_;
+    std::vector<std::string> files_;
+};
+
+// what the generated configuration holds
+struct torture_options {
+    torture_options() : programs(1000), zones(8), seconds(1), timed(50),
+    cpu_threads(0), io_threads(0), latency_us(0), failure_rate(0),
+    ignore_rate(0), stuck(0), readers(0), realtime(false), realtime_cpu(-1) {
+    }
+    int programs; // all due in the same minute, one zone each
+    int zones;
+    int seconds; // how long a timed zone waters
+    int timed; // every Nth program waters for seconds, the rest for 0
+    int cpu_threads;
+    int io_threads;
+    int latency_us; // gpio_fake faults
+    double failure_rate;
+    double ignore_rate;
+    int stuck; // a zone whose relay never switches, 0 for none
+    int readers; // threads reading scheduler snapshots throughout
+    bool realtime; // the realtime: node, default priority
+    int realtime_cpu;
+    std::string mqtt; // host:port of a broker to publish events to
+};
+
+/*! @brief Writes the torture configuration.
+ *
+ * Zones are driven through a fake gpio tree under directory and every
+ * program is due at hour:minute local, once a day. Durations are meant to
+ * be read as seconds.
+ *
+ * @return false if the file could not be written
+ */
+bool WriteTortureConfig(const std::string& path, const std::string& directory,
+        const torture_options& options, int hour, int minute);
+
+#endif /* TORTURE_HPP */
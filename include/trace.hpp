@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * File:   trace.hpp
+ * Author: Aaron
+ *
+ * Created on October 19, 2026, 10:15 PM
+ *
+ * A flight recorder of spans and instants, exported as Chrome trace event
+ * JSON (chrome://tracing, ui.perfetto.dev). Compiled in only when
+ * MYSPRINKLER_TRACE is defined, as the Debug configuration does; without
+ * it the macros expand to nothing and the functions are empty.
+ */
+
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <cstdint>
+#include <string>
+
+#ifdef MYSPRINKLER_TRACE
+
+// names and categories must be string literals, only the pointer is kept
+struct trace_event {
+    const char* category;
+    const char* name;
+    std::int64_t ts; // CLOCK_MONOTONIC nanoseconds
+    std::int64_t dur; // nanoseconds, -1 for an instant
+    std::int64_t arg;
+};
+
+void TraceRecord(const trace_event& event);
+std::int64_t TraceNow();
+
+// records a complete event from construction to destruction
+class trace_span {
+public:
+    trace_span(const char* category, const char* name, std::int64_t arg = 0) :
+    event_({category, name, TraceNow(), 0, arg}) {
+    }
+    ~trace_span() {
+        event_.dur = TraceNow() - event_.ts;
+        TraceRecord(event_);
+    }
+private:
+    trace_event event_;
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+// a span to the end of the enclosing scope
+#define TRACE_SPAN(category, name, ...) \
+    trace_span TRACE_CONCAT(trace_span_, __LINE__)(category, name, \
+    ##__VA_ARGS__)
+#define TRACE_INSTANT(category, name, arg) \
+    TraceRecord({category, name, TraceNow(), -1, arg})
+#define TRACE_THREAD(name) TraceThread(name)
+
+// names the calling thread in the trace
+void TraceThread(const std::string& name);
+/*! @brief Starts the thread that writes dumps.
+ *
+ * A dump holds the last seconds of every thread's events, as far as its
+ * ring reaches, and is written to directory/mysprinkler-trace-<time>.json.
+ */
+void TraceStart(const std::string& directory, int seconds);
+void TraceStop();
+// async-signal-safe, for SIGUSR1
+void TraceRequestDump();
+// writes the last seconds now, false if path could not be written
+bool TraceDump(const std::string& path, int seconds);
+
+#else
+
+#define TRACE_SPAN(category, name, ...) do { } while (0)
+#define TRACE_INSTANT(category, name, arg) do { } while (0)
+#define TRACE_THREAD(name) do { } while (0)
+
+inline void TraceStart(const std::string&, int) {
+}
+inline void TraceStop() {
+}
+inline void TraceRequestDump() {
+}
+inline bool TraceDump(const std::string&, int) {
+    return false;
+}
+
+#endif /* MYSPRINKLER_TRACE */
+
+#endif /* TRACE_HPP */
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * File:   validate.hpp
+ * Author: Aaron
+ *
+ * Created on October 19, 2026, 3:10 PM
+ */
+
+#ifndef VALIDATE_HPP
+#define VALIDATE_HPP
+
+#include "modbus.hpp"
+#include "program.hpp"
+
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include <yaml-cpp/yaml.h>
+
+// a zone as the daemon would load it, without touching its gpio
+struct site_zone {
+    int id;
+    int gpio;
+    modbus_coil coil; // bus 0 without one
+    bool enabled;
+    bool invert_logic;
+    int max_cycle; // minutes, see Zone::Cycle()
+    int min_soak;
+    double flow_rate; // per minute, 0 if not given
+    std::string name;
+};
+
+// what one site configuration holds and what is wrong with it
+struct site_report {
+    std::string source;
+    std::vector<std::string> errors; // the daemon would misbehave
+    std::vector<std::string> warnings; // probably not what was meant
+    std::vector<site_zone> zones;
+    std::vector<Program> programs; // as loaded, disabled ones too
+};
+
+/*! @brief Checks a configuration the way the daemon loads it.
+ *
+ * Zones are read with LoadZones' defaults and programs through
+ * Program::LoadProgram, so start times are the daemon's. Flags duplicate
+ * zone and program ids, zones without a gpio, Modbus zones on a bus that
+ * is not there or sharing a coil, unknown modes, weekday
+ * programs without weekdays, zone_detail ids that are not zones and
+ * programs whose after dependencies form a cycle and a tariff that cannot be
+ * read.
+ *
+ * @return false if there are errors
+ */
+bool ValidateConfig(const YAML::Node& yConfig, site_report& report);
+
+std::string JsonString(const std::string& text); // quoted and escaped
+std::string IsoUtc(std::time_t t); // eg: 2026-10-20T03:00:00Z
+
+// a directory contributes its *.yaml and *.yml files, sorted, else path
+void AddConfigs(const std::string& path, std::vector<std::string>& files);
+
+// mysprinkler validate [--jobs N] [--runs N] <config or directory>...
+int ValidateCommand(int argc, char* argv[]);
+
+#endif /* VALIDATE_HPP */
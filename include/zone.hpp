@@ -34,16 +34,47 @@
 #ifndef ZONES_HPP
 #define ZONES_HPP
 
+#include "gpio.hpp"
+#include "modbus.hpp"
+#include "supervisor.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include <yaml-cpp/yaml.h>
-#include <BlackLib/BlackLib.h>
 #include <memory>
-using namespace BlackLib;
 
-class Zone : private virtual BlackGPIO{
+// how a relay transition is confirmed, see Zone::TurnOn()
+struct relay_policy {
+    relay_policy() : budget_us(200000), backoff_us(1000) {
+    }
+    int budget_us; // attempts stop once the next would start past this
+    int backoff_us; // wait before the second attempt, doubling after
+};
+
+// transitions of one zone's relay
+struct relay_stats {
+    relay_stats() : transitions(0), attempts(0), retried(0), failed(0),
+    confirm_total(0), confirm_max(0) {
+    }
+    std::uint64_t transitions;
+    std::uint64_t attempts; // writes
+    std::uint64_t retried; // transitions that took more than one write
+    std::uint64_t failed; // not confirmed within the budget
+    std::chrono::nanoseconds confirm_total; // of confirmed transitions
+    std::chrono::nanoseconds confirm_max;
+};
+
+class Zone {
 public:
     explicit Zone(int id, std::string name, int pin, bool enabled, bool invertLogic);
+    // a relay coil on a Modbus board instead of a gpio
+    Zone(int id, std::string name, std::shared_ptr<ModbusBus> bus,
+            const modbus_coil& coil, bool enabled, bool invertLogic);
     virtual ~Zone();
     
     void Id(int id);
@@ -103,9 +134,79 @@ public:
      * @sa InvertLogic(bool)
      */
     bool InvertLogic() const;
+
+    /*! @brief Splits long runs of this zone into cycles with soaks between.
+     *
+     * Eg: clay or a slope that cannot take a whole run at once. Programs
+     * fill the soak with other zones, see PlanCycles().
+     *
+     * @param [in] max_cycle longest single watering in minutes, 0 for no limit
+     * @param [in] min_soak shortest rest between two cycles in minutes
+     *
+     * @sa MaxCycle(), MinSoak()
+     */
+    void Cycle(int max_cycle, int min_soak);
+    int MaxCycle() const;
+    int MinSoak() const;
     
+    /*! @brief Switches the relay and confirms it by reading the line back.
+     *
+     * A failed write or a readback that does not match is retried, after
+     * reopening the line if it is closed, with a backoff doubling from
+     * Policy().backoff_us until Policy().budget_us has passed. Commanded()
+     * changes whatever the outcome. Transitions from several threads, eg:
+     * the flow monitor faulting a zone, take turns. A Modbus coil is
+     * confirmed by the board's response, the bus does the retrying.
+     *
+     * @return false if the transition was not confirmed within the budget
+     */
     bool TurnOn();
     bool TurnOff();
+    // one unverified write off, safe in a signal handler as it takes no lock,
+    // a Modbus zone switches off every coil of its bus
+    void ForceOff();
+    /*! @brief Switches several zones at once.
+     *
+     * Transitions of Modbus zones are queued together, so each board gets
+     * a single request, eg: stopping every zone of the site.
+     *
+     * @return by zone, whether its transition was confirmed
+     */
+    static std::vector<bool> Switch(
+            const std::vector<std::shared_ptr<Zone> >& zones, bool on);
+    static void Policy(const relay_policy& policy);
+    static relay_policy Policy();
+    // busy through every transition, for the Supervisor
+    static Heartbeat& Beat();
+    int Pin() const; // gpio of the relay, 0 for a Modbus coil
+    modbus_coil Coil() const; // bus 0 for a gpio relay
+    relay_stats Stats() const;
+    int LastAttempts() const; // of the last transition
+
+    /*! @brief Returns the last state requested of this zone.
+     *
+     * Unlike IsOn() this does not read the GPIO pin and is safe to call
+     * from any thread.
+     *
+     * @return true after TurnOn(), false after TurnOff()
+     */
+    bool Commanded() const;
+
+    /*! @brief Marks this zone as faulted.
+     *
+     * A faulted zone is skipped by every program until the daemon
+     * restarts. Eg: flow above its learned baseline.
+     *
+     * @sa Faulted()
+     */
+    void Faulted(bool faulted);
+    /*! @brief Is this zone faulted?
+     *
+     * @return True if zone has been taken out of service
+     *
+     * @sa Faulted(bool)
+     */
+    bool Faulted() const;
     
     /*! @brief Checks value of GPIO pin
      * 
@@ -126,11 +227,32 @@ public:
      * @sa IsOn()
      */
     const std::string Status();
+    /*! @brief Checks the last GPIO operation.
+     *
+     * @return true if the last write, read or export of the pin failed.
+     */
+    bool Fail() const;
 private:
+    SysfsGpio gpio_; /*< @brief relay output under SysfsGpio::Root()*/
     int id_; /*!< @brief identification number for this zone */
     std::string name_; /*< @brief a friendly name for this zone*/
     bool enabled_; /*< @brief zone enabled?*/
     bool invert_logic_; /*< @brief use inverted logic?*/
+    int max_cycle_; /*< @brief minutes, 0 for no limit*/
+    int min_soak_; /*< @brief minutes between cycles*/
+    std::atomic<bool> commanded_; /*< @brief last requested state*/
+    std::atomic<bool> faulted_; /*< @brief taken out of service?*/
+    mutable std::mutex command_mutex_; // one transition at a time
+    relay_stats stats_;
+    int last_attempts_;
+    std::shared_ptr<ModbusBus> bus_; /*< @brief board the relay is on, if any*/
+    modbus_coil coil_;
+    bool bus_fail_; /*< @brief last transition not confirmed by the board*/
+
+    bool Command(bool on);
+    // counts a transition, with command_mutex_ held
+    void Account(bool confirmed, int attempts,
+            std::chrono::nanoseconds took);
 
 protected:
 };
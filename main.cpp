@@ -26,7 +26,14 @@
  */
 
 #include "include/main.hpp"
+#include "include/codegen.hpp"
+#include "include/validate.hpp"
 #include "include/shutdown.hpp"
+#include "include/soil.hpp"
+#include "include/timezone.hpp"
+#include "include/timeline.hpp"
+#include "include/trace.hpp"
+#include "include/torture.hpp"
 #include <cstdlib>
 #include <iostream>
 #include <fstream>
@@ -35,37 +42,131 @@
 #include <csignal>
 #include <cstdio>
 #include <cerrno>
+#include <cstring>
+#include <limits>
+#include <thread>
 
-#include <BlackLib/BlackLib.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 void signal_callback(int signum) {
     utils::Logger::Instance().Debug("Caught signal %d", signum);
     
-    StopAllZones();
+    // the main loop may be part way through a transition, verified
+    // switching waits its turn, so only force the relays off here
+    for (const auto& zone : zones_) {
+        zone->ForceOff();
+    }
     
     StartShutdown();
     
     cv_.notify_all();
 }
 
+// SIGUSR1 writes the trace of the last trace_seconds
+void signal_trace_callback(int /*signum*/) {
+    TraceRequestDump();
+}
+
 void signal_pipe_callback(int signum) {
     utils::Logger::Instance().Info("Caught and ignored signal %d", signum);
 }
 
+void LoadBuses(const YAML::Node yNodes) {
+    TRACE_SPAN("config", "LoadBuses");
+    for (auto it = yNodes.begin(); it != yNodes.end(); ++it) {
+        int id = it->first.as<int>(0);
+        YAML::Node yBus = it->second;
+        modbus_options options;
+        options.device = yBus["device"].as<std::string>("");
+        options.baud = yBus["baud"].as<int>(options.baud);
+        options.parity = yBus["parity"].as<std::string>(options.parity);
+        options.timeout_ms = yBus["timeout_ms"].as<int>(options.timeout_ms);
+        options.retries = std::max(0, yBus["retries"].as<int>(
+                options.retries));
+
+        // boards answering on a pseudo-terminal, to run without the line
+        YAML::Node ySim = yBus["simulated"];
+        if (ySim.IsDefined() && !ySim.IsNull()) {
+            modbus_sim_options sim;
+            if (ySim["slaves"].IsSequence()) {
+                sim.slaves = ySim["slaves"].as<std::vector<int> >();
+            }
+            sim.coils = ySim["coils"].as<int>(sim.coils);
+            sim.baud = options.baud;
+            sim.latency_us = ySim["latency_us"].as<int>(0);
+            sim.drop_rate = ySim["drop_rate"].as<double>(0);
+            sim.corrupt_rate = ySim["corrupt_rate"].as<double>(0);
+            std::unique_ptr<ModbusSlaveSim> boards(new ModbusSlaveSim());
+            if (boards->Start(sim)) {
+                options.device = boards->Device();
+                options.parity = "none"; // a pty refuses parity
+                utils::Logger::Instance().Info("Modbus bus %d simulated on %s",
+                        id, options.device.c_str());
+                modbus_sims_.push_back(std::move(boards));
+            } else {
+                utils::Logger::Instance().Warning("Modbus bus %d: unable to "
+                        "simulate, %s", id, strerror(errno));
+            }
+        }
+
+        // a bus that does not open fails its zones' transitions
+        auto bus = std::make_shared<ModbusBus>();
+        if (!bus->Open(options)) {
+            utils::Logger::Instance().Warning("Modbus bus %d: unable to open "
+                    "%s, %s", id, options.device.c_str(), strerror(errno));
+        }
+        modbus_buses_[id] = bus;
+    }
+}
+
 void LoadZones(const YAML::Node yNodes) {
+    TRACE_SPAN("config", "LoadZones");
     for (auto zone = yNodes.begin(); zone != yNodes.end(); ++zone) {
         YAML::Node details;
         details = zone->second;
         
-        shared_zone this_zone = std::make_shared<Zone>(
-                zone->first.as<int>(0),
-                details["name"].as<std::string>(""),
-                details["gpio"].as<int>(0),
-                details["enabled"].as<bool>(false),
-                details["invert_logic"].as<bool>(true));
+        shared_zone this_zone;
+        YAML::Node yCoil = details["modbus"];
+        if (yCoil.IsDefined() && !yCoil.IsNull()) {
+            modbus_coil coil;
+            coil.bus = yCoil["bus"].as<int>(0);
+            coil.slave = yCoil["slave"].as<int>(0);
+            coil.coil = yCoil["coil"].as<int>(0);
+            auto bus = modbus_buses_.find(coil.bus);
+            if (bus == modbus_buses_.end()) {
+                ace::utils::Logger::Instance().Warning("Zone %d: no Modbus "
+                        "bus %d", zone->first.as<int>(0), coil.bus);
+                continue;
+            }
+            this_zone = std::make_shared<Zone>(
+                    zone->first.as<int>(0),
+                    details["name"].as<std::string>(""),
+                    bus->second, coil,
+                    details["enabled"].as<bool>(false),
+                    details["invert_logic"].as<bool>(false));
+        } else {
+            this_zone = std::make_shared<Zone>(
+                    zone->first.as<int>(0),
+                    details["name"].as<std::string>(""),
+                    details["gpio"].as<int>(0),
+                    details["enabled"].as<bool>(false),
+                    details["invert_logic"].as<bool>(true));
+        }
+        this_zone->Cycle(details["max_cycle"].as<int>(0),
+                details["min_soak"].as<int>(0));
         
         this_zone->TurnOff();
+        if (this_zone->Fail() && this_zone->Coil().bus) {
+            ace::utils::Logger::Instance().Warning("Zone %d: coil %d of board "
+                    "%d on Modbus bus %d is not usable", this_zone->Id(),
+                    this_zone->Coil().coil, this_zone->Coil().slave,
+                    this_zone->Coil().bus);
+        } else if (this_zone->Fail()) {
+            ace::utils::Logger::Instance().Warning("Zone %d: gpio %d under %s "
+                    "is not usable", this_zone->Id(),
+                    details["gpio"].as<int>(0), SysfsGpio::Root().c_str());
+        }
         ace::utils::Logger::Instance().Debug("Zone %d is %s!",
                 this_zone->Id(), this_zone->Status().c_str());
         
@@ -77,15 +178,27 @@ void LoadZones(const YAML::Node yNodes) {
 }
 
 void LoadPrograms(const YAML::Node yNodes) {
+    TRACE_SPAN("config", "LoadPrograms");
     for (auto it = yNodes.begin(); it != yNodes.end(); ++it) {
         
         shared_program program = std::make_shared<Program>();
         
         program->LoadProgram(it->first.as<int>(0), it->second);
+        for (const auto& problem : program->Problems()) {
+            utils::Logger::Instance().Warning("Program %d: %s", program->Id(),
+                    problem.c_str());
+        }
+        auto offset = start_offsets_.find(program->Id());
+        if (offset != start_offsets_.end() && offset->second != 0) {
+            program->Offset(offset->second);
+            utils::Logger::Instance().Info("Program %d starts %d minutes "
+                    "after %02d:%02d to share the supply", program->Id(),
+                    offset->second, program->Hour(), program->Minute());
+        }
         
         if (!program->Disabled()) {
             QueueProgram(program);
-            std::tm tm = *std::localtime(&program->StartTime());
+            std::tm tm = TimeZone::Local().ToLocal(program->StartTime());
             std::stringstream ss;
             ss << std::put_time(&tm, "%Y/%m/%d %T %Z");
             utils::Logger::Instance().Info("Scheduling program %d for %s...",
@@ -99,48 +212,684 @@ void LoadPrograms(const YAML::Node yNodes) {
     }
 }
 
-void StopAllZones() {
+bool StopAllZones() {
     utils::Logger::Instance().Info("Stopping all zones.");
     
-    for (const auto& zone : zones_) {
+    // together, so zones on one Modbus board go off in one request
+    std::vector<shared_zone> zones(zones_.begin(), zones_.end());
+    std::vector<bool> off = Zone::Switch(zones, false);
+    bool confirmed = true;
+    for (size_t i = 0; i < zones.size(); i++) {
+        const shared_zone& zone = zones[i];
         utils::Logger::Instance().Debug("Stopping zone %d", zone->Id());
         
-        zone->TurnOff();
+        if (!off[i]) {
+            confirmed = false;
+            utils::Logger::Instance().Warning("Zone %d did not confirm off "
+                    "after %d attempts", zone->Id(), zone->LastAttempts());
+        }
         
         ace::utils::Logger::Instance().Debug("Zone %d turned %s!",
                 zone->Id(), zone->Status().c_str());
     }
+    return confirmed;
 }
 
-void RunZones(const std::list<zone_detail>& list_detail) {
-    for (const auto& detail : list_detail) {
-        if (ShutdownRequested()) break;
-        
+std::vector<int> ActiveZones() {
+    auto state = state_.Read();
+    return state ? state->ActiveZones() : std::vector<int>();
+}
+
+/**
+ * FaultZone
+ * Takes a zone out of service on abnormal flow, ends its run if watering.
+ * @param zone_id
+ * @param rate flow attributed to the zone, units per minute
+ */
+void FaultZone(int zone_id, double rate) {
+    for (const auto& zone : zones_) {
+        if (zone->Id() != zone_id) continue;
+        zone->Faulted(true);
+        zone->TurnOff();
+        utils::Logger::Instance().Warning("Zone %d faulted at %.2f/min, "
+                "turned %s!", zone_id, rate, zone->Status().c_str());
+    }
+    {
+        std::lock_guard<std::mutex> lk(program_mutex_);
+        fault_pending_ = true;
+    }
+    cv_.notify_all();
+}
+
+/**
+ * FaultSite
+ * Takes every zone out of service, eg: flow with every zone off.
+ * @param sensor_id
+ * @param rate units per minute
+ */
+void FaultSite(int sensor_id, double rate) {
+    utils::Logger::Instance().Warning("Taking all zones out of service, "
+            "sensor %d at %.2f/min", sensor_id, rate);
+    for (const auto& zone : zones_) {
+        zone->Faulted(true);
+    }
+    StopAllZones();
+    {
+        std::lock_guard<std::mutex> lk(program_mutex_);
+        fault_pending_ = true;
+    }
+    cv_.notify_all();
+}
+
+/**
+ * RelayFault
+ * A relay did not confirm a transition within the relay_verify budget. The
+ * zone is taken out of service and every relay is switched off.
+ * @param zone
+ * @param on the transition that failed
+ */
+void RelayFault(const shared_zone& zone, bool on) {
+    zone->Faulted(true);
+    utils::Logger::Instance().Warning("Zone %d relay did not confirm %s after "
+            "%d attempts, taking it out of service", zone->Id(),
+            on ? "on" : "off", zone->LastAttempts());
+    TRACE_INSTANT("zone", "relay fault", zone->Id());
+    if (!StopAllZones()) {
+        utils::Logger::Instance().Warning("Relays may still be on");
+    }
+}
+
+const int manual_priority = std::numeric_limits<int>::max();
+
+std::string FormatTime(std::time_t t, const char* format) {
+    std::tm tm = TimeZone::Local().ToLocal(t);
+    std::stringstream ss;
+    ss << std::put_time(&tm, format);
+    return ss.str();
+}
+
+/**
+ * RequestManualRun
+ * Runs a program now, preempting any scheduled program. Thread safe.
+ * @param program_id
+ */
+void RequestManualRun(int program_id) {
+    {
+        std::lock_guard<std::mutex> lk(program_mutex_);
+        manual_requests_.push_back(program_id);
+    }
+    cv_.notify_all();
+}
+
+/**
+ * RequestStop
+ * Ends every running, suspended and waiting run. Thread safe.
+ */
+void RequestStop() {
+    {
+        std::lock_guard<std::mutex> lk(program_mutex_);
+        stop_requested_ = true;
+    }
+    cv_.notify_all();
+}
+
+program_run NewRun(const shared_program& program, std::time_t due,
+        bool manual) {
+    program_run run = {};
+    run.program = program;
+    run.due = due;
+    run.released = due;
+    run.priority = manual ? manual_priority : program->Priority();
+    run.manual = manual;
+
+    // zones that need soaking water in cycles, interleaved with the others
+    int unit = static_cast<int> (duration_unit_.count());
+    std::vector<cycle_zone> cycle_zones;
+    for (const auto& detail : program->ZoneDetail()) {
         auto zone = std::find_if(zones_.begin(), zones_.end(),
                 [detail](const shared_zone & z) {
                     return detail.zone_id == z->Id();
                 });
-                
-        if (zone != zones_.end() && !ShutdownRequested() && (*zone)->Enabled()) {
-            utils::Logger::Instance().Info("Watering %s, zone %d for %d minutes",
-                    (*zone)->Name().c_str(), detail.zone_id, detail.duration);
-            
-            (*zone)->TurnOn(); // turn on the zone
-            
-            ace::utils::Logger::Instance().Debug("Zone %d turned %s!",
-                    (*zone)->Id(), (*zone)->Status().c_str());
-            
-            std::unique_lock<std::mutex>lk(zone_mutex_);
-            
-            cv_.wait_until(lk, std::chrono::system_clock::now() +
-                    std::chrono::minutes(detail.duration));
-            
-            (*zone)->TurnOff(); // turn of the zone
-            
+        bool known = zone != zones_.end();
+        cycle_zones.push_back({detail.zone_id, detail.duration * unit,
+            known ? (*zone)->MaxCycle() * unit : 0,
+            known ? (*zone)->MinSoak() * unit : 0});
+    }
+    cycle_plan plan = PlanCycles(cycle_zones, 1);
+    if (plan.steps.size() > cycle_zones.size()) {
+        utils::Logger::Instance().Info("Program %d waters in %zu cycles, "
+                "%.1f minutes instead of %.1f", program->Id(),
+                plan.steps.size(), plan.makespan / 60.0,
+                NaiveCycles(cycle_zones).makespan / 60.0);
+    }
+    run.remaining.assign(plan.steps.begin(), plan.steps.end());
+    if (!run.remaining.empty()) {
+        run.left = std::chrono::seconds(run.remaining.front().seconds);
+    }
+    return run;
+}
+
+void NextZone(program_run& run) {
+    run.remaining.pop_front();
+    if (!run.remaining.empty()) {
+        run.left = std::chrono::seconds(run.remaining.front().seconds);
+    }
+}
+
+/**
+ * RecordRun
+ * Appends a run to the history. In realtime mode the write is left to a
+ * normal priority thread.
+ * @param record
+ */
+void RecordRun(const run_record& record) {
+    events_.Push(event_zone_off, record.program_id, record.zone_id,
+            record.actual, static_cast<RUN_REASON> (record.reason));
+    if (!history_.IsOpen()) return;
+    if (background_.Running()) {
+        if (!background_.Post([record]() {
+                history_.Append(record);
+            })) {
+            utils::Logger::Instance().Warning("History of zone %d dropped, "
+                    "the writer is behind", record.zone_id);
+        }
+        return;
+    }
+    history_.Append(record);
+}
+
+// true if the program has a run waiting, watering or suspended
+bool Busy(int program_id) {
+    auto same = [program_id](const program_run & run) {
+        return run.program->Id() == program_id;
+    };
+    return std::any_of(runs_.begin(), runs_.end(), same) ||
+            std::any_of(pending_.begin(), pending_.end(), same);
+}
+
+/**
+ * Held
+ * A scheduled run waits while a program it starts after is due, waiting or
+ * running, and while a program it is not run with is running or suspended.
+ * Manual runs are never held.
+ * @param run
+ * @return the program waited on, 0 if none
+ */
+int Held(const program_run& run) {
+    if (run.manual) return 0;
+    for (int id : run.program->After()) {
+        if (Busy(id)) return id;
+    }
+    int id = run.program->Id();
+    for (const auto& other : runs_) {
+        const std::vector<int>& not_with = other.program->NotWith();
+        if (std::find(not_with.begin(), not_with.end(), id) !=
+                not_with.end()) return other.program->Id();
+        for (int excluded : run.program->NotWith()) {
+            if (other.program->Id() == excluded) return excluded;
+        }
+    }
+    return 0;
+}
+
+/**
+ * StartZone
+ * Turns on the first usable zone of a run, zones that cannot water are
+ * recorded and skipped. A zone still soaking from its last cycle leaves the
+ * run waiting until soak_end.
+ * @param run
+ * @return false if the run has no zones left
+ */
+bool StartZone(program_run& run) {
+    while (!run.remaining.empty()) {
+        const cycle_step& detail = run.remaining.front();
+        run.record = {};
+        run.record.zone_id = detail.zone_id;
+        run.record.program_id = run.program->Id();
+        run.record.planned = static_cast<std::int32_t> (run.left.count());
+        run.record.start = run.record.end = std::time(nullptr);
+
+        auto zone = std::find_if(zones_.begin(), zones_.end(),
+                [detail](const shared_zone & z) {
+                    return detail.zone_id == z->Id();
+                });
+
+        if (zone == zones_.end()) {
+            run.record.reason = reason_unknown_zone;
+        } else if (!(*zone)->Enabled()) {
+            run.record.reason = reason_disabled;
+        } else if ((*zone)->Faulted()) {
+            run.record.reason = reason_fault;
+        } else if (soil_monitor_.Wet(detail.zone_id)) {
+            utils::Logger::Instance().Debug("Zone %d skipped, its soil is "
+                    "wet", detail.zone_id);
+            run.record.reason = reason_moist;
+        } else {
+            std::chrono::system_clock::time_point ready;
+            auto off = run.off.find(detail.zone_id);
+            if (detail.soak > 0 && off != run.off.end()) {
+                ready = off->second + std::chrono::seconds(detail.soak);
+                if (std::chrono::system_clock::now() < ready) {
+                    if (!run.soaking) {
+                        utils::Logger::Instance().Debug("Zone %d soaking "
+                                "until %s", detail.zone_id, FormatTime(
+                                std::chrono::system_clock::to_time_t(ready),
+                                "%T").c_str());
+                    }
+                    run.soaking = true;
+                    run.soak_end = ready;
+                    return true;
+                }
+            }
+            run.soaking = false;
+            if (run.suspended) {
+                utils::Logger::Instance().Info("Resuming program %d",
+                        run.program->Id());
+                run.suspended = false;
+            }
+            utils::Logger::Instance().Info("Watering %s, zone %d for %lld "
+                    "seconds", (*zone)->Name().c_str(), detail.zone_id,
+                    static_cast<long long> (run.left.count()));
+
+            if (!(*zone)->TurnOn()) { // turn on the zone
+                RelayFault(*zone, true);
+                run.record.reason = reason_fault;
+                RecordRun(run.record);
+                NextZone(run);
+                continue;
+            }
+            TRACE_INSTANT("zone", "on", (*zone)->Id());
+            events_.Push(event_zone_on, run.program->Id(), (*zone)->Id());
+            if (start_latency_ != nullptr) {
+                // from when the run was due, the last zone went off or
+                // the soak ended
+                start_latency_->Record(std::chrono::system_clock::now() -
+                        std::max({free_at_, ready, std::chrono::system_clock::
+                        from_time_t(run.due)}));
+            }
+
             ace::utils::Logger::Instance().Debug("Zone %d turned %s!",
                     (*zone)->Id(), (*zone)->Status().c_str());
+
+            run.zone = *zone;
+            run.watering = true;
+            run.zone_end = std::chrono::system_clock::now() + run.left;
+            return true;
+        }
+
+        RecordRun(run.record);
+        NextZone(run);
+    }
+    return false;
+}
+
+/**
+ * StopZone
+ * Turns off the watering zone of a run and records it. A preempted zone
+ * keeps the rest of its duration for when the run resumes.
+ * @param run
+ * @param reason
+ */
+void StopZone(program_run& run, RUN_REASON reason) {
+    if (!run.zone->TurnOff()) { // turn of the zone
+        RelayFault(run.zone, false);
+    }
+    TRACE_INSTANT("zone", "off", run.zone->Id());
+    auto stopped = std::chrono::system_clock::now();
+    if (stop_latency_ != nullptr && reason == reason_ran) {
+        stop_latency_->Record(stopped - run.zone_end);
+    }
+    free_at_ = std::min(run.zone_end, stopped);
+    run.off[run.zone->Id()] = stopped;
+
+    ace::utils::Logger::Instance().Debug("Zone %d turned %s!",
+            run.zone->Id(), run.zone->Status().c_str());
+
+    run.record.end = std::time(nullptr);
+    run.record.actual = static_cast<std::int32_t> (run.record.end -
+            run.record.start);
+    run.record.reason = (reason == reason_ran && run.zone->Faulted()) ?
+            reason_fault : reason;
+    RecordRun(run.record);
+
+    run.watering = false;
+    run.zone.reset();
+    if (reason == reason_preempted) {
+        run.left = std::chrono::duration_cast<std::chrono::seconds>(
+                run.zone_end - std::chrono::system_clock::now());
+        if (run.left.count() > 0) {
+            run.remaining.front().soak = 0; // the same cycle, continued
+            return;
         }
     }
+    NextZone(run);
+}
+
+/**
+ * RunTask
+ * Waters the zones of a run in order, each cycle once its soak is over.
+ * Dispatch() resumes it while the run is current; after each zone or soak
+ * it suspends until the next pass, so a run due when a zone ends preempts
+ * before the next zone starts. Readying it mid zone or mid soak cuts the
+ * zone or soak short.
+ */
+class RunTask : public Task {
+public:
+    explicit RunTask(program_run& run) : run_(run) {
+    }
+protected:
+    void Resume(Executor& executor) override {
+        CO_BEGIN;
+        while (StartZone(run_)) {
+            if (run_.soaking) {
+                CO_SLEEP_UNTIL(executor, run_.soak_end);
+                run_.soaking = false;
+            } else {
+                // until the zone ends, faults or is preempted
+                CO_SLEEP_UNTIL(executor, run_.zone_end);
+                StopZone(run_, run_.suspended ? reason_preempted :
+                        reason_ran);
+            }
+            CO_SUSPEND; // until Dispatch() starts the next zone
+        }
+        utils::Logger::Instance().Info("Program %i completed",
+                run_.program->Id());
+        events_.Push(event_program_done, run_.program->Id());
+        run_.task = nullptr;
+        CO_END;
+    }
+private:
+    program_run& run_;
+};
+
+/**
+ * Dispatch
+ * Drops waiting runs past their catch up window, lets the highest priority
+ * waiting run preempt the current one and resumes the current run's task.
+ * @param now
+ */
+void Dispatch(std::time_t now) {
+    for (auto& run : pending_) {
+        int holder = Held(run);
+        if (holder != 0) {
+            if (!run.held) {
+                utils::Logger::Instance().Info("Program %d waits on program "
+                        "%d", run.program->Id(), holder);
+            }
+            run.released = now;
+        }
+        run.held = holder != 0;
+    }
+    for (auto it = pending_.begin(); it != pending_.end();) {
+        if (!it->manual && !it->held && !it->program->MayStart(
+                std::max(it->due, it->released), now)) {
+            utils::Logger::Instance().Info("Program %d skipped, missed its "
+                    "start at %s", it->program->Id(),
+                    FormatTime(it->due, "%T %Z").c_str());
+            it->program->RecordSkip();
+            events_.Push(event_program_skip, it->program->Id());
+            it = pending_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (;;) {
+        // highest priority first, then the earliest start, of the runs not
+        // held by a dependency
+        auto best = pending_.end();
+        for (auto it = pending_.begin(); it != pending_.end(); ++it) {
+            if (Held(*it) != 0) continue;
+            if (best == pending_.end() || (it->priority != best->priority ?
+                    it->priority > best->priority : it->due < best->due)) {
+                best = it;
+            }
+        }
+        if (best != pending_.end() &&
+                (runs_.empty() || best->priority > runs_.back().priority)) {
+            if (!runs_.empty() && !runs_.back().suspended) {
+                program_run& current = runs_.back();
+                utils::Logger::Instance().Info("Program %d preempted by "
+                        "program %d", current.program->Id(),
+                        best->program->Id());
+                current.suspended = true;
+                if (current.watering || current.soaking) {
+                    // it stops its zone and waits to be current again
+                    executor_.Ready(current.task);
+                    executor_.Poll();
+                }
+                current.program->RecordPreempted();
+                events_.Push(event_program_preempted, current.program->Id());
+            }
+            runs_.push_back(std::move(*best));
+            pending_.erase(best);
+
+            program_run& run = runs_.back();
+            run.task = executor_.Spawn(std::unique_ptr<Task>(
+                    new RunTask(run)));
+            events_.Push(event_program_start, run.program->Id(), 0,
+                    run.manual ? 0 : static_cast<int> (std::max<std::time_t>(
+                    0, now - run.due)));
+            if (run.manual) {
+                utils::Logger::Instance().Info("Starting manual run of "
+                        "program %d", run.program->Id());
+            } else {
+                run.program->RecordStart(run.due, now);
+                utils::Logger::Instance().Info("Starting program %d, %lld "
+                        "seconds after %s", run.program->Id(),
+                        static_cast<long long> (std::max<std::time_t>(0,
+                        now - run.due)), FormatTime(run.due, "%T %Z").c_str());
+            }
+        }
+
+        if (runs_.empty()) return;
+        // a zone or soak to end first
+        program_run& run = runs_.back();
+        if (run.watering || run.soaking) return;
+        executor_.Ready(run.task);
+        executor_.Poll();
+        if (run.task != nullptr) return;
+        runs_.pop_back();
+    }
+}
+
+/**
+ * PublishState
+ * Publishes the scheduler's state for readers on other threads, and to the
+ * status page if open.
+ * @param now
+ */
+void PublishState(std::time_t now) {
+    TRACE_SPAN("scheduler", "publish");
+    std::shared_ptr<scheduler_state> state(new scheduler_state());
+    state->at = now;
+    state->loops = loops_;
+
+    const program_run* current = runs_.empty() ? nullptr : &runs_.back();
+    for (const auto& zone : zones_) {
+        state_zone z = {zone->Id(), zone->Name(), zone->Enabled(),
+            zone->Commanded(), zone->Faulted(), 0};
+        if (current && current->watering && current->zone == zone) {
+            z.remaining = static_cast<int> (std::max<long long>(0,
+                    std::chrono::duration_cast<std::chrono::seconds>(
+                    current->zone_end - std::chrono::system_clock::now())
+                    .count()));
+        }
+        state->zones.push_back(std::move(z));
+    }
+    for (const auto& run : runs_) {
+        state->runs.push_back({run.program->Id(), run.priority, run.manual,
+            run.due, run.remaining.empty() ? -1 :
+            run.remaining.front().zone_id, run.watering, run.soaking,
+            static_cast<int> (run.remaining.size())});
+    }
+    for (const auto& run : pending_) {
+        state->pending.push_back({run.program->Id(), run.priority, run.due});
+    }
+    for (const auto& program : programs_) {
+        state->programs.push_back({program->Id(), program->Priority(),
+            program->StartTime()});
+    }
+    // unchanged but for at and loops: keep the version, readers can tell a
+    // change from a heartbeat, the status page still gets the heartbeat
+    bool changed;
+    {
+        auto last = state_.Read();
+        changed = !last || !last->SameAs(*state);
+    }
+    if (changed) state_.Publish(state);
+
+    if (status_.IsOpen()) PublishStatus(*state);
+}
+
+/**
+ * PublishStatus
+ * Copies zone and program state to the status page.
+ * @param state
+ */
+void PublishStatus(const scheduler_state& state) {
+    status_snapshot s = {};
+    s.pid = getpid();
+    s.started = started_;
+    s.heartbeat = state.at;
+    s.heartbeats = ++heartbeats_;
+    s.loops = state.loops;
+
+    const state_run* current = state.Current();
+    s.program_id = current ? current->program_id : -1;
+    if (current) {
+        s.program_priority = current->priority;
+        s.program_manual = current->manual;
+        s.program_due = current->due;
+        s.suspended = static_cast<std::int32_t> (state.runs.size() - 1);
+    }
+
+    for (const auto& zone : state.zones) {
+        if (s.zone_count == status_max_zones) break;
+        status_zone& z = s.zones[s.zone_count++];
+        z.id = zone.id;
+        z.enabled = zone.enabled;
+        z.commanded = zone.commanded;
+        z.faulted = zone.faulted;
+        z.remaining = zone.remaining;
+        std::snprintf(z.name, sizeof (z.name), "%s", zone.name.c_str());
+    }
+
+    // due runs waiting their turn come before future starts
+    for (const auto& run : state.pending) {
+        if (s.queued_count == status_max_queued) break;
+        s.queued[s.queued_count++] = {run.id, run.priority, run.start};
+    }
+    for (const auto& program : state.programs) {
+        if (s.queued_count == status_max_queued) break;
+        s.queued[s.queued_count++] = {program.id, program.priority,
+            program.start};
+    }
+
+    status_.Publish(s);
+}
+
+/**
+ * CheckDependencies
+ * Drops the dependencies of programs that depend on each other and logs
+ * the critical path of the next 24 hours.
+ */
+void CheckDependencies() {
+    std::vector<dag_program> all;
+    for (const auto& program : programs_) {
+        all.push_back({program->Id(), 0, 0, 0, {}, program->After(),
+            program->NotWith()});
+    }
+    std::vector<int> order, cycle;
+    while (!OrderPrograms(all, order, cycle)) {
+        std::string ids;
+        for (int id : cycle) {
+            ids += std::to_string(id) + " -> ";
+        }
+        utils::Logger::Instance().Warning("Programs %s%d depend on each "
+                "other, ignoring their dependencies", ids.c_str(),
+                cycle.front());
+        for (auto& entry : all) {
+            if (std::find(cycle.begin(), cycle.end(), entry.id) ==
+                    cycle.end()) continue;
+            entry.after.clear();
+            entry.not_with.clear();
+            for (const auto& program : programs_) {
+                if (program->Id() == entry.id) program->ClearDependencies();
+            }
+        }
+    }
+
+    std::vector<Program> programs;
+    for (const auto& program : programs_) {
+        programs.push_back(*program);
+    }
+    std::map<int, dag_zone> zones;
+    for (const auto& zone : zones_) {
+        zones[zone->Id()] = {zone->MaxCycle(), zone->MinSoak()};
+    }
+    std::time_t now = std::time(nullptr);
+    dag_plan plan = PlanNight(NightPrograms(programs, zones, now,
+            now + 24 * 60 * 60), 1);
+    std::string path;
+    for (int id : plan.critical) {
+        path += (path.empty() ? "" : " -> ") + std::to_string(id);
+    }
+    utils::Logger::Instance().Info("Next 24 hours: %zu program runs over %d "
+            "minutes, critical path %d minutes (%s)", plan.steps.size(),
+            plan.makespan / 60, plan.critical_path / 60, path.c_str());
+}
+
+/**
+ * PlanTonight
+ * Moves the programs with a start window to the cheapest starts of the
+ * night, noon to noon, that now is in, see PlanTariff().
+ * @param now
+ */
+void PlanTonight(std::time_t now) {
+    std::tm tm = TimeZone::Local().ToLocal(now);
+    if (tm.tm_hour < 12) tm.tm_mday--;
+    tm.tm_hour = 12;
+    tm.tm_min = tm.tm_sec = 0;
+    std::tm next = tm;
+    next.tm_mday++;
+    std::time_t origin = 0;
+    TimeZone::Local().ToUtc(tm, origin);
+    TimeZone::Local().ToUtc(next, next_tariff_plan_);
+
+    std::vector<Program> programs;
+    for (const auto& program : programs_) {
+        programs.push_back(*program);
+    }
+    std::map<int, tou_zone> zones;
+    for (const auto& zone : zones_) {
+        zones[zone->Id()] = {zone->Enabled(), zone->MaxCycle(),
+            zone->MinSoak(), tariff_.Kw(zone->Id())};
+    }
+    std::vector<tou_program> night = NightLoads(programs, zones, origin, now,
+            next_tariff_plan_);
+    tou_plan fixed = FixedStarts(night, tariff_);
+    tou_plan plan = PlanTariff(night, tariff_);
+    if (!plan.feasible) {
+        utils::Logger::Instance().Warning("No starts keep every program "
+                "window tonight, starting them as configured");
+    }
+    for (size_t i = 0; i < night.size(); i++) {
+        if (!night[i].window) continue;
+        for (const auto& program : programs_) {
+            if (program->Id() != night[i].id) continue;
+            program->Offset(plan.starts[i] - night[i].start);
+            utils::Logger::Instance().Info("Program %d starts at %s for the "
+                    "tariff", program->Id(), FormatTime(program->StartTime(),
+                    "%T %Z").c_str());
+        }
+    }
+    std::stable_sort(programs_.begin(), programs_.end(), [](
+            const shared_program& left, const shared_program & right) {
+        return left->StartTime() < right->StartTime();
+    });
+    utils::Logger::Instance().Info("Tonight's pump energy costs %.2f, %.2f "
+            "at fixed starts", plan.cost, fixed.cost);
 }
 
 /**
@@ -148,6 +897,7 @@ void RunZones(const std::list<zone_detail>& list_detail) {
  * @param program
  */
 void QueueProgram(const shared_program& program) {
+    TRACE_SPAN("scheduler", "QueueProgram", program->Id());
     if (!programs_.empty()) {
         // check for duplicate
         if (std::find_if(programs_.begin(), programs_.end(), [program](
@@ -172,43 +922,176 @@ void QueueProgram(const shared_program& program) {
     }
 }
 
-bool MainLoop() {
-    std::chrono::system_clock::time_point tp = std::chrono::system_clock::now();
-    std::time_t tt = std::chrono::system_clock::to_time_t(tp);
-    std::tm tm = *std::localtime(&tt);
-    std::stringstream ss;
+// moves programs whose start time has come to the waiting runs
+void TakeDuePrograms(std::time_t now) {
+    while (!programs_.empty() && programs_.front()->StartTime() <= now) {
+        shared_program program = programs_.front();
+        programs_.pop_front(); // remove program from the front of deque
 
-    while (!ShutdownRequested()) {
-        if (!programs_.empty()) {
-            // get a program from the front of deque
-            shared_program program = programs_.front();
-            programs_.pop_front(); // remove program from the front of deque
+        if (Busy(program->Id())) {
+            utils::Logger::Instance().Info("Program %i is still running, "
+                    "skipping its start at %s", program->Id(),
+                    FormatTime(program->StartTime(), "%T %Z").c_str());
+            program->RecordSkip();
+            events_.Push(event_program_skip, program->Id());
+        } else {
+            pending_.push_back(NewRun(program, program->StartTime(), false));
+        }
 
-            tm = *std::localtime(&program->StartTime());
+        program->NextStartTime(now); // set the next starting time
+        utils::Logger::Instance().Info("Program %i will run again on %s",
+                program->Id(), FormatTime(program->StartTime(),
+                "%Y/%m/%d at %T %Z").c_str());
+        QueueProgram(program); // add the updated program to the deque
+    }
+}
 
-            ss.str(std::string());
-            ss << std::put_time(&tm, "%T %Z on %Y/%m/%d");
-            utils::Logger::Instance().Info("Program %i scheduled to run at %s",
-                    program->Id(), ss.str().c_str());
+/**
+ * EndRuns
+ * Turns off the watering zone and records every zone not watered of every
+ * run, current run first. Waiting runs are dropped.
+ * @param reason
+ */
+void EndRuns(RUN_REASON reason) {
+    for (auto run = runs_.rbegin(); run != runs_.rend(); ++run) {
+        if (run->watering) StopZone(*run, reason);
+        std::time_t now = std::time(nullptr);
+        for (const auto& detail : run->remaining) {
+            run_record record = {};
+            record.zone_id = detail.zone_id;
+            record.program_id = run->program->Id();
+            record.planned = detail.seconds;
+            record.start = record.end = now;
+            record.reason = reason;
+            RecordRun(record);
+        }
+        events_.Push(event_program_done, run->program->Id());
+        executor_.Cancel(run->task);
+    }
+    runs_.clear();
+    pending_.clear();
+}
 
-            std::unique_lock<std::mutex>lk(program_mutex_);
-            if (cv_.wait_until(lk, std::chrono::system_clock::from_time_t(
-                    program->StartTime())) == std::cv_status::timeout) {
-                RunZones(program->ZoneDetail()); // run the program zone
-                program->NextStartTime(); // set the next starting time
-                tm = *std::localtime(&program->StartTime());
-
-                ss.str(std::string());
-                ss << std::put_time(&tm, "%Y/%m/%d at %T %Z");
-                utils::Logger::Instance().Info("Program %i completed and will run"
-                        " again on %s", program->Id(), ss.str().c_str());
-            }
-            QueueProgram(program); // add the updated program to the deque
+void TakeManualRequests(std::time_t now) {
+    std::deque<int> requests;
+    bool stop;
+    {
+        std::lock_guard<std::mutex> lk(program_mutex_);
+        requests.swap(manual_requests_);
+        stop = stop_requested_;
+        stop_requested_ = false;
+    }
+    // a stop ends what ran before it, not runs requested after
+    if (stop) {
+        utils::Logger::Instance().Info("Stopping every run");
+        EndRuns(reason_stopped);
+    }
+    for (int program_id : requests) {
+        auto program = std::find_if(programs_.begin(), programs_.end(),
+                [program_id](const shared_program & p) {
+                    return p->Id() == program_id;
+                });
+        if (program == programs_.end()) {
+            utils::Logger::Instance().Warning("Manual run of unknown or "
+                    "disabled program %d", program_id);
+        } else if (Busy(program_id)) {
+            utils::Logger::Instance().Info("Program %d is already running",
+                    program_id);
         } else {
+            pending_.push_back(NewRun(*program, now, true));
+        }
+    }
+}
+
+bool MainLoop() {
+    using clock = std::chrono::system_clock;
+    TRACE_THREAD("scheduler");
+
+    while (!ShutdownRequested()) {
+        scheduler_beat_.Busy();
+        // the same clock as the wait below, time() may lag it by a tick
+        std::time_t now = clock::to_time_t(clock::now());
+        {
+            TRACE_SPAN("scheduler", "pass");
+            TakeManualRequests(now);
+            if (!tariff_.rates.empty() && now >= next_tariff_plan_) {
+                PlanTonight(now);
+            }
+            TakeDuePrograms(now);
+            Dispatch(now);
+            PublishState(now);
+        }
+        loops_++;
+
+        if (programs_.empty() && runs_.empty()) {
             utils::Logger::Instance().Info("Nothing to do. Exiting...");
             StartShutdown();
+            break;
+        }
+
+        // wake for the next start, the end of the zone or soak the current
+        // run sleeps on or the end of a waiting run's catch up window
+        clock::time_point wake = clock::from_time_t(now) + std::chrono::hours(24);
+        if (!programs_.empty()) {
+            wake = std::min(wake, clock::from_time_t(
+                    programs_.front()->StartTime()));
+        }
+        wake = std::min(wake, executor_.Next());
+        if (status_.IsOpen()) {
+            wake = std::min(wake, clock::now() +
+                    std::chrono::seconds(status_seconds_));
+        }
+        if (!tariff_.rates.empty()) {
+            wake = std::min(wake, clock::from_time_t(next_tariff_plan_));
+        }
+        for (const auto& run : pending_) {
+            if (run.manual || run.program->CatchUp() == catch_up_run_late)
+                continue;
+            std::time_t late = run.program->CatchUp() == catch_up_skip ? 60 :
+                    (run.program->CatchUpMinutes() + 1) * 60;
+            wake = std::min(wake, clock::from_time_t(run.due + late));
         }
+
+        std::unique_lock<std::mutex>lk(program_mutex_);
+        scheduler_beat_.Idle();
+        {
+            // the argument is the planned wait in milliseconds
+            TRACE_SPAN("scheduler", "wait", static_cast<std::int64_t> (
+                    std::chrono::duration_cast<std::chrono::milliseconds>(
+                    wake - clock::now()).count()));
+            cv_.wait_until(lk, wake, [] {
+                return !manual_requests_.empty() || stop_requested_ ||
+                        fault_pending_ || ShutdownRequested();
+            });
+        }
+        // taken before the Faulted() check below, a fault after this sets
+        // it again rather than being lost
+        fault_pending_ = false;
+        scheduler_beat_.Busy();
+        lk.unlock();
+
+        // a faulted zone ends early, the others when their time is up
+        if (!runs_.empty() && runs_.back().watering &&
+                runs_.back().zone->Faulted()) {
+            executor_.Ready(runs_.back().task);
+        }
+        executor_.Poll();
     }
+
+    // record what shutdown cut short
+    EndRuns(reason_shutdown);
+    PublishState(std::time(nullptr));
+
+    for (const auto& program : programs_) {
+        const program_stats& stats = program->Stats();
+        utils::Logger::Instance().Info("Program %d ran %d times, skipped %d, "
+                "preempted %d, late %lld seconds on average, %lld at most",
+                program->Id(), stats.runs, stats.skips, stats.preemptions,
+                static_cast<long long> (stats.runs ?
+                stats.late_total / stats.runs : 0),
+                static_cast<long long> (stats.late_max));
+    }
+    scheduler_beat_.Idle();
     return true;
 }
 bool AppInit(int argc, char* argv[]){
@@ -223,6 +1106,7 @@ bool AppInit(int argc, char* argv[]){
     config_file_.assign(argv[1]);
     YAML::Node yConfig;
     try {
+        TRACE_SPAN("config", "parse");
         yConfig = YAML::LoadFile(config_file_);
     } catch (const std::exception& e) {
         std::cout << e.what() << "\n";
@@ -259,25 +1143,599 @@ bool AppInit(int argc, char* argv[]){
             return errno;
         }
     }
+
+    // realtime: the valve thread runs SCHED_FIFO in locked memory, logging
+    // and history writes move to normal priority threads. After daemon(),
+    // neither threads nor memory locks survive a fork.
+    YAML::Node yRealtime = yConfig["realtime"];
+    if (yRealtime.IsDefined() && !yRealtime.IsNull()) {
+        realtime_.enabled = yRealtime["enabled"].as<bool>(true);
+        realtime_.priority = yRealtime["priority"].as<int>(50);
+        realtime_.cpu = yRealtime["cpu"].as<int>(-1);
+        realtime_.lock_memory = yRealtime["lock_memory"].as<bool>(true);
+    }
+    if (realtime_.enabled) {
+        if (realtime_.lock_memory) {
+            std::string error = LockMemory(realtime_.heap_bytes);
+            if (!error.empty()) {
+                ace::utils::Logger::Instance().Warning("Memory not locked, "
+                        "%s", error.c_str());
+            }
+        }
+        ace::utils::Logger::Instance().Async(true);
+        background_.Start();
+    }
+
+    // Debug builds trace continuously, SIGUSR1 dumps the last seconds
+    TraceStart(yConfig["trace_directory"].as<std::string>("/tmp"),
+            yConfig["trace_seconds"].as<int>(30));
     
+    std::string history_directory =
+            yConfig["history_directory"].as<std::string>("");
+    if (!history_directory.empty()) {
+        history_.Open(history_directory);
+    }
+
+    started_ = std::time(nullptr);
+    std::string status_page = yConfig["status_page"].as<std::string>(
+            MYSPRINKLER_STATUS_PAGE);
+    status_seconds_ = std::max(1, yConfig["status_seconds"].as<int>(1));
+    if (!status_page.empty()) {
+        status_.Open(status_page.c_str());
+    }
+
+    // relays go through sysfs under gpio_directory, gpio_fake builds a
+    // scratch tree there, eg: under /dev/shm, to run without a board
+    std::string gpio_directory = yConfig["gpio_directory"].as<std::string>(
+            "/sys/class/gpio");
+    YAML::Node yFake = yConfig["gpio_fake"];
+    if (yFake.IsDefined() && !yFake.IsNull()) {
+        gpio_faults faults;
+        faults.latency_us = yFake["latency_us"].as<int>(0);
+        faults.failure_rate = yFake["failure_rate"].as<double>(0);
+        faults.ignore_rate = yFake["ignore_rate"].as<double>(0);
+        faults.stall_ms = yFake["stall_ms"].as<int>(0);
+        faults.stall_after = yFake["stall_after"].as<int>(0);
+        if (yFake["stuck"].IsSequence()) {
+            faults.stuck = yFake["stuck"].as<std::vector<int> >();
+        }
+        if (fake_gpio_.Create(gpio_directory)) {
+            SysfsGpio::Faults(faults);
+        }
+    }
+    SysfsGpio::Root(gpio_directory);
+
+    // mqtt: publishes zone and program state changes
+    YAML::Node yMqtt = yConfig["mqtt"];
+    if (yMqtt.IsDefined() && !yMqtt.IsNull()) {
+        mqtt_options mqtt;
+        mqtt.host = yMqtt["host"].as<std::string>(mqtt.host);
+        mqtt.port = yMqtt["port"].as<int>(mqtt.port);
+        mqtt.client_id = yMqtt["client_id"].as<std::string>(mqtt.client_id);
+        mqtt.topic = yMqtt["topic"].as<std::string>(mqtt.topic);
+        mqtt.keepalive = yMqtt["keepalive"].as<int>(mqtt.keepalive);
+        mqtt.buffer = yMqtt["buffer"].as<int>(mqtt.buffer);
+        mqtt.batch = yMqtt["batch"].as<int>(mqtt.batch);
+        mqtt.linger_ms = yMqtt["linger_ms"].as<int>(mqtt.linger_ms);
+        events_.Start(mqtt);
+    }
+
+    // each relay transition is read back and retried within a budget
+    YAML::Node yRelay = yConfig["relay_verify"];
+    relay_policy policy;
+    if (yRelay.IsDefined() && !yRelay.IsNull()) {
+        policy.budget_us = std::max(0, yRelay["budget_ms"].as<int>(
+                policy.budget_us / 1000)) * 1000;
+        policy.backoff_us = std::max(1, yRelay["backoff_us"].as<int>(
+                policy.backoff_us));
+    }
+    Zone::Policy(policy);
+
+    LoadBuses(yConfig["MODBUS"]);
     LoadZones(yConfig["ZONES"]);
 
+    // sites on one supply line stagger their starts, see mysprinkler supply
+    std::string offsets_file = yConfig["offsets_file"].as<std::string>("");
+    std::string offsets_error;
+    if (!offsets_file.empty() && !LoadOffsets(offsets_file, start_offsets_,
+            offsets_error)) {
+        utils::Logger::Instance().Warning("Starting without offsets, %s: %s",
+                offsets_file.c_str(), offsets_error.c_str());
+    }
+
     LoadPrograms(yConfig["PROGRAMS"]);
+    CheckDependencies();
+
+    // tariff: programs with a window start where pump energy is cheapest,
+    // planned for each night from the noon before, in MainLoop
+    std::string tariff_error;
+    if (!LoadTariff(yConfig, tariff_, tariff_error) && !tariff_error.empty()) {
+        utils::Logger::Instance().Warning("Ignoring the tariff, %s",
+                tariff_error.c_str());
+    }
+
+    flow_monitor_.LoadSensors(yConfig["FLOW_SENSORS"],
+            yConfig["flow_sample_seconds"].as<int>(5));
+    flow_monitor_.Start(ActiveZones, FaultZone, FaultSite);
+
+    // moisture probes skip zones whose soil is wet and may start a program
+    // when it dries out
+    soil_monitor_.LoadSensors(yConfig["SOIL_SENSORS"],
+            yConfig["adc_directory"].as<std::string>(
+            "/sys/bus/iio/devices/iio:device0"),
+            yConfig["soil_sample_ms"].as<int>(1000));
+    soil_monitor_.Start(ActiveZones, RequestManualRun);
+
+    // http: status and control from a browser, no authentication
+    YAML::Node yHttp = yConfig["http"];
+    if (yHttp.IsDefined() && !yHttp.IsNull()) {
+        http_options http;
+        http.bind = yHttp["bind"].as<std::string>(http.bind);
+        http.port = yHttp["port"].as<int>(http.port);
+        http.max_clients = yHttp["max_clients"].as<int>(http.max_clients);
+        http.idle_seconds = yHttp["idle_seconds"].as<int>(http.idle_seconds);
+        http.request_bytes = yHttp["request_bytes"].as<int>(
+                http.request_bytes);
+        http_.Start(http, state_, RequestManualRun, RequestStop);
+    }
+
+    // supervisor: when the scheduler or a relay transition stalls, relays
+    // are forced off, a dump written and the watchdog no longer petted
+    YAML::Node ySupervisor = yConfig["supervisor"];
+    if (ySupervisor.IsDefined() && !ySupervisor.IsNull()) {
+        supervisor_options supervision;
+        supervision.budget_ms = ySupervisor["budget_ms"].as<int>(
+                supervision.budget_ms);
+        supervision.period_ms = ySupervisor["period_ms"].as<int>(
+                supervision.period_ms);
+        supervision.watchdog = ySupervisor["watchdog"].as<std::string>("");
+        supervision.watchdog_timeout = ySupervisor["watchdog_timeout"].as<int>(
+                supervision.watchdog_timeout);
+        supervision.dump_directory = ySupervisor["dump_directory"].as<
+                std::string>(supervision.dump_directory);
+        if (supervision.budget_ms * 1000LL <= policy.budget_us) {
+            utils::Logger::Instance().Warning("supervisor budget_ms is within "
+                    "relay_verify budget_ms, a retried transition will stall");
+        }
+        std::vector<supervisor_relay> relays;
+        for (const auto& zone : zones_) {
+            if (zone->Pin() > 0) {
+                relays.push_back({zone->Pin(), zone->InvertLogic()});
+            }
+        }
+        supervisor_.Watch(scheduler_beat_);
+        supervisor_.Watch(Zone::Beat());
+        for (const auto& bus : modbus_buses_) {
+            std::shared_ptr<ModbusBus> coils = bus.second;
+            supervisor_.AddRelaysOff([coils]() {
+                coils->ForceOff();
+            });
+        }
+        supervisor_.Start(supervision, relays, []() {
+            std::string out;
+            auto state = state_.Read();
+            if (state) StatusJson(out, *state, state.Version());
+            return out;
+        }, [](const Heartbeat& heartbeat, std::int64_t busy,
+                const std::string& dump) {
+            utils::Logger::Instance().Warning("The %s stalled for %lld ms, "
+                    "relays forced off, dump in %s", heartbeat.Name(),
+                    static_cast<long long> (busy / 1000000), dump.c_str());
+            StartShutdown();
+            cv_.notify_all();
+        });
+    }
+
+    if (realtime_.enabled) {
+        std::thread valve([&fRet]() {
+            PrefaultStack(realtime_.stack_bytes);
+            std::string error = MakeRealtime(realtime_.priority,
+                    realtime_.cpu);
+            if (!error.empty()) {
+                utils::Logger::Instance().Warning("Valve thread at normal "
+                        "priority, %s", error.c_str());
+            } else {
+                utils::Logger::Instance().Info("Valve thread SCHED_FIFO "
+                        "priority %d, cpu %d", realtime_.priority,
+                        realtime_.cpu);
+            }
+            fRet = MainLoop();
+        });
+        valve.join();
+    } else {
+        fRet = MainLoop();
+    }
 
-    fRet = MainLoop();
+    if (http_.Running()) {
+        http_.Stop();
+        http_stats stats = http_.Stats();
+        ace::utils::Logger::Instance().Info("http: %llu requests, %llu not "
+                "modified, %llu bodies rebuilt, %llu clients turned away",
+                static_cast<unsigned long long> (stats.requests),
+                static_cast<unsigned long long> (stats.not_modified),
+                static_cast<unsigned long long> (stats.regenerated),
+                static_cast<unsigned long long> (stats.rejected));
+    }
+    flow_monitor_.Stop();
+    soil_monitor_.Stop();
+    background_.Stop();
+    if (events_.Running()) {
+        events_.Stop();
+        ace::utils::Logger::Instance().Info("Published %llu events, dropped "
+                "%llu", static_cast<unsigned long long> (events_.Published()),
+                static_cast<unsigned long long> (events_.Dropped()));
+    }
+    status_.Close();
+    StopAllZones();
+    relay_totals_ = relay_stats();
+    for (const auto& zone : zones_) {
+        relay_stats stats = zone->Stats();
+        ace::utils::Logger::Instance().Info("Zone %d relay %llu transitions, "
+                "%llu retried, %llu failed, confirmed in %.1f us on average, "
+                "%.1f at most", zone->Id(),
+                static_cast<unsigned long long> (stats.transitions),
+                static_cast<unsigned long long> (stats.retried),
+                static_cast<unsigned long long> (stats.failed),
+                stats.transitions > stats.failed ? stats.confirm_total.count()
+                / 1e3 / (stats.transitions - stats.failed) : 0.0,
+                stats.confirm_max.count() / 1e3);
+        relay_totals_.transitions += stats.transitions;
+        relay_totals_.attempts += stats.attempts;
+        relay_totals_.retried += stats.retried;
+        relay_totals_.failed += stats.failed;
+        relay_totals_.confirm_total += stats.confirm_total;
+        relay_totals_.confirm_max = std::max(relay_totals_.confirm_max,
+                stats.confirm_max);
+    }
+    if (supervisor_.Running()) {
+        supervisor_.Stop();
+        supervisor_stats stats = supervisor_.Stats();
+        ace::utils::Logger::Instance().Info("supervisor: %llu checks, %llu "
+                "watchdog pets, %llu stalls, busy %.1f ms at most",
+                static_cast<unsigned long long> (stats.checks),
+                static_cast<unsigned long long> (stats.pets),
+                static_cast<unsigned long long> (stats.stalls),
+                stats.longest_ns / 1e6);
+        // exit non-zero so a service manager restarts the daemon
+        fRet = fRet && !supervisor_.Stalled();
+    }
+    for (const auto& bus : modbus_buses_) {
+        bus.second->Close();
+        modbus_stats stats = bus.second->Stats();
+        ace::utils::Logger::Instance().Info("Modbus bus %d %llu transitions "
+                "in %llu requests, %llu sends, %llu timeouts, %llu bad frames, "
+                "%llu failed, %s", bus.first,
+                static_cast<unsigned long long> (stats.transitions),
+                static_cast<unsigned long long> (stats.requests),
+                static_cast<unsigned long long> (stats.attempts),
+                static_cast<unsigned long long> (stats.timeouts),
+                static_cast<unsigned long long> (stats.bad_frames),
+                static_cast<unsigned long long> (stats.failed),
+                bus.second->Latency().Summary("rtt").c_str());
+    }
+    zones_.clear();
+    modbus_buses_.clear();
+    for (auto& boards : modbus_sims_) {
+        boards->Stop();
+    }
+    fake_gpio_.Destroy();
 
     std::ofstream ofs(config_file_);
     ofs << yConfig;
     ofs.close();
     
     ace::utils::Logger::Instance().Info("mysprinkler exited cleanly.");
+    TraceStop();
+    ace::utils::Logger::Instance().Async(false);
     return fRet;
 }
 
+/**
+ * HistoryReport
+ * mysprinkler history <config> [day|month] [from YYYY-MM-DD] [to YYYY-MM-DD]
+ * @return exit status
+ */
+int HistoryReport(int argc, char* argv[]) {
+    if (argc < 1) {
+        std::cout << "eg: mysprinkler history /etc/mysprinkler.yaml month "
+                "2026-01-01 2027-01-01\n";
+        return EXIT_FAILURE;
+    }
+    YAML::Node yConfig;
+    try {
+        yConfig = YAML::LoadFile(argv[0]);
+    } catch (const std::exception& e) {
+        std::cout << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+    std::string directory = yConfig["history_directory"].as<std::string>("");
+    if (directory.empty() || !history_.Open(directory)) {
+        std::cout << "No usable history_directory in configuration.\n";
+        return EXIT_FAILURE;
+    }
+
+    PERIOD period = (argc > 1 && std::string(argv[1]) == "month") ?
+            by_month : by_day;
+
+    // range is in local days, [from, to), default the last 30 days
+    const TimeZone& tz = TimeZone::Local();
+    std::time_t now = std::time(nullptr);
+    std::tm tm = tz.ToLocal(now);
+    tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
+    std::tm tm_from = tm, tm_to = tm;
+    tm_from.tm_mday -= 30;
+    tm_to.tm_mday += 1;
+    for (int i = 2; i < argc && i < 4; i++) {
+        std::tm& target = (i == 2) ? tm_from : tm_to;
+        if (std::sscanf(argv[i], "%d-%d-%d", &target.tm_year, &target.tm_mon,
+                &target.tm_mday) != 3) {
+            std::cout << "Invalid date " << argv[i] << ", expecting YYYY-MM-DD\n";
+            return EXIT_FAILURE;
+        }
+        target.tm_year -= 1900;
+        target.tm_mon -= 1;
+    }
+    std::time_t from, to;
+    tz.ToUtc(tm_from, from);
+    tz.ToUtc(tm_to, to);
+
+    // zone flow rates, in units per minute, give the water estimate
+    std::map<int, double> flow_rates;
+    YAML::Node zNode = yConfig["ZONES"];
+    for (auto it = zNode.begin(); it != zNode.end(); ++it) {
+        flow_rates[it->first.as<int>(0)] = it->second["flow_rate"].as<double>(0);
+    }
+
+    auto totals = history_.Aggregate(from, to, period);
+    std::printf("%-10s %5s %5s %5s %10s %10s\n", "period", "zone", "runs",
+            "skips", "minutes", "water");
+    for (const auto& bucket : totals) {
+        char label[16];
+        if (period == by_month) {
+            std::snprintf(label, sizeof (label), "%04d-%02d",
+                    static_cast<int> (bucket.first / 12),
+                    static_cast<int> (bucket.first % 12) + 1);
+        } else {
+            std::int64_t y;
+            int m, d;
+            TimeZone::CivilFromDays(bucket.first, y, m, d);
+            std::snprintf(label, sizeof (label), "%04d-%02d-%02d",
+                    static_cast<int> (y), m, d);
+        }
+        for (const auto& zone : bucket.second) {
+            double minutes = zone.second.seconds / 60.0;
+            std::printf("%-10s %5d %5d %5d %10.1f %10.1f\n", label, zone.first,
+                    zone.second.runs, zone.second.skips, minutes,
+                    minutes * flow_rates[zone.first]);
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * TortureCommand
+ * mysprinkler torture [scratch dir] [--programs N] [--zones N] [--seconds N]
+ *     [--timed N] [--cpu N] [--io N] [--latency-us N] [--failure-rate F]
+ *     [--ignore-rate F] [--stuck ZONE] [--readers N]
+ * Runs the daemon on a generated configuration whose programs are all due
+ * in the same minute, against a fake gpio tree, and reports how late zones
+ * turned on and off. Zone durations are seconds.
+ * @return exit status
+ */
+int TortureCommand(int argc, char* argv[]) {
+    std::string directory = "/dev/shm/mysprinkler-torture";
+    torture_options options;
+    for (int i = 0; i < argc; i++) {
+        std::string arg = argv[i];
+        bool value = i + 1 < argc;
+        if (arg == "--programs" && value) {
+            options.programs = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--zones" && value) {
+            options.zones = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--seconds" && value) {
+            options.seconds = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--timed" && value) {
+            options.timed = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--cpu" && value) {
+            options.cpu_threads = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--io" && value) {
+            options.io_threads = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--latency-us" && value) {
+            options.latency_us = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--failure-rate" && value) {
+            options.failure_rate = std::atof(argv[++i]);
+        } else if (arg == "--ignore-rate" && value) {
+            options.ignore_rate = std::atof(argv[++i]);
+        } else if (arg == "--stuck" && value) {
+            options.stuck = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--readers" && value) {
+            options.readers = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--realtime") {
+            options.realtime = true;
+        } else if (arg == "--realtime-cpu" && value) {
+            options.realtime = true;
+            options.realtime_cpu = std::atoi(argv[++i]);
+        } else if (arg == "--mqtt" && value) {
+            options.mqtt = argv[++i];
+        } else {
+            directory = arg;
+        }
+    }
+    mkdir(directory.c_str(), 0755);
+
+    // due at the start of a minute, with a few seconds to load
+    std::time_t now = std::time(nullptr);
+    std::time_t due = (now / 60 + 1) * 60;
+    if (due - now < 5) due += 60;
+    std::tm tm = TimeZone::Local().ToLocal(due);
+    std::string config = directory + "/torture.yaml";
+    if (!WriteTortureConfig(config, directory, options, tm.tm_hour,
+            tm.tm_min)) {
+        std::cout << "Unable to write " << config << "\n";
+        return EXIT_FAILURE;
+    }
+    int timed = options.timed > 0 ? options.programs / options.timed : 0;
+    // a stuck zone's programs are recorded as faulted, never turned off
+    std::uint64_t expected = 0;
+    for (int program = 1; program <= options.programs; program++) {
+        if ((program - 1) % options.zones + 1 != options.stuck) expected++;
+    }
+    std::printf("%d programs on %d zones due at %s, %d of them for %d "
+            "seconds, load: %d cpu and %d io threads%s\n", options.programs,
+            options.zones, FormatTime(due, "%T").c_str(), timed,
+            options.seconds, options.cpu_threads, options.io_threads,
+            options.realtime ? ", realtime" : "");
+    std::fflush(stdout);
+
+    LatencyHistogram starts, stops;
+    start_latency_ = &starts;
+    stop_latency_ = &stops;
+    duration_unit_ = std::chrono::seconds(1);
+    LoadGenerator load;
+    load.Start(options.cpu_threads, options.io_threads, directory);
+
+    // readers check each snapshot holds together: the zones switched on
+    // are the running program's, while it waters
+    std::atomic<bool> reading(options.readers > 0);
+    std::atomic<std::uint64_t> reads(0), torn(0);
+    std::vector<std::thread> readers;
+    for (int i = 0; i < options.readers; i++) {
+        readers.emplace_back([&]() {
+            std::uint64_t count = 0, bad = 0;
+            while (reading.load(std::memory_order_relaxed)) {
+                auto state = state_.Read();
+                count++;
+                if (!state) continue;
+                const state_run* current = state->Current();
+                std::vector<int> active = state->ActiveZones();
+                bool watering = current && current->watering;
+                if (active.size() != (watering ? 1u : 0u) ||
+                        (watering && active[0] != current->zone_id)) bad++;
+            }
+            reads += count;
+            torn += bad;
+        });
+    }
+
+    // every program waters one zone, shut down once the last turned off
+    std::time_t deadline = due + 120 + timed * options.seconds;
+    std::thread watcher([&]() {
+        while (!ShutdownRequested() &&
+                stops.Count() < expected
+                && std::time(nullptr) < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        {
+            std::lock_guard<std::mutex> lk(program_mutex_);
+            StartShutdown();
+        }
+        cv_.notify_all();
+    });
+    std::string name = "mysprinkler";
+    char* args[] = {&name[0], &config[0]};
+    AppInit(2, args);
+    watcher.join();
+    reading = false;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    load.Stop();
+    start_latency_ = stop_latency_ = nullptr;
+    unlink(config.c_str());
+    rmdir(directory.c_str());
+
+    std::printf("%s\n%s\n", starts.Summary("on").c_str(),
+            stops.Summary("off").c_str());
+    std::printf("relays %llu transitions, %llu writes, %llu retried, %llu "
+            "failed, confirmed in %.1f us on average, %.1f at most\n",
+            static_cast<unsigned long long> (relay_totals_.transitions),
+            static_cast<unsigned long long> (relay_totals_.attempts),
+            static_cast<unsigned long long> (relay_totals_.retried),
+            static_cast<unsigned long long> (relay_totals_.failed),
+            relay_totals_.transitions > relay_totals_.failed ?
+            relay_totals_.confirm_total.count() / 1e3 /
+            (relay_totals_.transitions - relay_totals_.failed) : 0.0,
+            relay_totals_.confirm_max.count() / 1e3);
+    if (options.readers > 0) {
+        std::printf("snapshots %llu published, %llu read by %d readers, %llu "
+                "inconsistent\n", static_cast<unsigned long long> (
+                state_.Version()), static_cast<unsigned long long> (reads),
+                options.readers, static_cast<unsigned long long> (torn));
+    }
+    if (!options.mqtt.empty()) {
+        std::printf("events %llu pushed, %llu published, %llu dropped, %llu "
+                "connects\n", static_cast<unsigned long long> (
+                events_.Pushed()),
+                static_cast<unsigned long long> (events_.Published()),
+                static_cast<unsigned long long> (events_.Dropped()),
+                static_cast<unsigned long long> (events_.Connects()));
+    }
+    return stops.Count() == expected ?
+            EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 int main(int argc, char** argv) {
+    if (argc > 1 && std::string(argv[1]) == "history") {
+        return HistoryReport(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "generate") {
+        return GenerateCommand(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "status") {
+        return StatusCommand(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "validate") {
+        return ValidateCommand(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "gpio-bench") {
+        return GpioBenchCommand(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "modbus-bench") {
+        return ModbusBenchCommand(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "tz-bench") {
+        return TimeZoneBenchCommand(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "coro-bench") {
+        return CoroBenchCommand(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "snapshot-bench") {
+        return SnapshotBenchCommand(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "http-bench") {
+        return HttpBenchCommand(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "soil") {
+        return SoilCommand(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "diff") {
+        return DiffCommand(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "dag") {
+        return DagCommand(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "supply") {
+        return SupplyCommand(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "tariff") {
+        return TariffCommand(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "cycles") {
+        return CyclesCommand(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "timeline") {
+        return TimelineCommand(argc - 2, argv + 2);
+    }
+
     std::signal(SIGTERM, signal_callback);
     std::signal(SIGINT, signal_callback);
     std::signal(SIGPIPE, signal_pipe_callback);
+    std::signal(SIGUSR1, signal_trace_callback);
+
+    // runs the daemon itself, so after the handlers
+    if (argc > 1 && std::string(argv[1]) == "torture") {
+        return TortureCommand(argc - 2, argv + 2);
+    }
 
     return (AppInit(argc, argv)) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
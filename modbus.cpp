@@ -0,0 +1,714 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "include/modbus.hpp"
+#include "include/trace.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <random>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace {
+
+const int kMaxCoils = 1968; // Write Multiple Coils carries no more
+const std::uint8_t kWriteCoil = 0x05;
+const std::uint8_t kWriteCoils = 0x0f;
+
+std::int64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+speed_t Speed(int baud) {
+    switch (baud) {
+        case 1200: return B1200;
+        case 2400: return B2400;
+        case 4800: return B4800;
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        default: return B0;
+    }
+}
+
+// a character is 11 bits on the line: start, 8 data, parity or a second
+// stop bit, and stop
+std::int64_t CharNs(int baud) {
+    return 11 * 1000000000LL / std::max(1, baud);
+}
+
+void Put16(std::vector<std::uint8_t>& frame, int value) {
+    frame.push_back(static_cast<std::uint8_t> (value >> 8));
+    frame.push_back(static_cast<std::uint8_t> (value & 0xff));
+}
+
+int Get16(const std::vector<std::uint8_t>& frame, size_t at) {
+    return frame[at] << 8 | frame[at + 1];
+}
+
+// the CRC goes low byte first
+void Seal(std::vector<std::uint8_t>& frame) {
+    std::uint16_t crc = ModbusCrc(frame.data(), frame.size());
+    frame.push_back(static_cast<std::uint8_t> (crc & 0xff));
+    frame.push_back(static_cast<std::uint8_t> (crc >> 8));
+}
+
+bool Sealed(const std::uint8_t* data, size_t size) {
+    return size >= 4 && ModbusCrc(data, size - 2) ==
+            (data[size - 2] | data[size - 1] << 8);
+}
+
+bool WriteAll(int fd, const std::vector<std::uint8_t>& frame) {
+    size_t sent = 0;
+    while (sent < frame.size()) {
+        ssize_t n = write(fd, frame.data() + sent, frame.size() - sent);
+        if (n < 0 && errno == EAGAIN) {
+            pollfd p = {fd, POLLOUT, 0};
+            poll(&p, 1, 100);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+} // namespace
+
+std::uint16_t ModbusCrc(const std::uint8_t* data, size_t size) {
+    std::uint16_t crc = 0xffff;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xa001 : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+ModbusBus::ModbusBus() : fd_(-1), running_(false), force_off_(false),
+char_ns_(0), last_ns_(0) {
+    wake_fd_[0] = wake_fd_[1] = -1;
+}
+
+ModbusBus::~ModbusBus() {
+    Close();
+}
+
+bool ModbusBus::Open(const modbus_options& options) {
+    Close();
+    options_ = options;
+    speed_t speed = Speed(options.baud);
+    if (speed == B0) {
+        errno = EINVAL;
+        return false;
+    }
+    fd_ = open(options.device.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK |
+            O_CLOEXEC);
+    termios tio;
+    if (fd_ < 0 || tcgetattr(fd_, &tio) != 0) {
+        int error = errno;
+        Close();
+        errno = error;
+        return false;
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~(PARENB | PARODD | CSTOPB);
+    if (options.parity == "even") {
+        tio.c_cflag |= PARENB;
+    } else if (options.parity == "odd") {
+        tio.c_cflag |= PARENB | PARODD;
+    } else {
+        tio.c_cflag |= CSTOPB;
+    }
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    if (tcsetattr(fd_, TCSANOW, &tio) != 0 ||
+            pipe2(wake_fd_, O_CLOEXEC | O_NONBLOCK) != 0) {
+        int error = errno;
+        Close();
+        errno = error;
+        return false;
+    }
+    tcflush(fd_, TCIOFLUSH);
+    char_ns_ = CharNs(options.baud);
+    last_ns_ = 0;
+    running_ = true;
+    thread_ = std::thread(&ModbusBus::Run, this);
+    return true;
+}
+
+void ModbusBus::Close() {
+    if (thread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lk(lock_);
+            running_ = false;
+        }
+        char c = 0;
+        if (write(wake_fd_[1], &c, 1) < 0) {
+            // a full pipe wakes the thread as well
+        }
+        thread_.join();
+    }
+    for (int* fd : {&fd_, &wake_fd_[0], &wake_fd_[1]}) {
+        if (*fd >= 0) close(*fd);
+        *fd = -1;
+    }
+}
+
+bool ModbusBus::IsOpen() const {
+    return running_;
+}
+
+const std::string& ModbusBus::Device() const {
+    return options_.device;
+}
+
+void ModbusBus::Register(int slave, int coil, bool off) {
+    std::lock_guard<std::mutex> lk(lock_);
+    coils_.insert(std::make_pair(std::make_pair(slave, coil), off));
+    off_[std::make_pair(slave, coil)] = off;
+}
+
+std::future<modbus_result> ModbusBus::Submit(int slave, int coil, bool on) {
+    std::promise<modbus_result> done;
+    std::future<modbus_result> result = done.get_future();
+    {
+        std::lock_guard<std::mutex> lk(lock_);
+        if (!running_) {
+            done.set_value({false, 0});
+            return result;
+        }
+        queue_.push_back({slave, coil, on, std::move(done)});
+    }
+    char c = 0;
+    if (write(wake_fd_[1], &c, 1) < 0) {
+        // a full pipe wakes the thread as well
+    }
+    return result;
+}
+
+modbus_result ModbusBus::Write(int slave, int coil, bool on) {
+    return Submit(slave, coil, on).get();
+}
+
+bool ModbusBus::Coil(int slave, int coil) const {
+    std::lock_guard<std::mutex> lk(lock_);
+    auto it = coils_.find(std::make_pair(slave, coil));
+    return it != coils_.end() && it->second;
+}
+
+void ModbusBus::ForceOff() {
+    force_off_ = true;
+    char c = 0;
+    if (wake_fd_[1] >= 0 && write(wake_fd_[1], &c, 1) < 0) {
+        // a full pipe wakes the thread as well
+    }
+}
+
+modbus_stats ModbusBus::Stats() const {
+    std::lock_guard<std::mutex> lk(lock_);
+    return stats_;
+}
+
+const LatencyHistogram& ModbusBus::Latency() const {
+    return latency_;
+}
+
+void ModbusBus::Run() {
+    TRACE_THREAD("modbus");
+    for (;;) {
+        std::vector<request> batch;
+        bool running;
+        {
+            std::lock_guard<std::mutex> lk(lock_);
+            batch.swap(queue_);
+            running = running_;
+        }
+        bool force = force_off_.exchange(false);
+        if (batch.empty() && !force) {
+            if (!running) break;
+            pollfd p = {wake_fd_[0], POLLIN, 0};
+            if (poll(&p, 1, -1) < 0 && errno != EINTR) break;
+            char drain[64];
+            while (read(wake_fd_[0], drain, sizeof (drain)) > 0) {
+            }
+            continue;
+        }
+
+        // the state each board is to be left in, boards in the order they
+        // were asked for, later requests for a coil win
+        std::vector<int> slaves;
+        std::map<int, std::map<int, bool> > want;
+        {
+            std::lock_guard<std::mutex> lk(lock_);
+            if (force) {
+                for (const auto& coil : off_) {
+                    if (want.count(coil.first.first) == 0) {
+                        slaves.push_back(coil.first.first);
+                    }
+                    want[coil.first.first][coil.first.second] = coil.second;
+                }
+                stats_.transitions += off_.size();
+            }
+            for (const auto& r : batch) {
+                if (want.count(r.slave) == 0) slaves.push_back(r.slave);
+                want[r.slave][r.coil] = r.on;
+            }
+            stats_.transitions += batch.size();
+        }
+
+        for (int slave : slaves) {
+            const std::map<int, bool>& coils = want[slave];
+            for (auto it = coils.begin(); it != coils.end();) {
+                // a run of coils one request carries, the coils between
+                // are resent as the bus knows them
+                std::vector<std::uint8_t> frame;
+                int first = it->first, last = first;
+                auto end = std::next(it);
+                std::vector<bool> values(1, it->second);
+                {
+                    std::lock_guard<std::mutex> lk(lock_);
+                    for (; end != coils.end() &&
+                            end->first - first < kMaxCoils; ++end) {
+                        std::vector<bool> between;
+                        for (int c = last + 1; c < end->first; c++) {
+                            auto known = coils_.find(std::make_pair(slave, c));
+                            if (known == coils_.end()) break;
+                            between.push_back(known->second);
+                        }
+                        if (static_cast<int> (between.size()) !=
+                                end->first - last - 1) {
+                            break;
+                        }
+                        values.insert(values.end(), between.begin(),
+                                between.end());
+                        values.push_back(end->second);
+                        last = end->first;
+                    }
+                }
+                frame.push_back(static_cast<std::uint8_t> (slave));
+                if (first == last) {
+                    frame.push_back(kWriteCoil);
+                    Put16(frame, first);
+                    Put16(frame, it->second ? 0xff00 : 0);
+                } else {
+                    frame.push_back(kWriteCoils);
+                    Put16(frame, first);
+                    Put16(frame, static_cast<int> (values.size()));
+                    frame.push_back(static_cast<std::uint8_t> (
+                            (values.size() + 7) / 8));
+                    for (size_t i = 0; i < values.size(); i += 8) {
+                        std::uint8_t bits = 0;
+                        for (size_t b = 0; b < 8 && i + b < values.size();
+                                b++) {
+                            if (values[i + b]) bits |= 1 << b;
+                        }
+                        frame.push_back(bits);
+                    }
+                }
+                Seal(frame);
+
+                modbus_result result = Transact(frame, 8);
+                {
+                    std::lock_guard<std::mutex> lk(lock_);
+                    stats_.requests++;
+                    stats_.attempts += result.attempts;
+                    if (!result.confirmed) stats_.failed++;
+                    for (auto c = it; c != end && result.confirmed; ++c) {
+                        coils_[std::make_pair(slave, c->first)] = c->second;
+                    }
+                }
+                for (auto& r : batch) {
+                    if (r.slave == slave && r.coil >= first && r.coil <= last) {
+                        r.done.set_value(result);
+                    }
+                }
+                it = end;
+            }
+        }
+    }
+}
+
+modbus_result ModbusBus::Transact(const std::vector<std::uint8_t>& frame,
+        size_t response) {
+    TRACE_SPAN("modbus", "Transact", frame[0]);
+    modbus_result result = {false, 0};
+    std::uint8_t function = frame[1];
+    std::vector<std::uint8_t> in;
+    while (!result.confirmed && result.attempts <= options_.retries) {
+        result.attempts++;
+        Silence();
+        tcflush(fd_, TCIFLUSH); // a late answer to the previous send
+        std::int64_t begin = Now();
+        in.clear();
+        if (!WriteAll(fd_, frame)) {
+            last_ns_ = Now();
+            continue;
+        }
+        // both frames take their characters on the line
+        std::int64_t deadline = begin + (frame.size() + response) *
+                char_ns_ + options_.timeout_ms * 1000000LL;
+        bool exception = false;
+        while (in.size() < response && !exception) {
+            std::int64_t left = deadline - Now();
+            if (left <= 0) break;
+            pollfd p = {fd_, POLLIN, 0};
+            int ready = poll(&p, 1, static_cast<int> ((left + 999999) /
+                    1000000));
+            if (ready < 0 && errno == EINTR) continue;
+            if (ready <= 0) break;
+            std::uint8_t buffer[256];
+            ssize_t n = read(fd_, buffer, std::min(sizeof (buffer),
+                    response - in.size()));
+            if (n > 0) in.insert(in.end(), buffer, buffer + n);
+            // an exception response is 5 bytes
+            exception = in.size() >= 5 && in[1] == (function | 0x80);
+        }
+        last_ns_ = Now();
+
+        std::lock_guard<std::mutex> lk(lock_);
+        if (exception && Sealed(in.data(), 5) && in[0] == frame[0]) {
+            stats_.exceptions++;
+            return result; // refused, sending again changes nothing
+        }
+        if (in.size() < response && !exception) {
+            stats_.timeouts++;
+            continue;
+        }
+        if (exception || !Sealed(in.data(), response) ||
+                !std::equal(in.begin(), in.begin() + 6, frame.begin())) {
+            stats_.bad_frames++;
+            continue;
+        }
+        latency_.Record(std::chrono::nanoseconds(last_ns_ - begin));
+        result.confirmed = true;
+    }
+    return result;
+}
+
+void ModbusBus::Silence() {
+    // 3.5 characters, fixed at 1.75 ms above 19200 baud
+    std::int64_t gap = options_.baud > 19200 ? 1750000 : char_ns_ * 7 / 2;
+    std::int64_t wait = last_ns_ + gap - Now();
+    if (wait > 0) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+    }
+}
+
+ModbusSlaveSim::ModbusSlaveSim() : master_fd_(-1), slave_fd_(-1),
+running_(false), frames_(0) {
+    wake_fd_[0] = wake_fd_[1] = -1;
+}
+
+ModbusSlaveSim::~ModbusSlaveSim() {
+    Stop();
+}
+
+bool ModbusSlaveSim::Start(const modbus_sim_options& options) {
+    Stop();
+    options_ = options;
+    if (options_.slaves.empty()) options_.slaves.push_back(1);
+    boards_.clear();
+    for (int slave : options_.slaves) {
+        boards_[slave].assign(std::max(1, options_.coils), false);
+    }
+
+    master_fd_ = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    char name[128];
+    termios tio;
+    if (master_fd_ < 0 || grantpt(master_fd_) != 0 ||
+            unlockpt(master_fd_) != 0 ||
+            ptsname_r(master_fd_, name, sizeof (name)) != 0 ||
+            (slave_fd_ = open(name, O_RDWR | O_NOCTTY | O_CLOEXEC)) < 0 ||
+            tcgetattr(slave_fd_, &tio) != 0) {
+        int error = errno;
+        Stop();
+        errno = error;
+        return false;
+    }
+    // no echo or line editing, bytes pass as they are
+    cfmakeraw(&tio);
+    if (tcsetattr(slave_fd_, TCSANOW, &tio) != 0 ||
+            pipe2(wake_fd_, O_CLOEXEC) != 0) {
+        int error = errno;
+        Stop();
+        errno = error;
+        return false;
+    }
+    device_ = name;
+    running_ = true;
+    thread_ = std::thread(&ModbusSlaveSim::Run, this);
+    return true;
+}
+
+void ModbusSlaveSim::Stop() {
+    if (thread_.joinable()) {
+        running_ = false;
+        char c = 0;
+        if (write(wake_fd_[1], &c, 1) < 0) {
+            // the thread is gone already
+        }
+        thread_.join();
+    }
+    for (int* fd : {&master_fd_, &slave_fd_, &wake_fd_[0], &wake_fd_[1]}) {
+        if (*fd >= 0) close(*fd);
+        *fd = -1;
+    }
+}
+
+const std::string& ModbusSlaveSim::Device() const {
+    return device_;
+}
+
+bool ModbusSlaveSim::Coil(int slave, int coil) const {
+    std::lock_guard<std::mutex> lk(lock_);
+    auto board = boards_.find(slave);
+    return board != boards_.end() && coil >= 0 &&
+            coil < static_cast<int> (board->second.size()) &&
+            board->second[coil];
+}
+
+std::uint64_t ModbusSlaveSim::Frames() const {
+    return frames_;
+}
+
+void ModbusSlaveSim::Run() {
+    TRACE_THREAD("modbus sim");
+    std::vector<std::uint8_t> buffer;
+    pollfd fds[2] = {
+        {master_fd_, POLLIN, 0},
+        {wake_fd_[0], POLLIN, 0}
+    };
+    while (running_) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (!(fds[0].revents & POLLIN)) continue;
+        std::uint8_t chunk[256];
+        ssize_t n = read(master_fd_, chunk, sizeof (chunk));
+        if (n <= 0) continue;
+        buffer.insert(buffer.end(), chunk, chunk + n);
+
+        // a pty has no silent gaps, frames are told apart by their length
+        while (buffer.size() >= 2) {
+            size_t size = 8;
+            if (buffer[1] == kWriteCoils || buffer[1] == 0x10) {
+                if (buffer.size() < 7) break;
+                size = 9 + buffer[6];
+            }
+            if (buffer.size() < size) break;
+            std::vector<std::uint8_t> frame(buffer.begin(),
+                    buffer.begin() + size);
+            buffer.erase(buffer.begin(), buffer.begin() + size);
+            if (!Sealed(frame.data(), frame.size())) {
+                buffer.clear(); // lost track, wait for the master to resend
+                break;
+            }
+            frames_++;
+            Answer(frame);
+        }
+    }
+}
+
+void ModbusSlaveSim::Answer(std::vector<std::uint8_t>& frame) {
+    static thread_local std::mt19937 random(std::random_device{}());
+    std::uniform_real_distribution<double> chance(0, 1);
+    if (options_.drop_rate > 0 && chance(random) < options_.drop_rate) return;
+
+    std::uint8_t function = frame[1];
+    int address = Get16(frame, 2);
+    std::uint8_t exception = 0;
+    std::vector<std::uint8_t> reply;
+    {
+        std::lock_guard<std::mutex> lk(lock_);
+        auto board = boards_.find(frame[0]);
+        if (board == boards_.end()) return; // another board's
+        std::vector<bool>& coils = board->second;
+        int size = static_cast<int> (coils.size());
+        if (function == kWriteCoil) {
+            int value = Get16(frame, 4);
+            if (value != 0xff00 && value != 0) {
+                exception = 3;
+            } else if (address >= size) {
+                exception = 2;
+            } else {
+                coils[address] = value != 0;
+            }
+        } else if (function == kWriteCoils) {
+            int count = Get16(frame, 4);
+            if (count < 1 || count > kMaxCoils || frame[6] != (count + 7) / 8) {
+                exception = 3;
+            } else if (address + count > size) {
+                exception = 2;
+            } else {
+                for (int i = 0; i < count; i++) {
+                    coils[address + i] = (frame[7 + i / 8] >> (i % 8)) & 1;
+                }
+            }
+        } else {
+            exception = 1;
+        }
+    }
+    if (exception) {
+        reply = {frame[0], static_cast<std::uint8_t> (function | 0x80),
+            exception};
+    } else {
+        reply.assign(frame.begin(), frame.begin() + 6);
+    }
+    Seal(reply);
+
+    std::int64_t wait = options_.latency_us * 1000LL;
+    if (options_.baud > 0) {
+        wait += (frame.size() + reply.size()) * CharNs(options_.baud);
+    }
+    std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+    if (options_.corrupt_rate > 0 && chance(random) < options_.corrupt_rate) {
+        reply.back() ^= 0x5a;
+    }
+    WriteAll(master_fd_, reply);
+}
+
+int ModbusBenchCommand(int argc, char* argv[]) {
+    modbus_sim_options sim;
+    sim.coils = 8;
+    int slaves = 4;
+    int rounds = 10;
+    for (int i = 0; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        const char* value = argv[i + 1];
+        if (arg == "--slaves") {
+            slaves = std::max(1, std::min(247, std::atoi(value)));
+        } else if (arg == "--coils") {
+            sim.coils = std::max(1, std::min(kMaxCoils, std::atoi(value)));
+        } else if (arg == "--rounds") {
+            rounds = std::max(1, std::atoi(value));
+        } else if (arg == "--baud") {
+            sim.baud = std::atoi(value);
+        } else if (arg == "--latency-us") {
+            sim.latency_us = std::max(0, std::atoi(value));
+        } else if (arg == "--drop") {
+            sim.drop_rate = std::atof(value);
+        } else if (arg == "--corrupt") {
+            sim.corrupt_rate = std::atof(value);
+        } else {
+            std::printf("eg: mysprinkler modbus-bench [--slaves N] "
+                    "[--coils N] [--rounds N] [--baud N] [--latency-us N] "
+                    "[--drop R] [--corrupt R]\n");
+            return EXIT_FAILURE;
+        }
+    }
+    for (int slave = 1; slave <= slaves; slave++) {
+        sim.slaves.push_back(slave);
+    }
+    ModbusSlaveSim boards;
+    if (!boards.Start(sim)) {
+        std::printf("Unable to open a pseudo-terminal: %s\n",
+                std::strerror(errno));
+        return EXIT_FAILURE;
+    }
+    modbus_options options;
+    options.device = boards.Device();
+    options.baud = Speed(sim.baud) == B0 ? 115200 : sim.baud;
+    options.parity = "none"; // a pty refuses parity
+    std::printf("%d boards of %d coils on %s, %d baud, %d us to answer\n",
+            slaves, sim.coils, boards.Device().c_str(), sim.baud,
+            sim.latency_us);
+
+    // every coil switched each round, waiting on each transition or
+    // queuing them all as a program change or a stop of the site does
+    for (bool together : {false, true}) {
+        ModbusBus bus;
+        if (!bus.Open(options)) {
+            std::printf("Unable to open %s: %s\n", options.device.c_str(),
+                    std::strerror(errno));
+            return EXIT_FAILURE;
+        }
+        for (int slave : sim.slaves) {
+            for (int coil = 0; coil < sim.coils; coil++) {
+                bus.Register(slave, coil);
+            }
+        }
+        int mismatched = 0;
+        auto begin = std::chrono::steady_clock::now();
+        for (int round = 0; round < rounds; round++) {
+            bool on = round % 2 == 0;
+            std::vector<std::future<modbus_result> > pending;
+            for (int slave : sim.slaves) {
+                for (int coil = 0; coil < sim.coils; coil++) {
+                    if (together) {
+                        pending.push_back(bus.Submit(slave, coil, on));
+                    } else {
+                        bus.Write(slave, coil, on);
+                    }
+                }
+            }
+            for (auto& result : pending) {
+                result.get();
+            }
+            for (int slave : sim.slaves) {
+                for (int coil = 0; coil < sim.coils; coil++) {
+                    mismatched += boards.Coil(slave, coil) != on;
+                }
+            }
+        }
+        double seconds = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - begin).count();
+        bus.Close();
+        modbus_stats stats = bus.Stats();
+        std::printf("%-10s %6llu transitions in %5llu requests, %8.1f "
+                "transitions/s, %llu sends, %llu timeouts, %llu bad frames, "
+                "%llu failed, %d coils wrong\n", together ? "queued" :
+                "one by one", static_cast<unsigned long long> (
+                stats.transitions), static_cast<unsigned long long> (
+                stats.requests), stats.transitions / seconds,
+                static_cast<unsigned long long> (stats.attempts),
+                static_cast<unsigned long long> (stats.timeouts),
+                static_cast<unsigned long long> (stats.bad_frames),
+                static_cast<unsigned long long> (stats.failed), mismatched);
+        std::printf("%-10s %s\n", "", bus.Latency().Summary("rtt").c_str());
+    }
+    boards.Stop();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,98 @@
+#!/bin/bash
+#
+# Runs torture against a local mosquitto and checks every event pushed was
+# either published or counted as dropped, with the broker up throughout,
+# down until the programs are watering, and stopped (SIGSTOP) mid run.
+#
+#   ./mqtt-test.sh [mysprinkler binary]
+#
+# MOSQUITTO overrides the broker command, it is run as $MOSQUITTO -p PORT.
+# PORT defaults to 18830, TORTURE holds extra torture options.
+
+BIN=${1:-dist/Debug/GNU-Linux/mysprinkler}
+MOSQUITTO=${MOSQUITTO:-mosquitto}
+PORT=${PORT:-18830}
+# watering lasts a minute, past the publisher's 30 second reconnect backoff
+TORTURE=${TORTURE:-"--programs 1000 --zones 8 --timed 50 --seconds 3"}
+SCRATCH=$(mktemp -d /tmp/mysprinkler-mqtt.XXXXXX)
+BROKER=
+
+stop_broker() {
+    if [ -n "$BROKER" ]; then
+        kill -CONT $BROKER 2>/dev/null
+        kill $BROKER 2>/dev/null
+        wait $BROKER 2>/dev/null
+        BROKER=
+    fi
+}
+
+start_broker() {
+    $MOSQUITTO -p $PORT >$SCRATCH/broker.log 2>&1 &
+    BROKER=$!
+    sleep 1
+    if ! kill -0 $BROKER 2>/dev/null; then
+        echo "$MOSQUITTO -p $PORT did not start:"
+        cat $SCRATCH/broker.log
+        BROKER=
+        return 1
+    fi
+}
+
+trap 'stop_broker; rm -rf $SCRATCH' EXIT
+
+# waits for torture to print when its programs are due, then until a few
+# seconds into the watering
+wait_watering() {
+    local due=
+    while [ -z "$due" ] && kill -0 $1 2>/dev/null; do
+        sleep 0.2
+        due=$(sed -n 's/.* due at \([0-9:]*\),.*/\1/p' $SCRATCH/torture.txt)
+    done
+    [ -n "$due" ] || return 1
+    local at=$(($(date -d "$due" +%s) + $2))
+    while [ $(date +%s) -lt $at ]; do
+        sleep 0.2
+    done
+}
+
+# case name: up, down or stalled
+run_case() {
+    local name=$1
+    [ $name = down ] || start_broker || return 1
+    $BIN torture $SCRATCH/run --mqtt 127.0.0.1:$PORT $TORTURE \
+            >$SCRATCH/torture.txt 2>&1 &
+    local torture=$!
+    case $name in
+    down)
+        wait_watering $torture 3 && start_broker
+        ;;
+    stalled)
+        if wait_watering $torture 2; then
+            kill -STOP $BROKER
+            sleep 8
+            kill -CONT $BROKER
+        fi
+        ;;
+    esac
+    wait $torture
+    local status=$?
+    stop_broker
+
+    local counts=$(sed -n 's/^events \([0-9]*\) pushed, \([0-9]*\) published, \([0-9]*\) dropped, \([0-9]*\) connects$/\1 \2 \3 \4/p' \
+            $SCRATCH/torture.txt)
+    set -- $counts
+    if [ $status -ne 0 ] || [ $# -ne 4 ] || [ $1 -eq 0 ] ||
+            [ $(($2 + $3)) -ne $1 ] || [ $4 -eq 0 ]; then
+        echo "FAIL broker $name"
+        cat $SCRATCH/torture.txt
+        return 1
+    fi
+    echo "ok   broker $name: $1 pushed, $2 published, $3 dropped," \
+            "$4 connects"
+}
+
+failed=0
+for name in up down stalled; do
+    run_case $name || failed=1
+done
+exit $failed
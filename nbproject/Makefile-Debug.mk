@@ -35,10 +35,33 @@ OBJECTDIR=${CND_BUILDDIR}/${CND_CONF}/${CND_PLATFORM}
 
 # Object Files
 OBJECTFILES= \
+	${OBJECTDIR}/codegen.o \
+	${OBJECTDIR}/coroutine.o \
+	${OBJECTDIR}/cycles.o \
+	${OBJECTDIR}/dag.o \
+	${OBJECTDIR}/diff.o \
+	${OBJECTDIR}/events.o \
+	${OBJECTDIR}/flow.o \
+	${OBJECTDIR}/gpio.o \
+	${OBJECTDIR}/history.o \
+	${OBJECTDIR}/http.o \
 	${OBJECTDIR}/Logger.o \
 	${OBJECTDIR}/main.o \
+	${OBJECTDIR}/modbus.o \
 	${OBJECTDIR}/program.o \
+	${OBJECTDIR}/realtime.o \
 	${OBJECTDIR}/shutdown.o \
+	${OBJECTDIR}/soil.o \
+	${OBJECTDIR}/state.o \
+	${OBJECTDIR}/status.o \
+	${OBJECTDIR}/supervisor.o \
+	${OBJECTDIR}/supply.o \
+	${OBJECTDIR}/tariff.o \
+	${OBJECTDIR}/timeline.o \
+	${OBJECTDIR}/timezone.o \
+	${OBJECTDIR}/torture.o \
+	${OBJECTDIR}/trace.o \
+	${OBJECTDIR}/validate.o \
 	${OBJECTDIR}/zone.o
 
 
@@ -56,7 +79,7 @@ FFLAGS=
 ASFLAGS=
 
 # Link Libraries and Options
-LDLIBSOPTIONS=-lyaml-cpp -lBlackLib
+LDLIBSOPTIONS=-lyaml-cpp -lrt
 
 # Build Targets
 .build-conf: ${BUILD_SUBPROJECTS}
@@ -66,34 +89,148 @@ ${CND_DISTDIR}/${CND_CONF}/${CND_PLATFORM}/mysprinkler: ${OBJECTFILES}
 	${MKDIR} -p ${CND_DISTDIR}/${CND_CONF}/${CND_PLATFORM}
 	${LINK.cc} -o ${CND_DISTDIR}/${CND_CONF}/${CND_PLATFORM}/mysprinkler ${OBJECTFILES} ${LDLIBSOPTIONS} -pthread
 
+${OBJECTDIR}/codegen.o: codegen.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/codegen.o codegen.cpp
+
+${OBJECTDIR}/coroutine.o: coroutine.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -Iusr/include/BlackLib -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/coroutine.o coroutine.cpp
+
+${OBJECTDIR}/cycles.o: cycles.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/cycles.o cycles.cpp
+
+${OBJECTDIR}/dag.o: dag.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/dag.o dag.cpp
+
+${OBJECTDIR}/diff.o: diff.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/diff.o diff.cpp
+
+${OBJECTDIR}/events.o: events.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/events.o events.cpp
+
+${OBJECTDIR}/flow.o: flow.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/flow.o flow.cpp
+
+${OBJECTDIR}/gpio.o: gpio.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/gpio.o gpio.cpp
+
+${OBJECTDIR}/history.o: history.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/history.o history.cpp
+
+${OBJECTDIR}/http.o: http.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/http.o http.cpp
+
 ${OBJECTDIR}/Logger.o: Logger.cpp 
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} "$@.d"
-	$(COMPILE.cc) -g -s -Iusr/include/BlackLib -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/Logger.o Logger.cpp
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/Logger.o Logger.cpp
 
 ${OBJECTDIR}/main.o: main.cpp 
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} "$@.d"
-	$(COMPILE.cc) -g -s -Iusr/include/BlackLib -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/main.o main.cpp
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/main.o main.cpp
+
+${OBJECTDIR}/modbus.o: modbus.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/modbus.o modbus.cpp
 
 ${OBJECTDIR}/program.o: program.cpp 
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} "$@.d"
-	$(COMPILE.cc) -g -s -Iusr/include/BlackLib -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/program.o program.cpp
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/program.o program.cpp
+
+${OBJECTDIR}/realtime.o: realtime.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/realtime.o realtime.cpp
 
 ${OBJECTDIR}/shutdown.o: shutdown.cpp 
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} "$@.d"
-	$(COMPILE.cc) -g -s -Iusr/include/BlackLib -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/shutdown.o shutdown.cpp
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/shutdown.o shutdown.cpp
+
+${OBJECTDIR}/soil.o: soil.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/soil.o soil.cpp
+
+${OBJECTDIR}/state.o: state.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/state.o state.cpp
+
+${OBJECTDIR}/status.o: status.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/status.o status.cpp
+
+${OBJECTDIR}/supervisor.o: supervisor.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/supervisor.o supervisor.cpp
+
+${OBJECTDIR}/supply.o: supply.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/supply.o supply.cpp
+
+${OBJECTDIR}/tariff.o: tariff.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/tariff.o tariff.cpp
+
+${OBJECTDIR}/timeline.o: timeline.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/timeline.o timeline.cpp
+
+${OBJECTDIR}/timezone.o: timezone.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/timezone.o timezone.cpp
+
+${OBJECTDIR}/torture.o: torture.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/torture.o torture.cpp
+
+${OBJECTDIR}/trace.o: trace.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/trace.o trace.cpp
+
+${OBJECTDIR}/validate.o: validate.cpp 
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/validate.o validate.cpp
 
 ${OBJECTDIR}/zone.o: zone.cpp 
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} "$@.d"
-	$(COMPILE.cc) -g -s -Iusr/include/BlackLib -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/zone.o zone.cpp
+	$(COMPILE.cc) -g -s -DMYSPRINKLER_TRACE -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/zone.o zone.cpp
 
 # Subprojects
 .build-subprojects:
-	cd ../BlackLib && ${MAKE}  -f Makefile CONF=Debug
 
 # Clean Targets
 .clean-conf: ${CLEAN_SUBPROJECTS}
@@ -102,7 +239,6 @@ ${OBJECTDIR}/zone.o: zone.cpp
 
 # Subprojects
 .clean-subprojects:
-	cd ../BlackLib && ${MAKE}  -f Makefile CONF=Debug clean
 
 # Enable dependency checking
 .dep.inc: .depcheck-impl
@@ -26,14 +26,17 @@
  */
 
 #include "include/program.hpp"
+#include "include/timezone.hpp"
 
+#include <cstdio>
 #include <string>
 #include <chrono>
 #include <thread>
 #include <algorithm>
 
-Program::Program() : id_(-1), hour_(0), minute_(0), interval_(1),
-rain_delay_(false) {
+Program::Program() : id_(-1), hour_(0), minute_(0), offset_(0), interval_(1),
+rain_delay_(false), priority_(0), catch_up_(catch_up_run_late),
+catch_up_minutes_(0), window_from_(-1), window_until_(-1) {
 
 }
 
@@ -41,7 +44,7 @@ Program::~Program() {
 
 }
 
-bool Program::Disabled() {
+bool Program::Disabled() const {
     return disabled_;
 }
 
@@ -53,9 +56,116 @@ const int Program::Id() {
     return id_;
 }
 
-void Program::LoadWeekdays(YAML::Node weekdays) {
+int Program::Hour() const {
+    return hour_;
+}
+
+int Program::Minute() const {
+    return minute_;
+}
+
+int Program::Offset() const {
+    return offset_;
+}
+
+void Program::Offset(int minutes) {
+    offset_ = minutes;
+    NextStartTime();
+}
+
+MODE Program::Mode() const {
+    return mode_;
+}
+
+int Program::Interval() const {
+    return interval_;
+}
+
+const std::vector<int>& Program::Weekdays() const {
+    return weekdays_;
+}
+
+int Program::Priority() const {
+    return priority_;
+}
+
+CATCH_UP Program::CatchUp() const {
+    return catch_up_;
+}
+
+int Program::CatchUpMinutes() const {
+    return catch_up_minutes_;
+}
+
+bool Program::MayStart(std::time_t due, std::time_t now) const {
+    std::int64_t late = static_cast<std::int64_t> (now - due);
+    switch (catch_up_) {
+        case catch_up_skip:
+            return late < 60;
+        case catch_up_within:
+            return late < (catch_up_minutes_ + 1) * 60LL;
+        default:
+            return true;
+    }
+}
+
+void Program::RecordStart(std::time_t due, std::time_t started) {
+    std::int64_t late = std::max<std::int64_t>(0, started - due);
+    stats_.runs++;
+    stats_.late_total += late;
+    stats_.late_max = std::max(stats_.late_max, late);
+}
+
+void Program::RecordSkip() {
+    stats_.skips++;
+}
+
+void Program::RecordPreempted() {
+    stats_.preemptions++;
+}
+
+const program_stats& Program::Stats() const {
+    return stats_;
+}
+
+const std::vector<std::string>& Program::Problems() const {
+    return problems_;
+}
+
+const std::vector<int>& Program::After() const {
+    return after_;
+}
+
+const std::vector<int>& Program::NotWith() const {
+    return not_with_;
+}
+
+int Program::WindowFrom() const {
+    return window_from_;
+}
+
+int Program::WindowUntil() const {
+    return window_until_;
+}
+
+void Program::ClearDependencies() {
+    after_.clear();
+    not_with_.clear();
+}
+
+#ifndef MYSPRINKLER_FIXED
+void Program::LoadWeekdays(const YAML::Node& weekdays) {
+    // push_back'ing the scalar into a fresh list would merge the whole
+    // document's nodes into it, once per program
+    std::vector<std::string> days;
+    if (!weekdays.IsDefined()) return; // not given
+    if (weekdays.IsScalar()) { // eg: weekdays: monday
+        days.push_back(weekdays.as<std::string>("NAN"));
+    }
     for (int c = 0; c < weekdays.size(); c++) {
-        std::string day = weekdays[c].as<std::string>("NAN");
+        days.push_back(weekdays[c].as<std::string>("NAN"));
+    }
+    for (std::string day : days) {
         std::transform(day.begin(), day.end(), day.begin(), ::tolower);
         if (day.compare(0, 3, "sun") == 0) {
             weekdays_.push_back(0);
@@ -71,13 +181,55 @@ void Program::LoadWeekdays(YAML::Node weekdays) {
             weekdays_.push_back(5);
         } else if (day.compare(0, 3, "sat") == 0) {
             weekdays_.push_back(6);
+        } else {
+            problems_.push_back("unknown weekday " + day);
         }
     }
     if (!weekdays_.empty())
         std::sort(weekdays_.begin(), weekdays_.end());
 }
 
-void Program::LoadProgram(int id, YAML::Node node) {
+void Program::LoadWindow(const YAML::Node& node) {
+    window_from_ = window_until_ = -1;
+    if (!node.IsDefined() || node.IsNull()) return;
+    auto minutes = [](const std::string & clock) {
+        int hour = 0, minute = 0;
+        char extra;
+        if (std::sscanf(clock.c_str(), "%d:%d%c", &hour, &minute,
+                &extra) != 2 || hour < 0 || hour > 23 || minute < 0 ||
+                minute > 59) {
+            return -1;
+        }
+        return hour * 60 + minute;
+    };
+    int from = minutes(node["from"].as<std::string>(""));
+    int until = minutes(node["until"].as<std::string>(""));
+    if (from < 0 || until < 0 || from == until) {
+        problems_.push_back("window needs from and until, different, as "
+                "HH:MM");
+        return;
+    }
+    window_from_ = from;
+    window_until_ = until;
+}
+
+void Program::LoadIds(const YAML::Node& node, std::vector<int>& ids) {
+    ids.clear();
+    if (!node.IsDefined()) return;
+    if (node.IsScalar()) {
+        ids.push_back(node.as<int>(0));
+    } else if (node.IsSequence()) {
+        ids = node.as<std::vector<int> >();
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    if (std::find(ids.begin(), ids.end(), id_) != ids.end()) {
+        problems_.push_back("depends on itself");
+        ids.erase(std::find(ids.begin(), ids.end(), id_));
+    }
+}
+
+void Program::LoadProgram(int id, const YAML::Node& node) {
     id_ = id;
     hour_ = node["hour"].as<int>(0);
     minute_ = node["minute"].as<int>(0);
@@ -85,9 +237,19 @@ void Program::LoadProgram(int id, YAML::Node node) {
     interval_ = node["interval"].as<bool>(false);
     rain_delay_ = node["rain_delay"].as<bool>(false);
     disabled_ = node["disabled"].as<bool>(false);
+    priority_ = node["priority"].as<int>(0);
+    SetCatchUp(node["catch_up"].as<std::string>("run_late"));
+    catch_up_minutes_ = node["catch_up_minutes"].as<int>(0);
     LoadWeekdays(node["weekdays"]);
+    LoadIds(node["after"], after_);
+    LoadIds(node["not_with"], not_with_);
+    LoadWindow(node["window"]);
+    if (window_from_ >= 0 && !node["hour"].IsDefined()) {
+        hour_ = window_from_ / 60;
+        minute_ = window_from_ % 60;
+    }
 
-    YAML::Node zNode = node["zone_detail"];
+    const YAML::Node zNode = node["zone_detail"];
     for (auto it = zNode.begin(); it != zNode.end(); ++it) {
         zone_details_.push_back(zone_detail(
                 it->first.as<int>(0),
@@ -96,6 +258,28 @@ void Program::LoadProgram(int id, YAML::Node node) {
     zone_details_.sort([](const zone_detail& lhs, const zone_detail& rhs){
         return lhs.zone_id < rhs.zone_id;
     });
+    if (mode_ == MODE::weekdays && weekdays_.empty()) {
+        problems_.push_back("weekdays mode with no weekdays");
+    }
+    NextStartTime();
+}
+#endif
+
+void Program::LoadProgram(int id, int hour, int minute, MODE mode,
+        int interval, const std::vector<int>& weekdays,
+        const std::list<zone_detail>& zone_details) {
+    id_ = id;
+    hour_ = hour;
+    minute_ = minute;
+    mode_ = mode;
+    interval_ = interval;
+    disabled_ = false;
+    weekdays_ = weekdays;
+    std::sort(weekdays_.begin(), weekdays_.end());
+    zone_details_ = zone_details;
+    zone_details_.sort([](const zone_detail& lhs, const zone_detail& rhs){
+        return lhs.zone_id < rhs.zone_id;
+    });
     NextStartTime();
 }
 
@@ -104,20 +288,44 @@ const std::time_t& Program::StartTime() {
 }
 
 void Program::NextStartTime() {
-    std::chrono::system_clock::time_point tp = std::chrono::system_clock::now();
-    std::time_t tt = std::chrono::system_clock::to_time_t(tp);
-    std::tm ttm = *std::localtime(&tt);
+    NextStartTime(std::chrono::system_clock::to_time_t(
+            std::chrono::system_clock::now()));
+}
+
+void Program::NextStartTime(std::time_t now) {
+    std::tm tm_now = TimeZone::Local().ToLocal(now);
+    std::int64_t day = TimeZone::DaysFromCivil(tm_now.tm_year + 1900,
+            tm_now.tm_mon + 1, tm_now.tm_mday);
 
-    ttm.tm_hour = hour_;
-    ttm.tm_min = minute_;
-    ttm.tm_sec = 0;
-    next_runtime_ = std::mktime(&ttm);
+    next_runtime_ = LocalStart(day);
 
-    SetDay(ttm);
+    if (std::difftime(next_runtime_, now) <= 0) {
+        day++; // already passed today, start looking from tomorrow
+    }
 
-    next_runtime_ = std::mktime(&ttm);
+    next_runtime_ = LocalStart(SetDay(day));
 }
 
+std::time_t Program::LocalStart(std::int64_t day) {
+    std::int64_t year;
+    int month, mday;
+    TimeZone::CivilFromDays(day, year, month, mday);
+
+    std::tm tm = {};
+    tm.tm_year = static_cast<int> (year - 1900);
+    tm.tm_mon = month - 1;
+    tm.tm_mday = mday;
+    tm.tm_hour = hour_;
+    tm.tm_min = minute_ + offset_; // ToUtc() carries it into hours and days
+
+    // a start inside a DST gap runs an hour later, in an overlap the first time
+    std::time_t start = 0;
+    TimeZone::Local().ToUtc(tm, start, TimeZone::gap_forward,
+            TimeZone::overlap_earliest);
+    return start;
+}
+
+#ifndef MYSPRINKLER_FIXED
 void Program::SetMode(std::string mode) {
     std::transform(mode.begin(), mode.end(), mode.begin(), ::tolower);
     if (mode.compare("even_only") == 0) {
@@ -128,74 +336,72 @@ void Program::SetMode(std::string mode) {
         mode_ = MODE::weekdays;
     } else if (mode.compare("interval") == 0) {
         mode_ = MODE::interval;
+    } else {
+        mode_ = MODE::interval;
+        problems_.push_back("unknown mode " + mode);
     }
 }
 
-void Program::SetDay(std::tm& tm) {
-    bool isLeapYear = false;
-
-    std::chrono::system_clock::time_point tp = std::chrono::system_clock::now();
-    std::time_t tt = std::chrono::system_clock::to_time_t(tp);
-    std::tm tm_now = *std::localtime(&tt);
-
-    std::time_t now = std::mktime(&tm_now);
-    if (std::difftime(next_runtime_, now) <= 0) {
-        tm.tm_mday++; // increase the day by 1
-        mktime(&tm); // normalize tm struct
+void Program::SetCatchUp(std::string catch_up) {
+    std::transform(catch_up.begin(), catch_up.end(), catch_up.begin(),
+            ::tolower);
+    if (catch_up.compare("skip") == 0) {
+        catch_up_ = catch_up_skip;
+    } else if (catch_up.compare("within") == 0) {
+        catch_up_ = catch_up_within;
+    } else {
+        catch_up_ = catch_up_run_late;
     }
+}
+#endif
 
-    isLeapYear = tm.tm_year % 4 == 0;
+std::int64_t Program::SetDay(std::int64_t day) {
+    // days are stepped on the civil calendar, never through mktime, so DST
+    // changes can neither shift the start hour nor skip a day
+    std::int64_t year;
+    int month, mday;
+    TimeZone::CivilFromDays(day, year, month, mday);
 
     switch (mode_) {
         case MODE::even_only:
         {
-            while(tm.tm_mday % 2 != 0){
-                tm.tm_mday++;
-                mktime(&tm);
+            while (mday % 2 != 0) {
+                TimeZone::CivilFromDays(++day, year, month, mday);
             }
         }
             break;
         case MODE::odd_only:
         {
-            while(tm.tm_mday % 2 == 0){
-                tm.tm_mday++;
-                mktime(&tm);
+            while (mday % 2 == 0) {
+                TimeZone::CivilFromDays(++day, year, month, mday);
+            }
+            // skip the last odd day of the month, the 1st follows it
+            bool isLeapYear = year % 4 == 0;
+            if (mday == 31 || (mday == 29 && month == 2 && isLeapYear)) {
+                TimeZone::CivilFromDays(++day, year, month, mday);
             }
         }
             break;
         case MODE::interval:
         {
-            tm.tm_mday += interval_ > 0 ? interval_ : 0;
-            mktime(&tm);
+            day += interval_ > 0 ? interval_ : 0;
         }
             break;
         case MODE::weekdays:
         {
-            if (weekdays_.empty()) { 
+            if (weekdays_.empty()) {
                 Disabled(true); // disable misconfigured program
                 break; // no need to go any further
             }
-            while (true) {// iterate vector<int> and compare with day (0..6)
-                auto weekday = std::find_if(weekdays_.begin(), weekdays_.end(),
-                        [&tm](const int rhs) {
-                            return tm.tm_wday == rhs; // this day is in vector
-                        });
-                if (weekday == weekdays_.end()) { // this day not in vector
-                    tm.tm_mday++; // increase this day
-                    mktime(&tm); // normalize
-                } else {
-                    break;
-                }
+            // iterate vector<int> and compare with day (0..6)
+            while (std::find(weekdays_.begin(), weekdays_.end(),
+                    TimeZone::Weekday(day)) == weekdays_.end()) {
+                day++; // this day not in vector
             }
         }
             break;
     }
-
-    // skip the last odd day of the month
-    if (tm.tm_mday == 31 || (tm.tm_mday == 29 && tm.tm_mon == 2 && isLeapYear)) {
-        tm.tm_mday++;
-    }
-    mktime(&tm);
+    return day;
 }
 
 std::list<zone_detail> Program::ZoneDetail() {
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "include/realtime.hpp"
+#include "include/trace.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include <alloca.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+std::string LockMemory(size_t heap_bytes) {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        return std::string("mlockall: ") + std::strerror(errno);
+    }
+    // freed memory stays with the process, and locked
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+    if (heap_bytes) {
+        std::vector<char> heap(heap_bytes);
+        long page = sysconf(_SC_PAGESIZE);
+        for (size_t i = 0; i < heap.size(); i += page) {
+            *static_cast<volatile char*> (&heap[i]) = 0;
+        }
+    }
+    return std::string();
+}
+
+void PrefaultStack(size_t bytes) {
+    // alloca keeps it off the heap, the writes keep it from being optimised
+    volatile char* stack = static_cast<volatile char*> (alloca(bytes));
+    long page = sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < bytes; i += page) {
+        stack[i] = 0;
+    }
+}
+
+std::string MakeRealtime(int priority, int cpu) {
+    std::string error;
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        int e = pthread_setaffinity_np(pthread_self(), sizeof (set), &set);
+        if (e) {
+            error = "cpu " + std::to_string(cpu) + ": " + std::strerror(e);
+        }
+    }
+    sched_param param = {};
+    param.sched_priority = std::max(sched_get_priority_min(SCHED_FIFO),
+            std::min(priority, sched_get_priority_max(SCHED_FIFO)));
+    int e = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (e) {
+        if (!error.empty()) error += ", ";
+        error += std::string("SCHED_FIFO: ") + std::strerror(e);
+    }
+    return error;
+}
+
+WorkQueue::WorkQueue() : running_(false) {
+}
+
+WorkQueue::~WorkQueue() {
+    Stop();
+}
+
+void WorkQueue::Start() {
+    std::lock_guard<std::mutex>lock(lock_);
+    if (running_) return;
+    running_ = true;
+    thread_ = std::thread(&WorkQueue::Run, this);
+}
+
+void WorkQueue::Stop() {
+    {
+        std::lock_guard<std::mutex>lock(lock_);
+        if (!running_) return;
+        running_ = false;
+    }
+    cv_.notify_one();
+    thread_.join();
+}
+
+bool WorkQueue::Running() const {
+    std::lock_guard<std::mutex>lock(lock_);
+    return running_;
+}
+
+bool WorkQueue::Post(std::function<void()> work) {
+    {
+        std::lock_guard<std::mutex>lock(lock_);
+        if (!running_ || queue_.size() >= 1024) return false;
+        queue_.push_back(std::move(work));
+    }
+    cv_.notify_one();
+    return true;
+}
+
+void WorkQueue::Run() {
+    TRACE_THREAD("work queue");
+    std::unique_lock<std::mutex>lock(lock_);
+    while (running_ || !queue_.empty()) {
+        if (queue_.empty()) {
+            cv_.wait(lock);
+            continue;
+        }
+        std::function<void()> work = std::move(queue_.front());
+        queue_.pop_front();
+        lock.unlock();
+        work();
+        lock.lock();
+    }
+}
@@ -0,0 +1,393 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "include/soil.hpp"
+#include "include/Logger.h"
+#include "include/timezone.hpp"
+#include "include/trace.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using ace::utils::Logger;
+
+namespace {
+
+// consecutive failed reads before a sensor is no longer trusted
+const int kMaxFailures = 10;
+
+const char* kStateNames[] = {"unknown", "dry", "wet"};
+
+std::string ChannelPath(const std::string& directory, int channel) {
+    return directory + "/in_voltage" + std::to_string(channel) + "_raw";
+}
+
+} // namespace
+
+void soil_history::Add(std::time_t t, double moisture) {
+    std::time_t start = t - t % period;
+    if (count && start != open.start) {
+        open.mean /= count;
+        ring.Push(open);
+        count = 0;
+    }
+    float value = static_cast<float> (moisture);
+    if (count == 0) {
+        open = {start, 0, value, value};
+    }
+    open.mean += value;
+    open.min = std::min(open.min, value);
+    open.max = std::max(open.max, value);
+    count++;
+}
+
+SoilMonitor::SoilMonitor() : sample_ms_(1000), running_(false) {
+}
+
+SoilMonitor::~SoilMonitor() {
+    Stop();
+}
+
+void SoilMonitor::LoadSensors(const YAML::Node yNodes,
+        const std::string& directory, int sample_ms) {
+    directory_ = directory;
+    sample_ms_ = std::max(10, sample_ms);
+    for (auto it = yNodes.begin(); it != yNodes.end(); ++it) {
+        YAML::Node details = it->second;
+        std::unique_ptr<soil_sensor> sensor(new soil_sensor());
+
+        sensor->id = it->first.as<int>(0);
+        sensor->channel = details["channel"].as<int>(-1);
+        YAML::Node zones = details["zones"];
+        for (size_t c = 0; c < zones.size(); c++) {
+            sensor->zones.push_back(zones[c].as<int>(0));
+        }
+        sensor->dry_raw = details["dry_raw"].as<int>(4095);
+        sensor->wet_raw = details["wet_raw"].as<int>(0);
+        if (sensor->dry_raw == sensor->wet_raw) sensor->wet_raw--;
+        sensor->low = details["low"].as<double>(30);
+        sensor->high = std::max(sensor->low, details["high"].as<double>(40));
+        sensor->average = std::max(1, details["average"].as<int>(10));
+        sensor->program = details["program"].as<int>(0);
+        YAML::Node simulated = details["simulated"];
+        sensor->simulate = simulated.IsMap();
+        if (sensor->simulate) {
+            sensor->simulated_raw = simulated["raw"].as<double>(
+                    sensor->dry_raw);
+            sensor->simulated_dry_per_minute =
+                    simulated["dry_per_minute"].as<double>(0);
+            sensor->simulated_wet_per_minute =
+                    simulated["wet_per_minute"].as<double>(0);
+        }
+        sensor->fd = -1;
+        sensor->failures = 0;
+
+        Logger::Instance().Debug("Soil sensor %d on %s channel %d, dry below "
+                "%.0f%%, wet above %.0f%%", sensor->id, sensor->simulate ?
+                "simulated" : "adc", sensor->channel, sensor->low,
+                sensor->high);
+        sensors_.push_back(std::move(sensor));
+    }
+}
+
+bool SoilMonitor::Empty() const {
+    return sensors_.empty();
+}
+
+bool SoilMonitor::OpenChannel(soil_sensor& sensor) {
+    if (sensor.channel < 0) return false;
+    std::string path = ChannelPath(directory_, sensor.channel);
+    if (sensor.simulate) {
+        mkdir(directory_.c_str(), 0755);
+        sensor.fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    } else {
+        sensor.fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    return sensor.fd >= 0;
+}
+
+bool SoilMonitor::Start(active_zones_fn active_zones,
+        start_program_fn start_program) {
+    if (sensors_.empty() || running_) return true;
+
+    active_zones_ = active_zones;
+    start_program_ = start_program;
+    for (auto& sensor : sensors_) {
+        if (!OpenChannel(*sensor)) {
+            Logger::Instance().Warning("Unable to open soil sensor %d: %s",
+                    sensor->id, std::strerror(errno));
+        }
+    }
+    running_ = true;
+    thread_ = std::thread(&SoilMonitor::Run, this);
+    return true;
+}
+
+void SoilMonitor::Stop() {
+    if (!running_) return;
+    {
+        std::lock_guard<std::mutex>lock(lock_);
+        running_ = false;
+    }
+    cv_.notify_all();
+    thread_.join();
+    for (auto& sensor : sensors_) {
+        if (sensor->fd >= 0) close(sensor->fd);
+        sensor->fd = -1;
+    }
+}
+
+bool SoilMonitor::Wet(int zone_id) const {
+    bool measured = false;
+    for (const auto& sensor : sensors_) {
+        if (std::find(sensor->zones.begin(), sensor->zones.end(), zone_id) ==
+                sensor->zones.end()) continue;
+        if (sensor->state.load(std::memory_order_relaxed) != soil_wet) {
+            return false;
+        }
+        measured = true;
+    }
+    return measured;
+}
+
+std::vector<int> SoilMonitor::Sensors() const {
+    std::vector<int> ids;
+    for (const auto& sensor : sensors_) {
+        ids.push_back(sensor->id);
+    }
+    return ids;
+}
+
+const soil_sensor* SoilMonitor::Find(int sensor_id) const {
+    for (const auto& sensor : sensors_) {
+        if (sensor->id == sensor_id) return sensor.get();
+    }
+    return nullptr;
+}
+
+double SoilMonitor::Moisture(int sensor_id) const {
+    const soil_sensor* sensor = Find(sensor_id);
+    return sensor ? sensor->moisture.load() : 0;
+}
+
+SOIL_STATE SoilMonitor::State(int sensor_id) const {
+    const soil_sensor* sensor = Find(sensor_id);
+    return sensor ? static_cast<SOIL_STATE> (sensor->state.load()) :
+            soil_unknown;
+}
+
+int SoilMonitor::Raw(int sensor_id) const {
+    const soil_sensor* sensor = Find(sensor_id);
+    return sensor ? sensor->raw.load() : 0;
+}
+
+std::vector<soil_bucket> SoilMonitor::History(int sensor_id,
+        int period) const {
+    std::vector<soil_bucket> buckets;
+    const soil_sensor* sensor = Find(sensor_id);
+    if (sensor == nullptr) return buckets;
+    std::lock_guard<std::mutex>lock(history_lock_);
+    const soil_history& history = period >= 3600 ? sensor->hours :
+            sensor->minutes;
+    for (size_t i = 0; i < history.ring.Size(); i++) {
+        buckets.push_back(history.ring[i]);
+    }
+    return buckets;
+}
+
+void SoilMonitor::Run() {
+    TRACE_THREAD("soil");
+    auto period = std::chrono::milliseconds(sample_ms_);
+    auto next = std::chrono::steady_clock::now();
+    auto last = next;
+
+    while (running_) {
+        {
+            std::unique_lock<std::mutex>lk(lock_);
+            cv_.wait_until(lk, next, [this] {
+                return !running_;
+            });
+        }
+        if (!running_) break;
+        // a fixed cadence, a slow read does not push later samples back
+        auto now = std::chrono::steady_clock::now();
+        next += period;
+        if (next < now) next = now + period;
+
+        std::vector<int> active = active_zones_();
+        Simulate(std::chrono::duration<double>(now - last).count() / 60,
+                active);
+        last = now;
+
+        TRACE_SPAN("soil", "sample");
+        std::time_t t = std::time(nullptr);
+        for (auto& sensor : sensors_) {
+            if (sensor->fd >= 0) Sample(*sensor, t);
+        }
+    }
+}
+
+void SoilMonitor::Simulate(double minutes, const std::vector<int>& active) {
+    char text[16];
+    for (auto& sensor : sensors_) {
+        if (!sensor->simulate || sensor->fd < 0) continue;
+        bool watered = std::any_of(sensor->zones.begin(), sensor->zones.end(),
+                [&active](int zone) {
+                    return std::find(active.begin(), active.end(), zone) !=
+                            active.end();
+                });
+        // drier is towards dry_raw
+        double toward_dry = sensor->dry_raw > sensor->wet_raw ? 1 : -1;
+        sensor->simulated_raw += minutes * toward_dry * (watered ?
+                -sensor->simulated_wet_per_minute :
+                sensor->simulated_dry_per_minute);
+        sensor->simulated_raw = std::max<double>(std::min(sensor->dry_raw,
+                sensor->wet_raw), std::min<double>(std::max(sensor->dry_raw,
+                sensor->wet_raw), sensor->simulated_raw));
+        // fixed width, a reader never sees a shorter value's tail
+        int n = std::snprintf(text, sizeof (text), "%8d\n",
+                static_cast<int> (sensor->simulated_raw));
+        if (pwrite(sensor->fd, text, n, 0) != n) {
+            Logger::Instance().Warning("Unable to write simulated soil "
+                    "sensor %d", sensor->id);
+        }
+    }
+}
+
+void SoilMonitor::Sample(soil_sensor& sensor, std::time_t now) {
+    char text[32];
+    ssize_t n = pread(sensor.fd, text, sizeof (text) - 1, 0);
+    char* end = text;
+    long raw = 0;
+    if (n > 0) {
+        text[n] = 0;
+        raw = std::strtol(text, &end, 10);
+    }
+    if (n <= 0 || end == text) {
+        if (++sensor.failures == kMaxFailures &&
+                sensor.state != soil_unknown) {
+            Logger::Instance().Warning("Soil sensor %d unreadable, its zones "
+                    "water by the clock", sensor.id);
+            sensor.state = soil_unknown;
+        }
+        return;
+    }
+    sensor.failures = 0;
+    sensor.raw = static_cast<int> (raw);
+    sensor.samples.Push(static_cast<int> (raw));
+    if (sensor.samples.Size() < static_cast<size_t> (sensor.average)) return;
+
+    double sum = 0;
+    for (size_t i = sensor.samples.Size() - sensor.average;
+            i < sensor.samples.Size(); i++) {
+        sum += sensor.samples[i];
+    }
+    double moisture = (sensor.dry_raw - sum / sensor.average) * 100.0 /
+            (sensor.dry_raw - sensor.wet_raw);
+    moisture = std::max(0.0, std::min(100.0, moisture));
+    sensor.moisture = moisture;
+    {
+        std::lock_guard<std::mutex>lock(history_lock_);
+        sensor.minutes.Add(now, moisture);
+        sensor.hours.Add(now, moisture);
+    }
+
+    int state = sensor.state;
+    int next = state;
+    if (moisture <= sensor.low) {
+        next = soil_dry;
+    } else if (moisture >= sensor.high) {
+        next = soil_wet;
+    } else if (state == soil_unknown) {
+        next = moisture < (sensor.low + sensor.high) / 2 ? soil_dry : soil_wet;
+    }
+    if (next == state) return;
+    sensor.state = next;
+    Logger::Instance().Info("Soil sensor %d reads %.1f%%, %s", sensor.id,
+            moisture, kStateNames[next]);
+    if (next == soil_dry && sensor.program > 0) {
+        start_program_(sensor.program);
+    }
+}
+
+int SoilCommand(int argc, char* argv[]) {
+    if (argc < 1) {
+        std::cout << "eg: mysprinkler soil /etc/mysprinkler.yaml [seconds]\n";
+        return EXIT_FAILURE;
+    }
+    YAML::Node yConfig;
+    try {
+        yConfig = YAML::LoadFile(argv[0]);
+    } catch (const std::exception& e) {
+        std::cout << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+    int seconds = argc > 1 ? std::max(1, std::atoi(argv[1])) : 10;
+
+    SoilMonitor monitor;
+    monitor.LoadSensors(yConfig["SOIL_SENSORS"],
+            yConfig["adc_directory"].as<std::string>(
+            "/sys/bus/iio/devices/iio:device0"),
+            yConfig["soil_sample_ms"].as<int>(1000));
+    if (monitor.Empty()) {
+        std::cout << "No SOIL_SENSORS configured\n";
+        return EXIT_FAILURE;
+    }
+    // no zone is on and nothing is started, readings only
+    monitor.Start([]() {
+        return std::vector<int>();
+    }, [](int) {
+    });
+    for (int s = 0; s < seconds; s++) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        for (int id : monitor.Sensors()) {
+            std::printf("sensor %d raw %5d moisture %5.1f%% %s\n", id,
+                    monitor.Raw(id), monitor.Moisture(id),
+                    kStateNames[monitor.State(id)]);
+        }
+    }
+    monitor.Stop();
+    for (int id : monitor.Sensors()) {
+        for (const auto& bucket : monitor.History(id, 60)) {
+            char when[32];
+            std::tm tm = TimeZone::Local().ToLocal(bucket.start);
+            std::strftime(when, sizeof (when), "%F %R", &tm);
+            std::printf("sensor %d %s mean %5.1f%% min %5.1f%% max %5.1f%%\n",
+                    id, when, bucket.mean, bucket.min, bucket.max);
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "include/state.hpp"
+#include "include/torture.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+const state_run* scheduler_state::Current() const {
+    return runs.empty() ? nullptr : &runs.back();
+}
+
+std::vector<int> scheduler_state::ActiveZones() const {
+    std::vector<int> active;
+    for (const auto& zone : zones) {
+        if (zone.commanded) active.push_back(zone.id);
+    }
+    return active;
+}
+
+bool scheduler_state::SameAs(const scheduler_state& other) const {
+    return zones == other.zones && runs == other.runs &&
+            pending == other.pending && programs == other.programs;
+}
+
+bool operator==(const state_zone& left, const state_zone& right) {
+    return left.id == right.id && left.name == right.name &&
+            left.enabled == right.enabled &&
+            left.commanded == right.commanded &&
+            left.faulted == right.faulted && left.remaining == right.remaining;
+}
+
+bool operator==(const state_run& left, const state_run& right) {
+    return left.program_id == right.program_id &&
+            left.priority == right.priority && left.manual == right.manual &&
+            left.due == right.due && left.zone_id == right.zone_id &&
+            left.watering == right.watering && left.soaking == right.soaking &&
+            left.zones_left == right.zones_left;
+}
+
+bool operator==(const state_program& left, const state_program& right) {
+    return left.id == right.id && left.priority == right.priority &&
+            left.start == right.start;
+}
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+// how readers get at the latest state
+class SnapshotSource {
+public:
+    virtual ~SnapshotSource() {
+    }
+    virtual void Publish(std::shared_ptr<const scheduler_state> state) = 0;
+    // zone seconds remaining of the latest state, as a reader would use it
+    virtual long Read() = 0;
+};
+
+long Remaining(const scheduler_state& state) {
+    long remaining = 0;
+    for (const auto& zone : state.zones) {
+        remaining += zone.remaining;
+    }
+    return remaining;
+}
+
+class RcuSource : public SnapshotSource {
+public:
+    void Publish(std::shared_ptr<const scheduler_state> state) override {
+        snapshots_.Publish(std::move(state));
+    }
+
+    long Read() override {
+        auto view = snapshots_.Read();
+        return view ? Remaining(*view) : 0;
+    }
+private:
+    Snapshots<scheduler_state> snapshots_;
+};
+
+// a shared_ptr copied under a mutex
+class MutexSource : public SnapshotSource {
+public:
+    void Publish(std::shared_ptr<const scheduler_state> state) override {
+        std::lock_guard<std::mutex> lk(mutex_);
+        state_.swap(state);
+    }
+
+    long Read() override {
+        std::shared_ptr<const scheduler_state> state;
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            state = state_;
+        }
+        return state ? Remaining(*state) : 0;
+    }
+private:
+    std::mutex mutex_;
+    std::shared_ptr<const scheduler_state> state_;
+};
+
+// the state itself read under the scheduler's lock, as before
+class LockedSource : public SnapshotSource {
+public:
+    void Publish(std::shared_ptr<const scheduler_state> state) override {
+        std::lock_guard<std::mutex> lk(mutex_);
+        state_ = *state;
+    }
+
+    long Read() override {
+        std::lock_guard<std::mutex> lk(mutex_);
+        return Remaining(state_);
+    }
+private:
+    std::mutex mutex_;
+    scheduler_state state_;
+};
+
+// a state the size of a large site
+std::shared_ptr<const scheduler_state> MakeState(std::uint64_t loop) {
+    std::shared_ptr<scheduler_state> state(new scheduler_state());
+    state->at = std::time(nullptr);
+    state->loops = loop;
+    for (int zone = 1; zone <= 32; zone++) {
+        state->zones.push_back({zone, "zone " + std::to_string(zone), true,
+            zone == static_cast<int> (loop % 32) + 1, false,
+            static_cast<int> (loop % 600)});
+    }
+    state->runs.push_back({1, 0, false, state->at, 1, true, false, 4});
+    for (int program = 1; program <= 100; program++) {
+        state->programs.push_back({program, 0, state->at + program * 60});
+    }
+    return state;
+}
+
+struct bench_result {
+    std::uint64_t reads;
+    std::uint64_t publishes;
+    LatencyHistogram publish; // the swap only, the state is built before
+    LatencyHistogram read;
+};
+
+void Run(SnapshotSource& source, int readers, int seconds, int publish_us,
+        bench_result& result) {
+    source.Publish(MakeState(0));
+    std::atomic<bool> running(true);
+    std::vector<std::uint64_t> reads(readers);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < readers; i++) {
+        threads.emplace_back([&, i]() {
+            volatile long sink = 0;
+            std::uint64_t count = 0;
+            while (running.load(std::memory_order_relaxed)) {
+                sink = sink + source.Read();
+                count++;
+            }
+            reads[i] = count;
+        });
+    }
+
+    clock::time_point end = clock::now() + std::chrono::seconds(seconds);
+    clock::time_point next = clock::now();
+    std::uint64_t loop = 0;
+    while (clock::now() < end) {
+        auto state = MakeState(++loop);
+        auto begin = clock::now();
+        source.Publish(std::move(state));
+        result.publish.Record(clock::now() - begin);
+        // a reader on the scheduler's own thread, eg: the status page
+        begin = clock::now();
+        source.Read();
+        result.read.Record(clock::now() - begin);
+        next += std::chrono::microseconds(publish_us);
+        std::this_thread::sleep_until(next);
+    }
+    running = false;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    result.publishes = loop;
+    result.reads = 0;
+    for (auto count : reads) {
+        result.reads += count;
+    }
+}
+
+} // namespace
+
+int SnapshotBenchCommand(int argc, char* argv[]) {
+    int readers = argc > 0 ? std::max(0, std::atoi(argv[0])) : 8;
+    int seconds = argc > 1 ? std::max(1, std::atoi(argv[1])) : 3;
+    int publish_us = argc > 2 ? std::max(1, std::atoi(argv[2])) : 1000;
+    std::printf("%d readers, a 32 zone 100 program state published every "
+            "%d us for %d seconds\n", readers, publish_us, seconds);
+    std::printf("%-7s %12s %9s %12s %12s %12s %12s\n", "source", "reads/s",
+            "publishes", "publish p99", "publish max", "read p99",
+            "read max");
+
+    struct named_source {
+        const char* name;
+        std::unique_ptr<SnapshotSource> source;
+    };
+    named_source sources[] = {
+        {"rcu", std::unique_ptr<SnapshotSource>(new RcuSource())},
+        {"mutex", std::unique_ptr<SnapshotSource>(new MutexSource())},
+        {"locked", std::unique_ptr<SnapshotSource>(new LockedSource())},
+    };
+    for (auto& named : sources) {
+        bench_result result;
+        Run(*named.source, readers, seconds, publish_us, result);
+        std::printf("%-7s %12.0f %9llu %9.1f us %9.1f us %9.1f us %9.1f us\n",
+                named.name, static_cast<double> (result.reads) / seconds,
+                static_cast<unsigned long long> (result.publishes),
+                result.publish.Percentile(99) / 1e3,
+                result.publish.Max() / 1e3, result.read.Percentile(99) / 1e3,
+                result.read.Max() / 1e3);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "include/status.hpp"
+#include "include/Logger.h"
+#include "include/timezone.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+
+StatusWriter::StatusWriter() : page_(nullptr) {
+    name_[0] = '\0';
+}
+
+StatusWriter::~StatusWriter() {
+    Close();
+}
+
+bool StatusWriter::Open(const char* name) {
+    Close();
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        ace::utils::Logger::Instance().Warning("Unable to create status page"
+                " %s: %s", name, std::strerror(errno));
+        return false;
+    }
+    if (ftruncate(fd, sizeof (status_page)) != 0) {
+        ace::utils::Logger::Instance().Warning("Unable to size status page"
+                " %s: %s", name, std::strerror(errno));
+        close(fd);
+        return false;
+    }
+    void* map = mmap(nullptr, sizeof (status_page), PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+
+    page_ = static_cast<status_page*> (map);
+    std::snprintf(name_, sizeof (name_), "%s", name);
+
+    // readers reject the page until magic is written last
+    page_->magic = 0;
+    page_->version = status_version;
+    page_->size = sizeof (status_page);
+    page_->sequence.store(0, std::memory_order_relaxed);
+    std::memset(&page_->snapshot, 0, sizeof (page_->snapshot));
+    page_->snapshot.program_id = -1;
+    std::atomic_thread_fence(std::memory_order_release);
+    page_->magic = status_magic;
+    return true;
+}
+
+bool StatusWriter::IsOpen() const {
+    return page_ != nullptr;
+}
+
+void StatusWriter::Close() {
+    if (page_ == nullptr) return;
+    munmap(page_, sizeof (status_page));
+    page_ = nullptr;
+    shm_unlink(name_);
+}
+
+void StatusWriter::Publish(const status_snapshot& snapshot) {
+    if (page_ == nullptr) return;
+    std::uint32_t sequence = page_->sequence.load(std::memory_order_relaxed);
+    page_->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(&page_->snapshot, &snapshot, sizeof (snapshot));
+    page_->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+namespace {
+
+std::string FormatTime(std::int64_t t) {
+    std::tm tm = TimeZone::Local().ToLocal(static_cast<std::time_t> (t));
+    char buffer[64];
+    std::strftime(buffer, sizeof (buffer), "%Y/%m/%d %T %Z", &tm);
+    return buffer;
+}
+
+} // namespace
+
+int StatusCommand(int argc, char* argv[]) {
+    const char* name = argc > 0 ? argv[0] : MYSPRINKLER_STATUS_PAGE;
+    StatusReader reader;
+    if (!reader.Open(name)) {
+        std::printf("No status page %s, is mysprinkler running?\n", name);
+        return EXIT_FAILURE;
+    }
+    status_snapshot s;
+    if (!reader.Snapshot(s)) {
+        std::printf("Status page %s is busy.\n", name);
+        return EXIT_FAILURE;
+    }
+
+    std::printf("pid %d, up since %s\n", s.pid, FormatTime(s.started).c_str());
+    std::printf("heartbeat %s, %llu published, %llu scheduler wake ups\n",
+            FormatTime(s.heartbeat).c_str(),
+            static_cast<unsigned long long> (s.heartbeats),
+            static_cast<unsigned long long> (s.loops));
+    if (s.program_id < 0) {
+        std::printf("idle\n");
+    } else {
+        std::printf("running program %d%s, priority %d, due %s, %d suspended\n",
+                s.program_id, s.program_manual ? " (manual)" : "",
+                s.program_priority, FormatTime(s.program_due).c_str(),
+                s.suspended);
+    }
+    std::printf("%-6s %-8s %-10s %-36s\n", "zone", "state", "remaining",
+            "name");
+    for (int i = 0; i < s.zone_count && i < status_max_zones; i++) {
+        const status_zone& zone = s.zones[i];
+        const char* state = zone.faulted ? "faulted" : !zone.enabled ?
+                "disabled" : zone.commanded ? "on" : "off";
+        std::printf("%-6d %-8s %-10d %-36s\n", zone.id, state, zone.remaining,
+                zone.name);
+    }
+    for (int i = 0; i < s.queued_count && i < status_max_queued; i++) {
+        std::printf("next program %d, priority %d, at %s\n", s.queued[i].id,
+                s.queued[i].priority, FormatTime(s.queued[i].start).c_str());
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "include/supervisor.hpp"
+#include "include/Logger.h"
+#include "include/gpio.hpp"
+#include "include/trace.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include <execinfo.h>
+#include <fcntl.h>
+#include <linux/watchdog.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace {
+
+// the stalled thread writes its own stack here from SIGUSR2
+std::atomic<int> stack_fd_(-1);
+std::atomic<bool> stack_done_(false);
+
+void StackSignal(int /*signum*/) {
+    int fd = stack_fd_.load();
+    if (fd >= 0) {
+        void* frames[64];
+        backtrace_symbols_fd(frames, backtrace(frames, 64), fd);
+    }
+    stack_done_ = true;
+}
+
+std::int64_t SteadyNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// a dump goes straight to the file, the logger may be what is stuck
+void Put(int fd, const char* text, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, text, length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        text += n;
+        length -= static_cast<size_t> (n);
+    }
+}
+
+void Put(int fd, const std::string& text) {
+    Put(fd, text.data(), text.size());
+}
+
+} // namespace
+
+Heartbeat::Heartbeat(const char* name) : name_(name), since_(0), arg_(0),
+thread_(pthread_t()), beats_(0) {
+}
+
+void Heartbeat::Busy(std::int64_t arg) {
+    arg_.store(arg, std::memory_order_relaxed);
+    thread_.store(pthread_self(), std::memory_order_relaxed);
+    beats_.fetch_add(1, std::memory_order_relaxed);
+    since_.store(SteadyNow(), std::memory_order_release);
+}
+
+void Heartbeat::Idle() {
+    since_.store(0, std::memory_order_release);
+}
+
+const char* Heartbeat::Name() const {
+    return name_;
+}
+
+std::int64_t Heartbeat::BusyFor(std::int64_t now) const {
+    std::int64_t since = since_.load(std::memory_order_acquire);
+    return since ? std::max<std::int64_t>(0, now - since) : 0;
+}
+
+std::int64_t Heartbeat::Arg() const {
+    return arg_.load(std::memory_order_relaxed);
+}
+
+pthread_t Heartbeat::Thread() const {
+    return thread_.load(std::memory_order_relaxed);
+}
+
+std::uint64_t Heartbeat::Beats() const {
+    return beats_.load(std::memory_order_relaxed);
+}
+
+Supervisor::Supervisor() : watchdog_fd_(-1), running_(false),
+stalled_(false), checks_(0), pets_(0), stalls_(0), longest_ns_(0) {
+    wake_fd_[0] = wake_fd_[1] = -1;
+}
+
+Supervisor::~Supervisor() {
+    Stop();
+}
+
+void Supervisor::Watch(Heartbeat& heartbeat) {
+    heartbeats_.push_back(&heartbeat);
+}
+
+void Supervisor::AddRelaysOff(relays_off_fn off) {
+    relays_off_.push_back(std::move(off));
+}
+
+bool Supervisor::Start(const supervisor_options& options,
+        const std::vector<supervisor_relay>& relays, state_fn state,
+        stalled_fn stalled) {
+    Stop();
+    options_ = options;
+    options_.budget_ms = std::max(1, options_.budget_ms);
+    options_.period_ms = std::max(1, options_.period_ms);
+    relays_.clear();
+    for (const auto& relay : relays) {
+        relays_.push_back(std::make_pair(SysfsGpio::Root() + "/gpio" +
+                std::to_string(relay.pin) + "/value",
+                relay.invert_logic ? "1" : "0"));
+    }
+    state_ = state;
+    stalled_fn_ = stalled;
+    stalled_ = false;
+
+    // loads the unwinder now rather than in the signal handler
+    void* frame;
+    backtrace(&frame, 1);
+    struct sigaction action = {};
+    action.sa_handler = StackSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR2, &action, nullptr);
+
+    bool ok = true;
+    if (!options_.watchdog.empty()) {
+        watchdog_fd_ = open(options_.watchdog.c_str(), O_WRONLY | O_CLOEXEC);
+        if (watchdog_fd_ < 0) {
+            ace::utils::Logger::Instance().Warning("Unable to open watchdog "
+                    "%s: %s", options_.watchdog.c_str(), std::strerror(errno));
+            ok = false;
+        } else if (options_.watchdog_timeout > 0) {
+            int timeout = options_.watchdog_timeout;
+            if (ioctl(watchdog_fd_, WDIOC_SETTIMEOUT, &timeout) != 0) {
+                ace::utils::Logger::Instance().Warning("Watchdog %s keeps "
+                        "its timeout: %s", options_.watchdog.c_str(),
+                        std::strerror(errno));
+            }
+        }
+    }
+    if (pipe2(wake_fd_, O_CLOEXEC) != 0) {
+        wake_fd_[0] = wake_fd_[1] = -1;
+    }
+    running_ = true;
+    thread_ = std::thread(&Supervisor::Run, this);
+    return ok;
+}
+
+void Supervisor::Stop() {
+    if (running_.exchange(false)) {
+        if (wake_fd_[1] >= 0 && write(wake_fd_[1], "", 1) < 0) {
+            // the thread wakes within a period anyway
+        }
+        thread_.join();
+    }
+    for (int& fd : wake_fd_) {
+        if (fd >= 0) close(fd);
+        fd = -1;
+    }
+    if (watchdog_fd_ >= 0) {
+        // the magic close disarms it, after a stall the board resets unless
+        // the daemon is back in time
+        if (!stalled_ && write(watchdog_fd_, "V", 1) != 1) {
+            ace::utils::Logger::Instance().Warning("Watchdog %s left armed: "
+                    "%s", options_.watchdog.c_str(), std::strerror(errno));
+        }
+        close(watchdog_fd_);
+        watchdog_fd_ = -1;
+    }
+}
+
+bool Supervisor::Running() const {
+    return running_;
+}
+
+bool Supervisor::Stalled() const {
+    return stalled_;
+}
+
+supervisor_stats Supervisor::Stats() const {
+    return {checks_, pets_, stalls_, longest_ns_};
+}
+
+void Supervisor::Run() {
+    TRACE_THREAD("supervisor");
+    std::int64_t budget = options_.budget_ms * 1000000LL;
+    while (running_) {
+        std::int64_t now = SteadyNow();
+        const Heartbeat* late = nullptr;
+        std::int64_t late_for = 0;
+        for (const Heartbeat* heartbeat : heartbeats_) {
+            std::int64_t busy = heartbeat->BusyFor(now);
+            if (busy > longest_ns_) longest_ns_ = busy;
+            if (busy > budget && busy > late_for) {
+                late = heartbeat;
+                late_for = busy;
+            }
+        }
+        checks_++;
+
+        if (late && !stalled_) {
+            Stall(*late, late_for);
+        } else if (stalled_) {
+            RelaysOff(); // in case the stuck thread carries on switching
+        } else if (!late && watchdog_fd_ >= 0) {
+            if (write(watchdog_fd_, "1", 1) == 1) pets_++;
+        }
+
+        pollfd wake = {wake_fd_[0], POLLIN, 0};
+        poll(&wake, wake_fd_[0] >= 0 ? 1 : 0, options_.period_ms);
+    }
+}
+
+void Supervisor::Stall(const Heartbeat& heartbeat, std::int64_t busy) {
+    stalled_ = true;
+    stalls_++;
+    TRACE_INSTANT("supervisor", "stall", busy / 1000000);
+    RelaysOff();
+    std::string dump = Dump(heartbeat, busy);
+    if (stalled_fn_) stalled_fn_(heartbeat, busy, dump);
+}
+
+void Supervisor::RelaysOff() {
+    for (const auto& relay : relays_) {
+        int fd = open(relay.first.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) continue;
+        Put(fd, relay.second, 1);
+        close(fd);
+    }
+    for (const auto& off : relays_off_) {
+        off();
+    }
+}
+
+std::string Supervisor::Dump(const Heartbeat& stalled, std::int64_t busy) {
+    std::string base = options_.dump_directory + "/mysprinkler-stall-" +
+            std::to_string(std::time(nullptr));
+    int fd = open((base + ".txt").c_str(), O_WRONLY | O_CREAT | O_TRUNC |
+            O_CLOEXEC, 0644);
+    if (fd < 0) return "";
+
+    char line[256];
+    std::snprintf(line, sizeof (line), "%s busy %.1f ms, budget %d ms, "
+            "relays forced off\n\nheartbeats\n", stalled.Name(), busy / 1e6,
+            options_.budget_ms);
+    Put(fd, line);
+    std::int64_t now = SteadyNow();
+    for (const Heartbeat* heartbeat : heartbeats_) {
+        std::snprintf(line, sizeof (line), "  %-12s busy %10.1f ms  beats "
+                "%llu  arg %lld\n", heartbeat->Name(),
+                heartbeat->BusyFor(now) / 1e6,
+                static_cast<unsigned long long> (heartbeat->Beats()),
+                static_cast<long long> (heartbeat->Arg()));
+        Put(fd, line);
+    }
+
+    // the handler runs once the thread leaves the kernel or is interrupted
+    Put(fd, "\nstack of the stalled thread\n");
+    stack_done_ = false;
+    stack_fd_ = fd;
+    if (pthread_kill(stalled.Thread(), SIGUSR2) == 0) {
+        for (int i = 0; i < 1000 && !stack_done_; i++) {
+            usleep(1000);
+        }
+    }
+    stack_fd_ = -1;
+    if (!stack_done_) {
+        Put(fd, "  none within a second\n");
+    }
+
+    Put(fd, "\nscheduler state\n");
+    if (state_) {
+        Put(fd, state_() + "\n");
+    }
+    close(fd);
+
+    // Debug builds, the last seconds of every thread
+    if (TraceDump(base + ".json", 30)) {
+        return base + ".txt and " + base + ".json";
+    }
+    return base + ".txt";
+}
@@ -0,0 +1,406 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "include/supply.hpp"
+#include "include/cycles.hpp"
+#include "include/validate.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <numeric>
+
+#include <yaml-cpp/yaml.h>
+
+namespace {
+
+const int kDay = 24 * 60;
+const double kSlack = 1e-9; // flows summed in a different order
+
+int AfterNoon(int hour, int minute) {
+    return ((hour * 60 + minute - 12 * 60) % kDay + kDay) % kDay;
+}
+
+int Length(const supply_program& program) {
+    return static_cast<int> (program.flow.size());
+}
+
+double Volume(const supply_program& program) {
+    return std::accumulate(program.flow.begin(), program.flow.end(), 0.0);
+}
+
+double Peak(const supply_program& program) {
+    return program.flow.empty() ? 0 :
+            *std::max_element(program.flow.begin(), program.flow.end());
+}
+
+// minute by minute draw on the supply and what each site runs
+class Timeline {
+public:
+    explicit Timeline(size_t sites) : busy_(sites) {
+    }
+
+    bool Fits(const supply_program& program, int at, double capacity) const {
+        const std::vector<bool>& busy = busy_[program.site];
+        for (int m = 0; m < Length(program); m++) {
+            size_t t = static_cast<size_t> (at + m);
+            if (t < busy.size() && busy[t]) return false;
+            double load = t < load_.size() ? load_[t] : 0;
+            // more than the capacity alone runs with nothing else
+            if (load > 0 && load + program.flow[m] > capacity + kSlack) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void Add(const supply_program& program, int at) {
+        size_t end = static_cast<size_t> (at + Length(program));
+        std::vector<bool>& busy = busy_[program.site];
+        if (busy.size() < end) busy.resize(end);
+        if (load_.size() < end) load_.resize(end);
+        for (int m = 0; m < Length(program); m++) {
+            busy[at + m] = true;
+            load_[at + m] += program.flow[m];
+        }
+    }
+
+    const std::vector<double>& Load() const {
+        return load_;
+    }
+private:
+    std::vector<std::vector<bool> > busy_; // by site
+    std::vector<double> load_;
+};
+
+// places programs in order, each once the programs it comes after are
+supply_plan Place(const std::vector<supply_program>& programs,
+        const std::vector<size_t>& order, double capacity, bool stagger) {
+    size_t sites = 0;
+    std::map<std::pair<size_t, int>, size_t> index;
+    for (size_t i = 0; i < programs.size(); i++) {
+        sites = std::max(sites, programs[i].site + 1);
+        index[std::make_pair(programs[i].site, programs[i].id)] = i;
+    }
+    std::vector<int> begin(programs.size(), -1);
+    Timeline timeline(sites);
+    for (size_t placed = 0; placed < programs.size(); placed++) {
+        size_t pick = programs.size();
+        for (size_t i : order) {
+            if (begin[i] >= 0) continue;
+            bool ready = true;
+            for (int id : programs[i].after) {
+                auto it = index.find(std::make_pair(programs[i].site, id));
+                ready = ready && (it == index.end() || begin[it->second] >= 0);
+            }
+            if (ready) {
+                pick = i;
+                break;
+            }
+        }
+        if (pick == programs.size()) { // a cycle, validate reports it
+            for (size_t i : order) {
+                if (begin[i] < 0) {
+                    pick = i;
+                    break;
+                }
+            }
+        }
+        const supply_program& program = programs[pick];
+        int at = program.start;
+        for (int id : program.after) {
+            auto it = index.find(std::make_pair(program.site, id));
+            if (it != index.end() && begin[it->second] >= 0) {
+                at = std::max(at, begin[it->second] +
+                        Length(programs[it->second]));
+            }
+        }
+        double room = stagger ? capacity :
+                std::numeric_limits<double>::infinity();
+        while (!timeline.Fits(program, at, room)) {
+            at++;
+        }
+        timeline.Add(program, at);
+        begin[pick] = at;
+    }
+
+    supply_plan plan = {{}, 0, 0, 0};
+    if (programs.empty()) return plan;
+    int first = begin[0], last = 0;
+    for (size_t i = 0; i < programs.size(); i++) {
+        plan.offsets.push_back(begin[i] - programs[i].start);
+        first = std::min(first, begin[i]);
+        last = std::max(last, begin[i] + Length(programs[i]));
+    }
+    plan.window = last - first;
+    for (double load : timeline.Load()) {
+        plan.peak = std::max(plan.peak, load);
+        if (load > capacity + kSlack) plan.over++;
+    }
+    return plan;
+}
+
+std::vector<size_t> ByStart(const std::vector<supply_program>& programs) {
+    std::vector<size_t> order(programs.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+            [&programs](size_t lhs, size_t rhs) {
+                return programs[lhs].start < programs[rhs].start;
+            });
+    return order;
+}
+
+std::string Clock(int after_noon) {
+    int minute = (12 * 60 + after_noon) % kDay;
+    char buffer[16];
+    std::snprintf(buffer, sizeof (buffer), "%02d:%02d", minute / 60,
+            minute % 60);
+    return buffer;
+}
+
+std::string Hours(int minutes) {
+    char buffer[16];
+    std::snprintf(buffer, sizeof (buffer), "%d:%02d", minutes / 60,
+            minutes % 60);
+    return buffer;
+}
+
+// /etc/mysprinkler/sites/front.yaml is site front
+std::string SiteName(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    std::string name = slash == std::string::npos ? path :
+            path.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+    return dot == std::string::npos || dot == 0 ? name : name.substr(0, dot);
+}
+
+// the minutes of a program's run as PlanCycles() orders its zones
+void SitePrograms(size_t site, const site_report& report,
+        std::vector<supply_program>& programs) {
+    std::map<int, const site_zone*> zones;
+    for (const auto& zone : report.zones) {
+        zones[zone.id] = &zone;
+    }
+    for (auto program : report.programs) {
+        if (program.Disabled()) continue;
+        std::vector<cycle_zone> cycle_zones;
+        for (const auto& detail : program.ZoneDetail()) {
+            // the daemon skips disabled and unknown zones
+            auto zone = zones.find(detail.zone_id);
+            if (zone == zones.end() || !zone->second->enabled) continue;
+            cycle_zones.push_back({detail.zone_id, detail.duration * 60,
+                zone->second->max_cycle * 60, zone->second->min_soak * 60});
+        }
+        cycle_plan plan = PlanCycles(cycle_zones, 1);
+        supply_program entry = {site, program.Id(),
+            AfterNoon(program.Hour(), program.Minute()), {}, program.After()};
+        entry.flow.assign((plan.makespan + 59) / 60, 0);
+        for (const auto& step : plan.steps) {
+            double flow = zones[step.zone_id]->flow_rate;
+            for (int m = step.start / 60; m * 60 < step.start + step.seconds;
+                    m++) {
+                entry.flow[m] = std::max(entry.flow[m], flow);
+            }
+        }
+        programs.push_back(entry);
+    }
+}
+
+} // namespace
+
+supply_plan PlanSupply(const std::vector<supply_program>& programs,
+        double capacity) {
+    std::vector<std::vector<size_t> > orders;
+    orders.push_back(ByStart(programs));
+    std::vector<size_t> order = orders.front();
+    std::stable_sort(order.begin(), order.end(),
+            [&programs](size_t lhs, size_t rhs) {
+                return Volume(programs[lhs]) > Volume(programs[rhs]);
+            });
+    orders.push_back(order);
+    order = orders.front();
+    std::stable_sort(order.begin(), order.end(),
+            [&programs](size_t lhs, size_t rhs) {
+                return Peak(programs[lhs]) > Peak(programs[rhs]);
+            });
+    orders.push_back(order);
+
+    supply_plan best = {};
+    for (size_t i = 0; i < orders.size(); i++) {
+        supply_plan plan = Place(programs, orders[i], capacity, true);
+        if (i == 0 || plan.window < best.window ||
+                (plan.window == best.window && plan.peak < best.peak)) {
+            best = plan;
+        }
+    }
+    return best;
+}
+
+supply_plan Unstaggered(const std::vector<supply_program>& programs,
+        double capacity) {
+    return Place(programs, ByStart(programs), capacity, false);
+}
+
+int SupplyLowerBound(const std::vector<supply_program>& programs,
+        double capacity) {
+    if (programs.empty()) return 0;
+    int first = programs[0].start;
+    for (const auto& program : programs) {
+        first = std::min(first, program.start);
+    }
+    int bound = 0;
+    double volume = 0; // a minute over the capacity still takes a minute
+    std::map<size_t, int> site_minutes;
+    for (const auto& program : programs) {
+        bound = std::max(bound, program.start - first + Length(program));
+        site_minutes[program.site] += Length(program);
+        for (double flow : program.flow) {
+            volume += std::min(flow, capacity);
+        }
+    }
+    for (const auto& site : site_minutes) {
+        bound = std::max(bound, site.second);
+    }
+    return std::max(bound, static_cast<int> (std::ceil(volume / capacity -
+            kSlack)));
+}
+
+bool LoadOffsets(const std::string& path, std::map<int, int>& offsets,
+        std::string& error) {
+    try {
+        YAML::Node yPrograms = YAML::LoadFile(path)["PROGRAMS"];
+        for (auto it = yPrograms.begin(); it != yPrograms.end(); ++it) {
+            offsets[it->first.as<int>()] = it->second.as<int>();
+        }
+    } catch (const std::exception& e) {
+        error = e.what();
+        return false;
+    }
+    return true;
+}
+
+int SupplyCommand(int argc, char* argv[]) {
+    double capacity = 0;
+    bool show_plan = false;
+    std::string out;
+    std::vector<std::string> files;
+    for (int i = 0; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--capacity" && i + 1 < argc) {
+            capacity = std::atof(argv[++i]);
+        } else if (arg == "--out" && i + 1 < argc) {
+            out = argv[++i];
+        } else if (arg == "--plan") {
+            show_plan = true;
+        } else {
+            AddConfigs(arg, files);
+        }
+    }
+    if (files.empty() || capacity <= 0) {
+        std::cout << "eg: mysprinkler supply --capacity 30 [--out DIR] "
+                "[--plan] /etc/mysprinkler/sites\n";
+        return EXIT_FAILURE;
+    }
+
+    std::vector<supply_program> programs;
+    for (size_t i = 0; i < files.size(); i++) {
+        site_report report;
+        report.source = files[i];
+        try {
+            if (!ValidateConfig(YAML::LoadFile(files[i]), report)) {
+                for (const auto& error : report.errors) {
+                    std::cout << files[i] << ": " << error << "\n";
+                }
+                return EXIT_FAILURE;
+            }
+        } catch (const std::exception& e) {
+            std::cout << files[i] << ": " << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+        SitePrograms(i, report, programs);
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    supply_plan plan = PlanSupply(programs, capacity);
+    double ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - begin).count();
+    supply_plan configured = Unstaggered(programs, capacity);
+
+    std::printf("sites %zu, programs %zu, capacity %.1f per minute\n",
+            files.size(), programs.size(), capacity);
+    std::printf("%-12s %7s %8s %14s\n", "", "window", "peak", "over capacity");
+    std::printf("%-12s %7s %8.1f %6d minutes\n", "configured",
+            Hours(configured.window).c_str(), configured.peak, configured.over);
+    std::printf("%-12s %7s %8.1f %6d minutes\n", "staggered",
+            Hours(plan.window).c_str(), plan.peak, plan.over);
+    std::printf("%-12s %7s\n", "lower bound",
+            Hours(SupplyLowerBound(programs, capacity)).c_str());
+    std::printf("planned in %.2f ms\n", ms);
+    if (plan.window > kDay) {
+        std::printf("the programs do not fit in a day at this capacity\n");
+    }
+
+    if (show_plan) {
+        std::printf("%-16s %7s %6s %7s %6s\n", "site", "program", "start",
+                "offset", "until");
+        for (size_t i : ByStart(programs)) {
+            const supply_program& program = programs[i];
+            int start = program.start + plan.offsets[i];
+            std::printf("%-16s %7d %6s %+7d %6s\n",
+                    SiteName(files[program.site]).c_str(), program.id,
+                    Clock(start).c_str(), plan.offsets[i],
+                    Clock(start + Length(program)).c_str());
+        }
+    }
+
+    if (!out.empty()) {
+        for (size_t site = 0; site < files.size(); site++) {
+            std::string path = out + "/" + SiteName(files[site]) +
+                    ".offsets.yaml";
+            std::ofstream ofs(path);
+            ofs << "# mysprinkler supply --capacity " << capacity
+                    << ", minutes added to each program's start\n"
+                    << "PROGRAMS:\n";
+            for (size_t i = 0; i < programs.size(); i++) {
+                if (programs[i].site != site) continue;
+                ofs << "  " << programs[i].id << ": " << plan.offsets[i]
+                        << "\n";
+            }
+            if (!ofs) {
+                std::cout << "could not write " << path << "\n";
+                return EXIT_FAILURE;
+            }
+            std::printf("wrote %s\n", path.c_str());
+        }
+    }
+    return plan.over ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,528 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "include/tariff.hpp"
+#include "include/cycles.hpp"
+#include "include/timezone.hpp"
+#include "include/validate.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <set>
+#include <tuple>
+
+namespace {
+
+const int kDay = 24 * 60;
+const double kNever = std::numeric_limits<double>::infinity();
+
+// minutes of the day from "HH:MM", -1 if it is not
+int ClockMinutes(const std::string& clock) {
+    int hour = 0, minute = 0;
+    char extra;
+    if (std::sscanf(clock.c_str(), "%d:%d%c", &hour, &minute, &extra) != 2 ||
+            hour < 0 || hour > 23 || minute < 0 || minute > 59) {
+        return -1;
+    }
+    return hour * 60 + minute;
+}
+
+int AfterNoon(int minute_of_day) {
+    return (minute_of_day - 12 * 60 + kDay) % kDay;
+}
+
+std::string Clock(int after_noon) {
+    int minute = (12 * 60 + after_noon) % kDay;
+    char buffer[16];
+    std::snprintf(buffer, sizeof (buffer), "%02d:%02d", minute / 60,
+            minute % 60);
+    return buffer;
+}
+
+int Length(const tou_program& program) {
+    return static_cast<int> (program.kw.size());
+}
+
+// minutes of a run drawing the same power
+struct segment {
+    int begin;
+    int end;
+    double kw;
+};
+
+std::vector<segment> Segments(const tou_program& program) {
+    std::vector<segment> segments;
+    for (int m = 0; m < Length(program); m++) {
+        if (program.kw[m] == 0) continue;
+        if (!segments.empty() && segments.back().end == m &&
+                segments.back().kw == program.kw[m]) {
+            segments.back().end++;
+        } else {
+            segments.push_back({m, m + 1, program.kw[m]});
+        }
+    }
+    return segments;
+}
+
+// the cost of a kW for the minutes after noon up to each
+std::vector<double> PricePrefix(const tariff_table& tariff, int minutes) {
+    std::vector<double> prefix(minutes + 1, 0);
+    for (int m = 0; m < minutes; m++) {
+        prefix[m + 1] = prefix[m] + tariff.Price((12 * 60 + m) % kDay) / 60;
+    }
+    return prefix;
+}
+
+double Cost(const std::vector<double>& prefix,
+        const std::vector<segment>& segments, int start) {
+    double cost = 0;
+    for (const auto& s : segments) {
+        cost += s.kw * (prefix[start + s.end] - prefix[start + s.begin]);
+    }
+    return cost;
+}
+
+// the furthest any start and run can reach
+int Horizon(const std::vector<tou_program>& programs) {
+    int horizon = 2 * kDay;
+    for (const auto& program : programs) {
+        horizon += Length(program);
+    }
+    return horizon;
+}
+
+// after dependencies first, then by window opening, or by when a program
+// must be done, then start and id
+std::vector<size_t> Order(const std::vector<tou_program>& programs,
+        bool by_deadline) {
+    std::map<int, size_t> index;
+    for (size_t i = 0; i < programs.size(); i++) {
+        index[programs[i].id] = i;
+    }
+    std::vector<int> waiting(programs.size(), 0);
+    std::vector<std::vector<size_t> > next(programs.size());
+    for (size_t i = 0; i < programs.size(); i++) {
+        for (int id : programs[i].after) {
+            auto it = index.find(id);
+            if (it == index.end() || it->second == i) continue;
+            waiting[i]++;
+            next[it->second].push_back(i);
+        }
+    }
+    auto key = [&programs, by_deadline](size_t i) {
+        const tou_program& program = programs[i];
+        int deadline = program.window ? program.until :
+                program.start + Length(program);
+        return std::make_tuple(by_deadline ? deadline : program.from,
+                program.start, program.id, i);
+    };
+    std::set<std::tuple<int, int, int, size_t> > ready, rest;
+    for (size_t i = 0; i < programs.size(); i++) {
+        (waiting[i] ? rest : ready).insert(key(i));
+    }
+    std::vector<size_t> order;
+    while (order.size() < programs.size()) {
+        // a cycle, validate reports it, takes the rest as they come
+        auto& from = ready.empty() ? rest : ready;
+        size_t i = std::get<3>(*from.begin());
+        from.erase(from.begin());
+        rest.erase(key(i));
+        order.push_back(i);
+        for (size_t j : next[i]) {
+            if (--waiting[j] == 0 && rest.erase(key(j))) {
+                ready.insert(key(j));
+            }
+        }
+    }
+    return order;
+}
+
+// where windowed programs may not run, the fixed ones at their starts
+struct fixed_runs {
+    tou_plan plan; // starts and cost of the fixed programs
+    std::vector<int> busy; // minutes taken up to each minute
+};
+
+fixed_runs FixedRuns(const std::vector<tou_program>& programs,
+        const tariff_table& tariff, int horizon) {
+    std::vector<tou_program> fixed;
+    std::vector<size_t> index;
+    for (size_t i = 0; i < programs.size(); i++) {
+        if (programs[i].window) continue;
+        fixed.push_back(programs[i]);
+        index.push_back(i);
+    }
+    tou_plan plan = FixedStarts(fixed, tariff);
+    fixed_runs runs = {{std::vector<int>(programs.size(), -1), plan.cost,
+            true}, std::vector<int>(horizon + 1, 0)};
+    std::vector<int> taken(horizon, 0);
+    for (size_t k = 0; k < fixed.size(); k++) {
+        runs.plan.starts[index[k]] = plan.starts[k];
+        for (int m = plan.starts[k]; m < plan.starts[k] + Length(fixed[k]) &&
+                m < horizon; m++) {
+            taken[m] = 1;
+        }
+    }
+    for (int m = 0; m < horizon; m++) {
+        runs.busy[m + 1] = runs.busy[m] + taken[m];
+    }
+    return runs;
+}
+
+// the windowed programs in order, fitted between the fixed runs
+tou_plan PlanOrder(const std::vector<tou_program>& programs,
+        const std::vector<size_t>& order, const std::vector<double>& prefix,
+        const fixed_runs& fixed) {
+    int horizon = static_cast<int> (prefix.size()) - 1;
+    std::map<int, size_t> index;
+    for (size_t i = 0; i < programs.size(); i++) {
+        index[programs[i].id] = i;
+    }
+
+    // cost[t], the cheapest of the first k programs with the k-th starting
+    // at t; back[k][t], where the one before it started
+    std::vector<double> cost(horizon + 1, kNever), next, best;
+    std::vector<int> best_at;
+    std::vector<std::vector<int> > back(order.size());
+    for (size_t k = 0; k < order.size(); k++) {
+        const tou_program& program = programs[order[k]];
+        std::vector<segment> segments = Segments(program);
+        int length = Length(program);
+
+        // after a fixed program it waits for it to finish, before one it
+        // has to be done by its start
+        int first = program.from;
+        int last = std::min(program.until, horizon) - length;
+        for (int id : program.after) {
+            auto it = index.find(id);
+            if (it == index.end() || programs[it->second].window) continue;
+            first = std::max(first, fixed.plan.starts[it->second] +
+                    Length(programs[it->second]));
+        }
+        for (size_t i = 0; i < programs.size(); i++) {
+            if (programs[i].window || std::find(programs[i].after.begin(),
+                    programs[i].after.end(), program.id) ==
+                    programs[i].after.end()) {
+                continue;
+            }
+            last = std::min(last, fixed.plan.starts[i] - length);
+        }
+        auto free = [&fixed, length](int t) {
+            return fixed.busy[t + length] == fixed.busy[t];
+        };
+
+        next.assign(horizon + 1, kNever);
+        back[k].assign(horizon + 1, -1);
+        if (k == 0) {
+            for (int t = std::max(first, 0); t <= last; t++) {
+                if (free(t)) next[t] = Cost(prefix, segments, t);
+            }
+            cost.swap(next);
+            continue;
+        }
+
+        // the cheapest way to have the one before finished by each minute
+        int before = Length(programs[order[k - 1]]);
+        best.assign(horizon + 1, kNever);
+        best_at.assign(horizon + 1, -1);
+        for (int t = 0; t <= horizon; t++) {
+            best[t] = t ? best[t - 1] : kNever;
+            best_at[t] = t ? best_at[t - 1] : -1;
+            if (cost[t] < best[t]) {
+                best[t] = cost[t];
+                best_at[t] = t;
+            }
+        }
+        for (int t = std::max(first, before); t <= last; t++) {
+            if (best[t - before] < kNever && free(t)) {
+                next[t] = best[t - before] + Cost(prefix, segments, t);
+                back[k][t] = best_at[t - before];
+            }
+        }
+        cost.swap(next);
+    }
+
+    tou_plan plan = fixed.plan;
+    if (order.empty()) return plan;
+    auto end = std::min_element(cost.begin(), cost.end());
+    plan.feasible = *end < kNever;
+    if (!plan.feasible) return plan;
+    plan.cost += *end;
+    int t = static_cast<int> (end - cost.begin());
+    for (size_t k = order.size(); k-- > 0;) {
+        plan.starts[order[k]] = t;
+        t = back[k][t];
+    }
+    return plan;
+}
+
+} // namespace
+
+double tariff_table::Price(int minute) const {
+    if (rates.empty()) return 0;
+    // before the first rate of the day the last one of the day before holds
+    auto it = std::upper_bound(rates.begin(), rates.end(),
+            std::make_pair(minute, kNever));
+    return it == rates.begin() ? rates.back().second : (it - 1)->second;
+}
+
+double tariff_table::Kw(int zone_id) const {
+    auto it = zone_kw.find(zone_id);
+    return it == zone_kw.end() ? pump_kw : it->second;
+}
+
+bool LoadTariff(const YAML::Node& yConfig, tariff_table& tariff,
+        std::string& error) {
+    tariff = tariff_table();
+    error.clear();
+    YAML::Node yTariff = yConfig["tariff"];
+    if (!yTariff.IsDefined() || yTariff.IsNull()) return false;
+    try {
+        tariff.pump_kw = yTariff["pump_kw"].as<double>(tariff.pump_kw);
+        YAML::Node yRates = yTariff["rates"];
+        for (auto it = yRates.begin(); it != yRates.end(); ++it) {
+            std::string clock = it->first.as<std::string>("");
+            int minute = ClockMinutes(clock);
+            if (minute < 0) {
+                error = "tariff rate from " + clock + " is not HH:MM";
+                return false;
+            }
+            tariff.rates.push_back(std::make_pair(minute,
+                    it->second.as<double>()));
+        }
+        YAML::Node yZones = yConfig["ZONES"];
+        for (auto it = yZones.begin(); it != yZones.end(); ++it) {
+            if (it->second["pump_kw"].IsDefined()) {
+                tariff.zone_kw[it->first.as<int>(0)] =
+                        it->second["pump_kw"].as<double>();
+            }
+        }
+    } catch (const std::exception& e) {
+        error = std::string("tariff: ") + e.what();
+        return false;
+    }
+    if (tariff.rates.empty()) {
+        error = "tariff without rates";
+        return false;
+    }
+    std::sort(tariff.rates.begin(), tariff.rates.end());
+    return true;
+}
+
+std::vector<tou_program> NightLoads(const std::vector<Program>& programs,
+        const std::map<int, tou_zone>& zones, std::time_t origin,
+        std::time_t from, std::time_t to) {
+    int earliest = static_cast<int> ((from - origin + 59) / 60);
+    std::vector<tou_program> night;
+    Program program; // assigned over, its lists keep their memory
+    for (const auto& configured : programs) {
+        if (configured.Disabled()) continue;
+        program = configured;
+        bool window = program.WindowFrom() >= 0;
+        if (window) program.Offset(0); // where the plan starts from
+        program.NextStartTime(from - 1);
+        if (program.StartTime() >= to) continue;
+
+        tou_program entry = {program.Id(), static_cast<int> (
+                (program.StartTime() - origin) / 60), window, 0, 0, {},
+            program.After()};
+        entry.from = entry.start;
+        if (window) {
+            entry.from = AfterNoon(program.WindowFrom());
+            entry.until = AfterNoon(program.WindowUntil());
+            if (entry.until <= entry.from) entry.until += kDay;
+            entry.from = std::max(entry.from, earliest);
+        }
+
+        // the daemon skips disabled and unknown zones
+        std::vector<cycle_zone> cycle_zones;
+        for (const auto& detail : program.ZoneDetail()) {
+            auto zone = zones.find(detail.zone_id);
+            if (zone == zones.end() || !zone->second.enabled) continue;
+            cycle_zones.push_back({detail.zone_id, detail.duration * 60,
+                zone->second.max_cycle * 60, zone->second.min_soak * 60});
+        }
+        cycle_plan plan = PlanCycles(cycle_zones, 1);
+        entry.kw.assign((plan.makespan + 59) / 60, 0);
+        for (const auto& step : plan.steps) {
+            double kw = zones.find(step.zone_id)->second.kw;
+            for (int m = step.start / 60; m * 60 < step.start + step.seconds;
+                    m++) {
+                entry.kw[m] = std::max(entry.kw[m], kw);
+            }
+        }
+        night.push_back(entry);
+    }
+    return night;
+}
+
+tou_plan FixedStarts(const std::vector<tou_program>& programs,
+        const tariff_table& tariff) {
+    tou_plan plan = {std::vector<int>(programs.size()), 0, true};
+    std::vector<double> prefix = PricePrefix(tariff, Horizon(programs));
+    std::vector<size_t> order(programs.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(),
+            [&programs](size_t lhs, size_t rhs) {
+                return programs[lhs].start < programs[rhs].start;
+            });
+    int free = 0;
+    for (size_t i : order) {
+        const tou_program& program = programs[i];
+        int start = std::max(program.start, free);
+        plan.starts[i] = start;
+        plan.cost += Cost(prefix, Segments(program), start);
+        free = start + Length(program);
+        if (program.window && free > program.until) plan.feasible = false;
+    }
+    return plan;
+}
+
+tou_plan PlanTariff(const std::vector<tou_program>& programs,
+        const tariff_table& tariff) {
+    if (programs.empty()) return {{}, 0, true};
+    int horizon = Horizon(programs);
+    std::vector<double> prefix = PricePrefix(tariff, horizon);
+    fixed_runs fixed = FixedRuns(programs, tariff, horizon);
+    tou_plan plan = {};
+    for (bool by_deadline : {false, true}) {
+        std::vector<size_t> order;
+        for (size_t i : Order(programs, by_deadline)) {
+            if (programs[i].window) order.push_back(i);
+        }
+        tou_plan ordered = PlanOrder(programs, order, prefix, fixed);
+        if (ordered.feasible && (!plan.feasible || ordered.cost < plan.cost)) {
+            plan = ordered;
+        }
+    }
+    if (!plan.feasible) {
+        plan = FixedStarts(programs, tariff);
+        plan.feasible = false;
+    }
+    return plan;
+}
+
+int TariffCommand(int argc, char* argv[]) {
+    int nights = 7;
+    bool show_plan = false;
+    std::string config;
+    for (int i = 0; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--nights" && i + 1 < argc) {
+            nights = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--plan") {
+            show_plan = true;
+        } else {
+            config = arg;
+        }
+    }
+    if (config.empty()) {
+        std::cout << "eg: mysprinkler tariff /etc/mysprinkler.yaml "
+                "[--nights N] [--plan]\n";
+        return EXIT_FAILURE;
+    }
+    site_report report;
+    tariff_table tariff;
+    std::string error;
+    try {
+        YAML::Node yConfig = YAML::LoadFile(config);
+        ValidateConfig(yConfig, report);
+        if (!LoadTariff(yConfig, tariff, error)) {
+            std::cout << (error.empty() ? "no tariff: node" : error) << "\n";
+            return EXIT_FAILURE;
+        }
+    } catch (const std::exception& e) {
+        std::cout << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+    std::map<int, tou_zone> zones;
+    for (const auto& zone : report.zones) {
+        zones[zone.id] = {zone.enabled, zone.max_cycle, zone.min_soak,
+            tariff.Kw(zone.id)};
+    }
+
+    // nights run from noon to noon, local, tonight first
+    std::tm tm = TimeZone::Local().ToLocal(std::time(nullptr));
+    tm.tm_hour = 12;
+    tm.tm_min = tm.tm_sec = 0;
+    std::printf("%-10s %8s %9s %9s %9s %8s\n", "night", "programs", "fixed",
+            "planned", "delta", "ms");
+    double fixed_total = 0, planned_total = 0;
+    for (int night = 0; night < nights; night++) {
+        std::tm noon = tm;
+        noon.tm_mday += night;
+        std::tm next = noon;
+        next.tm_mday++;
+        std::time_t from = 0, to = 0;
+        TimeZone::Local().ToUtc(noon, from);
+        TimeZone::Local().ToUtc(next, to);
+        std::vector<tou_program> programs = NightLoads(report.programs,
+                zones, from, from, to);
+        tou_plan fixed = FixedStarts(programs, tariff);
+        auto begin = std::chrono::steady_clock::now();
+        tou_plan plan = PlanTariff(programs, tariff);
+        double ms = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - begin).count();
+        fixed_total += fixed.cost;
+        planned_total += plan.cost;
+
+        std::tm local = TimeZone::Local().ToLocal(from);
+        char date[16];
+        std::strftime(date, sizeof (date), "%Y-%m-%d", &local);
+        std::printf("%-10s %8zu %9.2f %9.2f %+9.2f %8.2f%s\n", date,
+                programs.size(), fixed.cost, plan.cost, plan.cost - fixed.cost,
+                ms, plan.feasible ? "" : "  windows cannot all be kept");
+        if (!show_plan) continue;
+        std::vector<size_t> order(programs.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&plan](size_t lhs, size_t rhs) {
+            return plan.starts[lhs] < plan.starts[rhs];
+        });
+        for (size_t i : order) {
+            const tou_program& program = programs[i];
+            std::string window = program.window ? Clock(program.from) + "-" +
+                    Clock(program.until) : "fixed";
+            std::printf("    program %-4d %-11s %s -> %s until %s\n",
+                    program.id, window.c_str(),
+                    Clock(fixed.starts[i]).c_str(),
+                    Clock(plan.starts[i]).c_str(),
+                    Clock(plan.starts[i] + Length(program)).c_str());
+        }
+    }
+    std::printf("%-10s %8s %9.2f %9.2f %+8.1f%%\n", "total", "",
+            fixed_total, planned_total, fixed_total > 0 ?
+            (planned_total - fixed_total) * 100 / fixed_total : 0.0);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,838 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "include/timeline.hpp"
+#include "include/dag.hpp"
+#include "include/supply.hpp"
+#include "include/timezone.hpp"
+#include "include/validate.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+const std::time_t kNever = std::numeric_limits<std::time_t>::max();
+const std::time_t kDawn = std::numeric_limits<std::time_t>::min();
+
+// everything of a program the expansion or the replay depends on
+std::string Fingerprint(Program& program) {
+    std::ostringstream os;
+    os << program.Hour() << ' ' << program.Minute() << ' ' << program.Mode()
+            << ' ' << program.Interval() << ' ' << program.Priority() << ' '
+            << program.CatchUp() << ' ' << program.CatchUpMinutes() << ' '
+            << program.Disabled() << ' ' << program.Offset() << ' '
+            << program.WindowFrom() << ' ' << program.WindowUntil() << " w";
+    for (int day : program.Weekdays()) {
+        os << ' ' << day;
+    }
+    os << " z";
+    for (const auto& detail : program.ZoneDetail()) {
+        os << ' ' << detail.zone_id << ':' << detail.duration;
+    }
+    os << " a";
+    for (int id : program.After()) {
+        os << ' ' << id;
+    }
+    os << " n";
+    for (int id : program.NotWith()) {
+        os << ' ' << id;
+    }
+    return os.str();
+}
+
+// noon of the night t is in, noon to noon, days after, local
+std::time_t Noon(std::time_t t, int days) {
+    std::tm tm = TimeZone::Local().ToLocal(t);
+    if (tm.tm_hour < 12) tm.tm_mday--;
+    tm.tm_mday += days; // ToUtc() carries it into months
+    tm.tm_hour = 12;
+    tm.tm_min = tm.tm_sec = 0;
+    std::time_t noon = 0;
+    TimeZone::Local().ToUtc(tm, noon);
+    return noon;
+}
+
+// a program start, in the order the replay takes them
+struct replay_start {
+    std::time_t at;
+    int program_id;
+    Program* program;
+};
+
+// a program_run of the scheduler, in whole seconds
+struct replay_run {
+    Program* program;
+    int program_id;
+    std::time_t due;
+    std::time_t released; // due, or when a hold last kept it waiting
+    bool held;
+    int priority;
+    std::uint64_t queued; // order it joined the pending runs
+    std::deque<cycle_step> remaining;
+    std::time_t left; // seconds of the front cycle still to water
+    bool watering;
+    bool soaking;
+    std::time_t zone_start;
+    std::time_t zone_end;
+    std::time_t soak_end;
+    std::map<int, std::time_t> off; // zone id, last turned off
+};
+
+// the order Dispatch() of main.cpp picks pending runs in: the highest
+// priority, the earliest due, then the first queued
+struct replay_rank {
+    int priority;
+    std::time_t due;
+    std::uint64_t queued;
+
+    bool operator<(const replay_rank& other) const {
+        if (priority != other.priority) return priority > other.priority;
+        if (due != other.due) return due < other.due;
+        return queued < other.queued;
+    }
+};
+
+replay_rank Rank(const replay_run& run) {
+    return {run.priority, run.due, run.queued};
+}
+
+// when a pending run may no longer start, as MayStart() of Program, never
+// for catch_up_run_late
+std::time_t Deadline(const replay_run& run) {
+    const Program& program = *run.program;
+    if (program.CatchUp() == catch_up_run_late) return kNever;
+    std::time_t late = program.CatchUp() == catch_up_skip ? 60 :
+            (program.CatchUpMinutes() + 1) * 60;
+    return std::max(run.due, run.released) + late;
+}
+
+} // namespace
+
+Timeline::Timeline(std::time_t now, int horizon_days) : now_(now),
+horizon_(now + horizon_days * 86400LL), horizon_days_(horizon_days),
+windows_dirty_(false), dirty_(kNever), index_dirty_(true), replayed_(0) {
+}
+
+void Timeline::Zone(int zone_id, bool enabled, int max_cycle,
+        int min_soak) {
+    auto zone = zones_.find(zone_id);
+    if (zone != zones_.end() && zone->second.enabled == enabled &&
+            zone->second.max_cycle == max_cycle &&
+            zone->second.min_soak == min_soak) return;
+    zones_[zone_id] = {enabled, max_cycle, min_soak};
+    windows_dirty_ = true;
+    Invalidate(kDawn);
+}
+
+bool Timeline::Set(const Program& program) {
+    Program copy = program;
+    std::string fingerprint = Fingerprint(copy);
+    auto old = programs_.find(copy.Id());
+    if (old != programs_.end() && old->second.fingerprint == fingerprint) {
+        return false;
+    }
+
+    program_entry entry = {copy, fingerprint, {}};
+    if (old != programs_.end()) {
+        // the starts already past stay as they were
+        for (std::time_t start : old->second.starts) {
+            if (start < now_) entry.starts.push_back(start);
+        }
+    }
+    entry.next.NextStartTime(now_); // as the daemon would load it now
+    Expand(entry);
+    programs_[copy.Id()] = entry;
+    windows_dirty_ = true;
+    Invalidate(now_);
+    return true;
+}
+
+void Timeline::Remove(int program_id) {
+    auto program = programs_.find(program_id);
+    if (program == programs_.end()) return;
+    Invalidate(program->second.starts.empty() ? now_ :
+            program->second.starts.front());
+    programs_.erase(program);
+    windows_dirty_ = true;
+}
+
+void Timeline::Tariff(const tariff_table& tariff) {
+    tariff_ = tariff;
+    // windowed programs start from scratch, planned or as configured
+    for (auto& program : programs_) {
+        program_entry& entry = program.second;
+        if (entry.next.WindowFrom() < 0) continue;
+        entry.starts.erase(std::lower_bound(entry.starts.begin(),
+                entry.starts.end(), now_), entry.starts.end());
+        entry.next.NextStartTime(now_);
+        Expand(entry);
+    }
+    windows_dirty_ = true;
+    Invalidate(now_);
+}
+
+void Timeline::Advance(std::time_t now) {
+    now_ = std::max(now_, now);
+    std::time_t horizon = now_ + horizon_days_ * 86400LL;
+    if (horizon > horizon_) {
+        // every new start is at or after the old horizon
+        Invalidate(horizon_);
+        horizon_ = horizon;
+        windows_dirty_ = true;
+        for (auto& program : programs_) {
+            Expand(program.second);
+        }
+    }
+    index_dirty_ = true; // Build() trims what is now past
+}
+
+std::time_t Timeline::Horizon() const {
+    return horizon_;
+}
+
+bool Timeline::At(std::time_t t, timeline_slot& slot) {
+    Build();
+    auto it = std::upper_bound(slots_.begin(), slots_.end(), t,
+            [](std::time_t value, const timeline_slot & s) {
+                return value < s.start;
+            });
+    if (it == slots_.begin()) return false;
+    --it;
+    if (t >= it->end) return false;
+    slot = *it;
+    return true;
+}
+
+std::vector<timeline_slot> Timeline::Range(std::time_t from, std::time_t to) {
+    Build();
+    // slots never overlap, so ends are sorted as well as starts
+    auto it = std::partition_point(slots_.begin(), slots_.end(),
+            [from](const timeline_slot & s) {
+                return s.end <= from;
+            });
+    std::vector<timeline_slot> slots;
+    for (; it != slots_.end() && it->start < to; ++it) {
+        slots.push_back(*it);
+    }
+    return slots;
+}
+
+std::int64_t Timeline::ZoneSeconds(int zone_id, std::time_t from,
+        std::time_t to) {
+    Build();
+    auto zone = by_zone_.find(zone_id);
+    if (zone == by_zone_.end() || from >= to) return 0;
+    const zone_index& index = zone->second;
+
+    size_t first = std::upper_bound(index.ends.begin(), index.ends.end(),
+            from) - index.ends.begin();
+    size_t last = std::lower_bound(index.starts.begin(), index.starts.end(),
+            to) - index.starts.begin();
+    if (first >= last) return 0;
+    // whole slots, less the parts of the two edge slots outside the range
+    std::int64_t seconds = index.seconds[last] - index.seconds[first];
+    seconds -= std::max<std::int64_t>(0, from - index.starts[first]);
+    seconds -= std::max<std::int64_t>(0, index.ends[last - 1] - to);
+    return seconds;
+}
+
+std::map<int, std::int64_t> Timeline::ZoneTotals(std::time_t from,
+        std::time_t to) {
+    Build();
+    std::map<int, std::int64_t> totals;
+    for (const auto& zone : by_zone_) {
+        std::int64_t seconds = ZoneSeconds(zone.first, from, to);
+        if (seconds > 0) totals[zone.first] = seconds;
+    }
+    return totals;
+}
+
+std::vector<timeline_skip> Timeline::Skips(std::time_t from, std::time_t to) {
+    Build();
+    std::vector<timeline_skip> skips;
+    for (const auto& skip : skips_) {
+        if (skip.due >= from && skip.due < to) skips.push_back(skip);
+    }
+    return skips;
+}
+
+std::uint64_t Timeline::Replayed() const {
+    return replayed_;
+}
+
+bool Timeline::Planned(const Program& program) const {
+    return !tariff_.rates.empty() && program.WindowFrom() >= 0;
+}
+
+void Timeline::Expand(program_entry& entry) {
+    if (Planned(entry.next)) return; // PlanWindows() has them
+    while (!entry.next.Disabled() && entry.next.StartTime() < horizon_) {
+        std::time_t start = entry.next.StartTime();
+        entry.starts.push_back(start);
+        // the scheduler steps from the start it just took
+        entry.next.NextStartTime(start);
+        if (entry.next.StartTime() <= start) break;
+    }
+}
+
+void Timeline::PlanWindows() {
+    windows_dirty_ = false;
+    std::vector<Program> programs;
+    bool planned = false;
+    for (auto& program : programs_) {
+        programs.push_back(program.second.next);
+        if (!Planned(program.second.next)) continue;
+        planned = true;
+        auto& starts = program.second.starts;
+        starts.erase(std::lower_bound(starts.begin(), starts.end(), now_),
+                starts.end());
+    }
+    if (!planned) return;
+
+    std::map<int, tou_zone> zones;
+    for (const auto& zone : zones_) {
+        zones[zone.first] = {zone.second.enabled, zone.second.max_cycle,
+            zone.second.min_soak, tariff_.Kw(zone.first)};
+    }
+    // PlanTonight() of main.cpp, each night, a night is planned on its own
+    // so they are spread over the cores
+    std::vector<std::time_t> noons(1, Noon(now_, 0));
+    while (noons.back() < horizon_) {
+        noons.push_back(Noon(noons.back(), 1));
+    }
+    size_t nights = noons.size() - 1;
+    std::vector<std::vector<std::pair<int, std::time_t> > > plans(nights);
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t n; (n = next.fetch_add(1)) < nights;) {
+            std::time_t origin = noons[n];
+            std::vector<tou_program> night = NightLoads(programs, zones,
+                    origin, std::max(origin, now_), noons[n + 1]);
+            tou_plan plan = PlanTariff(night, tariff_);
+            for (size_t i = 0; i < night.size(); i++) {
+                std::time_t start = origin + plan.starts[i] * 60LL;
+                if (!night[i].window || start < now_ || start >= horizon_) {
+                    continue;
+                }
+                plans[n].push_back(std::make_pair(night[i].id, start));
+            }
+        }
+    };
+    size_t jobs = std::min<size_t>(nights,
+            std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < jobs; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (const auto& plan : plans) {
+        for (const auto& start : plan) {
+            programs_[start.first].starts.push_back(start.second);
+        }
+    }
+    for (auto& program : programs_) {
+        auto& starts = program.second.starts;
+        if (Planned(program.second.next)) std::sort(starts.begin(),
+                starts.end());
+    }
+    Invalidate(now_);
+}
+
+void Timeline::Invalidate(std::time_t from) {
+    dirty_ = std::min(dirty_, from);
+    index_dirty_ = true;
+}
+
+void Timeline::Build() {
+    if (windows_dirty_) PlanWindows();
+    if (dirty_ != kNever) {
+        Replay();
+        dirty_ = kNever;
+    }
+    if (!index_dirty_) return;
+    Trim();
+
+    by_zone_.clear();
+    for (const auto& slot : slots_) {
+        zone_index& index = by_zone_[slot.zone_id];
+        if (index.seconds.empty()) index.seconds.push_back(0);
+        index.starts.push_back(slot.start);
+        index.ends.push_back(slot.end);
+        index.seconds.push_back(index.seconds.back() + slot.end - slot.start);
+    }
+    index_dirty_ = false;
+}
+
+void Timeline::Replay() {
+    // restart from the last idle moment at or before the change
+    auto idle = std::upper_bound(idle_.begin(), idle_.end(), dirty_,
+            [](std::time_t value, const checkpoint & c) {
+                return value < c.at;
+            });
+    std::time_t from = kDawn;
+    if (idle == idle_.begin()) {
+        slots_.clear();
+        skips_.clear();
+        idle_.clear();
+    } else {
+        --idle;
+        from = idle->at;
+        slots_.resize(idle->slots);
+        skips_.resize(idle->skips);
+        idle_.erase(idle + 1, idle_.end());
+    }
+
+    std::vector<replay_start> starts;
+    for (auto& program : programs_) {
+        auto& times = program.second.starts;
+        for (auto it = std::lower_bound(times.begin(), times.end(), from);
+                it != times.end(); ++it) {
+            starts.push_back({*it, program.first, &program.second.next});
+        }
+    }
+    std::sort(starts.begin(), starts.end(),
+            [](const replay_start& left, const replay_start & right) {
+                return left.at != right.at ? left.at < right.at :
+                        left.program_id < right.program_id;
+            });
+
+    std::vector<replay_run> runs; // back is current, as runs_ in main.cpp
+    // pending runs no hold applies to wait in the order they are picked in
+    // and by deadline, the few that may be held are checked on each
+    // dispatch as main.cpp checks them all
+    std::map<replay_rank, replay_run> ready;
+    std::set<std::pair<std::time_t, replay_rank> > deadlines; // of ready
+    std::vector<replay_run> holdable;
+    std::map<int, int> queued; // program id, its runs current or pending
+    std::uint64_t sequence = 0;
+
+    auto next_zone = [](replay_run & run) {
+        run.remaining.pop_front();
+        if (!run.remaining.empty()) {
+            run.left = run.remaining.front().seconds;
+        }
+    };
+    auto busy = [&queued](int program_id) {
+        return queued.count(program_id) != 0;
+    };
+    auto leave = [&queued](int program_id) {
+        auto it = queued.find(program_id);
+        if (--it->second == 0) queued.erase(it);
+    };
+    // a run may be held if it waits on others, excludes others or is
+    // excluded by one, with no after or not_with nothing is ever held
+    std::set<int> may_hold;
+    for (const auto& program : programs_) {
+        const Program& next = program.second.next;
+        if (next.After().empty() && next.NotWith().empty()) continue;
+        may_hold.insert(program.first);
+        may_hold.insert(next.NotWith().begin(), next.NotWith().end());
+    }
+    // Held() of main.cpp
+    auto held = [&runs, &busy](const replay_run & run) {
+        for (int id : run.program->After()) {
+            if (busy(id)) return true;
+        }
+        for (const auto& other : runs) {
+            const std::vector<int>& not_with = other.program->NotWith();
+            if (std::find(not_with.begin(), not_with.end(), run.program_id) !=
+                    not_with.end()) return true;
+            for (int excluded : run.program->NotWith()) {
+                if (other.program_id == excluded) return true;
+            }
+        }
+        return false;
+    };
+    auto stop_zone = [this, &next_zone](replay_run& run, std::time_t now,
+            bool preempted) {
+        if (now > run.zone_start) {
+            slots_.push_back({run.zone_start, now, run.remaining.front().zone_id,
+                run.program_id, run.due});
+            replayed_++;
+        }
+        run.watering = false;
+        run.off[run.remaining.front().zone_id] = now;
+        if (preempted) {
+            run.left = run.zone_end - now;
+            if (run.left > 0) {
+                run.remaining.front().soak = 0;
+                return;
+            }
+        }
+        next_zone(run);
+    };
+    auto start_zone = [this, &next_zone](replay_run& run, std::time_t now) {
+        while (!run.remaining.empty()) {
+            const cycle_step& step = run.remaining.front();
+            auto zone = zones_.find(step.zone_id);
+            if (zone != zones_.end() && zone->second.enabled) {
+                auto off = run.off.find(step.zone_id);
+                if (step.soak > 0 && off != run.off.end() &&
+                        now < off->second + step.soak) {
+                    run.soaking = true;
+                    run.soak_end = off->second + step.soak;
+                    return true;
+                }
+                run.soaking = false;
+                run.watering = true;
+                run.zone_start = now;
+                run.zone_end = now + run.left;
+                return true;
+            }
+            next_zone(run);
+        }
+        return false;
+    };
+    // Dispatch() of main.cpp, start_zone and stop_zone are the steps of its
+    // RunTask
+    auto dispatch = [&](std::time_t now) {
+        for (auto& run : holdable) {
+            run.held = held(run);
+            if (run.held) run.released = now;
+        }
+        // past their catch up, skipped in the order they were queued
+        std::vector<std::pair<std::uint64_t, timeline_skip> > late;
+        for (auto it = holdable.begin(); it != holdable.end();) {
+            if (!it->held && !it->program->MayStart(std::max(it->due,
+                    it->released), now)) {
+                late.push_back({it->queued, {it->due, it->program_id}});
+                it = holdable.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        while (!deadlines.empty() && deadlines.begin()->first <= now) {
+            auto it = ready.find(deadlines.begin()->second);
+            late.push_back({it->second.queued, {it->second.due,
+                    it->second.program_id}});
+            ready.erase(it);
+            deadlines.erase(deadlines.begin());
+        }
+        std::sort(late.begin(), late.end(),
+                [](const std::pair<std::uint64_t, timeline_skip>& left,
+                const std::pair<std::uint64_t, timeline_skip>& right) {
+                    return left.first < right.first;
+                });
+        for (const auto& skip : late) {
+            skips_.push_back(skip.second);
+            leave(skip.second.program_id);
+        }
+        for (;;) {
+            auto best = holdable.end();
+            for (auto it = holdable.begin(); it != holdable.end(); ++it) {
+                if (held(*it)) continue;
+                if (best == holdable.end() || Rank(*it) < Rank(*best)) {
+                    best = it;
+                }
+            }
+            bool first = !ready.empty() && (best == holdable.end() ||
+                    ready.begin()->first < Rank(*best));
+            const replay_run* pick = first ? &ready.begin()->second :
+                    best != holdable.end() ? &*best : nullptr;
+            if (pick &&
+                    (runs.empty() || pick->priority > runs.back().priority)) {
+                // the preempted task is woken out of its zone or soak
+                if (!runs.empty() && runs.back().watering) {
+                    stop_zone(runs.back(), now, true);
+                }
+                if (!runs.empty()) runs.back().soaking = false;
+                if (first) {
+                    auto it = ready.begin();
+                    deadlines.erase(std::make_pair(Deadline(it->second),
+                            it->first));
+                    runs.push_back(std::move(it->second));
+                    ready.erase(it);
+                } else {
+                    runs.push_back(std::move(*best));
+                    holdable.erase(best);
+                }
+            }
+            if (runs.empty() || runs.back().watering ||
+                    runs.back().soaking) return;
+            if (start_zone(runs.back(), now)) return;
+            leave(runs.back().program_id);
+            runs.pop_back();
+        }
+    };
+
+    size_t next = 0;
+    std::time_t now = from != kDawn ? from :
+            (starts.empty() ? now_ : starts.front().at);
+    for (;;) {
+        if (runs.empty() && ready.empty() && holdable.empty() &&
+                (idle_.empty() || idle_.back().at < now)) {
+            idle_.push_back({now, slots_.size(), skips_.size()});
+        }
+        for (; next < starts.size() && starts[next].at <= now; next++) {
+            const replay_start& start = starts[next];
+            if (busy(start.program_id)) {
+                skips_.push_back({start.at, start.program_id});
+                continue;
+            }
+            replay_run run = {};
+            run.program = start.program;
+            run.program_id = start.program_id;
+            run.due = start.at;
+            run.released = start.at;
+            run.priority = start.program->Priority();
+            run.queued = sequence++;
+            // as NewRun() in main.cpp
+            std::vector<cycle_zone> cycle_zones;
+            for (const auto& detail : start.program->ZoneDetail()) {
+                auto zone = zones_.find(detail.zone_id);
+                bool known = zone != zones_.end();
+                cycle_zones.push_back({detail.zone_id, detail.duration * 60,
+                    known ? zone->second.max_cycle * 60 : 0,
+                    known ? zone->second.min_soak * 60 : 0});
+            }
+            cycle_plan plan = PlanCycles(cycle_zones, 1);
+            run.remaining.assign(plan.steps.begin(), plan.steps.end());
+            if (!run.remaining.empty()) {
+                run.left = run.remaining.front().seconds;
+            }
+            queued[start.program_id]++;
+            if (may_hold.count(start.program_id)) {
+                holdable.push_back(std::move(run));
+                continue;
+            }
+            replay_rank rank = Rank(run);
+            std::time_t deadline = Deadline(run);
+            if (deadline != kNever) deadlines.insert({deadline, rank});
+            ready.emplace(rank, std::move(run));
+        }
+        dispatch(now);
+
+        // the next start, the end of the watering zone or the end of a
+        // waiting run's catch up window, a held run waits on the others
+        std::time_t wake = next < starts.size() ? starts[next].at : kNever;
+        if (!runs.empty() && runs.back().watering) {
+            wake = std::min(wake, runs.back().zone_end);
+        }
+        if (!runs.empty() && runs.back().soaking) {
+            wake = std::min(wake, runs.back().soak_end);
+        }
+        if (!deadlines.empty()) {
+            wake = std::min(wake, deadlines.begin()->first);
+        }
+        for (const auto& run : holdable) {
+            if (!run.held) wake = std::min(wake, Deadline(run));
+        }
+        if (wake == kNever) break;
+
+        // the task's timer, its zone or soak ends before the next pass
+        now = wake;
+        if (!runs.empty() && runs.back().watering &&
+                now >= runs.back().zone_end) {
+            stop_zone(runs.back(), now, false);
+        }
+        if (!runs.empty() && runs.back().soaking &&
+                now >= runs.back().soak_end) {
+            runs.back().soaking = false;
+        }
+    }
+}
+
+void Timeline::Trim() {
+    // keep from the last idle moment at or before now, nothing before it
+    // can change any more
+    auto idle = std::upper_bound(idle_.begin(), idle_.end(), now_,
+            [](std::time_t value, const checkpoint & c) {
+                return value < c.at;
+            });
+    if (idle == idle_.begin() || --idle == idle_.begin()) return;
+
+    checkpoint keep = *idle;
+    slots_.erase(slots_.begin(), slots_.begin() + keep.slots);
+    skips_.erase(skips_.begin(), skips_.begin() + keep.skips);
+    idle_.erase(idle_.begin(), idle);
+    for (auto& c : idle_) {
+        c.slots -= keep.slots;
+        c.skips -= keep.skips;
+    }
+    for (auto& program : programs_) {
+        auto& starts = program.second.starts;
+        starts.erase(starts.begin(), std::lower_bound(starts.begin(),
+                starts.end(), keep.at));
+    }
+}
+
+bool ParseLocal(const char* text, std::time_t& t) {
+    std::tm tm = {};
+    int fields = std::sscanf(text, "%d-%d-%d %d:%d", &tm.tm_year, &tm.tm_mon,
+            &tm.tm_mday, &tm.tm_hour, &tm.tm_min);
+    if (fields != 3 && fields != 5) return false;
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    return TimeZone::Local().ToUtc(tm, t);
+}
+
+std::vector<std::string> LoadTimeline(Timeline& timeline,
+        const YAML::Node& yConfig, const site_report& report) {
+    std::vector<std::string> warnings;
+    for (const auto& zone : report.zones) {
+        timeline.Zone(zone.id, zone.enabled, zone.max_cycle, zone.min_soak);
+    }
+    std::map<int, int> offsets;
+    std::string offsets_file = yConfig["offsets_file"].as<std::string>("");
+    std::string error;
+    if (!offsets_file.empty() && !LoadOffsets(offsets_file, offsets, error)) {
+        warnings.push_back("starting without offsets, " + offsets_file +
+                ": " + error);
+    }
+    // CheckDependencies() of main.cpp, the programs of a cycle lose theirs
+    std::vector<Program> programs;
+    std::vector<dag_program> graph;
+    for (Program program : report.programs) {
+        if (program.Disabled()) continue;
+        auto offset = offsets.find(program.Id());
+        if (offset != offsets.end() && offset->second != 0) {
+            program.Offset(offset->second);
+        }
+        programs.push_back(program);
+        graph.push_back({program.Id(), 0, 0, 0, {}, program.After(),
+            program.NotWith()});
+    }
+    std::vector<int> order, cycle;
+    while (!OrderPrograms(graph, order, cycle)) {
+        for (size_t i = 0; i < graph.size(); i++) {
+            if (std::find(cycle.begin(), cycle.end(), graph[i].id) ==
+                    cycle.end()) continue;
+            graph[i].after.clear();
+            graph[i].not_with.clear();
+            programs[i].ClearDependencies();
+        }
+    }
+    tariff_table tariff;
+    error.clear();
+    if (!LoadTariff(yConfig, tariff, error) && !error.empty()) {
+        warnings.push_back("ignoring the tariff, " + error);
+    }
+    timeline.Tariff(tariff);
+    for (const auto& program : programs) {
+        timeline.Set(program);
+    }
+    return warnings;
+}
+
+std::string FormatLocal(std::time_t t, const char* format) {
+    std::tm tm = TimeZone::Local().ToLocal(t);
+    char buffer[64];
+    std::strftime(buffer, sizeof (buffer), format, &tm);
+    return buffer;
+}
+
+int TimelineCommand(int argc, char* argv[]) {
+    if (argc < 1) {
+        std::cout << "eg: mysprinkler timeline /etc/mysprinkler.yaml [days] "
+                "[at \"2026-10-14 04:45\"] [from 2026-10-19] [to 2026-10-26]\n";
+        return EXIT_FAILURE;
+    }
+    std::time_t now = std::time(nullptr);
+    std::time_t from = now, to = now + 7 * 86400, at = 0;
+    bool point = false;
+    int days = 14;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if ((arg == "at" || arg == "from" || arg == "to") && i + 1 < argc) {
+            std::time_t& target = arg == "at" ? at : arg == "from" ? from : to;
+            if (!ParseLocal(argv[++i], target)) {
+                std::cout << "Invalid time " << argv[i] << ", expecting "
+                        "YYYY-MM-DD [HH:MM]\n";
+                return EXIT_FAILURE;
+            }
+            point = point || arg == "at";
+        } else {
+            days = std::max(1, std::atoi(argv[i]));
+        }
+    }
+
+    site_report report;
+    report.source = argv[0];
+    YAML::Node yConfig;
+    try {
+        yConfig = YAML::LoadFile(argv[0]);
+        ValidateConfig(yConfig, report);
+    } catch (const std::exception& e) {
+        std::cout << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+    for (const auto& error : report.errors) {
+        std::cout << "warning: " << error << "\n";
+    }
+
+    // the horizon covers whatever is asked about
+    std::time_t until = std::max(to, point ? at + 1 : to);
+    days = std::max(days, static_cast<int> ((until - now) / 86400 + 1));
+    Timeline timeline(now, days);
+    for (const auto& warning : LoadTimeline(timeline, yConfig, report)) {
+        std::cout << "warning: " << warning << "\n";
+    }
+
+    if (point) {
+        timeline_slot slot;
+        std::cout << FormatLocal(at, "%Y/%m/%d %H:%M %Z") << ": ";
+        if (timeline.At(at, slot)) {
+            std::cout << "zone " << slot.zone_id << " of program "
+                    << slot.program_id << " (due "
+                    << FormatLocal(slot.due, "%H:%M") << "), "
+                    << FormatLocal(slot.start, "%H:%M:%S") << " to "
+                    << FormatLocal(slot.end, "%H:%M:%S") << "\n";
+        } else {
+            std::cout << "no zone is watering\n";
+        }
+        return EXIT_SUCCESS;
+    }
+
+    std::printf("%-20s %-8s %5s %7s %-8s\n", "start", "end", "zone",
+            "program", "due");
+    for (const auto& slot : timeline.Range(from, to)) {
+        std::printf("%-20s %-8s %5d %7d %-8s\n",
+                FormatLocal(slot.start, "%Y/%m/%d %H:%M:%S").c_str(),
+                FormatLocal(slot.end, "%H:%M:%S").c_str(), slot.zone_id,
+                slot.program_id, FormatLocal(slot.due, "%H:%M").c_str());
+    }
+    for (const auto& skip : timeline.Skips(from, to)) {
+        std::printf("program %d skips its start at %s\n", skip.program_id,
+                FormatLocal(skip.due, "%Y/%m/%d %H:%M").c_str());
+    }
+    std::printf("\n%5s %10s\n", "zone", "minutes");
+    for (const auto& total : timeline.ZoneTotals(from, to)) {
+        std::printf("%5d %10.1f\n", total.first, total.second / 60.0);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,580 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "include/timezone.hpp"
+#include "include/Logger.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+namespace {
+
+const std::int64_t kSecondsPerDay = 86400;
+const std::int64_t kLastRuleYear = 2100; // footer rules are expanded to here
+
+std::int64_t FloorDiv(std::int64_t a, std::int64_t b) {
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+std::int64_t ReadBE(const std::vector<unsigned char>& data, size_t pos,
+        int bytes) {
+    std::uint64_t v = 0;
+    for (int i = 0; i < bytes; i++) {
+        v = (v << 8) | data[pos + i];
+    }
+    if (bytes == 4) {
+        return static_cast<std::int32_t> (v);
+    }
+    return static_cast<std::int64_t> (v);
+}
+
+bool IsLeap(std::int64_t y) {
+    return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+}
+
+int DaysInMonth(std::int64_t y, int m) {
+    static const int days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    return (m == 2 && IsLeap(y)) ? 29 : days[m - 1];
+}
+
+// POSIX TZ string cursor, eg: EST5EDT,M3.2.0,M11.1.0
+struct rule_reader {
+    const std::string& s;
+    size_t pos;
+
+    bool Done() const {
+        return pos >= s.size();
+    }
+
+    char Peek() const {
+        return Done() ? '\0' : s[pos];
+    }
+
+    bool Name(std::string& name) {
+        size_t start = pos;
+        if (Peek() == '<') {
+            size_t end = s.find('>', pos);
+            if (end == std::string::npos) return false;
+            name = s.substr(pos + 1, end - pos - 1);
+            pos = end + 1;
+            return !name.empty();
+        }
+        while (!Done() && std::isalpha(static_cast<unsigned char> (Peek())))
+            pos++;
+        name = s.substr(start, pos - start);
+        return name.size() >= 3;
+    }
+
+    bool Number(int& n) {
+        if (!std::isdigit(static_cast<unsigned char> (Peek()))) return false;
+        n = 0;
+        while (std::isdigit(static_cast<unsigned char> (Peek())))
+            n = n * 10 + (s[pos++] - '0');
+        return true;
+    }
+
+    // [+-]hh[:mm[:ss]] in seconds
+    bool Time(std::int32_t& secs) {
+        int sign = 1;
+        if (Peek() == '+' || Peek() == '-') {
+            sign = s[pos++] == '-' ? -1 : 1;
+        }
+        int h = 0, m = 0, sec = 0;
+        if (!Number(h)) return false;
+        if (Peek() == ':') {
+            pos++;
+            if (!Number(m)) return false;
+            if (Peek() == ':') {
+                pos++;
+                if (!Number(sec)) return false;
+            }
+        }
+        secs = sign * (h * 3600 + m * 60 + sec);
+        return true;
+    }
+};
+
+// a rule date, Jn, n or Mm.w.d, plus the local time of the change
+struct rule_date {
+    char kind;
+    int a, b, c;
+    std::int32_t time;
+
+    bool Parse(rule_reader& r) {
+        time = 2 * 3600;
+        if (r.Peek() == 'J') {
+            kind = 'J';
+            r.pos++;
+            if (!r.Number(a)) return false;
+        } else if (r.Peek() == 'M') {
+            kind = 'M';
+            r.pos++;
+            if (!r.Number(a) || r.Peek() != '.') return false;
+            r.pos++;
+            if (!r.Number(b) || r.Peek() != '.') return false;
+            r.pos++;
+            if (!r.Number(c)) return false;
+            if (a < 1 || a > 12 || b < 1 || b > 5 || c > 6) return false;
+        } else {
+            kind = 'n';
+            if (!r.Number(a)) return false;
+        }
+        if (r.Peek() == '/') {
+            r.pos++;
+            if (!r.Time(time)) return false;
+        }
+        return true;
+    }
+
+    // local seconds since the epoch at which the change happens in year y
+    std::int64_t Local(std::int64_t y) const {
+        std::int64_t day = 0;
+        switch (kind) {
+            case 'J':
+                day = TimeZone::DaysFromCivil(y, 1, 1) + a - 1;
+                if (IsLeap(y) && a >= 60) day++;
+                break;
+            case 'n':
+                day = TimeZone::DaysFromCivil(y, 1, 1) + a;
+                break;
+            default:
+            {
+                std::int64_t first = TimeZone::DaysFromCivil(y, a, 1);
+                day = first + (c - TimeZone::Weekday(first) + 7) % 7
+                        + (b - 1) * 7;
+                while (day >= first + DaysInMonth(y, a))
+                    day -= 7; // week 5 means the last one
+            }
+                break;
+        }
+        return day * kSecondsPerDay + time;
+    }
+};
+
+} // namespace
+
+TimeZone::TimeZone() : name_("UTC"), initial_type_(0) {
+    AddType(0, false, "UTC");
+}
+
+const TimeZone& TimeZone::Local() {
+    static const TimeZone local = [] {
+        TimeZone tz;
+        if (!tz.Load()) {
+            ace::utils::Logger::Instance().Warning(
+                    "Unable to load local time zone, using UTC.");
+            tz = TimeZone();
+        }
+        return tz;
+    }();
+    return local;
+}
+
+const std::string& TimeZone::Name() const {
+    return name_;
+}
+
+bool TimeZone::Load() {
+    const char* env = std::getenv("TZ");
+    if (env == nullptr) {
+        return LoadFile("/etc/localtime");
+    }
+    std::string tz(env);
+    if (!tz.empty() && tz[0] == ':') {
+        tz.erase(0, 1);
+    }
+    if (tz.empty()) {
+        *this = TimeZone();
+        return true;
+    }
+    if (tz[0] == '/') {
+        return LoadFile(tz);
+    }
+    if (tz.find("..") == std::string::npos &&
+            LoadFile("/usr/share/zoneinfo/" + tz)) {
+        return true;
+    }
+    return LoadRule(tz);
+}
+
+bool TimeZone::LoadFile(const std::string& path) {
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs) return false;
+    std::vector<unsigned char> data((std::istreambuf_iterator<char>(ifs)),
+            std::istreambuf_iterator<char>());
+
+    TimeZone tz;
+    tz.types_.clear();
+    if (!tz.ParseTzif(data)) return false;
+    tz.name_ = path;
+    *this = tz;
+    return true;
+}
+
+bool TimeZone::LoadRule(const std::string& rule) {
+    TimeZone tz;
+    tz.types_.clear();
+    if (!tz.ParseRule(rule, 0)) return false;
+    tz.name_ = rule;
+    *this = tz;
+    return true;
+}
+
+int TimeZone::AddType(std::int32_t offset, bool is_dst,
+        const std::string& abbr) {
+    for (size_t i = 0; i < types_.size(); i++) {
+        if (types_[i].offset == offset && types_[i].is_dst == is_dst &&
+                abbr.compare(types_[i].abbr) == 0) {
+            return static_cast<int> (i);
+        }
+    }
+    zone_type type;
+    type.offset = offset;
+    type.is_dst = is_dst;
+    std::memset(type.abbr, 0, sizeof (type.abbr));
+    abbr.copy(type.abbr, sizeof (type.abbr) - 1);
+    types_.push_back(type);
+    return static_cast<int> (types_.size() - 1);
+}
+
+bool TimeZone::ParseTzif(const std::vector<unsigned char>& data) {
+    const size_t header_len = 44;
+    if (data.size() < header_len || std::memcmp(data.data(), "TZif", 4) != 0)
+        return false;
+
+    size_t pos = 0;
+    int time_len = 4;
+    auto counts = [&data](size_t at, std::int64_t c[6]) {
+        for (int i = 0; i < 6; i++) c[i] = ReadBE(data, at + 20 + i * 4, 4);
+    };
+    std::int64_t c[6]; // isutcnt, isstdcnt, leapcnt, timecnt, typecnt, charcnt
+    counts(pos, c);
+
+    if (data[4] >= '2') { // skip the 32 bit block, use the 64 bit one
+        pos = header_len + c[3] * 4 + c[3] + c[4] * 6 + c[5] + c[2] * 8 +
+                c[1] + c[0];
+        if (data.size() < pos + header_len ||
+                std::memcmp(data.data() + pos, "TZif", 4) != 0)
+            return false;
+        counts(pos, c);
+        time_len = 8;
+    }
+    pos += header_len;
+
+    for (int i = 0; i < 6; i++) {
+        if (c[i] < 0) return false;
+    }
+    const std::int64_t timecnt = c[3], typecnt = c[4], charcnt = c[5];
+    const size_t block = timecnt * time_len + timecnt + typecnt * 6 + charcnt
+            + c[2] * (time_len + 4) + c[1] + c[0];
+    if (typecnt < 1 || typecnt > 256 || data.size() < pos + block)
+        return false;
+
+    const size_t idx_at = pos + timecnt * time_len;
+    const size_t types_at = idx_at + timecnt;
+    const size_t chars_at = types_at + typecnt * 6;
+
+    for (std::int64_t i = 0; i < typecnt; i++) {
+        size_t at = types_at + i * 6;
+        size_t abbr = data[at + 5];
+        if (abbr >= static_cast<size_t> (charcnt)) return false;
+        const char* p = reinterpret_cast<const char*> (&data[chars_at + abbr]);
+        zone_type type;
+        type.offset = static_cast<std::int32_t> (ReadBE(data, at, 4));
+        type.is_dst = data[at + 4] != 0;
+        std::memset(type.abbr, 0, sizeof (type.abbr));
+        std::strncpy(type.abbr, p, std::min<size_t>(sizeof (type.abbr) - 1,
+                charcnt - abbr));
+        types_.push_back(type); // keep file indexes, no de-duplication
+    }
+
+    for (std::int64_t i = 0; i < timecnt; i++) {
+        std::uint8_t type = data[idx_at + i];
+        if (type >= typecnt) return false;
+        transitions_.push_back(ReadBE(data, pos + i * time_len, time_len));
+        transition_types_.push_back(type);
+    }
+    initial_type_ = 0;
+
+    // v2+ footer holds the rule for instants after the last transition
+    size_t footer = pos + block;
+    if (time_len == 8 && footer < data.size() && data[footer] == '\n') {
+        size_t end = footer + 1;
+        while (end < data.size() && data[end] != '\n') end++;
+        std::string rule(data.begin() + footer + 1, data.begin() + end);
+        if (!rule.empty()) {
+            std::int64_t from = transitions_.empty() ? 0 : transitions_.back();
+            if (!ParseRule(rule, from) && transitions_.empty())
+                return false;
+        }
+    }
+    return true;
+}
+
+bool TimeZone::ParseRule(const std::string& rule, std::int64_t from) {
+    rule_reader r{rule, 0};
+    std::string std_name, dst_name;
+    std::int32_t std_off = 0, dst_off = 0;
+
+    if (!r.Name(std_name) || !r.Time(std_off)) return false;
+    std_off = -std_off; // POSIX offsets are positive west of Greenwich
+    int std_type = AddType(std_off, false, std_name);
+
+    if (r.Done()) { // no daylight saving time
+        if (transitions_.empty()) initial_type_ = std_type;
+        return true;
+    }
+
+    if (!r.Name(dst_name)) return false;
+    dst_off = std_off + 3600;
+    if (r.Peek() != ',' && !r.Done()) {
+        if (!r.Time(dst_off)) return false;
+        dst_off = -dst_off;
+    }
+    int dst_type = AddType(dst_off, true, dst_name);
+
+    std::string us_default(",M3.2.0,M11.1.0");
+    rule_reader dr = r.Done() ? rule_reader{us_default, 0} : r;
+    rule_date start, end;
+    if (dr.Peek() != ',') return false;
+    dr.pos++;
+    if (!start.Parse(dr) || dr.Peek() != ',') return false;
+    dr.pos++;
+    if (!end.Parse(dr) || !dr.Done()) return false;
+
+    if (transitions_.empty()) initial_type_ = std_type;
+
+    std::int64_t y;
+    int m, d;
+    CivilFromDays(FloorDiv(from, kSecondsPerDay), y, m, d);
+    for (; y <= kLastRuleYear; y++) {
+        // start is given in standard time, end in daylight time
+        std::int64_t on = start.Local(y) - std_off;
+        std::int64_t off = end.Local(y) - dst_off;
+        std::int64_t first = std::min(on, off), second = std::max(on, off);
+        int first_type = on < off ? dst_type : std_type;
+        int second_type = on < off ? std_type : dst_type;
+        if (first > from) {
+            transitions_.push_back(first);
+            transition_types_.push_back(static_cast<std::uint8_t> (first_type));
+        }
+        if (second > from) {
+            transitions_.push_back(second);
+            transition_types_.push_back(static_cast<std::uint8_t> (second_type));
+        }
+    }
+    return types_.size() <= 256;
+}
+
+int TimeZone::TypeAt(std::time_t utc) const {
+    auto it = std::upper_bound(transitions_.begin(), transitions_.end(),
+            static_cast<std::int64_t> (utc));
+    if (it == transitions_.begin()) return initial_type_;
+    return transition_types_[std::distance(transitions_.begin(), it) - 1];
+}
+
+int TimeZone::Offset(std::time_t utc) const {
+    return types_[TypeAt(utc)].offset;
+}
+
+std::tm TimeZone::ToLocal(std::time_t utc) const {
+    const zone_type& type = types_[TypeAt(utc)];
+    std::int64_t local = static_cast<std::int64_t> (utc) + type.offset;
+    std::int64_t days = FloorDiv(local, kSecondsPerDay);
+    std::int64_t secs = local - days * kSecondsPerDay;
+    std::int64_t y;
+    int m, d;
+    CivilFromDays(days, y, m, d);
+
+    std::tm tm = {};
+    tm.tm_year = static_cast<int> (y - 1900);
+    tm.tm_mon = m - 1;
+    tm.tm_mday = d;
+    tm.tm_hour = static_cast<int> (secs / 3600);
+    tm.tm_min = static_cast<int> (secs % 3600 / 60);
+    tm.tm_sec = static_cast<int> (secs % 60);
+    tm.tm_wday = Weekday(days);
+    tm.tm_yday = static_cast<int> (days - DaysFromCivil(y, 1, 1));
+    tm.tm_isdst = type.is_dst ? 1 : 0;
+#ifdef __GLIBC__
+    tm.tm_gmtoff = type.offset;
+    tm.tm_zone = type.abbr;
+#endif
+    return tm;
+}
+
+bool TimeZone::ToUtc(const std::tm& local, std::time_t& utc, GAP_POLICY gap,
+        OVERLAP_POLICY overlap) const {
+    std::int64_t y = local.tm_year + 1900LL + FloorDiv(local.tm_mon, 12);
+    int m = static_cast<int> (local.tm_mon - FloorDiv(local.tm_mon, 12) * 12);
+    std::int64_t wall = (DaysFromCivil(y, m + 1, 1) + local.tm_mday - 1) *
+            kSecondsPerDay + local.tm_hour * 3600LL + local.tm_min * 60LL +
+            local.tm_sec;
+
+    // offsets either side of any transition near this wall time; real zones
+    // never change offset twice within two days
+    std::int32_t before = Offset(wall - kSecondsPerDay);
+    std::int32_t after = Offset(wall + kSecondsPerDay);
+    std::int64_t early = wall - before, late = wall - after;
+    bool early_ok = Offset(early) == before;
+    bool late_ok = Offset(late) == after;
+
+    if (before == after || (early_ok && !late_ok)) {
+        utc = early;
+    } else if (late_ok && !early_ok) {
+        utc = late;
+    } else if (early_ok && late_ok) { // wall time happens twice
+        if (overlap == overlap_reject) return false;
+        utc = overlap == overlap_earliest ? std::min(early, late) :
+                std::max(early, late);
+    } else { // wall time never happens
+        if (gap == gap_reject) return false;
+        utc = gap == gap_forward ? early : late;
+    }
+    return true;
+}
+
+std::int64_t TimeZone::DaysFromCivil(std::int64_t y, int m, int d) {
+    y -= m <= 2;
+    const std::int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const std::int64_t yoe = y - era * 400;
+    const std::int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const std::int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+void TimeZone::CivilFromDays(std::int64_t days, std::int64_t& y, int& m,
+        int& d) {
+    days += 719468;
+    const std::int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const std::int64_t doe = days - era * 146097;
+    const std::int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096)
+            / 365;
+    const std::int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const std::int64_t mp = (5 * doy + 2) / 153;
+    d = static_cast<int> (doy - (153 * mp + 2) / 5 + 1);
+    m = static_cast<int> (mp < 10 ? mp + 3 : mp - 9);
+    y = yoe + era * 400 + (m <= 2);
+}
+
+int TimeZone::Weekday(std::int64_t days) {
+    return static_cast<int> (days >= -4 ? (days + 4) % 7 : (days + 5) % 7 + 6);
+}
+
+namespace {
+
+bool SameTime(const std::tm& a, const std::tm& b) {
+    return a.tm_year == b.tm_year && a.tm_mon == b.tm_mon &&
+            a.tm_mday == b.tm_mday && a.tm_hour == b.tm_hour &&
+            a.tm_min == b.tm_min && a.tm_sec == b.tm_sec &&
+            a.tm_wday == b.tm_wday && a.tm_yday == b.tm_yday &&
+            a.tm_isdst == b.tm_isdst;
+}
+
+// ns per conversion with convert(i) run count times across threads
+template <typename Convert>
+double Measure(int threads, int count, Convert convert) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; t++) {
+        pool.emplace_back([t, threads, count, &convert]() {
+            for (int i = t; i < count; i += threads) convert(i);
+        });
+    }
+    for (auto& thread : pool) thread.join();
+    return std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - start).count() / count;
+}
+
+} // namespace
+
+int TimeZoneBenchCommand(int argc, char* argv[]) {
+    int count = argc > 0 ? std::max(1, std::atoi(argv[0])) : 1000000;
+    int threads = argc > 1 ? std::max(1, std::atoi(argv[1])) :
+            std::max(1u, std::thread::hardware_concurrency());
+    const TimeZone& zone = TimeZone::Local();
+
+    // instants spread over 2000-2040, so every transition rule is hit
+    std::vector<std::time_t> instants(count);
+    std::vector<std::tm> locals(count);
+    std::uint64_t seed = 88172645463325252ull;
+    for (int i = 0; i < count; i++) {
+        seed ^= seed << 13, seed ^= seed >> 7, seed ^= seed << 17;
+        instants[i] = 946684800 + static_cast<std::time_t> (seed %
+                (40ull * 365 * kSecondsPerDay));
+        localtime_r(&instants[i], &locals[i]);
+    }
+
+    int local_differ = 0, utc_differ = 0;
+    for (int i = 0; i < count; i++) {
+        std::tm tm = locals[i];
+        std::time_t utc = 0;
+        // tm_isdst picks the occurrence of a repeated hour, as for mktime
+        if (!SameTime(zone.ToLocal(instants[i]), locals[i])) local_differ++;
+        if (!zone.ToUtc(locals[i], utc, TimeZone::gap_forward,
+                locals[i].tm_isdst > 0 ? TimeZone::overlap_earliest :
+                TimeZone::overlap_latest) || utc != instants[i] ||
+                mktime(&tm) != instants[i]) {
+            utc_differ++;
+        }
+    }
+    std::printf("%s, %d conversions from 2000 to 2040, results differ: "
+            "%d to local, %d to utc\n", zone.Name().c_str(), count,
+            local_differ, utc_differ);
+    std::printf("%-8s %12s %12s %12s %12s\n", "threads", "ToLocal",
+            "localtime_r", "ToUtc", "mktime");
+
+    std::vector<int> runs = {1};
+    if (threads > 1) runs.push_back(threads);
+    for (int run : runs) {
+        std::vector<std::tm> out(count);
+        std::vector<std::time_t> back(count);
+        double to_local = Measure(run, count, [&](int i) {
+            out[i] = zone.ToLocal(instants[i]);
+        });
+        double libc_local = Measure(run, count, [&](int i) {
+            localtime_r(&instants[i], &out[i]);
+        });
+        double to_utc = Measure(run, count, [&](int i) {
+            zone.ToUtc(locals[i], back[i]);
+        });
+        double libc_utc = Measure(run, count, [&](int i) {
+            std::tm tm = locals[i];
+            back[i] = mktime(&tm);
+        });
+        std::printf("%-8d %9.1f ns %9.1f ns %9.1f ns %9.1f ns\n", run,
+                to_local, libc_local, to_utc, libc_utc);
+    }
+    return EXIT_SUCCESS;
+}
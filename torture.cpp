@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "include/torture.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+const int kSubBits = 7; // 128 sub buckets, the upper half per power of two
+const size_t kSub = size_t(1) << kSubBits;
+const size_t kHalf = kSub / 2;
+
+int BitLength(std::uint64_t value) {
+    return value ? 64 - __builtin_clzll(value) : 0;
+}
+
+} // namespace
+
+LatencyHistogram::LatencyHistogram() :
+counts_(kSub + (64 - kSubBits) * kHalf), count_(0), max_(0) {
+}
+
+void LatencyHistogram::Record(std::chrono::nanoseconds latency) {
+    std::int64_t value = std::max<std::int64_t>(0, latency.count());
+    counts_[Index(static_cast<std::uint64_t> (value))]++;
+    max_ = std::max(max_, value);
+    count_.store(count_.load(std::memory_order_relaxed) + 1,
+            std::memory_order_release);
+}
+
+std::uint64_t LatencyHistogram::Count() const {
+    return count_.load(std::memory_order_acquire);
+}
+
+std::int64_t LatencyHistogram::Percentile(double percent) const {
+    std::uint64_t count = Count();
+    if (count == 0) return 0;
+    // the rank of the value, 1 based, as HdrHistogram
+    std::uint64_t rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(
+            percent / 100.0 * count + 0.5));
+    std::uint64_t seen = 0;
+    for (size_t i = 0; i < counts_.size(); i++) {
+        seen += counts_[i];
+        if (seen >= rank) return std::min(Highest(i), max_);
+    }
+    return max_;
+}
+
+std::int64_t LatencyHistogram::Max() const {
+    return max_;
+}
+
+std::string LatencyHistogram::Summary(const char* name) const {
+    char line[160];
+    std::snprintf(line, sizeof (line), "%-6s %7llu  p50 %9.1f  p99 %9.1f  "
+            "p99.9 %9.1f  max %9.1f us", name,
+            static_cast<unsigned long long> (Count()), Percentile(50) / 1e3,
+            Percentile(99) / 1e3, Percentile(99.9) / 1e3, Max() / 1e3);
+    return line;
+}
+
+size_t LatencyHistogram::Index(std::uint64_t value) {
+    if (value < kSub) return static_cast<size_t> (value);
+    int shift = BitLength(value) - kSubBits;
+    return kSub + (shift - 1) * kHalf + ((value >> shift) - kHalf);
+}
+
+std::int64_t LatencyHistogram::Highest(size_t index) {
+    if (index < kSub) return static_cast<std::int64_t> (index);
+    size_t shift = (index - kSub) / kHalf + 1;
+    std::uint64_t top = (index - kSub) % kHalf + kHalf;
+    return static_cast<std::int64_t> (((top + 1) << shift) - 1);
+}
+
+LoadGenerator::LoadGenerator() : running_(false) {
+}
+
+LoadGenerator::~LoadGenerator() {
+    Stop();
+}
+
+void LoadGenerator::Start(int cpu_threads, int io_threads,
+        const std::string& directory) {
+    Stop();
+    running_ = true;
+    for (int i = 0; i < cpu_threads; i++) {
+        threads_.emplace_back([this]() {
+            volatile std::uint64_t x = 88172645463325252ULL;
+            while (running_.load(std::memory_order_relaxed)) {
+                for (int n = 0; n < 4096; n++) {
+                    x ^= x << 13;
+                    x ^= x >> 7;
+                    x ^= x << 17;
+                }
+            }
+        });
+    }
+    for (int i = 0; i < io_threads; i++) {
+        files_.push_back(directory + "/load-" + std::to_string(i));
+        std::string file = files_.back();
+        threads_.emplace_back([this, file]() {
+            std::vector<char> block(64 * 1024, 'x');
+            int fd = open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC |
+                    O_CLOEXEC, 0644);
+            if (fd < 0) return;
+            for (off_t at = 0; running_.load(std::memory_order_relaxed);) {
+                if (pwrite(fd, block.data(), block.size(), at) < 0) break;
+                fsync(fd);
+                // rewrite the first 16MB over and over
+                at = (at + block.size()) % (16 * 1024 * 1024);
+            }
+            close(fd);
+        });
+    }
+}
+
+void LoadGenerator::Stop() {
+    running_ = false;
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+    threads_.clear();
+    for (const auto& file : files_) {
+        unlink(file.c_str());
+    }
+    files_.clear();
+}
+
+bool WriteTortureConfig(const std::string& path, const std::string& directory,
+        const torture_options& options, int hour, int minute) {
+    std::ofstream ofs(path);
+    ofs << "logging_mode: NONE\n"
+            << "status_page: \"\"\n"
+            << "gpio_directory: " << directory << "/gpio\n"
+            << "gpio_fake:\n"
+            << "  latency_us: " << options.latency_us << "\n"
+            << "  failure_rate: " << options.failure_rate << "\n"
+            << "  ignore_rate: " << options.ignore_rate << "\n";
+    if (options.stuck > 0) {
+        ofs << "  stuck: [" << 100 + options.stuck << "]\n";
+    }
+    if (options.realtime) {
+        ofs << "realtime:\n"
+                << "  cpu: " << options.realtime_cpu << "\n";
+    }
+    if (!options.mqtt.empty()) {
+        size_t colon = options.mqtt.rfind(':');
+        ofs << "mqtt:\n"
+                << "  host: " << options.mqtt.substr(0, colon) << "\n";
+        if (colon != std::string::npos) {
+            ofs << "  port: " << options.mqtt.substr(colon + 1) << "\n";
+        }
+    }
+    ofs << "ZONES:\n";
+    for (int zone = 1; zone <= options.zones; zone++) {
+        // gpio numbers are arbitrary in a fake tree
+        ofs << "  " << zone << ": {name: zone " << zone << ", gpio: "
+                << 100 + zone << ", enabled: true, invert_logic: false}\n";
+    }
+    ofs << "PROGRAMS:\n";
+    for (int program = 1; program <= options.programs; program++) {
+        int duration = (options.timed > 0 && program % options.timed == 0) ?
+                options.seconds : 0;
+        ofs << "  " << program << ":\n"
+                << "    hour: " << hour << "\n"
+                << "    minute: " << minute << "\n"
+                << "    mode: interval\n"
+                << "    interval: 1\n"
+                << "    zone_detail:\n"
+                << "      " << (program - 1) % options.zones + 1
+                << ": {duration: " << duration << "}\n";
+    }
+    return static_cast<bool> (ofs);
+}
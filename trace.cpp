@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "include/trace.hpp"
+
+#ifdef MYSPRINKLER_TRACE
+
+#include "include/Logger.h"
+#include "include/timezone.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+// events each thread keeps, about 160KB
+const size_t kEvents = 4096;
+
+// one thread's ring, written by the thread, read by a dump
+struct trace_buffer {
+    trace_buffer() : events(kEvents), next(0), size(0) {
+    }
+    std::mutex lock; // uncontended but while a dump copies it
+    std::vector<trace_event> events;
+    size_t next;
+    size_t size;
+    long tid;
+    std::string name;
+};
+
+std::mutex buffers_lock;
+// kept after their threads exit, their events still belong in a dump
+std::vector<std::shared_ptr<trace_buffer> > buffers;
+thread_local trace_buffer* current = nullptr;
+
+std::thread dump_thread;
+int wake_fd[2] = {-1, -1};
+std::atomic<bool> running(false);
+std::string dump_directory;
+int dump_seconds = 30;
+
+trace_buffer& Buffer() {
+    if (current == nullptr) {
+        std::shared_ptr<trace_buffer> buffer(new trace_buffer());
+        buffer->tid = syscall(SYS_gettid);
+        buffer->name = "thread " + std::to_string(buffer->tid);
+        std::lock_guard<std::mutex>lock(buffers_lock);
+        buffers.push_back(buffer);
+        current = buffer.get();
+    }
+    return *current;
+}
+
+std::string Escape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        if (static_cast<unsigned char> (c) >= 0x20) escaped += c;
+    }
+    return escaped;
+}
+
+void DumpThread() {
+    TraceThread("trace");
+    pollfd p = {wake_fd[0], POLLIN, 0};
+    while (running) {
+        if (poll(&p, 1, -1) < 0 && errno != EINTR) break;
+        char c[16];
+        if (read(wake_fd[0], c, sizeof (c)) <= 0 || !running) continue;
+
+        char name[64];
+        std::tm local = TimeZone::Local().ToLocal(std::time(nullptr));
+        std::strftime(name, sizeof (name), "mysprinkler-trace-%Y%m%d-%H%M%S"
+                ".json", &local);
+        std::string path = dump_directory + "/" + name;
+        if (TraceDump(path, dump_seconds)) {
+            ace::utils::Logger::Instance().Info("Trace of the last %d "
+                    "seconds written to %s", dump_seconds, path.c_str());
+        } else {
+            ace::utils::Logger::Instance().Warning("Unable to write trace "
+                    "%s", path.c_str());
+        }
+    }
+}
+
+} // namespace
+
+std::int64_t TraceNow() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void TraceRecord(const trace_event& event) {
+    trace_buffer& buffer = Buffer();
+    std::lock_guard<std::mutex>lock(buffer.lock);
+    buffer.events[buffer.next] = event;
+    buffer.next = (buffer.next + 1) % buffer.events.size();
+    if (buffer.size < buffer.events.size()) buffer.size++;
+}
+
+void TraceThread(const std::string& name) {
+    trace_buffer& buffer = Buffer();
+    std::lock_guard<std::mutex>lock(buffer.lock);
+    buffer.name = name;
+}
+
+void TraceStart(const std::string& directory, int seconds) {
+    if (running) return;
+    dump_directory = directory;
+    dump_seconds = seconds > 0 ? seconds : 30;
+    if (pipe2(wake_fd, O_CLOEXEC | O_NONBLOCK) != 0) return;
+    running = true;
+    dump_thread = std::thread(DumpThread);
+}
+
+void TraceStop() {
+    if (!running) return;
+    running = false;
+    TraceRequestDump();
+    dump_thread.join();
+    close(wake_fd[0]);
+    close(wake_fd[1]);
+    wake_fd[0] = wake_fd[1] = -1;
+}
+
+void TraceRequestDump() {
+    if (wake_fd[1] < 0) return;
+    char c = 1;
+    // a full pipe already holds a request
+    ssize_t ignored = write(wake_fd[1], &c, 1);
+    (void) ignored;
+}
+
+bool TraceDump(const std::string& path, int seconds) {
+    std::int64_t now = TraceNow();
+    std::int64_t from = now - seconds * 1000000000LL;
+    std::vector<std::shared_ptr<trace_buffer> > all;
+    {
+        std::lock_guard<std::mutex>lock(buffers_lock);
+        all = buffers;
+    }
+
+    FILE* f = std::fopen(path.c_str(), "w");
+    if (f == nullptr) return false;
+    std::fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    long pid = getpid();
+    bool first = true;
+    std::vector<trace_event> events;
+    for (const auto& buffer : all) {
+        std::string name;
+        {
+            // copied out so the thread is held up only by a memcpy
+            std::lock_guard<std::mutex>lock(buffer->lock);
+            size_t start = (buffer->next + buffer->events.size() -
+                    buffer->size) % buffer->events.size();
+            events.clear();
+            for (size_t i = 0; i < buffer->size; i++) {
+                events.push_back(buffer->events[(start + i) %
+                        buffer->events.size()]);
+            }
+            name = buffer->name;
+        }
+        std::fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\","
+                "\"pid\":%ld,\"tid\":%ld,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", pid, buffer->tid, Escape(name).c_str());
+        first = false;
+        for (const auto& e : events) {
+            // a span that ended within the window counts
+            if (e.ts + std::max<std::int64_t>(0, e.dur) < from) continue;
+            if (e.dur < 0) {
+                std::fprintf(f, ",\n{\"ph\":\"i\",\"s\":\"t\",\"cat\":"
+                        "\"%s\",\"name\":\"%s\",\"pid\":%ld,\"tid\":%ld,"
+                        "\"ts\":%.3f,\"args\":{\"v\":%lld}}", e.category,
+                        e.name, pid, buffer->tid, e.ts / 1e3,
+                        static_cast<long long> (e.arg));
+            } else {
+                std::fprintf(f, ",\n{\"ph\":\"X\",\"cat\":\"%s\","
+                        "\"name\":\"%s\",\"pid\":%ld,\"tid\":%ld,"
+                        "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"v\":%lld}}",
+                        e.category, e.name, pid, buffer->tid, e.ts / 1e3,
+                        e.dur / 1e3, static_cast<long long> (e.arg));
+            }
+        }
+    }
+    std::fprintf(f, "\n]}\n");
+    return std::fclose(f) == 0;
+}
+
+#endif /* MYSPRINKLER_TRACE */
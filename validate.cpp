@@ -0,0 +1,345 @@
+/*
+ * Copyright (c) 2017, Aaron Coombs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the mysprinkler Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL AARON COOMBS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "include/validate.hpp"
+#include "include/dag.hpp"
+#include "include/tariff.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <tuple>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+bool ValidateConfig(const YAML::Node& yConfig, site_report& report) {
+    std::set<int> buses;
+    YAML::Node bNode = yConfig["MODBUS"];
+    for (auto it = bNode.begin(); it != bNode.end(); ++it) {
+        std::string id = std::to_string(it->first.as<int>(0));
+        buses.insert(it->first.as<int>(0));
+        YAML::Node sim = it->second["simulated"];
+        if (it->second["device"].as<std::string>("").empty() &&
+                (!sim.IsDefined() || sim.IsNull())) {
+            report.errors.push_back("Modbus bus " + id + " has no device");
+        }
+        std::string parity = it->second["parity"].as<std::string>("even");
+        if (parity != "even" && parity != "odd" && parity != "none") {
+            report.errors.push_back("Modbus bus " + id + " has parity " +
+                    parity + ", not even, odd or none");
+        }
+    }
+
+    std::set<int> zone_ids;
+    std::map<std::tuple<int, int, int>, int> coils; // zone by bus, slave, coil
+    YAML::Node zNode = yConfig["ZONES"];
+    if (!zNode.IsMap() || zNode.size() == 0) {
+        report.warnings.push_back("no zones");
+    }
+    for (auto it = zNode.begin(); it != zNode.end(); ++it) {
+        // the defaults of LoadZones()
+        site_zone zone;
+        zone.id = it->first.as<int>(0);
+        zone.name = it->second["name"].as<std::string>("");
+        zone.gpio = it->second["gpio"].as<int>(0);
+        zone.enabled = it->second["enabled"].as<bool>(false);
+        YAML::Node yCoil = it->second["modbus"];
+        if (yCoil.IsDefined() && !yCoil.IsNull()) {
+            zone.coil.bus = yCoil["bus"].as<int>(0);
+            zone.coil.slave = yCoil["slave"].as<int>(0);
+            zone.coil.coil = yCoil["coil"].as<int>(0);
+        }
+        zone.invert_logic = it->second["invert_logic"].as<bool>(
+                zone.coil.bus == 0);
+        zone.max_cycle = it->second["max_cycle"].as<int>(0);
+        zone.min_soak = it->second["min_soak"].as<int>(0);
+        zone.flow_rate = it->second["flow_rate"].as<double>(0);
+
+        std::string id = std::to_string(zone.id);
+        if (!zone_ids.insert(zone.id).second) {
+            report.errors.push_back("duplicate zone id " + id);
+        }
+        if (zone.coil.bus != 0) {
+            std::string coil = "coil " + std::to_string(zone.coil.coil) +
+                    " of board " + std::to_string(zone.coil.slave);
+            auto shared = coils.insert(std::make_pair(std::make_tuple(
+                    zone.coil.bus, zone.coil.slave, zone.coil.coil), zone.id));
+            if (buses.count(zone.coil.bus) == 0) {
+                report.errors.push_back("zone " + id + " is on Modbus bus " +
+                        std::to_string(zone.coil.bus) + " that is not there");
+            } else if (zone.coil.slave < 1 || zone.coil.slave > 247 ||
+                    zone.coil.coil < 0) {
+                report.errors.push_back("zone " + id + " has " + coil +
+                        ", boards are 1 to 247 and coils from 0");
+            } else if (!shared.second) {
+                report.errors.push_back("zone " + id + " shares " + coil +
+                        " with zone " + std::to_string(shared.first->second));
+            }
+        } else if (zone.gpio <= 0) {
+            report.errors.push_back("zone " + id + " has no gpio");
+        }
+        if (zone.min_soak > 0 && zone.max_cycle <= 0) {
+            report.warnings.push_back("zone " + id + " soaks without a "
+                    "max_cycle");
+        }
+        report.zones.push_back(zone);
+    }
+
+    std::set<int> program_ids;
+    YAML::Node pNode = yConfig["PROGRAMS"];
+    for (auto it = pNode.begin(); it != pNode.end(); ++it) {
+        Program program;
+        program.LoadProgram(it->first.as<int>(0), it->second);
+        std::string id = std::to_string(program.Id());
+
+        if (!program_ids.insert(program.Id()).second) {
+            report.errors.push_back("duplicate program id " + id);
+        }
+        for (const auto& problem : program.Problems()) {
+            report.errors.push_back("program " + id + " " + problem);
+        }
+        if (program.ZoneDetail().empty()) {
+            report.warnings.push_back("program " + id + " has no zones");
+        }
+        for (const auto& detail : program.ZoneDetail()) {
+            std::string zone = std::to_string(detail.zone_id);
+            if (zone_ids.count(detail.zone_id) == 0) {
+                report.errors.push_back("program " + id +
+                        " uses unknown zone " + zone);
+            }
+            if (detail.duration <= 0) {
+                report.warnings.push_back("program " + id + " waters zone " +
+                        zone + " for no time");
+            }
+        }
+        report.programs.push_back(program);
+    }
+
+    std::vector<dag_program> graph;
+    for (auto& program : report.programs) {
+        std::string id = std::to_string(program.Id());
+        for (int other : program.After()) {
+            if (program_ids.count(other) == 0) {
+                report.warnings.push_back("program " + id + " starts after "
+                        "unknown program " + std::to_string(other));
+            }
+        }
+        for (int other : program.NotWith()) {
+            if (program_ids.count(other) == 0) {
+                report.warnings.push_back("program " + id + " is not_with "
+                        "unknown program " + std::to_string(other));
+            }
+        }
+        graph.push_back({program.Id(), 0, 0, 0, {}, program.After(),
+            program.NotWith()});
+    }
+    std::vector<int> order, cycle;
+    if (!OrderPrograms(graph, order, cycle)) {
+        std::string ids;
+        for (int id : cycle) {
+            ids += std::to_string(id) + " -> ";
+        }
+        report.errors.push_back("programs " + ids +
+                std::to_string(cycle.front()) + " depend on each other");
+    }
+
+    tariff_table tariff;
+    std::string error;
+    if (!LoadTariff(yConfig, tariff, error) && !error.empty()) {
+        report.errors.push_back(error);
+    }
+    return report.errors.empty();
+}
+
+std::string JsonString(const std::string& text) {
+    std::string out = "\"";
+    for (unsigned char c : text) {
+        switch (c) {
+            case '"': out += "\\\"";
+                break;
+            case '\\': out += "\\\\";
+                break;
+            case '\n': out += "\\n";
+                break;
+            case '\t': out += "\\t";
+                break;
+            default:
+                if (c < 0x20) {
+                    char buffer[8];
+                    std::snprintf(buffer, sizeof (buffer), "\\u%04x", c);
+                    out += buffer;
+                } else {
+                    out += static_cast<char> (c);
+                }
+        }
+    }
+    return out + "\"";
+}
+
+std::string IsoUtc(std::time_t t) {
+    std::tm tm;
+    gmtime_r(&t, &tm);
+    char buffer[32];
+    std::strftime(buffer, sizeof (buffer), "%Y-%m-%dT%H:%M:%SZ", &tm);
+    return buffer;
+}
+
+namespace {
+
+std::string JsonStrings(const std::vector<std::string>& list) {
+    std::string out = "[";
+    for (size_t i = 0; i < list.size(); i++) {
+        out += (i ? ", " : "") + JsonString(list[i]);
+    }
+    return out + "]";
+}
+
+// one site, as a member of the report's "sites" array
+bool ValidateFile(const std::string& path, int runs, std::string& json) {
+    site_report report;
+    report.source = path;
+    try {
+        ValidateConfig(YAML::LoadFile(path), report);
+    } catch (const std::exception& e) {
+        report.errors.push_back(e.what());
+    }
+
+    std::ostringstream os;
+    os << "    {\"file\": " << JsonString(path)
+            << ", \"ok\": " << (report.errors.empty() ? "true" : "false")
+            << ", \"zones\": " << report.zones.size()
+            << ",\n     \"errors\": " << JsonStrings(report.errors)
+            << ",\n     \"warnings\": " << JsonStrings(report.warnings)
+            << ",\n     \"programs\": [";
+    for (size_t i = 0; i < report.programs.size(); i++) {
+        Program& program = report.programs[i];
+        os << (i ? ",\n       " : "\n       ") << "{\"id\": " << program.Id()
+                << ", \"disabled\": "
+                << (program.Disabled() ? "true" : "false") << ", \"next\": [";
+        for (int run = 0; run < runs && !program.Disabled(); run++) {
+            std::time_t start = program.StartTime();
+            os << (run ? ", " : "") << JsonString(IsoUtc(start));
+            program.NextStartTime(start);
+        }
+        os << "]}";
+    }
+    os << "]}";
+    json = os.str();
+    return report.errors.empty();
+}
+
+bool IsConfig(const std::string& name) {
+    auto ends = [&name](const std::string & suffix) {
+        return name.size() > suffix.size() && name.compare(
+                name.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+    return ends(".yaml") || ends(".yml");
+}
+
+} // namespace
+
+void AddConfigs(const std::string& path, std::vector<std::string>& files) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        files.push_back(path);
+        return;
+    }
+    std::vector<std::string> found;
+    DIR* dir = opendir(path.c_str());
+    if (dir == nullptr) return;
+    while (struct dirent* entry = readdir(dir)) {
+        if (IsConfig(entry->d_name)) {
+            found.push_back(path + "/" + entry->d_name);
+        }
+    }
+    closedir(dir);
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+}
+
+int ValidateCommand(int argc, char* argv[]) {
+    int jobs = static_cast<int> (std::thread::hardware_concurrency());
+    int runs = 3;
+    std::vector<std::string> files;
+    for (int i = 0; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--jobs" && i + 1 < argc) {
+            jobs = std::atoi(argv[++i]);
+        } else if (arg == "--runs" && i + 1 < argc) {
+            runs = std::max(0, std::atoi(argv[++i]));
+        } else {
+            AddConfigs(arg, files);
+        }
+    }
+    if (files.empty()) {
+        std::cout << "eg: mysprinkler validate [--jobs N] [--runs N] "
+                "/etc/mysprinkler/sites\n";
+        return EXIT_FAILURE;
+    }
+    jobs = std::max(1, std::min(jobs, static_cast<int> (files.size())));
+
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::string> sites(files.size());
+    std::vector<unsigned char> ok(files.size());
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i; (i = next.fetch_add(1)) < files.size();) {
+            ok[i] = ValidateFile(files[i], runs, sites[i]);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < jobs; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - begin).count();
+
+    size_t failed = std::count(ok.begin(), ok.end(), 0);
+    std::string out = "{\"sites\": [\n";
+    for (size_t i = 0; i < sites.size(); i++) {
+        out += sites[i] + (i + 1 < sites.size() ? ",\n" : "\n");
+    }
+    char summary[160];
+    std::snprintf(summary, sizeof (summary), "  ],\n \"summary\": {\"sites\": "
+            "%zu, \"failed\": %zu, \"jobs\": %d, \"seconds\": %.3f}}\n",
+            sites.size(), failed, jobs, seconds);
+    out += summary;
+    std::fwrite(out.data(), 1, out.size(), stdout);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -27,13 +27,36 @@
 
 #include "include/zone.hpp"
 
+#include <algorithm>
+#include <thread>
+
+namespace {
+
+relay_policy policy_; // set before any zone switches
+Heartbeat beat_("relay");
+
+} // namespace
+
 Zone::Zone(int id, std::string name, int pin, bool enabled, bool invertLogic) :
-BlackGPIO(static_cast<gpioName> (pin), direction::output, 
-SecureMode){
+gpio_(pin, true), max_cycle_(0), min_soak_(0), commanded_(false),
+faulted_(false), last_attempts_(0), bus_fail_(false) {
+    Id(id);
+    Name(name);
+    Enabled(enabled);
+    InvertLogic(invertLogic);
+    gpio_.Open();
+}
+
+Zone::Zone(int id, std::string name, std::shared_ptr<ModbusBus> bus,
+        const modbus_coil& coil, bool enabled, bool invertLogic) :
+gpio_(0, true), max_cycle_(0), min_soak_(0), commanded_(false),
+faulted_(false), last_attempts_(0), bus_(bus), coil_(coil),
+bus_fail_(false) {
     Id(id);
     Name(name);
     Enabled(enabled);
     InvertLogic(invertLogic);
+    bus_->Register(coil_.slave, coil_.coil, invertLogic);
 }
 
 void Zone::Id(int id) {
@@ -45,11 +68,144 @@ int Zone::Id() const {
 }
 
 bool Zone::TurnOff() {
-    return setValue(InvertLogic() ? high : low);
+    return Command(false);
 }
 
 bool Zone::TurnOn() {
-    return setValue(InvertLogic() ? low : high);
+    return Command(true);
+}
+
+bool Zone::Command(bool on) {
+    using clock = std::chrono::steady_clock;
+    beat_.Busy(id_);
+    std::lock_guard<std::mutex> lk(command_mutex_);
+    commanded_ = on;
+    bool high = on != InvertLogic();
+    auto begin = clock::now();
+    auto deadline = begin + std::chrono::microseconds(policy_.budget_us);
+    std::chrono::microseconds backoff(std::max(1, policy_.backoff_us));
+
+    bool confirmed = false;
+    int attempts = 0;
+    if (bus_) {
+        // the bus retries within its own timeouts
+        modbus_result result = bus_->Write(coil_.slave, coil_.coil, high);
+        confirmed = result.confirmed;
+        attempts = result.attempts;
+    } else {
+        for (;;) {
+            attempts++;
+            if (!gpio_.IsOpen()) gpio_.Open();
+            if (gpio_.Write(high)) {
+                bool read = gpio_.IsHigh();
+                confirmed = !gpio_.Fail() && read == high;
+            }
+            if (confirmed || clock::now() + backoff > deadline) break;
+            std::this_thread::sleep_for(backoff);
+            backoff *= 2;
+        }
+    }
+
+    Account(confirmed, attempts, clock::now() - begin);
+    beat_.Idle();
+    return confirmed;
+}
+
+void Zone::Account(bool confirmed, int attempts,
+        std::chrono::nanoseconds took) {
+    last_attempts_ = attempts;
+    bus_fail_ = !confirmed;
+    stats_.transitions++;
+    stats_.attempts += attempts;
+    if (attempts > 1) stats_.retried++;
+    if (confirmed) {
+        stats_.confirm_total += took;
+        stats_.confirm_max = std::max<std::chrono::nanoseconds>(
+                stats_.confirm_max, took);
+    } else {
+        stats_.failed++;
+    }
+}
+
+std::vector<bool> Zone::Switch(const std::vector<shared_zone>& zones,
+        bool on) {
+    using clock = std::chrono::steady_clock;
+    std::vector<bool> confirmed(zones.size(), false);
+    std::vector<std::future<modbus_result> > pending(zones.size());
+    auto begin = clock::now();
+    for (size_t i = 0; i < zones.size(); i++) {
+        Zone& zone = *zones[i];
+        if (!zone.bus_) continue;
+        std::lock_guard<std::mutex> lk(zone.command_mutex_);
+        zone.commanded_ = on;
+        pending[i] = zone.bus_->Submit(zone.coil_.slave, zone.coil_.coil,
+                on != zone.InvertLogic());
+    }
+    for (size_t i = 0; i < zones.size(); i++) {
+        if (!zones[i]->bus_) confirmed[i] = zones[i]->Command(on);
+    }
+    beat_.Busy();
+    for (size_t i = 0; i < zones.size(); i++) {
+        Zone& zone = *zones[i];
+        if (!zone.bus_) continue;
+        modbus_result result = pending[i].get();
+        std::lock_guard<std::mutex> lk(zone.command_mutex_);
+        zone.Account(result.confirmed, result.attempts, clock::now() - begin);
+        confirmed[i] = result.confirmed;
+    }
+    beat_.Idle();
+    return confirmed;
+}
+
+void Zone::ForceOff() {
+    commanded_ = false;
+    if (bus_) {
+        bus_->ForceOff();
+    } else {
+        gpio_.ForceWrite(InvertLogic());
+    }
+}
+
+void Zone::Policy(const relay_policy& policy) {
+    policy_ = policy;
+}
+
+relay_policy Zone::Policy() {
+    return policy_;
+}
+
+Heartbeat& Zone::Beat() {
+    return beat_;
+}
+
+int Zone::Pin() const {
+    return gpio_.Pin();
+}
+
+modbus_coil Zone::Coil() const {
+    return coil_;
+}
+
+relay_stats Zone::Stats() const {
+    std::lock_guard<std::mutex> lk(command_mutex_);
+    return stats_;
+}
+
+int Zone::LastAttempts() const {
+    std::lock_guard<std::mutex> lk(command_mutex_);
+    return last_attempts_;
+}
+
+bool Zone::Commanded() const {
+    return commanded_;
+}
+
+void Zone::Faulted(bool faulted) {
+    faulted_ = faulted;
+}
+
+bool Zone::Faulted() const {
+    return faulted_;
 }
 
 void Zone::Enabled(bool enabled) {
@@ -68,14 +224,32 @@ bool Zone::InvertLogic() const {
     return invert_logic_; 
 }
 
+void Zone::Cycle(int max_cycle, int min_soak) {
+    max_cycle_ = max_cycle > 0 ? max_cycle : 0;
+    min_soak_ = min_soak > 0 ? min_soak : 0;
+}
+
+int Zone::MaxCycle() const {
+    return max_cycle_;
+}
+
+int Zone::MinSoak() const {
+    return min_soak_;
+}
+
 bool Zone::IsOn() {
-    return InvertLogic() ? !isHigh() : isHigh();
+    bool high = bus_ ? bus_->Coil(coil_.slave, coil_.coil) : gpio_.IsHigh();
+    return InvertLogic() ? !high : high;
 }
 
 const std::string Zone::Status(){
     return IsOn() ? std::string("On") : std::string("Off");
 }
 
+bool Zone::Fail() const {
+    return bus_ ? bus_fail_ : gpio_.Fail();
+}
+
 void Zone::Name(std::string name) {
     name_ = name;
 }